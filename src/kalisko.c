@@ -56,7 +56,7 @@ int main(int argc, char **argv)
 	logMessage("core", LOG_LEVEL_INFO, "Entering Kalisko event loop");
 	while(hasMoreTimerCallbacks()) {
 		int sleepTime = getCurrentSleepTime();
-		g_usleep(sleepTime < MIN_SLEEP_TIME ? MIN_SLEEP_TIME : sleepTime);
+		sleepTimers(sleepTime < MIN_SLEEP_TIME ? MIN_SLEEP_TIME : sleepTime);
 		notifyTimerCallbacks();
 	}
 	logMessage("core", LOG_LEVEL_INFO, "Leaving Kalisko event loop");
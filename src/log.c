@@ -32,12 +32,21 @@
 static void handleGlibLogMessage(const char *domain, GLogLevelFlags logLevel, const char *message, void *userData);
 static void defaultLogHandler(const char *name, LogLevel level, const char *message);
 
+/** The size of the stack buffer messages are formatted into, longer messages are allocated on the heap */
+#define LOG_MESSAGE_BUFFER_SIZE 512
+
 static LogLevel defaultLevel;
 static LogHandler *logHandler = &defaultLogHandler;
+static LogLevel handlerLevels = LOG_LEVEL_ALL;
 
 API void initLog(LogLevel level)
 {
 	defaultLevel = level;
+
+	if(logHandler == &defaultLogHandler) {
+		handlerLevels = level;
+	}
+
 	g_log_set_default_handler(handleGlibLogMessage, NULL);
 }
 
@@ -49,31 +58,60 @@ API bool shouldLog(LogLevel level)
 API char *formatLogMessage(const char *source, LogLevel level, const char *message)
 {
 	GDateTime *now = g_date_time_new_now_local();
-	GString *result = g_string_new("");
-
-	g_string_append_printf(result, "[%02d:%02d:%02d] [%s:%s] %s", g_date_time_get_hour(now), g_date_time_get_minute(now), g_date_time_get_second(now), source, getStaticLogLevelName(level), message);
-
+	char *result = g_strdup_printf("[%02d:%02d:%02d] [%s:%s] %s", g_date_time_get_hour(now), g_date_time_get_minute(now), g_date_time_get_second(now), source, getStaticLogLevelName(level), message);
 	g_date_time_unref(now);
-	return g_string_free(result, false);
+
+	return result;
 }
 
 API void setLogHandler(LogHandler *handler)
 {
 	if(handler == NULL) {
 		logHandler = &defaultLogHandler;
+		handlerLevels = defaultLevel;
 	} else {
 		logHandler = handler;
+		handlerLevels = LOG_LEVEL_ALL;
 	}
 }
 
+API LogHandler *getLogHandler()
+{
+	return logHandler;
+}
+
+API void setLogHandlerLevels(LogLevel levels)
+{
+	handlerLevels = levels;
+}
+
+API LogLevel getLogHandlerLevels()
+{
+	return handlerLevels;
+}
+
 API void logMessage(const char *module, LogLevel level, const char *message, ...)
 {
+	if(!(handlerLevels & level)) {
+		return; // nobody is interested in this message, so don't even format it
+	}
+
+	char buffer[LOG_MESSAGE_BUFFER_SIZE];
 	va_list va;
 	va_start(va, message);
-	GString *assembled = g_string_new("");
-	g_string_append_vprintf(assembled, message, va);
-	logHandler(module, level, assembled->str);
-	g_string_free(assembled, true);
+	int length = vsnprintf(buffer, LOG_MESSAGE_BUFFER_SIZE, message, va);
+	va_end(va);
+
+	if(length < LOG_MESSAGE_BUFFER_SIZE) {
+		logHandler(module, level, length < 0 ? message : buffer);
+	} else { // too long for the stack buffer, format it again on the heap
+		va_start(va, message);
+		char *assembled = g_strdup_vprintf(message, va);
+		va_end(va);
+
+		logHandler(module, level, assembled);
+		g_free(assembled);
+	}
 }
 
 API const char *getStaticLogLevelName(LogLevel level)
@@ -138,7 +176,7 @@ static void defaultLogHandler(const char *name, LogLevel level, const char *mess
 		char *formatted = formatLogMessage(name, level, message);
 		fprintf(stderr, "%s\n", formatted);
 		free(formatted);
+		fflush(stderr);
 	}
-	fflush(stderr);
 }
 
@@ -74,6 +74,28 @@ API void initLog(LogLevel level);
  */
 API void setLogHandler(LogHandler *handler);
 
+/**
+ * Returns the current log handler
+ *
+ * @result				the log handler currently in use
+ */
+API LogHandler *getLogHandler();
+
+/**
+ * Sets the log levels the current log handler is interested in. Messages of all other levels are discarded by logMessage before they are even
+ * formatted. Setting a log handler resets this to all levels, or to the level passed to initLog if the default handler is restored.
+ *
+ * @param levels		a bitmask of the log levels to pass to the log handler
+ */
+API void setLogHandlerLevels(LogLevel levels);
+
+/**
+ * Returns the log levels the current log handler is interested in
+ *
+ * @result				a bitmask of the log levels passed to the log handler
+ */
+API LogLevel getLogHandlerLevels();
+
 /**
  * Determines whether (under the current settings) the specified level should get logged
  *
@@ -20,8 +20,13 @@
 
 #include <curl/curl.h>
 #include <glib.h>
+#include <string.h> // strdup
 
 #include "dll.h"
+#include "log.h"
+#include "timer.h"
+#include "memory_alloc.h"
+#include "modules/socket/poll.h"
 
 #define API
 #include "curl.h"
@@ -29,21 +34,83 @@
 MODULE_NAME("curl");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("CURL library access");
-MODULE_VERSION(0, 1, 2);
+MODULE_VERSION(0, 2, 0);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_NODEPS;
+MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 14, 0));
+
+/**
+ * Struct representing an asynchronous URL request in progress
+ */
+struct CurlRequestStruct {
+	/** the requested URL */
+	char *url;
+	/** the easy handle performing the request */
+	CURL *handle;
+	/** the page received so far */
+	GString *result;
+	/** the callback to notify when the request finished */
+	CurlRequestCallback *callback;
+	/** custom userdata to pass to the callback */
+	void *userdata;
+	/** buffer for CURL to store an error message in */
+	char error[CURL_ERROR_SIZE];
+};
 
 size_t writeCurlData(void *buffer, size_t size, size_t nmemb, void *userp);
+static int updateCurlSocket(CURL *handle, curl_socket_t fd, int what, void *userp, void *socketp);
+static int updateCurlTimer(CURLM *multi, long timeout, void *userp);
+static void curlSocketReady(int fd, int flags, void *userdata);
+static void processFinishedCurlRequests();
+static void freeCurlRequest(CurlRequest *request);
+TIMER_CALLBACK(curl_timeout);
+
+/**
+ * The multi handle performing all asynchronous requests, which also caches their connections for reuse
+ */
+static CURLM *multi;
+
+/**
+ * The timer after which CURL wants to be notified about a timeout, or NULL if there is none
+ */
+static GTimeVal *multiTimer = NULL;
+
+/**
+ * The asynchronous requests in progress
+ */
+static GQueue *requests;
 
 MODULE_INIT
 {
 	curl_global_init(CURL_GLOBAL_ALL);
 
+	if((multi = curl_multi_init()) == NULL) {
+		logError("Failed to create CURL multi handle");
+		curl_global_cleanup();
+		return false;
+	}
+
+	curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, &updateCurlSocket);
+	curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, &updateCurlTimer);
+
+	requests = g_queue_new();
+
 	return true;
 }
 
 MODULE_FINALIZE
 {
+	while(!g_queue_is_empty(requests)) {
+		cancelCurlRequest(g_queue_peek_head(requests));
+	}
+
+	g_queue_free(requests);
+
+	if(multiTimer != NULL) {
+		TIMER_DEL(multiTimer);
+		multiTimer = NULL;
+	}
+
+	curl_multi_cleanup(multi);
 	curl_global_cleanup();
 }
 
@@ -62,6 +129,7 @@ API GString *curlRequestUrl(const char *url)
 
 	if(curl_easy_perform(curl) != 0) {
 		logError("Failed to read URL '%s': %s", url, error);
+		curl_easy_cleanup(curl);
 		g_string_free(result, true);
 		return NULL;
 	}
@@ -71,6 +139,52 @@ API GString *curlRequestUrl(const char *url)
 	return result;
 }
 
+API CurlRequest *curlRequestUrlAsync(const char *url, CurlRequestCallback *callback, void *userdata)
+{
+	CURL *handle;
+
+	if((handle = curl_easy_init()) == NULL) {
+		logError("Failed to create CURL handle for URL '%s'", url);
+		return NULL;
+	}
+
+	CurlRequest *request = ALLOCATE_OBJECT(CurlRequest);
+	request->url = strdup(url);
+	request->handle = handle;
+	request->result = g_string_new("");
+	request->callback = callback;
+	request->userdata = userdata;
+	request->error[0] = '\0';
+
+	curl_easy_setopt(handle, CURLOPT_URL, url);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &writeCurlData);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, request->result);
+	curl_easy_setopt(handle, CURLOPT_ERRORBUFFER, request->error);
+	curl_easy_setopt(handle, CURLOPT_PRIVATE, request);
+	curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L); // don't let the resolver interrupt our main loop with signals
+
+	CURLMcode code;
+	if((code = curl_multi_add_handle(multi, handle)) != CURLM_OK) {
+		logError("Failed to add request for URL '%s': %s", url, curl_multi_strerror(code));
+		freeCurlRequest(request);
+		return NULL;
+	}
+
+	g_queue_push_tail(requests, request);
+	logInfo("Requesting URL '%s' asynchronously...", url);
+
+	return request; // the transfer itself is started by the timeout CURL schedules right away
+}
+
+API void cancelCurlRequest(CurlRequest *request)
+{
+	logInfo("Cancelling request for URL '%s'", request->url);
+
+	g_queue_remove(requests, request);
+	curl_multi_remove_handle(multi, request->handle);
+	freeCurlRequest(request);
+}
+
 size_t writeCurlData(void *buffer, size_t size, size_t nmemb, void *userp)
 {
 	GString *result = (GString *) userp;
@@ -80,3 +194,105 @@ size_t writeCurlData(void *buffer, size_t size, size_t nmemb, void *userp)
 	return size * nmemb;
 }
 
+/**
+ * CURL socket callback that adjusts what the socket poller watches a connection of an asynchronous request for
+ */
+static int updateCurlSocket(CURL *handle, curl_socket_t fd, int what, void *userp, void *socketp)
+{
+	if(what == CURL_POLL_REMOVE) {
+		$(bool, socket, disableFdPolling)(fd);
+	} else {
+		int flags = ((what & CURL_POLL_IN) ? FD_POLL_READ : 0) | ((what & CURL_POLL_OUT) ? FD_POLL_WRITE : 0);
+		$(bool, socket, enableFdPolling)(fd, flags, &curlSocketReady, NULL);
+	}
+
+	return 0;
+}
+
+/**
+ * CURL timer callback that schedules the timeout after which CURL wants to be notified
+ */
+static int updateCurlTimer(CURLM *multi, long timeout, void *userp)
+{
+	if(multiTimer != NULL) {
+		TIMER_DEL(multiTimer);
+		multiTimer = NULL;
+	}
+
+	if(timeout >= 0) { // -1 deletes the timer
+		multiTimer = TIMER_ADD_TIMEOUT(timeout * 1000, curl_timeout);
+	}
+
+	return 0;
+}
+
+/**
+ * FdPollCallback notifying CURL that a connection of an asynchronous request is ready
+ */
+static void curlSocketReady(int fd, int flags, void *userdata)
+{
+	int action = ((flags & FD_POLL_READ) ? CURL_CSELECT_IN : 0) | ((flags & FD_POLL_WRITE) ? CURL_CSELECT_OUT : 0) | ((flags & FD_POLL_ERROR) ? CURL_CSELECT_ERR : 0);
+	int running;
+
+	curl_multi_socket_action(multi, fd, action, &running);
+	processFinishedCurlRequests();
+}
+
+/**
+ * Notifies the callbacks of all asynchronous requests that finished
+ */
+static void processFinishedCurlRequests()
+{
+	CURLMsg *message;
+	int pending;
+
+	while((message = curl_multi_info_read(multi, &pending)) != NULL) {
+		if(message->msg != CURLMSG_DONE) {
+			continue;
+		}
+
+		// The message is invalidated when its handle is removed, so back up everything we need first
+		CURL *handle = message->easy_handle;
+		CURLcode code = message->data.result;
+		CurlRequest *request;
+		curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char **) &request);
+
+		g_queue_remove(requests, request);
+		curl_multi_remove_handle(multi, handle);
+
+		if(code == CURLE_OK) {
+			logInfo("Finished request for URL '%s'", request->url);
+			request->callback(request->url, request->result, request->userdata);
+		} else {
+			logError("Failed to read URL '%s': %s", request->url, request->error[0] != '\0' ? request->error : curl_easy_strerror(code));
+			request->callback(request->url, NULL, request->userdata);
+		}
+
+		freeCurlRequest(request);
+	}
+}
+
+/**
+ * Frees an asynchronous request that isn't part of the multi handle anymore
+ *
+ * @param request		the request to free
+ */
+static void freeCurlRequest(CurlRequest *request)
+{
+	curl_easy_cleanup(request->handle);
+	g_string_free(request->result, true);
+	free(request->url);
+	free(request);
+}
+
+/**
+ * Timer callback notifying CURL about a timeout it asked for, which also kicks off newly added requests
+ */
+TIMER_CALLBACK(curl_timeout)
+{
+	int running;
+
+	multiTimer = NULL; // we were already removed from the timer queue
+	curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &running);
+	processFinishedCurlRequests();
+}
@@ -21,6 +21,23 @@
 #ifndef CURL_CURL_H
 #define CURL_CURL_H
 
+#include <glib.h>
+
+struct CurlRequestStruct;
+
+/**
+ * An asynchronous URL request in progress
+ */
+typedef struct CurlRequestStruct CurlRequest;
+
+/**
+ * Callback notifying about a finished asynchronous URL request
+ *
+ * @param url			the requested URL
+ * @param result		the resulting page as a string or NULL on failure, which is freed after the callback returns
+ * @param userdata		custom userdata passed when requesting the URL
+ */
+typedef void (CurlRequestCallback)(const char *url, GString *result, void *userdata);
 
 /**
  * Requests an URL using the CURL library and returns the results as a string
@@ -30,4 +47,23 @@
  */
 API GString *curlRequestUrl(const char *url);
 
+/**
+ * Requests an URL asynchronously using the CURL library. The transfer is driven by the socket poller and the timer loop, so this returns
+ * immediately and the main loop never blocks on the transfer. Concurrent requests are performed in parallel and reuse connections to the
+ * same host.
+ *
+ * @param url			the url to request
+ * @param callback		the callback to notify when the request finished
+ * @param userdata		custom userdata to pass to the callback
+ * @result				the request in progress or NULL on failure
+ */
+API CurlRequest *curlRequestUrlAsync(const char *url, CurlRequestCallback *callback, void *userdata);
+
+/**
+ * Cancels an asynchronous URL request that hasn't finished yet. Its callback won't be notified.
+ *
+ * @param request		the request to cancel
+ */
+API void cancelCurlRequest(CurlRequest *request);
+
 #endif
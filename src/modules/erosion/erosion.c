@@ -22,16 +22,105 @@
 #include <assert.h>
 #include <glib.h>
 #include <stdio.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "dll.h"
 #include "modules/image/image.h"
 #include "modules/image/io.h"
 #define API
 #include "erosion.h"
 
+/** The number of heightmap rows an erosion worker processes at once */
+#define EROSION_TILE_ROWS 32
+/** The thermal erosion talus angle depends on the terrain scale, this is the horizontal distance between two heightmap cells */
+#define EROSION_THERMAL_CELL_SIZE 0.01
+/** The fraction of the excess material a cell sheds per thermal erosion step */
+#define EROSION_THERMAL_RATE 0.5
+/** The amount of new water per cell and hydraulic erosion step */
+#define EROSION_HYDRAULIC_RAIN 0.01
+/** The amount of terrain dissolved per unit of water and hydraulic erosion step */
+#define EROSION_HYDRAULIC_SOLUBILITY 0.01
+/** The fraction of the water that evaporates per hydraulic erosion step */
+#define EROSION_HYDRAULIC_EVAPORATION 0.5
+/** The amount of sediment a unit of water can carry */
+#define EROSION_HYDRAULIC_CAPACITY 0.3
+
+typedef struct ErosionJobStruct ErosionJob;
+
+/**
+ * Function type for a pass over one row of an erosion job
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+typedef void (ErosionRowFunction)(ErosionJob *job, unsigned int y);
+
+/**
+ * An erosion job works on float maps that are padded with a border of one cell on each side. The terrain border is NaN so that comparisons
+ * with it are always false and border cells never exchange any material with the outside. Each step runs a number of passes over all rows,
+ * which only read the maps written by the previous pass, so rows can be processed by several threads in any order.
+ */
+struct ErosionJobStruct {
+	/** the width of the eroded heightmap */
+	unsigned int width;
+	/** the height of the eroded heightmap */
+	unsigned int height;
+	/** the distance between two rows in the padded maps */
+	unsigned int stride;
+	/** the offsets of the eight neighbours of a cell in the padded maps */
+	int neighbours[8];
+	/** the terrain height map */
+	float *terrain;
+	/** the terrain height map being written by the current pass */
+	float *terrainNext;
+	/** the water map for hydraulic erosion */
+	float *water;
+	/** the water map being written by the current pass */
+	float *waterNext;
+	/** the sediment map for hydraulic erosion */
+	float *sediment;
+	/** the sediment map being written by the current pass */
+	float *sedimentNext;
+	/** for each cell, the amount of material or water it sheds per unit of difference to a lower neighbour */
+	float *outflow;
+	/** for each cell, the amount of sediment it sheds per unit of difference to a lower neighbour */
+	float *sedimentOutflow;
+	/** for each cell, one over the number of its neighbours that shed material or water into it, or zero if there are none */
+	float *share;
+	/** the minimum height difference for thermal erosion to occur */
+	float talus;
+	/** the function of the current pass */
+	ErosionRowFunction *function;
+	/** the thread pool processing the tiles of a pass, or NULL to process them in the calling thread */
+	GThreadPool *pool;
+	/** the number of tiles of the current pass that aren't processed yet */
+	unsigned int pending;
+	/** mutex protecting pending */
+	GMutex mutex;
+	/** condition signalled when all tiles of a pass are processed */
+	GCond condition;
+};
+
+static ErosionJob *createErosionJob(Image *hMap);
+static void runErosionPass(ErosionJob *job, ErosionRowFunction *function);
+static void runErosionTile(void *tile, void *job);
+static void finishErosionJob(ErosionJob *job, Image *hMap);
+static void freeErosionJob(ErosionJob *job);
+static float *createErosionMap(ErosionJob *job, float border);
+static void swapErosionMaps(float **a, float **b);
+static void computeThermalOutflow(ErosionJob *job, unsigned int y);
+static void applyThermalOutflow(ErosionJob *job, unsigned int y);
+static void rainAndDissolve(ErosionJob *job, unsigned int y);
+static void computeWaterOutflow(ErosionJob *job, unsigned int y);
+static void applyWaterOutflow(ErosionJob *job, unsigned int y);
+static void evaporateWater(ErosionJob *job, unsigned int y);
+static void depositSediment(ErosionJob *job, unsigned int y);
+
 MODULE_NAME("erosion");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Erosion functions");
-MODULE_VERSION(0, 1, 7);
+MODULE_VERSION(0, 2, 1);
 MODULE_BCVERSION(0, 1, 0);
 MODULE_DEPENDS(MODULE_DEPENDENCY("image", 0, 5, 16));
 
@@ -70,254 +159,561 @@ MODULE_FINALIZE
 {
 }
 
-static inline void erodeThermalCell(Image* hMap, unsigned int x, unsigned int y, float talusAngle)
+API void erodeThermal(Image* hMap, double talusAngle, unsigned int steps)
 {
-	const float c = 0.5;
-	const float cellSize = 0.01; // NOTE: angle depends on the terrain scale!
-	double dMax = 0.0, dTotal = 0.0;
-	double T = cellSize * tan(talusAngle);
-
-	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,hMap->height)); i++) {
-		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,hMap->width)); j++) {
-			if(j == x && i == y)
-				continue;
-
-			double di = getImage(hMap, x, y, 0) - getImage(hMap, j, i, 0);
-			if(di > T) {
-				dTotal += di;
-				if(di > dMax) {
-					dMax = di;
-				}
-			}
-		}
+	assert(hMap != NULL);
+
+	if(steps == 0)
+		return;
+
+	ErosionJob *job = createErosionJob(hMap);
+	job->talus = EROSION_THERMAL_CELL_SIZE * tan(talusAngle);
+	job->terrainNext = createErosionMap(job, NAN);
+	job->outflow = createErosionMap(job, 0.0f);
+	job->share = createErosionMap(job, 0.0f);
+
+	for(unsigned int k = 0; k < steps; k++) {
+		runErosionPass(job, &computeThermalOutflow);
+		runErosionPass(job, &applyThermalOutflow);
+		swapErosionMaps(&job->terrain, &job->terrainNext);
 	}
 
-	if(!(dTotal > 0.0)) {
+	finishErosionJob(job, hMap);
+	freeErosionJob(job);
+}
+
+API void erodeHydraulic(Image* hMap, unsigned int steps)
+{
+	assert(hMap != NULL);
+
+	if(steps == 0)
 		return;
+
+	ErosionJob *job = createErosionJob(hMap);
+	job->water = createErosionMap(job, 0.0f);
+	job->waterNext = createErosionMap(job, 0.0f);
+	job->sediment = createErosionMap(job, 0.0f);
+	job->sedimentNext = createErosionMap(job, 0.0f);
+	job->outflow = createErosionMap(job, 0.0f);
+	job->sedimentOutflow = createErosionMap(job, 0.0f);
+	job->share = createErosionMap(job, 0.0f);
+
+	for(unsigned int k = 0; k < steps; k++) {
+		runErosionPass(job, &rainAndDissolve);
+		runErosionPass(job, &computeWaterOutflow);
+		runErosionPass(job, &applyWaterOutflow);
+		swapErosionMaps(&job->water, &job->waterNext);
+		swapErosionMaps(&job->sediment, &job->sedimentNext);
+		runErosionPass(job, &evaporateWater);
 	}
 
-	float h = getImage(hMap, x, y, 0);
+	// evaporate all remaining water
+	runErosionPass(job, &depositSediment);
 
-	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,hMap->height)); i++) {
-		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,hMap->width)); j++) {
-			if(j == x && i == y)
-				continue;
+	finishErosionJob(job, hMap);
+	freeErosionJob(job);
+}
 
-			double di = h - getImage(hMap, j, i, 0);
-			if(di > T) {
-				double hNew = getImage(hMap, j, i, 0) + c * (dMax-T) * di/dTotal;
-				setImage(hMap, j, i, 0, hNew);
-			}
+/**
+ * Creates an erosion job for a heightmap, copying its first channel into the padded terrain map
+ *
+ * @param hMap			the heightmap to erode
+ * @result				the created erosion job
+ */
+static ErosionJob *createErosionJob(Image *hMap)
+{
+	ErosionJob *job = ALLOCATE_OBJECT(ErosionJob);
+	memset(job, 0, sizeof(ErosionJob));
+	job->width = hMap->width;
+	job->height = hMap->height;
+	job->stride = hMap->width + 2;
+
+	int stride = job->stride;
+	int neighbours[8] = {-stride - 1, -stride, -stride + 1, -1, 1, stride - 1, stride, stride + 1};
+	memcpy(job->neighbours, neighbours, sizeof(neighbours));
+
+	job->terrain = createErosionMap(job, NAN);
+	for(unsigned int y = 0; y < job->height; y++) {
+		float *row = job->terrain + (y + 1) * job->stride + 1;
+		for(unsigned int x = 0; x < job->width; x++) {
+			row[x] = getImage(hMap, x, y, 0);
 		}
 	}
 
-	// reduce the cell center to preserve the total amount of material
-	float hNew = h - c * (dMax-T);
-	setImage(hMap, x, y, 0, hNew);
+	unsigned int tiles = (job->height + EROSION_TILE_ROWS - 1) / EROSION_TILE_ROWS;
+	unsigned int threads = MIN(g_get_num_processors(), tiles);
+
+	if(threads > 1) {
+		g_mutex_init(&job->mutex);
+		g_cond_init(&job->condition);
+		job->pool = g_thread_pool_new(&runErosionTile, job, threads, true, NULL);
+	}
+
+	return job;
 }
 
-API void erodeThermal(Image* hMap, double talusAngle, unsigned int steps)
+/**
+ * Runs a pass over all rows of an erosion job and waits until it is finished
+ *
+ * @param job			the erosion job to process
+ * @param function		the function to call for each row
+ */
+static void runErosionPass(ErosionJob *job, ErosionRowFunction *function)
 {
-	assert(hMap != NULL);
+	unsigned int tiles = (job->height + EROSION_TILE_ROWS - 1) / EROSION_TILE_ROWS;
+	job->function = function;
 
-	if(steps == 0)
+	if(job->pool == NULL) {
+		for(unsigned int y = 0; y < job->height; y++) {
+			function(job, y);
+		}
 		return;
+	}
 
-	unsigned int width, height;
-	width = hMap->width;
-	height = hMap->height;
+	job->pending = tiles;
+	for(unsigned int tile = 0; tile < tiles; tile++) {
+		g_thread_pool_push(job->pool, GUINT_TO_POINTER(tile + 1), NULL); // offset by one since NULL can't be pushed
+	}
 
-	// ensure floating point precission
-	Image *heightMap = $(Image *, image, copyImage)(hMap, IMAGE_TYPE_FLOAT);
+	// the next pass reads the results of the neighbouring tiles, so wait for all of them
+	g_mutex_lock(&job->mutex);
+	while(job->pending > 0) {
+		g_cond_wait(&job->condition, &job->mutex);
+	}
+	g_mutex_unlock(&job->mutex);
+}
 
-	for(int k=0; k<steps; k++) {
-		// erode one time step
-		for(unsigned int y = 0; y < height; y++) {
-			for(unsigned int x = 0; x < width; x++) {
-				erodeThermalCell(heightMap, x, y, talusAngle);
-			}
-		}
+/**
+ * Thread pool worker processing a tile of rows of the current erosion pass
+ *
+ * @param tile			the index of the tile to process plus one
+ * @param job			the erosion job to process
+ */
+static void runErosionTile(void *tile, void *job)
+{
+	ErosionJob *erosionJob = job;
+	unsigned int start = (GPOINTER_TO_UINT(tile) - 1) * EROSION_TILE_ROWS;
+	unsigned int end = MIN(start + EROSION_TILE_ROWS, erosionJob->height);
+
+	for(unsigned int y = start; y < end; y++) {
+		erosionJob->function(erosionJob, y);
 	}
 
-	// copy result to the other height map channels
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			double value = getImage(heightMap, x, y, 0);
+	g_mutex_lock(&erosionJob->mutex);
+	if(--erosionJob->pending == 0) {
+		g_cond_signal(&erosionJob->condition);
+	}
+	g_mutex_unlock(&erosionJob->mutex);
+}
+
+/**
+ * Copies the eroded terrain of an erosion job back into all channels of a heightmap
+ *
+ * @param job			the finished erosion job
+ * @param hMap			the heightmap to write the eroded terrain to
+ */
+static void finishErosionJob(ErosionJob *job, Image *hMap)
+{
+	for(unsigned int y = 0; y < job->height; y++) {
+		float *row = job->terrain + (y + 1) * job->stride + 1;
+		for(unsigned int x = 0; x < job->width; x++) {
+			double value = row[x];
 			assert(value <= 1.0 && value >= 0.0);
 			for(unsigned int c = 0; c < MIN(hMap->channels, 4); c++) {
 				setImage(hMap, x, y, c, value);
 			}
 		}
 	}
-
-	// cleanup
-	$(void, image, freeImage)(heightMap);
 }
 
-static inline void waterFlowCell(Image* hMap, Image* waterMap, Image* sedimentMap, unsigned int x, unsigned int y)
+/**
+ * Frees an erosion job
+ *
+ * @param job			the erosion job to free
+ */
+static void freeErosionJob(ErosionJob *job)
 {
-	unsigned int width = hMap->width;
-	unsigned int height = hMap->height;
-	unsigned int cellCount = 0;
-	double dTotal = 0.0, aTotal = 0.0;
-	double w = getImage(waterMap, x, y, 0);
-	double h = getImage(hMap, x, y, 0);
-	double m = getImage(sedimentMap, x, y, 0);
-	double a = h + w;
-
-	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,height)); i++) {
-		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,width)); j++) {
-			if(j == x && i == y)
-				continue;
-
-			double hi = getImage(hMap, j, i, 0);
-			double wi = getImage(waterMap, j, i, 0);
-			double ai = hi + wi;
-			double di = a - ai;
-			if(di > 0.0) {
-				dTotal += di;
-				aTotal += ai;
-				cellCount++;
-			}
-		}
+	if(job->pool != NULL) {
+		g_thread_pool_free(job->pool, false, true);
+		g_mutex_clear(&job->mutex);
+		g_cond_clear(&job->condition);
 	}
 
-	if(cellCount < 1) {
-		return;
+	free(job->terrain);
+	free(job->terrainNext);
+	free(job->water);
+	free(job->waterNext);
+	free(job->sediment);
+	free(job->sedimentNext);
+	free(job->outflow);
+	free(job->sedimentOutflow);
+	free(job->share);
+	free(job);
+}
+
+/**
+ * Creates a padded map for an erosion job
+ *
+ * @param job			the erosion job to create the map for
+ * @param border		the value of the border cells, the inner cells are set to zero
+ * @result				the created map
+ */
+static float *createErosionMap(ErosionJob *job, float border)
+{
+	unsigned int size = job->stride * (job->height + 2);
+	float *map = ALLOCATE_OBJECTS(float, size);
+
+	for(unsigned int i = 0; i < size; i++) {
+		map[i] = border;
 	}
 
-	double deltaA = a - (aTotal / (double)cellCount);
-
-	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,height)); i++) {
-		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,width)); j++) {
-			if(j == x && i == y)
-				continue;
-
-			double hi = getImage(hMap, j, i, 0);
-			double wi = getImage(waterMap, j, i, 0);
-			double mi = getImage(sedimentMap, j, i, 0);
-			double ai = hi + wi;
-			double di = a - ai;
-
-			if(di > 0.0) {
-				// water flow to neighboring cells
-				double deltaWi = (MIN(w, deltaA)) * di / dTotal;
-				setImage(waterMap, j, i, 0, wi + deltaWi);
-
-				// sediment distribution
-				// assumption: all material is uniformly distributed within the water w
-				double deltaMi = m * deltaWi / w;
-				setImage(sedimentMap, j, i, 0, mi + deltaMi);
-				setImage(sedimentMap, x, y, 0, getImage(sedimentMap, x, y, 0) - deltaMi);
-			}
+	for(unsigned int y = 1; y <= job->height; y++) {
+		for(unsigned int x = 1; x <= job->width; x++) {
+			map[y * job->stride + x] = 0.0f;
 		}
 	}
 
-	setImage(waterMap, x, y, 0, w - (MIN(w, deltaA)));
+	return map;
 }
 
-API void erodeHydraulic(Image* hMap, unsigned int steps)
+/**
+ * Swaps two erosion maps
+ *
+ * @param a				the first map to swap
+ * @param b				the second map to swap
+ */
+static void swapErosionMaps(float **a, float **b)
 {
-	assert(hMap != NULL);
+	float *swap = *a;
+	*a = *b;
+	*b = swap;
+}
 
-	if(steps == 0)
-		return;
+/**
+ * Thermal erosion pass computing how much material each cell of a row sheds to its lower neighbours. A cell sheds a fraction of the excess
+ * of its steepest drop over the talus threshold, distributed in proportion to the drops. Also counts how many neighbours shed into each cell.
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void computeThermalOutflow(ErosionJob *job, unsigned int y)
+{
+	const float talus = job->talus;
+	const int *neighbours = job->neighbours;
+	unsigned int offset = (y + 1) * job->stride + 1;
+	const float *terrain = job->terrain + offset;
+	float *outflow = job->outflow + offset;
+	float *share = job->share + offset;
+	unsigned int x = 0;
+
+#ifdef __SSE2__
+	// four cells at a time, reading each neighbour offset as a contiguous run of the row above, the same or the row below
+	const __m128 talus4 = _mm_set1_ps(talus);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 rate = _mm_set1_ps(EROSION_THERMAL_RATE);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for(; x + 4 <= job->width; x += 4) {
+		__m128 h = _mm_loadu_ps(terrain + x);
+		__m128 dTotal = zero;
+		__m128 dMax = zero;
+		__m128 donors = zero;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			__m128 d = _mm_sub_ps(h, _mm_loadu_ps(terrain + (int) x + neighbours[k]));
+			__m128 lower = _mm_cmpgt_ps(d, talus4);
+			__m128 steeper = _mm_and_ps(lower, _mm_cmpgt_ps(d, dMax));
+			dTotal = _mm_add_ps(dTotal, _mm_and_ps(lower, d));
+			dMax = _mm_or_ps(_mm_and_ps(steeper, d), _mm_andnot_ps(steeper, dMax));
+			donors = _mm_add_ps(donors, _mm_and_ps(_mm_cmpgt_ps(_mm_xor_ps(d, signMask), talus4), one));
+		}
 
-	Image *waterMap, *sedimentMap;
-	unsigned int width, height;
-	const float K_rain = 0.01; // amount of new water per cell
-	const float K_solubility = 0.01; // (German: lösbarkeit)
-	const float K_evaporation = 0.5;
-	const float K_capacity = 0.3;
+		_mm_storeu_ps(outflow + x, _mm_and_ps(_mm_cmpgt_ps(dTotal, zero), _mm_div_ps(_mm_mul_ps(rate, _mm_sub_ps(dMax, talus4)), dTotal)));
+		_mm_storeu_ps(share + x, _mm_and_ps(_mm_cmpgt_ps(donors, zero), _mm_div_ps(one, donors)));
+	}
+#endif
 
-	width = hMap->width;
-	height = hMap->height;
+	for(; x < job->width; x++) {
+		float h = terrain[x];
+		float dTotal = 0.0f;
+		float dMax = 0.0f;
+		float donors = 0.0f;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			float d = h - terrain[(int) x + neighbours[k]];
+			dTotal += d > talus ? d : 0.0f;
+			dMax = d > talus && d > dMax ? d : dMax;
+			donors += -d > talus ? 1.0f : 0.0f;
+		}
 
-	// ensure floating point precission
-	Image *heightMap = $(Image *, image, copyImage)(hMap, IMAGE_TYPE_FLOAT);
+		outflow[x] = dTotal > 0.0f ? EROSION_THERMAL_RATE * (dMax - talus) / dTotal : 0.0f;
+		share[x] = donors > 0.0f ? 1.0f / donors : 0.0f;
+	}
+}
 
-	// create water map
-	waterMap = $(Image *, image, createImageFloat)(width, height, 1);
-	assert(waterMap != NULL);
+/**
+ * Thermal erosion pass moving material between the cells of a row and their neighbours. What a cell sheds to a neighbour is divided by the
+ * number of cells shedding into that neighbour, so a pit can't be filled above its rim within one step. Since every exchange is computed
+ * identically from both of its sides, the total amount of material is preserved.
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void applyThermalOutflow(ErosionJob *job, unsigned int y)
+{
+	const float talus = job->talus;
+	const int *neighbours = job->neighbours;
+	unsigned int offset = (y + 1) * job->stride + 1;
+	const float *terrain = job->terrain + offset;
+	const float *outflow = job->outflow + offset;
+	const float *share = job->share + offset;
+	float *terrainNext = job->terrainNext + offset;
+	unsigned int x = 0;
+
+#ifdef __SSE2__
+	const __m128 talus4 = _mm_set1_ps(talus);
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for(; x + 4 <= job->width; x += 4) {
+		__m128 h = _mm_loadu_ps(terrain + x);
+		__m128 out = _mm_loadu_ps(outflow + x);
+		__m128 in = _mm_loadu_ps(share + x);
+		__m128 delta = _mm_setzero_ps();
+
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			__m128 d = _mm_sub_ps(h, _mm_loadu_ps(terrain + n));
+			__m128 rise = _mm_xor_ps(d, signMask);
+			delta = _mm_sub_ps(delta, _mm_and_ps(_mm_cmpgt_ps(d, talus4), _mm_mul_ps(_mm_mul_ps(out, d), _mm_loadu_ps(share + n))));
+			delta = _mm_add_ps(delta, _mm_and_ps(_mm_cmpgt_ps(rise, talus4), _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(outflow + n), rise), in)));
+		}
 
-	// create map of the sediment in the water
-	sedimentMap = $(Image *, image, createImageFloat)(width, height, 1);
-	assert(sedimentMap != NULL);
+		_mm_storeu_ps(terrainNext + x, _mm_add_ps(h, delta));
+	}
+#endif
 
-	// init water level and sediment to zero
-	memset(waterMap->data.byte_data, 0, width*height*sizeof(float));
-	memset(sedimentMap->data.byte_data, 0, width*height*sizeof(float));
+	for(; x < job->width; x++) {
+		float h = terrain[x];
+		float delta = 0.0f;
 
-	for(int k=0; k<steps; k++) {
-		// let it rain
-		for(unsigned int y = 0; y < height; y++) {
-			for(unsigned int x = 0; x < width; x++) {
-				setImage(waterMap, x, y, 0, getImage(waterMap, x, y, 0) + K_rain);
-			}
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			float d = h - terrain[n];
+			delta -= d > talus ? outflow[x] * d * share[n] : 0.0f;
+			delta += -d > talus ? outflow[n] * -d * share[x] : 0.0f;
 		}
 
-		// erode terrain
-		for(unsigned int y = 0; y < height; y++) {
-			for(unsigned int x = 0; x < width; x++) {
-				//double mMax = getImage(waterMap, x, y, 0) * K_solubility - getImage(sedimentMap, x, y, 0);
-				//double deltaM = CLAMP(mMax, 0.f, getImage(heightMap, x, y, 0));
-				double deltaM = K_solubility * getImage(waterMap, x, y, 0);
-				setImage(heightMap, x, y, 0, getImage(heightMap, x, y, 0) - deltaM);
-				setImage(sedimentMap, x, y, 0, getImage(sedimentMap, x, y, 0) + deltaM);
-			}
-		}
+		terrainNext[x] = h + delta;
+	}
+}
 
-		// water flow and sediment transport
-		for(unsigned int y = 0; y < height; y++) {
-			for(unsigned int x = 0; x < width; x++) {
-				waterFlowCell(heightMap, waterMap, sedimentMap, x, y);
-			}
+/**
+ * Hydraulic erosion pass adding rain water to each cell of a row, which dissolves some of the terrain into sediment
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void rainAndDissolve(ErosionJob *job, unsigned int y)
+{
+	unsigned int offset = (y + 1) * job->stride + 1;
+	float *terrain = job->terrain + offset;
+	float *water = job->water + offset;
+	float *sediment = job->sediment + offset;
+
+	for(unsigned int x = 0; x < job->width; x++) {
+		float w = water[x] + EROSION_HYDRAULIC_RAIN;
+		float deltaM = EROSION_HYDRAULIC_SOLUBILITY * w;
+
+		water[x] = w;
+		terrain[x] -= deltaM;
+		sediment[x] += deltaM;
+	}
+}
+
+/**
+ * Hydraulic erosion pass computing how much water each cell of a row sheds to its lower neighbours. A cell sheds enough water to level its
+ * surface with the average of its lower neighbours, distributed in proportion to the surface differences. The sediment is carried along
+ * with the water. Also counts how many neighbours shed into each cell.
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void computeWaterOutflow(ErosionJob *job, unsigned int y)
+{
+	const int *neighbours = job->neighbours;
+	unsigned int offset = (y + 1) * job->stride + 1;
+	const float *terrain = job->terrain + offset;
+	const float *water = job->water + offset;
+	const float *sediment = job->sediment + offset;
+	float *outflow = job->outflow + offset;
+	float *sedimentOutflow = job->sedimentOutflow + offset;
+	float *share = job->share + offset;
+	unsigned int x = 0;
+
+#ifdef __SSE2__
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	for(; x + 4 <= job->width; x += 4) {
+		__m128 w = _mm_loadu_ps(water + x);
+		__m128 a = _mm_add_ps(_mm_loadu_ps(terrain + x), w);
+		__m128 dTotal = zero;
+		__m128 aTotal = zero;
+		__m128 cellCount = zero;
+		__m128 donors = zero;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			__m128 ai = _mm_add_ps(_mm_loadu_ps(terrain + n), _mm_loadu_ps(water + n));
+			__m128 d = _mm_sub_ps(a, ai);
+			__m128 lower = _mm_cmpgt_ps(d, zero);
+			dTotal = _mm_add_ps(dTotal, _mm_and_ps(lower, d));
+			aTotal = _mm_add_ps(aTotal, _mm_and_ps(lower, ai));
+			cellCount = _mm_add_ps(cellCount, _mm_and_ps(lower, one));
+			donors = _mm_add_ps(donors, _mm_and_ps(_mm_cmplt_ps(d, zero), one));
 		}
 
-		// evaporate water and accumulate sediments
-		for(unsigned int y = 0; y < height; y++) {
-			for(unsigned int x = 0; x < width; x++) {
-				double h = getImage(heightMap, x, y, 0);
-				double m = getImage(sedimentMap, x, y, 0);
-				double w = getImage(waterMap, x, y, 0);
+		__m128 deltaW = _mm_and_ps(_mm_cmpgt_ps(cellCount, zero), _mm_min_ps(w, _mm_sub_ps(a, _mm_div_ps(aTotal, cellCount))));
+		__m128 out = _mm_and_ps(_mm_cmpgt_ps(dTotal, zero), _mm_div_ps(deltaW, dTotal));
+		_mm_storeu_ps(outflow + x, out);
+		_mm_storeu_ps(sedimentOutflow + x, _mm_and_ps(_mm_cmpgt_ps(w, zero), _mm_div_ps(_mm_mul_ps(out, _mm_loadu_ps(sediment + x)), w)));
+		_mm_storeu_ps(share + x, _mm_and_ps(_mm_cmpgt_ps(donors, zero), _mm_div_ps(one, donors)));
+	}
+#endif
 
-				double wNew = w * (1.0 - K_evaporation);
-				// NOTE: water will never completely vanish
+	for(; x < job->width; x++) {
+		float w = water[x];
+		float a = terrain[x] + w;
+		float dTotal = 0.0f;
+		float aTotal = 0.0f;
+		float cellCount = 0.0f;
+		float donors = 0.0f;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			float ai = terrain[n] + water[n];
+			float d = a - ai;
+			dTotal += d > 0.0f ? d : 0.0f;
+			aTotal += d > 0.0f ? ai : 0.0f;
+			cellCount += d > 0.0f ? 1.0f : 0.0f;
+			donors += d < 0.0f ? 1.0f : 0.0f;
+		}
 
-				double mMax = K_capacity * wNew;
-				double deltaM = MAX(0.0, m - mMax);
+		float deltaW = cellCount > 0.0f ? MIN(w, a - aTotal / cellCount) : 0.0f;
+		outflow[x] = dTotal > 0.0f ? deltaW / dTotal : 0.0f;
+		// assumption: all material is uniformly distributed within the water w
+		sedimentOutflow[x] = w > 0.0f ? outflow[x] * sediment[x] / w : 0.0f;
+		share[x] = donors > 0.0f ? 1.0f / donors : 0.0f;
+	}
+}
 
-				setImage(sedimentMap, x, y, 0, m - deltaM);
-				setImage(heightMap, x, y, 0, h + deltaM);
-				setImage(waterMap, x, y, 0, wNew);
-			}
+/**
+ * Hydraulic erosion pass moving water and sediment between the cells of a row and their neighbours, see applyThermalOutflow
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void applyWaterOutflow(ErosionJob *job, unsigned int y)
+{
+	const int *neighbours = job->neighbours;
+	unsigned int offset = (y + 1) * job->stride + 1;
+	const float *terrain = job->terrain + offset;
+	const float *water = job->water + offset;
+	const float *sediment = job->sediment + offset;
+	const float *outflow = job->outflow + offset;
+	const float *sedimentOutflow = job->sedimentOutflow + offset;
+	const float *share = job->share + offset;
+	float *waterNext = job->waterNext + offset;
+	float *sedimentNext = job->sedimentNext + offset;
+	unsigned int x = 0;
+
+#ifdef __SSE2__
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 signMask = _mm_set1_ps(-0.0f);
+
+	for(; x + 4 <= job->width; x += 4) {
+		__m128 w = _mm_loadu_ps(water + x);
+		__m128 a = _mm_add_ps(_mm_loadu_ps(terrain + x), w);
+		__m128 outW = _mm_loadu_ps(outflow + x);
+		__m128 outM = _mm_loadu_ps(sedimentOutflow + x);
+		__m128 shareX = _mm_loadu_ps(share + x);
+		__m128 deltaW = zero;
+		__m128 deltaM = zero;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			__m128 d = _mm_sub_ps(a, _mm_add_ps(_mm_loadu_ps(terrain + n), _mm_loadu_ps(water + n)));
+			__m128 out = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_mul_ps(d, _mm_loadu_ps(share + n)));
+			__m128 in = _mm_and_ps(_mm_cmplt_ps(d, zero), _mm_mul_ps(_mm_xor_ps(d, signMask), shareX));
+			deltaW = _mm_add_ps(deltaW, _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(outflow + n), in), _mm_mul_ps(outW, out)));
+			deltaM = _mm_add_ps(deltaM, _mm_sub_ps(_mm_mul_ps(_mm_loadu_ps(sedimentOutflow + n), in), _mm_mul_ps(outM, out)));
 		}
+
+		_mm_storeu_ps(waterNext + x, _mm_add_ps(w, deltaW));
+		_mm_storeu_ps(sedimentNext + x, _mm_add_ps(_mm_loadu_ps(sediment + x), deltaM));
 	}
+#endif
 
-	// evaporate all remaining water
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			double h = getImage(heightMap, x, y, 0);
-			double m = getImage(sedimentMap, x, y, 0);
-			setImage(heightMap, x, y, 0, h + m);
-			// NOTE: unnecessary
-			setImage(waterMap, x, y, 0, 0.0);
+	for(; x < job->width; x++) {
+		float a = terrain[x] + water[x];
+		float deltaW = 0.0f;
+		float deltaM = 0.0f;
+
+		for(unsigned int k = 0; k < 8; k++) {
+			int n = (int) x + neighbours[k];
+			float d = a - (terrain[n] + water[n]);
+			float out = d > 0.0f ? d * share[n] : 0.0f;
+			float in = d < 0.0f ? -d * share[x] : 0.0f;
+			deltaW += outflow[n] * in - outflow[x] * out;
+			deltaM += sedimentOutflow[n] * in - sedimentOutflow[x] * out;
 		}
+
+		waterNext[x] = water[x] + deltaW;
+		sedimentNext[x] = sediment[x] + deltaM;
 	}
+}
 
-	// copy values to the original height map channels
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			double value = getImage(heightMap, x, y, 0);
-			assert(value <= 1.0 && value >= 0.0);
-			for(unsigned int c = 0; c < MIN(hMap->channels, 4); c++) {
-				setImage(hMap, x, y, c, value);
-			}
-		}
+/**
+ * Hydraulic erosion pass evaporating water from each cell of a row, depositing the sediment the remaining water can't carry
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void evaporateWater(ErosionJob *job, unsigned int y)
+{
+	unsigned int offset = (y + 1) * job->stride + 1;
+	float *terrain = job->terrain + offset;
+	float *water = job->water + offset;
+	float *sediment = job->sediment + offset;
+
+	for(unsigned int x = 0; x < job->width; x++) {
+		// NOTE: water will never completely vanish
+		float w = water[x] * (1.0f - EROSION_HYDRAULIC_EVAPORATION);
+		float deltaM = MAX(0.0f, sediment[x] - EROSION_HYDRAULIC_CAPACITY * w);
+
+		water[x] = w;
+		sediment[x] -= deltaM;
+		terrain[x] += deltaM;
 	}
+}
 
-	// cleanup
-	$(void, image, freeImage)(heightMap);
-	$(void, image, freeImage)(waterMap);
-	$(void, image, freeImage)(sedimentMap);
+/**
+ * Hydraulic erosion pass evaporating all water from each cell of a row, depositing all of its sediment
+ *
+ * @param job			the erosion job to process
+ * @param y				the row to process
+ */
+static void depositSediment(ErosionJob *job, unsigned int y)
+{
+	unsigned int offset = (y + 1) * job->stride + 1;
+	float *terrain = job->terrain + offset;
+	float *water = job->water + offset;
+	float *sediment = job->sediment + offset;
+
+	for(unsigned int x = 0; x < job->width; x++) {
+		terrain[x] += sediment[x];
+		sediment[x] = 0.0f;
+		water[x] = 0.0f;
+	}
 }
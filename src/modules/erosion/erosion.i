@@ -28,6 +28,9 @@
 /**
  * Erodes the height map using thermal weathering.
  *
+ * Each step computes all cells from the previous step's heights, so the result doesn't depend on the order in which the cells are processed.
+ * The rows are processed in parallel on all available processors. The total amount of material is preserved.
+ *
  * @param height_map	height map of the erosion surface
  * @param talusAngle	critical angle of response
  * @param steps			number of iteration steps
@@ -37,6 +40,8 @@ API void erodeThermal(Image* hMap, double talusAngle, unsigned int steps);
 /**
  * Erodes the height map using hydraulic erosion.
  *
+ * Like erodeThermal, each step is independent of the processing order and runs in parallel. The total amount of material is preserved.
+ *
  * @param height_map	height map of the erosion surface
  * @param steps			number of iteration steps
  */
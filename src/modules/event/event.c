@@ -32,224 +32,377 @@
 MODULE_NAME("event");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The event module implements an observer pattern that's freely attachable to any object");
-MODULE_VERSION(0, 4, 2);
+MODULE_VERSION(0, 5, 0);
 MODULE_BCVERSION(0, 1, 1);
 MODULE_NODEPS;
 
-static void freeEventListenerQueue(void *queue_p);
-static void freeEventSubject(void *subject_p);
-static int compareEventListeners(const void *first_p, const void *second_p, void *data);
+/**
+ * Struct to identify the listeners of an event on a subject
+ */
+typedef struct {
+	/** The subject the event belongs to */
+	void *subject;
+	/** The interned identifier of the event */
+	EventId event;
+} EventKey;
+
+/**
+ * Immutable, reference counted array of event listeners. Attaching or detaching a listener replaces the whole array, so an array that is currently
+ * being dispatched never changes underneath its dispatcher.
+ */
+typedef struct {
+	/** The reference count of the array */
+	int refs;
+	/** The number of listeners in the array */
+	unsigned int count;
+	/** The listeners ordered by priority */
+	EventListenerEntry listeners[];
+} EventListenerArray;
+
+static EventId internEventId(const char *event);
+static EventListenerArray *lookupEventListeners(void *subject, EventId event);
+static EventListenerArray *createEventListenerArray(unsigned int count);
+static void unrefEventListenerArray(void *listeners_p);
+static int dispatchEvent(void *subject, EventId event, const char *name, va_list args);
+static unsigned int hashEventKey(const void *key_p);
+static bool equalEventKeys(const void *first_p, const void *second_p);
+
+/**
+ * A GHashTable that maps EventKey objects to EventListenerArray objects
+ */
+static GHashTable *listeners;
+
+/**
+ * A GHashTable that maps event names to their interned EventId
+ */
+static GHashTable *eventIds;
 
 /**
- * A GHashTable that maps objects to other GHashTables which themselves map string identifiers to EventListenerEntry objects with event listeners
+ * A GPtrArray that maps interned EventId values back to their names
  */
-static GHashTable *subjects;
+static GPtrArray *eventNames;
 
 /**
- * Mutex to make the event module thread-safe
+ * Reader-writer lock to make the event module thread-safe. Triggering events only ever takes the reader side and only for the duration of the lookup,
+ * so multiple threads can trigger events concurrently and listeners are called without holding the lock.
  */
-static GRecMutex mutex;
+static GRWLock lock;
 
 MODULE_INIT
 {
-	subjects = g_hash_table_new_full(&g_direct_hash, &g_direct_equal, NULL, &freeEventSubject);
+	listeners = g_hash_table_new_full(&hashEventKey, &equalEventKeys, &free, &unrefEventListenerArray);
+	eventIds = g_hash_table_new(&g_str_hash, &g_str_equal);
+	eventNames = g_ptr_array_new_with_free_func(&free);
+	g_ptr_array_add(eventNames, NULL); // reserve EVENT_ID_INVALID
 
 	return true;
 }
 
 MODULE_FINALIZE
 {
-	g_hash_table_destroy(subjects);
+	g_hash_table_destroy(listeners);
+	g_hash_table_destroy(eventIds);
+	g_ptr_array_free(eventNames, true);
 }
 
-API void attachEventListener(void *subject, const char *event, void *custom, EventListener *listener)
+API EventId getEventId(const char *event)
 {
-	attachEventListenerWithPriority(subject, event, EVENT_LISTENER_PRIORITY_NORMAL, custom, listener);
+	g_rw_lock_reader_lock(&lock);
+	EventId id = GPOINTER_TO_UINT(g_hash_table_lookup(eventIds, event));
+	g_rw_lock_reader_unlock(&lock);
+
+	if(id == EVENT_ID_INVALID) {
+		g_rw_lock_writer_lock(&lock);
+		id = internEventId(event);
+		g_rw_lock_writer_unlock(&lock);
+	}
+
+	return id;
 }
 
-API void attachEventListenerWithPriority(void *subject, const char *event, int priority, void *custom, EventListener *listener)
+API const char *getEventName(EventId event)
 {
-	g_rec_mutex_lock(&mutex);
-
-	GHashTable *events;
+	g_rw_lock_reader_lock(&lock);
+	const char *name = event < eventNames->len ? g_ptr_array_index(eventNames, event) : NULL;
+	g_rw_lock_reader_unlock(&lock);
 
-	if((events = g_hash_table_lookup(subjects, subject)) == NULL) { // Create events if it doesn't exist yet
-		events = g_hash_table_new_full(&g_str_hash, &g_str_equal, &free, &freeEventListenerQueue);
-		g_hash_table_insert(subjects, subject, events);
-	}
+	return name;
+}
 
-	GQueue *queue;
+API void attachEventListener(void *subject, const char *event, void *custom, EventListener *listener)
+{
+	attachEventListenerWithPriority(subject, event, EVENT_LISTENER_PRIORITY_NORMAL, custom, listener);
+}
 
-	if((queue = g_hash_table_lookup(events, event)) == NULL) { // Create queue if it doesn't exist yet
-		queue = g_queue_new();
-		g_hash_table_insert(events, strdup(event), queue);
-	}
+API void attachEventListenerWithPriority(void *subject, const char *event, int priority, void *custom, EventListener *listener)
+{
+	g_rw_lock_writer_lock(&lock);
 
-	EventListenerEntry *entry = ALLOCATE_OBJECT(EventListenerEntry);
-	entry->listener = listener;
-	entry->custom = custom;
-	entry->priority = priority;
+	EventKey key = {subject, internEventId(event)};
+	EventListenerArray *old = g_hash_table_lookup(listeners, &key);
+	unsigned int count = old != NULL ? old->count : 0;
 
+	// Find the position to insert the new listener at
+	unsigned int position;
 	switch(priority) {
 		case EVENT_LISTENER_PRIORITY_LOWEST:
-			g_queue_push_head(queue, entry);
+			position = 0;
 		break;
 		case EVENT_LISTENER_PRIORITY_HIGHEST:
-			g_queue_push_tail(queue, entry);
+			position = count;
 		break;
 		default:
-			g_queue_insert_sorted(queue, entry, &compareEventListeners, NULL);
+			for(position = 0; position < count && old->listeners[position].priority < priority; position++);
 		break;
 	}
 
-	triggerEvent(subject, "listener_attached", event);
+	// Copy the old listeners into a new array with the new listener inserted
+	EventListenerArray *array = createEventListenerArray(count + 1);
+
+	for(unsigned int i = 0; i < position; i++) {
+		array->listeners[i] = old->listeners[i];
+	}
+
+	array->listeners[position].listener = listener;
+	array->listeners[position].custom = custom;
+	array->listeners[position].priority = priority;
 
-	g_rec_mutex_unlock(&mutex);
+	for(unsigned int i = position; i < count; i++) {
+		array->listeners[i + 1] = old->listeners[i];
+	}
+
+	EventKey *newKey = ALLOCATE_OBJECT(EventKey);
+	*newKey = key;
+	g_hash_table_replace(listeners, newKey, array); // releases our reference to the old array, running dispatches keep their own
+
+	g_rw_lock_writer_unlock(&lock);
+
+	triggerEvent(subject, "listener_attached", event);
 }
 
 API void detachEventListener(void *subject, const char *event, void *custom, EventListener *listener)
 {
-	g_rec_mutex_lock(&mutex);
-
-	GHashTable *events;
+	g_rw_lock_writer_lock(&lock);
 
-	if((events = g_hash_table_lookup(subjects, subject)) != NULL) {
-		GQueue *queue;
+	EventId id = GPOINTER_TO_UINT(g_hash_table_lookup(eventIds, event));
+	EventKey key = {subject, id};
+	EventListenerArray *old;
 
-		if((queue = g_hash_table_lookup(events, event)) != NULL) {
-			for(GList *iter = queue->head; iter != NULL; iter = iter->next) {
-				EventListenerEntry *entry = iter->data;
-
-				if(entry->listener == listener && entry->custom == custom) { // matches
-					// Remove listener
-					g_queue_remove(queue, entry);
-					free(entry);
+	if(id == EVENT_ID_INVALID || (old = g_hash_table_lookup(listeners, &key)) == NULL) {
+		g_rw_lock_writer_unlock(&lock);
+		return;
+	}
 
-					// Check if this was the last listener
-					if(g_queue_get_length(queue) == 0) {
-						// Remove event
-						g_hash_table_remove(events, event);
+	unsigned int position;
+	for(position = 0; position < old->count; position++) {
+		if(old->listeners[position].listener == listener && old->listeners[position].custom == custom) { // matches
+			break;
+		}
+	}
 
-						// Check if this was the last event
-						if(g_hash_table_size(events) == 0) {
-							// Remove subject
-							g_hash_table_remove(subjects, subject);
-						}
-					}
+	if(position == old->count) { // not found
+		g_rw_lock_writer_unlock(&lock);
+		return;
+	}
 
-					triggerEvent(subject, "listener_detached", event);
+	if(old->count == 1) { // this was the last listener, remove the event
+		g_hash_table_remove(listeners, &key);
+	} else {
+		// Copy the old listeners into a new array without the detached listener
+		EventListenerArray *array = createEventListenerArray(old->count - 1);
 
-					break;
-				}
+		for(unsigned int i = 0, j = 0; i < old->count; i++) {
+			if(i != position) {
+				array->listeners[j++] = old->listeners[i];
 			}
 		}
+
+		EventKey *newKey = ALLOCATE_OBJECT(EventKey);
+		*newKey = key;
+		g_hash_table_replace(listeners, newKey, array);
 	}
 
-	g_rec_mutex_unlock(&mutex);
+	g_rw_lock_writer_unlock(&lock);
+
+	triggerEvent(subject, "listener_detached", event);
 }
 
 API int triggerEvent(void *subject, const char *event, ...)
 {
-	g_rec_mutex_lock(&mutex);
-
-	GHashTable *events;
+	g_rw_lock_reader_lock(&lock);
+	EventId id = GPOINTER_TO_UINT(g_hash_table_lookup(eventIds, event));
+	g_rw_lock_reader_unlock(&lock);
 
-	if((events = g_hash_table_lookup(subjects, subject)) == NULL) {
-		g_rec_mutex_unlock(&mutex);
+	if(id == EVENT_ID_INVALID) { // nobody ever listened to this event
 		return -1;
 	}
 
-	GQueue *queue;
-
-	if((queue = g_hash_table_lookup(events, event)) == NULL) {
-		g_rec_mutex_unlock(&mutex);
-		return -1;
-	}
+	va_list args;
+	va_start(args, event);
+	int counter = dispatchEvent(subject, id, event, args);
+	va_end(args);
 
-	// copy the list to make the event system reentrant
-	GList *list = g_list_copy(queue->head);
+	return counter;
+}
 
-	int counter = 0;
+API int triggerEventById(void *subject, EventId event, ...)
+{
+	va_list args;
+	va_start(args, event);
+	int counter = dispatchEvent(subject, event, NULL, args);
+	va_end(args);
 
-	for(GList *iter = list; iter != NULL; iter = iter->next, counter++) {
-		va_list args;
-		// Get args and listener
-		va_start(args, event);
-		EventListenerEntry *entry = iter->data;
+	return counter;
+}
 
-		// Notify listener
-		entry->listener(subject, event, entry->custom, args);
-	}
+API int getEventListenerCount(void *subject, const char *event)
+{
+	g_rw_lock_reader_lock(&lock);
 
-	g_list_free(list);
+	EventId id = GPOINTER_TO_UINT(g_hash_table_lookup(eventIds, event));
+	EventKey key = {subject, id};
+	EventListenerArray *array = g_hash_table_lookup(listeners, &key);
+	unsigned int length = array != NULL ? array->count : 0;
 
-	g_rec_mutex_unlock(&mutex);
+	g_rw_lock_reader_unlock(&lock);
 
-	return counter;
+	return length;
 }
 
-API int getEventListenerCount(void *subject, const char *event)
+/**
+ * Interns an event name. The caller must hold the writer lock.
+ *
+ * @param event		the event name to intern
+ * @result			the interned identifier of the event
+ */
+static EventId internEventId(const char *event)
 {
-	g_rec_mutex_lock(&mutex);
-
-	GHashTable *events;
+	EventId id = GPOINTER_TO_UINT(g_hash_table_lookup(eventIds, event));
 
-	if((events = g_hash_table_lookup(subjects, subject)) == NULL) { // Create events if it doesn't exist yet
-		g_rec_mutex_unlock(&mutex);
-		return 0;
+	if(id == EVENT_ID_INVALID) {
+		char *name = strdup(event);
+		id = eventNames->len;
+		g_ptr_array_add(eventNames, name);
+		g_hash_table_insert(eventIds, name, GUINT_TO_POINTER(id));
 	}
 
-	GQueue *queue;
+	return id;
+}
+
+/**
+ * Looks up the listeners of an event on a subject and acquires a reference to them. The caller must call unrefEventListenerArray on the result when done.
+ *
+ * @param subject		the subject to which the event belongs
+ * @param event			the identifier of the event
+ * @result				the listeners of the event or NULL if there are none
+ */
+static EventListenerArray *lookupEventListeners(void *subject, EventId event)
+{
+	EventKey key = {subject, event};
+
+	g_rw_lock_reader_lock(&lock);
+
+	EventListenerArray *array = g_hash_table_lookup(listeners, &key);
 
-	if((queue = g_hash_table_lookup(events, event)) == NULL) { // Create queue if it doesn't exist yet
-		g_rec_mutex_unlock(&mutex);
-		return 0;
+	if(array != NULL) {
+		g_atomic_int_inc(&array->refs);
 	}
 
-	unsigned int length = g_queue_get_length(queue);
+	g_rw_lock_reader_unlock(&lock);
 
-	g_rec_mutex_unlock(&mutex);
+	return array;
+}
 
-	return length;
+/**
+ * Creates a new event listener array with a single reference
+ *
+ * @param count		the number of listeners to allocate
+ * @result			the created array
+ */
+static EventListenerArray *createEventListenerArray(unsigned int count)
+{
+	EventListenerArray *array = allocateMemory(sizeof(EventListenerArray) + count * sizeof(EventListenerEntry));
+	array->refs = 1;
+	array->count = count;
+
+	return array;
 }
 
 /**
- * GCompareDataFunc to compare two EventListenerEntry objects by their priority
+ * A GDestroyNotify function to release a reference to an event listener array
  *
- * @param first_p		the first EventListenerEntry
- * @param second_p		the second EventListenerEntry
- * @param data			unused
+ * @param listeners_p	a pointer to the event listener array to release
  */
-static int compareEventListeners(const void *first_p, const void *second_p, void *data)
+static void unrefEventListenerArray(void *listeners_p)
 {
-	const EventListenerEntry *first = first_p;
-	const EventListenerEntry *second = second_p;
+	EventListenerArray *array = listeners_p;
 
-	return first->priority - second->priority;
+	if(g_atomic_int_dec_and_test(&array->refs)) {
+		free(array);
+	}
 }
 
 /**
- * A GDestroyNotify function to free an event listener queue
+ * Notifies all listeners of an event. No lock is held while the listeners are called, which makes this function reentrant: the listeners may freely
+ * trigger more events or attach and detach listeners, which only takes effect for future dispatches.
  *
- * @param queue_p			a pointer to the queue to frees
+ * @param subject		the subject for which the event should be triggered
+ * @param event			the identifier of the event
+ * @param name			the name of the event or NULL if it should be looked up
+ * @param args			the data to pass to the listeners
+ * @result				the number of listeners notified, -1 if there are none
  */
-static void freeEventListenerQueue(void *queue_p)
+static int dispatchEvent(void *subject, EventId event, const char *name, va_list args)
 {
-	GQueue *queue = queue_p;
+	EventListenerArray *array;
+
+	if((array = lookupEventListeners(subject, event)) == NULL) {
+		return -1;
+	}
 
-	for(GList *iter = queue->head; iter != NULL; iter = iter->next) {
-		free(iter->data);
+	if(name == NULL) {
+		name = getEventName(event);
 	}
 
-	g_queue_free(queue);
+	for(unsigned int i = 0; i < array->count; i++) {
+		EventListenerEntry *entry = &array->listeners[i];
+
+		// Every listener gets its own copy of the arguments
+		va_list listenerArgs;
+		va_copy(listenerArgs, args);
+		entry->listener(subject, name, entry->custom, listenerArgs);
+		va_end(listenerArgs);
+	}
+
+	int counter = array->count;
+	unrefEventListenerArray(array);
+
+	return counter;
 }
 
 /**
- * A GDestroyNotify wrapper around g_hash_table_destroy to destroy an event subject
+ * A GHashFunc for EventKey objects
  *
- * @param subject_p		a pointer to the subject to free
+ * @param key_p		the EventKey to hash
+ * @result			the hash value of the key
  */
-static void freeEventSubject(void *subject)
+static unsigned int hashEventKey(const void *key_p)
 {
-	g_hash_table_destroy((GHashTable *) subject);
+	const EventKey *key = key_p;
+	return g_direct_hash(key->subject) ^ (key->event * 2654435761u);
+}
+
+/**
+ * A GEqualFunc for EventKey objects
+ *
+ * @param first_p		the first EventKey to compare
+ * @param second_p		the second EventKey to compare
+ * @result				true if both keys are equal
+ */
+static bool equalEventKeys(const void *first_p, const void *second_p)
+{
+	const EventKey *first = first_p;
+	const EventKey *second = second_p;
+
+	return first->subject == second->subject && first->event == second->event;
 }
@@ -33,6 +33,16 @@
  */
 typedef void (EventListener)(void *subject, const char *event, void *custom_data, va_list args);
 
+/**
+ * Interned identifier of an event name
+ */
+typedef unsigned int EventId;
+
+/**
+ * Event identifier that never refers to an event
+ */
+#define EVENT_ID_INVALID 0
+
 /**
  * Predefined set of event listener priorities
  */
@@ -56,6 +66,27 @@ typedef struct
 } EventListenerEntry;
 
 
+/**
+ * Interns an event name into an event identifier that can be used to trigger the event without looking up its name. Identifiers are stable for the
+ * lifetime of the event module, so hot code paths should resolve them once and keep them around.
+ *
+ * This function is thread-safe
+ *
+ * @param event			the name of the event to intern
+ * @result				the identifier of the event
+ */
+API EventId getEventId(const char *event);
+
+/**
+ * Returns the name of an interned event identifier
+ *
+ * This function is thread-safe
+ *
+ * @param event			the identifier of the event
+ * @result				the name of the event or NULL if the identifier is unknown
+ */
+API const char *getEventName(EventId event);
+
 /**
  * Attaches an event listener to a subject
  *
@@ -110,6 +141,20 @@ API void detachEventListener(void *subject, const char *event, void *custom, Eve
  */
 API int triggerEvent(void *subject, const char *event, ...);
 
+/**
+ * Triggers an event by its interned identifier and notifies all its listeners. This avoids hashing the event name and is the preferred way to trigger
+ * frequent events. Triggering an event without listeners neither allocates nor takes more than a shared lock.
+ *
+ * This function is both reentrant and thread-safe, meaning you can freely trigger more events while executing an event listener.
+ *
+ * @see getEventId
+ * @param subject		the subject for which the event should be triggered
+ * @param event			the identifier of the event that should be triggered
+ * @param ...			the data to pass to the listeners
+ * @result				the number of listeners notified, -1 on error
+ */
+API int triggerEventById(void *subject, EventId event, ...);
+
 /**
  * Returns the listener count for an event on a subject
  *
@@ -18,30 +18,93 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef WIN32
+#include <sys/types.h> // pid_t
+#include <sys/socket.h> // socketpair
+#include <poll.h> // poll
+#include <sys/wait.h> // waitpid
+#include <signal.h> // kill, SIGKILL
+#include <fcntl.h> // open
+#include <unistd.h> // fork, dup2, execvp, syscall
+#endif
+#ifdef __linux__
+#include <sys/syscall.h> // SYS_pidfd_open
+#endif
+#include <stdlib.h> // exit
+#include <errno.h> // errno, EINTR
+#include <stdarg.h>
 #include <glib.h>
 #include "dll.h"
 #include "log.h"
 #include "types.h"
+#include "timer.h"
+#include "memory_alloc.h"
+#include "modules/config/config.h"
+#include "modules/store/path.h"
+#include "modules/event/event.h"
 #include "modules/socket/socket.h"
 #include "modules/socket/poll.h"
 #define API
 #include "exec.h"
 
+#define EXEC_REAP_DELAY_MIN 1000
+#define EXEC_REAP_DELAY_MAX 1000000
+
 MODULE_NAME("exec");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The exec module offers a simple interface to execute shell commands and return their output");
-MODULE_VERSION(0, 1, 2);
+MODULE_VERSION(0, 4, 0);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 6, 3));
+MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 14, 0), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3), MODULE_DEPENDENCY("event", 0, 5, 0));
+
+TIMER_CALLBACK(EXEC_TIMEOUT);
+TIMER_CALLBACK(EXEC_REAP);
+static bool spawnExecProcess(ExecProcess *process);
+static void startQueuedExecProcesses();
+static void processStreamRead(void *subject, const char *event, void *data, va_list args);
+static void processStreamDisconnected(void *subject, const char *event, void *data, va_list args);
+static void closeProcessStream(ExecProcess *process, Socket **stream_p);
+static void drainProcessStream(ExecProcess *process, Socket **stream_p);
+static bool terminateExecProcess(ExecProcess *process, ExecProcessState state);
+static bool watchExecProcess(ExecProcess *process);
+static void unwatchExecProcess(ExecProcess *process);
+static void processExited(int fd, int flags, void *userdata);
+static void reapExecProcess(ExecProcess *process);
+static void completeExecProcess(ExecProcess *process);
+static void finishExecProcess(ExecProcess *process, ExecProcessState state);
+
+/**
+ * The maximum number of asynchronously executed processes running at the same time
+ */
+static unsigned int maxProcesses = 16;
+
+/**
+ * The number of asynchronously executed processes currently running
+ */
+static unsigned int running = 0;
+
+/**
+ * Queue of processes waiting for other processes to exit
+ */
+static GQueue *queued;
 
 MODULE_INIT
 {
+	Store *configMaxProcesses = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "exec/maxProcesses");
+	if(configMaxProcesses != NULL && configMaxProcesses->type == STORE_INTEGER && configMaxProcesses->content.integer > 0) {
+		maxProcesses = configMaxProcesses->content.integer;
+	} else {
+		logNotice("Could not determine config value exec/maxProcesses, using default");
+	}
+
+	queued = g_queue_new();
+
 	return true;
 }
 
 MODULE_FINALIZE
 {
-
+	g_queue_free(queued);
 }
 
 API GString *executeShellCommand(char *command)
@@ -65,6 +128,23 @@ API GString *executeShellCommandArgs(char **args)
 	char buffer[SOCKET_POLL_BUFSIZE];
 
 	while(socket->connected) {
+#ifndef WIN32
+		// Block until there's output instead of spinning on the non-blocking socket, poll isn't limited to descriptors below FD_SETSIZE
+		struct pollfd pfd;
+		pfd.fd = socket->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		if(poll(&pfd, 1, -1) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			logSystemError("Failed to wait for output of shell socket %d", socket->fd);
+			break;
+		}
+#endif
+
 		int size = $(int, socket, socketReadRaw)(socket, buffer, SOCKET_POLL_BUFSIZE);
 
 		if(size > 0) {
@@ -76,3 +156,461 @@ API GString *executeShellCommandArgs(char **args)
 
 	return ret;
 }
+
+API unsigned int getExecProcessLimit()
+{
+	return maxProcesses;
+}
+
+API void setExecProcessLimit(unsigned int limit)
+{
+	maxProcesses = limit > 0 ? limit : 1;
+	startQueuedExecProcesses(); // the limit might have been raised
+}
+
+API ExecProcess *createExecProcess(char **args)
+{
+	ExecProcess *process = ALLOCATE_OBJECT(ExecProcess);
+	process->args = g_strdupv(args);
+	process->state = EXEC_PROCESS_CREATED;
+	process->pid = -1;
+	process->status = 0;
+	process->timeout = 0;
+	process->out = NULL;
+	process->err = NULL;
+	process->timeout_timer = NULL;
+	process->reap_timer = NULL;
+	process->reap_delay = EXEC_REAP_DELAY_MIN;
+	process->pidfd = -1;
+
+	return process;
+}
+
+API bool startExecProcess(ExecProcess *process, int timeout)
+{
+	if(process->state != EXEC_PROCESS_CREATED) {
+		logError("Cannot start process %s that was already started", process->args[0]);
+		return false;
+	}
+
+	process->timeout = timeout;
+
+	if(running >= maxProcesses) {
+		logInfo("Reached limit of %u running processes, queueing process %s", maxProcesses, process->args[0]);
+		process->state = EXEC_PROCESS_QUEUED;
+		g_queue_push_tail(queued, process);
+		return true;
+	}
+
+	return spawnExecProcess(process);
+}
+
+API bool killExecProcess(ExecProcess *process)
+{
+	switch(process->state) {
+		case EXEC_PROCESS_QUEUED:
+			g_queue_remove(queued, process);
+			finishExecProcess(process, EXEC_PROCESS_KILLED);
+			return true;
+		break;
+		case EXEC_PROCESS_RUNNING:
+			return terminateExecProcess(process, EXEC_PROCESS_KILLED);
+		break;
+		default:
+			logError("Cannot kill process %s that isn't running", process->args[0]);
+			return false;
+		break;
+	}
+}
+
+API void freeExecProcess(ExecProcess *process)
+{
+	if(process->state == EXEC_PROCESS_QUEUED) {
+		g_queue_remove(queued, process);
+	} else if(process->pid > 0) { // still running, so kill and reap it right away
+#ifndef WIN32
+		kill(process->pid, SIGKILL);
+		waitpid(process->pid, NULL, 0);
+#endif
+		running--;
+	}
+
+	unwatchExecProcess(process);
+
+	closeProcessStream(process, &process->out);
+	closeProcessStream(process, &process->err);
+
+	if(process->timeout_timer != NULL) {
+		TIMER_DEL(process->timeout_timer);
+	}
+
+	if(process->reap_timer != NULL) {
+		TIMER_DEL(process->reap_timer);
+	}
+
+	g_strfreev(process->args);
+	free(process);
+
+	startQueuedExecProcesses();
+}
+
+/**
+ * Forks and executes a process with its standard output and error connected to polled sockets
+ *
+ * @param process		the process to spawn
+ * @result				true if successful
+ */
+static bool spawnExecProcess(ExecProcess *process)
+{
+#ifdef WIN32
+	logError("Asynchronous process execution is not supported on Windows");
+	finishExecProcess(process, EXEC_PROCESS_FAILED);
+	return false;
+#else
+	int type = SOCK_STREAM;
+#ifdef SOCK_CLOEXEC
+	type |= SOCK_CLOEXEC; // don't leak our ends into other children, dup2 clears the flag for the child's ends
+#endif
+
+	int outFds[2];
+	int errFds[2];
+
+	if(socketpair(AF_UNIX, type, 0, outFds) != 0) {
+		logSystemError("socketpair() failed for process %s", process->args[0]);
+		finishExecProcess(process, EXEC_PROCESS_FAILED);
+		return false;
+	}
+
+	if(socketpair(AF_UNIX, type, 0, errFds) != 0) {
+		logSystemError("socketpair() failed for process %s", process->args[0]);
+		close(outFds[0]);
+		close(outFds[1]);
+		finishExecProcess(process, EXEC_PROCESS_FAILED);
+		return false;
+	}
+
+	pid_t pid;
+
+	if((pid = fork()) < 0) {
+		logSystemError("fork() failed for process %s", process->args[0]);
+		close(outFds[0]);
+		close(outFds[1]);
+		close(errFds[0]);
+		close(errFds[1]);
+		finishExecProcess(process, EXEC_PROCESS_FAILED);
+		return false;
+	} else if(pid == 0) { // Child
+		int null = open("/dev/null", O_RDONLY);
+
+		if(null >= 0 && dup2(null, 0) == 0 && dup2(outFds[1], 1) == 1 && dup2(errFds[1], 2) == 2) {
+			execvp(process->args[0], process->args);
+		}
+
+		_exit(127); // like a shell, report a command that couldn't be executed
+	}
+
+	close(outFds[1]);
+	close(errFds[1]);
+
+	process->pid = pid;
+	process->state = EXEC_PROCESS_RUNNING;
+	running++;
+
+	if((process->out = $(Socket *, socket, createFdSocket)(outFds[0])) == NULL) {
+		close(outFds[0]);
+	}
+
+	if((process->err = $(Socket *, socket, createFdSocket)(errFds[0])) == NULL) {
+		close(errFds[0]);
+	}
+
+	if(process->out == NULL || process->err == NULL) { // we wouldn't be able to tell when the process is done
+		logError("Failed to create output sockets for process %d executing %s, killing it", pid, process->args[0]);
+		closeProcessStream(process, &process->out);
+		closeProcessStream(process, &process->err);
+		kill(pid, SIGKILL);
+		process->state = EXEC_PROCESS_FAILED;
+		reapExecProcess(process);
+		return false;
+	}
+
+	attachEventListener(process->out, "read", process, &processStreamRead);
+	attachEventListener(process->out, "disconnect", process, &processStreamDisconnected);
+	attachEventListener(process->err, "read", process, &processStreamRead);
+	attachEventListener(process->err, "disconnect", process, &processStreamDisconnected);
+	$(bool, socket, enableSocketPolling)(process->out);
+	$(bool, socket, enableSocketPolling)(process->err);
+
+	if(!watchExecProcess(process)) {
+		logInfo("Process descriptors aren't available, reaping process %d executing %s once its output is closed", pid, process->args[0]);
+	}
+
+	if(process->timeout > 0) {
+		process->timeout_timer = TIMER_ADD_TIMEOUT_EX(process->timeout * G_USEC_PER_SEC, EXEC_TIMEOUT, process);
+	}
+
+	logInfo("Started process %d executing %s", pid, process->args[0]);
+
+	return true;
+#endif
+}
+
+/**
+ * Starts as many queued processes as the concurrency limit allows
+ */
+static void startQueuedExecProcesses()
+{
+	while(running < maxProcesses && !g_queue_is_empty(queued)) {
+		ExecProcess *process = g_queue_pop_head(queued);
+		process->state = EXEC_PROCESS_CREATED;
+		spawnExecProcess(process);
+	}
+}
+
+/**
+ * Event listener that delivers output read from one of the streams of a process
+ */
+static void processStreamRead(void *subject, const char *event, void *data, va_list args)
+{
+	Socket *stream = subject;
+	ExecProcess *process = data;
+	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
+
+	triggerEvent(process, stream == process->out ? "stdout" : "stderr", message, size);
+}
+
+/**
+ * Event listener that closes a stream of a process once the process closed its end. If the process can't be watched through a process descriptor,
+ * this tries to reap it once both are closed.
+ */
+static void processStreamDisconnected(void *subject, const char *event, void *data, va_list args)
+{
+	Socket *stream = subject;
+	ExecProcess *process = data;
+
+	closeProcessStream(process, stream == process->out ? &process->out : &process->err);
+
+	if(process->out == NULL && process->err == NULL && process->pidfd < 0 && process->reap_timer == NULL) { // not reaped through its descriptor or after being killed
+		reapExecProcess(process);
+	}
+}
+
+/**
+ * Stops polling and frees a stream of a process
+ *
+ * @param process		the process to close the stream for
+ * @param stream_p		a pointer to the stream to close, which is set to NULL afterwards
+ */
+static void closeProcessStream(ExecProcess *process, Socket **stream_p)
+{
+	Socket *stream = *stream_p;
+
+	if(stream == NULL) {
+		return;
+	}
+
+	detachEventListener(stream, "read", process, &processStreamRead);
+	detachEventListener(stream, "disconnect", process, &processStreamDisconnected);
+	$(void, socket, freeSocket)(stream);
+	*stream_p = NULL;
+}
+
+/**
+ * Delivers the output still buffered in a stream of a process and closes it afterwards
+ *
+ * @param process		the process to drain the stream for
+ * @param stream_p		a pointer to the stream to drain, which is set to NULL afterwards
+ */
+static void drainProcessStream(ExecProcess *process, Socket **stream_p)
+{
+	Socket *stream = *stream_p;
+
+	if(stream == NULL) {
+		return;
+	}
+
+	char buffer[SOCKET_POLL_BUFSIZE];
+	int size;
+
+	while(stream->connected && (size = $(int, socket, socketReadRaw)(stream, buffer, SOCKET_POLL_BUFSIZE)) > 0) {
+		triggerEvent(process, stream == process->out ? "stdout" : "stderr", buffer, size);
+	}
+
+	closeProcessStream(process, stream_p);
+}
+
+/**
+ * Kills a running process. It is reaped as soon as its process descriptor reports its exit, or else by retrying with an increasing delay since
+ * background processes it left behind might keep its output open.
+ *
+ * @param process		the process to kill
+ * @param state			the final state of the process once it has been reaped
+ * @result				true if successful
+ */
+static bool terminateExecProcess(ExecProcess *process, ExecProcessState state)
+{
+#ifndef WIN32
+	if(kill(process->pid, SIGKILL) != 0) {
+		logSystemError("Failed to kill process %d", process->pid);
+		return false;
+	}
+#endif
+
+	process->state = state;
+
+	if(process->pidfd < 0 && process->reap_timer == NULL) {
+		process->reap_timer = TIMER_ADD_TIMEOUT_EX(process->reap_delay, EXEC_REAP, process);
+	}
+
+	return true;
+}
+
+/**
+ * Opens a process descriptor for a running process and polls it to reap the process as soon as it exits
+ *
+ * @param process		the process to watch
+ * @result				true if successful, false if process descriptors aren't supported
+ */
+static bool watchExecProcess(ExecProcess *process)
+{
+#if defined(__linux__) && defined(SYS_pidfd_open)
+	int pidfd;
+
+	if((pidfd = syscall(SYS_pidfd_open, process->pid, 0)) < 0) {
+		return false;
+	}
+
+	if(!$(bool, socket, enableFdPolling)(pidfd, FD_POLL_READ, &processExited, process)) {
+		close(pidfd);
+		return false;
+	}
+
+	process->pidfd = pidfd;
+	return true;
+#else
+	return false;
+#endif
+}
+
+/**
+ * Stops polling and closes the process descriptor of a process
+ *
+ * @param process		the process to stop watching
+ */
+static void unwatchExecProcess(ExecProcess *process)
+{
+#ifndef WIN32
+	if(process->pidfd < 0) {
+		return;
+	}
+
+	$(bool, socket, disableFdPolling)(process->pidfd);
+	close(process->pidfd);
+	process->pidfd = -1;
+#endif
+}
+
+/**
+ * Descriptor polling callback that reaps a process once its process descriptor reports that it exited
+ */
+static void processExited(int fd, int flags, void *userdata)
+{
+#ifndef WIN32
+	ExecProcess *process = userdata;
+	pid_t ret;
+
+	if((ret = waitpid(process->pid, &process->status, WNOHANG)) == 0) { // not exited yet
+		return;
+	} else if(ret < 0) {
+		logSystemError("Failed to reap process %d", process->pid);
+	}
+
+	unwatchExecProcess(process);
+	completeExecProcess(process);
+#endif
+}
+
+/**
+ * Collects the exit status of a process that can't be watched through a process descriptor. This is driven by the output streams reaching EOF
+ * or by the process being killed, instead of listening for SIGCHLD. If it's still alive, we retry with an increasing delay.
+ *
+ * @param process		the process to reap
+ */
+static void reapExecProcess(ExecProcess *process)
+{
+#ifndef WIN32
+	pid_t ret;
+
+	if((ret = waitpid(process->pid, &process->status, WNOHANG)) == 0) { // still running
+		process->reap_timer = TIMER_ADD_TIMEOUT_EX(process->reap_delay, EXEC_REAP, process);
+		process->reap_delay = MIN(process->reap_delay * 2, EXEC_REAP_DELAY_MAX);
+		return;
+	} else if(ret < 0) {
+		logSystemError("Failed to reap process %d", process->pid);
+	}
+#endif
+
+	completeExecProcess(process);
+}
+
+/**
+ * Completes a reaped process by delivering its remaining output and finishing it. Its output streams are closed even if background processes it
+ * left behind still hold them open.
+ *
+ * @param process		the reaped process to complete
+ */
+static void completeExecProcess(ExecProcess *process)
+{
+	drainProcessStream(process, &process->out);
+	drainProcessStream(process, &process->err);
+
+	logInfo("Process %d executing %s exited with status %d", process->pid, process->args[0], process->status);
+	process->pid = -1;
+	running--;
+
+	finishExecProcess(process, process->state == EXEC_PROCESS_RUNNING ? EXEC_PROCESS_EXITED : process->state);
+}
+
+/**
+ * Finishes a process and notifies its listeners
+ *
+ * @param process		the process to finish
+ * @param state			the final state of the process
+ */
+static void finishExecProcess(ExecProcess *process, ExecProcessState state)
+{
+	if(process->timeout_timer != NULL) {
+		TIMER_DEL(process->timeout_timer);
+		process->timeout_timer = NULL;
+	}
+
+	process->state = state;
+	triggerEvent(process, "exit", state); // listeners may free the process
+
+	startQueuedExecProcesses();
+}
+
+/**
+ * Timer callback that kills a process that exceeded its timeout
+ */
+TIMER_CALLBACK(EXEC_TIMEOUT)
+{
+	ExecProcess *process = custom_data;
+	process->timeout_timer = NULL;
+
+	if(process->state == EXEC_PROCESS_RUNNING) {
+		logWarning("Process %d executing %s exceeded its timeout of %d seconds, killing it", process->pid, process->args[0], process->timeout);
+		terminateExecProcess(process, EXEC_PROCESS_TIMED_OUT);
+	}
+}
+
+/**
+ * Timer callback that retries reaping a process
+ */
+TIMER_CALLBACK(EXEC_REAP)
+{
+	ExecProcess *process = custom_data;
+	process->reap_timer = NULL;
+	reapExecProcess(process);
+}
@@ -22,6 +22,58 @@
 #ifndef EXEC_EXEC_H
 #define EXEC_EXEC_H
 
+#include <glib.h>
+#include "types.h"
+#include "modules/socket/socket.h"
+
+/**
+ * Enum of the states an asynchronously executed process can be in
+ */
+typedef enum {
+	/** the process was created but not started yet */
+	EXEC_PROCESS_CREATED,
+	/** the process waits for other processes to exit because the concurrency limit is reached */
+	EXEC_PROCESS_QUEUED,
+	/** the process is running */
+	EXEC_PROCESS_RUNNING,
+	/** the process exited on its own */
+	EXEC_PROCESS_EXITED,
+	/** the process was killed because it exceeded its timeout */
+	EXEC_PROCESS_TIMED_OUT,
+	/** the process was killed on request */
+	EXEC_PROCESS_KILLED,
+	/** the process could not be started */
+	EXEC_PROCESS_FAILED
+} ExecProcessState;
+
+/**
+ * Struct representing an asynchronously executed process
+ */
+typedef struct {
+	/** the command arguments of the process, terminated by NULL */
+	char **args;
+	/** the current state of the process */
+	ExecProcessState state;
+	/** the process ID of the process while it's running */
+	int pid;
+	/** the exit status of the process as returned by waitpid */
+	int status;
+	/** the timeout in seconds after which the process is killed or 0 if it may run forever */
+	int timeout;
+	/** socket reading the standard output of the process */
+	Socket *out;
+	/** socket reading the standard error of the process */
+	Socket *err;
+	/** the timer killing the process on timeout */
+	GTimeVal *timeout_timer;
+	/** the timer retrying to reap the process if it has no process descriptor and closed its output before exiting or was killed */
+	GTimeVal *reap_timer;
+	/** the number of microseconds to wait before retrying to reap the process */
+	int reap_delay;
+	/** the process descriptor polled to reap the process as soon as it exits, or -1 if it is reaped once its output is closed */
+	int pidfd;
+} ExecProcess;
+
 
 /**
  * Executes a shell command and returns its output. Note that this function blocks until the command finished its execution.
@@ -34,10 +86,64 @@ API GString *executeShellCommand(char *command);
 
 /**
  * Executes a shell command by a list of arguments and returns its output. Note that this function blocks until the command finished its execution.
+ * Use createExecProcess to execute commands without blocking the main loop.
  *
  * @param command			the command args to execute
  * @result					the output of the command, or NULL if failed
  */
 API GString *executeShellCommandArgs(char **args);
 
+/**
+ * Returns the maximum number of asynchronously executed processes running at the same time
+ *
+ * @result				the maximum number of concurrently running processes
+ */
+API unsigned int getExecProcessLimit();
+
+/**
+ * Sets the maximum number of asynchronously executed processes running at the same time, overriding the config value exec/maxProcesses. If the
+ * limit is raised, queued processes are started right away. If it is lowered, running processes are left alone.
+ *
+ * @param limit			the maximum number of concurrently running processes, at least 1
+ */
+API void setExecProcessLimit(unsigned int limit);
+
+/**
+ * Creates a process to be executed asynchronously. Attach your listeners to the returned process before starting it:
+ *  * "stdout" (char *data, int size) is triggered whenever the process wrote something to its standard output
+ *  * "stderr" (char *data, int size) is triggered whenever the process wrote something to its standard error
+ *  * "exit" (ExecProcessState state) is triggered after the process exited and all of its output was delivered, or if it failed to start. Output
+ *    written after the process exited by background processes it left behind is not delivered.
+ *
+ * @param args			the command arguments of the process to execute, terminated by NULL
+ * @result				the created process
+ */
+API ExecProcess *createExecProcess(char **args);
+
+/**
+ * Starts executing a process asynchronously. Its output is read by the socket poller and delivered through events while the main loop keeps
+ * running. If the maximum number of concurrently running processes is reached, the process is queued and started as soon as another one exits.
+ *
+ * @param process		the process to start
+ * @param timeout		the timeout in seconds after which the process is killed or 0 if it may run forever
+ * @result				true if successful
+ */
+API bool startExecProcess(ExecProcess *process, int timeout);
+
+/**
+ * Kills a running or queued process. The "exit" event is triggered once the process has been reaped.
+ *
+ * @param process		the process to kill
+ * @result				true if successful
+ */
+API bool killExecProcess(ExecProcess *process);
+
+/**
+ * Frees an asynchronously executed process. If it is still running, it is killed first. Note that this must not be called from within
+ * "stdout" or "stderr" listeners of the process, but it may be called from within "exit" listeners.
+ *
+ * @param process		the process to free
+ */
+API void freeExecProcess(ExecProcess *process);
+
 #endif
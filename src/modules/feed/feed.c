@@ -34,14 +34,15 @@
 MODULE_NAME("feed");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Module to track XML feeds");
-MODULE_VERSION(0, 4, 0);
+MODULE_VERSION(0, 5, 0);
 MODULE_BCVERSION(0, 2, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("xml", 0, 1, 2), MODULE_DEPENDENCY("curl", 0, 1, 1), MODULE_DEPENDENCY("http_server", 0, 1, 2), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3));
+MODULE_DEPENDS(MODULE_DEPENDENCY("xml", 0, 1, 2), MODULE_DEPENDENCY("curl", 0, 2, 0), MODULE_DEPENDENCY("http_server", 0, 1, 2), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3));
 
 #define FEED_LIMIT 200
 #define GENERIC_FEED_URI "^/feeds/%s$"
 
 TIMER_CALLBACK(feed_update);
+static void feedDownloaded(const char *url, GString *xml, void *feed_p);
 static bool indexHandler(HttpRequest *request, HttpResponse *response, void *userdata_p);
 static bool feedHandler(HttpRequest *request, HttpResponse *response, void *userdata_p);
 static bool compareFeedContentEntries(GHashTable *first, GHashTable *second);
@@ -155,52 +156,71 @@ TIMER_CALLBACK(feed_update)
 			continue;
 		}
 
-		GString *xml;
-		if((xml = curlRequestUrl(feed->url)) == NULL) {
+		if(feed->request != NULL) {
+			logWarning("Feed '%s' is still being updated, skipping", feed->name);
 			continue;
 		}
 
-		xmlDocPtr document = parseXmlString(xml->str);
-		g_string_free(xml, true);
+		// All feeds are downloaded concurrently without blocking the main loop
+		feed->request = curlRequestUrlAsync(feed->url, &feedDownloaded, feed);
+	}
 
-		if(document == NULL) {
-			continue;
-		}
+	TIMER_ADD_TIMEOUT(60 * G_USEC_PER_SEC, feed_update);
+}
 
-		GHashTable *entry = g_hash_table_new_full(&g_str_hash, &g_str_equal, &free, &free);
+/**
+ * CurlRequestCallback to record a new content entry for a feed after it was downloaded
+ *
+ * @param url			the URL of the feed
+ * @param xml			the downloaded feed or NULL on failure
+ * @param feed_p		the feed that was downloaded
+ */
+static void feedDownloaded(const char *url, GString *xml, void *feed_p)
+{
+	Feed *feed = feed_p;
+	feed->request = NULL;
 
-		for(GList *iter = feed->fields->head; iter != NULL; iter = iter->next) {
-			FeedField *field = iter->data;
-			GString *value = evaluateXPathExpressionFirst(document, field->expression);
-			if(value != NULL) {
-				logInfo("Feed '%s' field '%s' value: %s", name, field->name, value->str);
-				g_hash_table_insert(entry, strdup(field->name), value->str);
-				g_string_free(value, false);
-			}
-		}
+	if(xml == NULL) {
+		return;
+	}
 
-		xmlFreeDoc(document);
+	xmlDocPtr document = parseXmlString(xml->str);
 
-		if(!g_queue_is_empty(feed->content)) {
-			// Check if the new content element is different from the last recorded one
-			GHashTable *last = g_queue_peek_head(feed->content);
-			if(compareFeedContentEntries(last, entry)) {
-				g_hash_table_destroy(entry);
-				logInfo("Feed entry for feed '%s' already exists, skipping", feed->name);
-				continue;
-			}
+	if(document == NULL) {
+		return;
+	}
+
+	GHashTable *entry = g_hash_table_new_full(&g_str_hash, &g_str_equal, &free, &free);
+
+	for(GList *iter = feed->fields->head; iter != NULL; iter = iter->next) {
+		FeedField *field = iter->data;
+		GString *value = evaluateXPathExpressionFirst(document, field->expression);
+		if(value != NULL) {
+			logInfo("Feed '%s' field '%s' value: %s", feed->name, field->name, value->str);
+			g_hash_table_insert(entry, strdup(field->name), value->str);
+			g_string_free(value, false);
 		}
+	}
 
-		g_queue_push_head(feed->content, entry);
-		logInfo("Added new feed content entry for '%s'", feed->name);
+	xmlFreeDoc(document);
 
-		if(g_queue_get_length(feed->content) > FEED_LIMIT) {
-			GHashTable *first = g_queue_pop_tail(feed->content);
-			g_hash_table_destroy(first);
+	if(!g_queue_is_empty(feed->content)) {
+		// Check if the new content element is different from the last recorded one
+		GHashTable *last = g_queue_peek_head(feed->content);
+		if(compareFeedContentEntries(last, entry)) {
+			g_hash_table_destroy(entry);
+			logInfo("Feed entry for feed '%s' already exists, skipping", feed->name);
+			return;
 		}
 	}
 
-	TIMER_ADD_TIMEOUT(60 * G_USEC_PER_SEC, feed_update);
+	g_queue_push_head(feed->content, entry);
+	logInfo("Added new feed content entry for '%s'", feed->name);
+
+	if(g_queue_get_length(feed->content) > FEED_LIMIT) {
+		GHashTable *first = g_queue_pop_tail(feed->content);
+		g_hash_table_destroy(first);
+	}
 }
 
 API bool createFeed(const char *name, const char *url)
@@ -216,6 +236,7 @@ API bool createFeed(const char *name, const char *url)
 	feed->fields = g_queue_new();
 	feed->content = g_queue_new();
 	feed->enabled = false;
+	feed->request = NULL;
 
 	g_hash_table_insert(feeds, strdup(name), feed);
 
@@ -392,6 +413,10 @@ static void freeFeed(void *feed_p)
 {
 	Feed *feed = feed_p;
 
+	if(feed->request != NULL) {
+		cancelCurlRequest(feed->request);
+	}
+
 	GString *regex = g_string_new("");
 	g_string_append_printf(regex, GENERIC_FEED_URI, feed->name);
 	unregisterHttpServerRequestHandler(http, regex->str, &feedHandler, feed);
@@ -21,6 +21,8 @@
 #ifndef FEED_FEED_H
 #define FEED_FEED_H
 
+#include "modules/curl/curl.h"
+
 typedef struct {
 	/** The name of the field */
 	char *name;
@@ -39,6 +41,8 @@ typedef struct {
 	GQueue *content;
 	/** Whether the feed is enabled */
 	bool enabled;
+	/** The update request in progress for this feed or NULL if the feed isn't being updated right now */
+	CurlRequest *request;
 } Feed;
 
 
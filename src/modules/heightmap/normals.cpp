@@ -19,8 +19,7 @@
  */
 
 #include "dll.h"
-#include "modules/linalg/Vector.h"
-#include "modules/linalg/Matrix.h"
+#include "modules/linalg/FixedVector.h"
 extern "C" {
 #include "modules/image/image.h"
 }
@@ -31,13 +30,26 @@ extern "C" {
 }
 #include "normals.h"
 
-static inline Vector getHeightmapVector(Image *heights, int x, int y, float widthScale, float heightScale)
+/** The number of consecutive rows computed by a single thread pool job */
+#define HEIGHTMAP_NORMALS_TILE_ROWS 16
+
+typedef struct {
+	Image *heights;
+	Image *normals;
+	float widthScale;
+	float heightScale;
+} HeightmapNormalsJob;
+
+static void computeHeightmapNormalsTile(void *tilePointer, void *jobPointer);
+
+static inline FixedVector3 getHeightmapVector(Image *heights, int x, int y, float widthScale, float heightScale)
 {
-	return Vector3((float) x * widthScale, getImage(heights, x, y, 0), (float) y * heightScale);
+	return FixedVector3((float) x * widthScale, getImage(heights, x, y, 0), (float) y * heightScale);
 }
 
 /**
  * Computes the heightmap normals for a heightfield image. The resulting normal vectors are then packed to fit into a [0,1] value range.
+ * Rows are computed in parallel on all available processors.
  *
  * @param heights			the heightfield for which to compute the normal vectors
  * @param normals			the normal map in which to write the computed normals
@@ -50,11 +62,51 @@ API void computeHeightmapNormals(Image *heights, Image *normals, float widthScal
 	assert(heights->width == normals->width);
 	assert(normals->channels >= 3);
 
-	Vector up = Vector3(0.0f, 1.0f, 0.0f);
+	HeightmapNormalsJob job;
+	job.heights = heights;
+	job.normals = normals;
+	job.widthScale = widthScale;
+	job.heightScale = heightScale;
+
+	unsigned int tiles = (heights->height + HEIGHTMAP_NORMALS_TILE_ROWS - 1) / HEIGHTMAP_NORMALS_TILE_ROWS;
+	unsigned int threads = MIN(g_get_num_processors(), tiles);
+
+	if(threads <= 1) { // not worth spawning any threads
+		for(unsigned int tile = 0; tile < tiles; tile++) {
+			computeHeightmapNormalsTile(GUINT_TO_POINTER(tile + 1), &job);
+		}
+		return;
+	}
+
+	// every pixel only reads the heightfield and writes its own normal, so rows can be computed in any order
+	GThreadPool *pool = g_thread_pool_new(&computeHeightmapNormalsTile, &job, threads, true, NULL);
+	for(unsigned int tile = 0; tile < tiles; tile++) {
+		g_thread_pool_push(pool, GUINT_TO_POINTER(tile + 1), NULL); // offset by one since NULL can't be pushed
+	}
+	g_thread_pool_free(pool, false, true);
+}
+
+/**
+ * Thread pool worker computing the normals of a tile of consecutive heightmap rows
+ *
+ * @param tilePointer		the index of the tile to compute plus one
+ * @param jobPointer		the HeightmapNormalsJob to work on
+ */
+static void computeHeightmapNormalsTile(void *tilePointer, void *jobPointer)
+{
+	HeightmapNormalsJob *job = (HeightmapNormalsJob *) jobPointer;
+	Image *heights = job->heights;
+	Image *normals = job->normals;
+	float widthScale = job->widthScale;
+	float heightScale = job->heightScale;
 	int height = heights->height;
 	int width = heights->width;
 
-	for(int y = 0; y < height; y++) {
+	int tile = GPOINTER_TO_UINT(tilePointer) - 1;
+	int yStart = tile * HEIGHTMAP_NORMALS_TILE_ROWS;
+	int yEnd = MIN(yStart + HEIGHTMAP_NORMALS_TILE_ROWS, height);
+
+	for(int y = yStart; y < yEnd; y++) {
 		int ym1 = y - 1 < 0 ? 0 : y - 1;
 		int yp1 = y + 1 >= height ? height - 1 : y + 1;
 
@@ -62,14 +114,14 @@ API void computeHeightmapNormals(Image *heights, Image *normals, float widthScal
 			int xm1 = x - 1 < 0 ? 0 : x - 1;
 			int xp1 = x + 1 >= width ? width - 1 : x + 1;
 
-			Vector normal = Vector3(0.0f, 0.0f, 0.0f);
-			Vector current = getHeightmapVector(heights, x, y, widthScale, heightScale);
-			Vector exp1yp0 = getHeightmapVector(heights, xp1, y, widthScale, heightScale) - current;
-			Vector exp1ym1 = getHeightmapVector(heights, xp1, ym1, widthScale, heightScale) - current;
-			Vector exp0yp1 = getHeightmapVector(heights, x, yp1, widthScale, heightScale) - current;
-			Vector exp0ym1 = getHeightmapVector(heights, x, ym1, widthScale, heightScale) - current;
-			Vector exm1yp1 = getHeightmapVector(heights, xm1, yp1, widthScale, heightScale) - current;
-			Vector exm1yp0 = getHeightmapVector(heights, xm1, y, widthScale, heightScale) - current;
+			FixedVector3 normal;
+			FixedVector3 current = getHeightmapVector(heights, x, y, widthScale, heightScale);
+			FixedVector3 exp1yp0 = getHeightmapVector(heights, xp1, y, widthScale, heightScale) - current;
+			FixedVector3 exp1ym1 = getHeightmapVector(heights, xp1, ym1, widthScale, heightScale) - current;
+			FixedVector3 exp0yp1 = getHeightmapVector(heights, x, yp1, widthScale, heightScale) - current;
+			FixedVector3 exp0ym1 = getHeightmapVector(heights, x, ym1, widthScale, heightScale) - current;
+			FixedVector3 exm1yp1 = getHeightmapVector(heights, xm1, yp1, widthScale, heightScale) - current;
+			FixedVector3 exm1yp0 = getHeightmapVector(heights, xm1, y, widthScale, heightScale) - current;
 
 			// add contributions from neighboring triangles
 			normal += (exp1yp0 % exp1ym1).normalize();
@@ -25,8 +25,10 @@
 
 #include "http_parser.h"
 
-#define MATCH_HTTP_REQUEST_LINE "^(GET|POST)[ ]+(.+)[ ]+HTTP/\\d\\.\\d$"
-#define MATCH_CONTENT_LENGTH_LINE "^Content-Length: ([\\d]+).*$"
+#define HTTP_VERSION_PREFIX "HTTP/"
+#define HTTP_VERSION_1_1_STRING "1.1"
+#define HTTP_CONTENT_LENGTH_HEADER "Content-Length"
+#define HTTP_CONNECTION_HEADER "Connection"
 
 #define HTTP_GET "GET"
 #define HTTP_POST "POST"
@@ -38,18 +40,23 @@ static void replaceString(char **old, char *new);
 static void parseUri(HttpRequest *request, char *uri);
 static void parseMethod(HttpRequest *request, char *method);
 
-static void tryParseMethodLine(HttpRequest *request, char *line);
-static void tryParseContentLength(HttpRequest *request, char *line);
+static void parseRequestLine(HttpRequest *request, char *line);
+static void parseHeaderLine(HttpRequest *request, char *line);
 
 API void parseHttpRequestLine(HttpRequest *request, char *line)
 {
 	logTrace("Parsing HTTP line: %s", line);
-	tryParseMethodLine(request, line);
-	tryParseContentLength(request, line);
 
-	// An empty line indicates the end of the request
-	if(strlen(line) == 0) {
+	if(!request->got_request_line) {
+		if(*line != '\0') { // Empty lines preceding the request line are ignored
+			parseRequestLine(request, line);
+			request->got_request_line = true;
+		}
+	} else if(*line == '\0') {
+		// An empty line indicates the end of the request header
 		request->got_empty_line = true;
+	} else {
+		parseHeaderLine(request, line);
 	}
 }
 
@@ -59,45 +66,78 @@ API void parseHttpRequestBody(HttpRequest *request, char *body)
 }
 
 /**
- * Attempts to parse the given line as a method line, i.e. a line of the form <METHOD> <URI> HTTP/<NUMBER>.
+ * Parses the request line, i.e. a line of the form <METHOD> <URI> HTTP/<NUMBER>. The line is modified in place. If the line is malformed or the method
+ * isn't supported, the request is left untouched so it will be answered with a bad request.
  */
-static void tryParseMethodLine(HttpRequest *request, char *line)
+static void parseRequestLine(HttpRequest *request, char *line)
 {
-	GRegex *regexp = g_regex_new(MATCH_HTTP_REQUEST_LINE, 0, 0, NULL);
-	GMatchInfo *match_info;
+	char *uri = strchr(line, ' ');
+	char *version = strrchr(line, ' ');
 
-	if(g_regex_match(regexp, line, 0, &match_info)) {
-		char *method = g_match_info_fetch(match_info, 1);
-		parseMethod(request, method);
-		free(method);
+	if(uri == NULL || uri == version) {
+		logInfo("Malformed HTTP request line: %s", line);
+		return;
+	}
 
-		char *uri = g_match_info_fetch(match_info, 2);
-		parseUri(request, uri);
-		free(uri);
+	*uri++ = '\0'; // terminate the method
+	*version++ = '\0'; // terminate the URI
+
+	if(strncmp(version, HTTP_VERSION_PREFIX, strlen(HTTP_VERSION_PREFIX)) != 0) {
+		logInfo("Malformed HTTP version in request line: %s", version);
+		return;
+	}
+
+	// HTTP/1.1 connections are persistent by default, older ones aren't
+	version += strlen(HTTP_VERSION_PREFIX);
+	request->version = strcmp(version, HTTP_VERSION_1_1_STRING) < 0 ? HTTP_VERSION_1_0 : HTTP_VERSION_1_1;
+	request->keep_alive = request->version != HTTP_VERSION_1_0;
+
+	g_strstrip(uri); // methods, URIs and versions may be separated by more than one space
+
+	if(*uri == '\0') {
+		logInfo("Missing URI in HTTP request line");
+		return;
 	}
 
-	g_match_info_free(match_info);
-	g_regex_unref(regexp);
+	parseMethod(request, line);
+
+	if(request->method != HTTP_REQUEST_METHOD_UNKNOWN) {
+		parseUri(request, uri);
+	}
 }
 
 /**
- * Attempts to parse the given line as a Content-Length line, i.e. a line of the form Content-length: XX.
+ * Parses a header line, i.e. a line of the form <NAME>: <VALUE>. Header names are case-insensitive, and headers not needed by the server are ignored.
  */
-static void tryParseContentLength(HttpRequest *request, char *line)
+static void parseHeaderLine(HttpRequest *request, char *line)
 {
-	GRegex *regexp = g_regex_new(MATCH_CONTENT_LENGTH_LINE, 0, 0, NULL);
-	GMatchInfo *match_info;
+	char *value = strchr(line, ':');
+
+	if(value == NULL) {
+		logInfo("Malformed HTTP header line: %s", line);
+		return;
+	}
 
-	if(g_regex_match(regexp, line, 0, &match_info)) {
-		char *content_length_str = g_match_info_fetch(match_info, 1);
+	*value++ = '\0';
 
-		// Returns 0 on failure, which is fine for us.
-		request->content_length = atoi(content_length_str);
-		free(content_length_str);
+	while(*value == ' ' || *value == '\t') {
+		value++;
 	}
 
-	g_match_info_free(match_info);
-	g_regex_unref(regexp);
+	if(g_ascii_strcasecmp(line, HTTP_CONTENT_LENGTH_HEADER) == 0) {
+		if(!g_ascii_isdigit(*value)) {
+			logInfo("Invalid HTTP content length: %s", value);
+			return;
+		}
+
+		request->content_length = atoi(value);
+	} else if(g_ascii_strcasecmp(line, HTTP_CONNECTION_HEADER) == 0) {
+		if(g_ascii_strcasecmp(value, "close") == 0) {
+			request->keep_alive = false;
+		} else if(g_ascii_strcasecmp(value, "keep-alive") == 0) {
+			request->keep_alive = true;
+		}
+	}
 }
 
 static int countParts(char **parts)
@@ -22,9 +22,16 @@
 #include <stdarg.h>
 #include <glib.h>
 #include "dll.h"
+#include "log.h"
+#include "timer.h"
+#include "util.h"
+#include "modules/config/config.h"
+#include "modules/store/store.h"
 #include "modules/event/event.h"
 #include "modules/socket/socket.h"
 #include "modules/socket/poll.h"
+#include "modules/socket/shard.h"
+#include "modules/socket/linebuffer.h"
 #define API
 #include "http_server.h"
 #include "http_parser.h"
@@ -32,50 +39,96 @@
 #define OK_STATUS_STRING "200 OK"
 #define FILE_NOT_FOUND_STATUS_STRING "404 Not Found"
 #define BAD_REQUEST_STATUS_STRING "400 Bad Request"
+#define HTTP_CONTENT_TYPE_HEADER "Content-Type"
+#define HTTP_DEFAULT_CONTENT_TYPE "text/html; charset=utf-8"
+#define REGEXP_METACHARACTERS ".[]()*+?{}|\\^$"
 
 MODULE_NAME("http_server");
 MODULE_AUTHOR("Dino Wernli");
 MODULE_DESCRIPTION("This module provides a basic http server library which can be used to easily create http servers.");
-MODULE_VERSION(0, 1, 5);
+MODULE_VERSION(0, 4, 1);
 MODULE_BCVERSION(0, 1, 2);
-MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 7, 0), MODULE_DEPENDENCY("event", 0, 1, 2));
+MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 15, 2), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3));
 
 /** Struct used to map regular expressions to function which respond to HTTP requests */
 typedef struct
 {
+	/** The regular expression as passed at registration time */
 	char *regexp;
+	/** The compiled regular expression, or NULL if the regular expression is a plain literal */
+	GRegex *compiled;
+	/** The literal prefix every matching hierarchical part must start with */
+	char *prefix;
+	/** Registration sequence number used to keep the matching precedence */
+	unsigned long sequence;
 	HttpRequestHandler *handler;
 	void *userdata;
 } RequestHandlerMapping;
 
+/** Node of the trie indexing the handler mappings by their literal prefixes */
+struct HttpHandlerTrieNodeStruct
+{
+	/** Child nodes indexed by the next character of the prefix */
+	GHashTable *children;
+	/** Handler mappings whose literal prefix ends at this node */
+	GQueue *mappings;
+};
+
 /** Struct used to map requests to the server on which they came in */
 typedef struct
 {
 	HttpServer *server;
+	/** The request currently being read from the connection, reused for every request on a persistent connection */
 	HttpRequest *request;
+	/** The client socket of the connection */
+	Socket *socket;
+	/** The timer closing the connection once it has been idle for too long, or NULL if there is none */
+	GTimeVal *idle_timer;
 } ServerRequestMapping;
 
 static RequestHandlerMapping *createRequestHandlerMapping(char *regexp, HttpRequestHandler *handler, void *userdata);
-static void freeRequestHandlerMappingContent(void *mapping);
-static ServerRequestMapping *createServerRequestMapping(HttpServer *server, HttpRequest *request);
+static void freeRequestHandlerMapping(void *mapping);
+static char *getLiteralPrefix(const char *regexp, bool *literal_p);
+static HttpHandlerTrieNode *createHandlerTrieNode();
+static void freeHandlerTrieNode(void *node);
+static HttpHandlerTrieNode *lookupHandlerTrieNode(HttpHandlerTrieNode *root, const char *prefix, bool create);
+static int compareRequestHandlerMappings(const void *a, const void *b);
+static ServerRequestMapping *createServerRequestMapping(HttpServer *server, HttpRequest *request, Socket *socket);
 static void freeServerRequestMapping(ServerRequestMapping *mapping);
 
 static void tryFreeServer(HttpServer *server);
 static void clientAccepted(void *subject, const char *event, void *data, va_list args);
 static void processAvailableLines(HttpRequest *request);
+static void processAvailableRequests(ServerRequestMapping *mapping);
+static void resetHttpRequest(HttpRequest *request);
+static void resetIdleTimer(ServerRequestMapping *mapping);
+static void freeHttpHeader(void *header);
+static HttpHeader *lookupHttpResponseHeader(HttpResponse *response, const char *name);
+static bool sendResponseHead(Socket *client, HttpResponse *response, GString *head, GString *content);
 static bool sendResponse(Socket *client, HttpResponse *response);
-static void handleAndRespond(Socket *client, HttpServer *server, HttpRequest *request);
+static bool handleAndRespond(Socket *client, HttpServer *server, HttpRequest *request);
 static void clientSocketDisconnected(void *subject, const char *event, void *data, va_list args);
 static void clientSocketRead(void *subject, const char *event, void *data, va_list args);
+static bool spawnHttpServerShards();
+
+/** Sequence number of the next handler registration */
+static unsigned long handlerSequence = 0;
+
+TIMER_CALLBACK(IDLE_TIMEOUT);
 
 MODULE_INIT
 {
+	if(!spawnHttpServerShards()) {
+		logError("Failed to spawn the configured HTTP server shards");
+		return false;
+	}
+
 	return true;
 }
 
 MODULE_FINALIZE
 {
-
+	$(void, socket, freeSocketShards)();
 }
 
 API HttpServer *createHttpServer(char* port)
@@ -86,8 +139,9 @@ API HttpServer *createHttpServer(char* port)
 	server->state = SERVER_STATE_CREATED;
 	server->open_connections = 0;
 	server->server_socket = createServerSocket(port);
-	server->handler_mappings = g_array_new(false, false, sizeof(RequestHandlerMapping*));
-	g_array_set_clear_func(server->handler_mappings, &freeRequestHandlerMappingContent);
+	server->handler_mappings = g_ptr_array_new_with_free_func(&freeRequestHandlerMapping);
+	server->handler_trie = createHandlerTrieNode();
+	server->idle_timeout = HTTP_SERVER_DEFAULT_IDLE_TIMEOUT;
 
 	attachEventListener(server->server_socket, "accept", server, &clientAccepted);
 	return server;
@@ -118,21 +172,33 @@ API bool startHttpServer(HttpServer *server)
 	return true;
 }
 
+API void setHttpServerIdleTimeout(HttpServer *server, int timeout)
+{
+	server->idle_timeout = timeout;
+}
+
 API void registerHttpServerRequestHandler(HttpServer *server, char *hierarchical_regexp, HttpRequestHandler *handler, void *userdata)
 {
 	logInfo("Registering HTTP request handler for URIs matching %s", hierarchical_regexp);
 	RequestHandlerMapping *mapping = createRequestHandlerMapping(hierarchical_regexp, handler, userdata);
-	g_array_append_val(server->handler_mappings, mapping);
+	if(mapping == NULL) {
+		return;
+	}
+
+	g_ptr_array_add(server->handler_mappings, mapping);
+
+	HttpHandlerTrieNode *node = lookupHandlerTrieNode(server->handler_trie, mapping->prefix, true);
+	g_queue_push_tail(node->mappings, mapping);
 }
 
 API void unregisterHttpServerRequestHandler(HttpServer *server, char *hierarchical_regexp, HttpRequestHandler *handler, void *userdata)
 {
 	logInfo("Unregistering HTTP request handler for URIs matching %s", hierarchical_regexp);
-	GArray *mappings = server->handler_mappings;
+	GPtrArray *mappings = server->handler_mappings;
 
 	int match_index = -1;
 	for(int i = 0; i < mappings->len; ++i) {
-		RequestHandlerMapping *mapping = g_array_index(mappings, RequestHandlerMapping*, i);
+		RequestHandlerMapping *mapping = g_ptr_array_index(mappings, i);
 		if(!strcmp(mapping->regexp, hierarchical_regexp) && mapping->handler == handler && mapping->userdata == userdata) {
 			if(match_index != -1) {
 				logInfo("Unregistering found multiple matches, using last one");
@@ -142,9 +208,10 @@ API void unregisterHttpServerRequestHandler(HttpServer *server, char *hierarchic
 	}
 
 	if(match_index != -1) {
-		RequestHandlerMapping *mapping = g_array_index(mappings, RequestHandlerMapping*, match_index);
-		freeRequestHandlerMappingContent(mapping);
-		g_array_remove_index(mappings, match_index); // Frees the mapping struct itself
+		RequestHandlerMapping *mapping = g_ptr_array_index(mappings, match_index);
+		HttpHandlerTrieNode *node = lookupHandlerTrieNode(server->handler_trie, mapping->prefix, false);
+		g_queue_remove(node->mappings, mapping);
+		g_ptr_array_remove_index(mappings, match_index); // Frees the mapping struct itself
 	}
 }
 
@@ -155,9 +222,13 @@ API HttpRequest *createHttpRequest()
 	request->uri = NULL;
 	request->hierarchical = NULL;
 	request->parameters = g_hash_table_new_full(g_str_hash, g_str_equal, &free, &free);
-	request->line_buffer = g_string_new("");
+	request->line_buffer = createLineBuffer(false);
 	request->content_length = -1;
+	request->got_request_line = false;
 	request->got_empty_line = false;
+	request->version = HTTP_VERSION_1_0;
+	request->keep_alive = false;
+	request->socket = NULL;
 	return request;
 }
 
@@ -166,7 +237,7 @@ API void destroyHttpRequest(HttpRequest *request)
 	free(request->uri);
 	free(request->hierarchical);
 	g_hash_table_destroy(request->parameters); // Frees all the key and value strings
-	g_string_free(request->line_buffer, true);
+	freeLineBuffer(request->line_buffer);
 	free(request);
 }
 
@@ -203,6 +274,13 @@ API HttpResponse *createHttpResponse(const char *status, const char *content)
 	HttpResponse *response = ALLOCATE_OBJECT(HttpResponse);
 	response->status = strdup(status);
 	response->content = g_string_new(content);
+	response->headers = g_queue_new();
+	response->version = HTTP_VERSION_1_0;
+	response->keep_alive = false;
+	response->socket = NULL;
+	response->streaming = false;
+
+	setHttpResponseHeader(response, HTTP_CONTENT_TYPE_HEADER, HTTP_DEFAULT_CONTENT_TYPE);
 	return response;
 }
 
@@ -210,9 +288,74 @@ API void destroyHttpResponse(HttpResponse *response)
 {
 	free(response->status);
 	g_string_free(response->content, true);
+	g_queue_free_full(response->headers, &freeHttpHeader);
 	free(response);
 }
 
+API bool setHttpResponseHeader(HttpResponse *response, const char *name, const char *value)
+{
+	if(response->streaming) {
+		logWarning("Cannot set HTTP response header %s after the response was already flushed", name);
+		return false;
+	}
+
+	HttpHeader *header = lookupHttpResponseHeader(response, name);
+	if(header == NULL) {
+		header = ALLOCATE_OBJECT(HttpHeader);
+		header->name = strdup(name);
+		header->value = strdup(value);
+		g_queue_push_tail(response->headers, header);
+	} else {
+		free(header->value);
+		header->value = strdup(value);
+	}
+
+	return true;
+}
+
+API const char *getHttpResponseHeader(HttpResponse *response, const char *name)
+{
+	HttpHeader *header = lookupHttpResponseHeader(response, name);
+	if(header == NULL) {
+		return NULL;
+	}
+
+	return header->value;
+}
+
+API bool flushHttpResponseContent(HttpResponse *response)
+{
+	if(response->socket == NULL || response->version == HTTP_VERSION_1_0) {
+		// Chunked transfer encoding isn't available, so keep buffering the content until the response is complete
+		return true;
+	}
+
+	if(!response->streaming) {
+		GString *head = g_string_new("Transfer-Encoding: chunked\r\n");
+		bool result = sendResponseHead(response->socket, response, head, NULL);
+		g_string_free(head, true);
+		response->streaming = true;
+
+		if(!result) {
+			return false;
+		}
+	}
+
+	if(response->content->len == 0) {
+		return true; // an empty chunk would terminate the response
+	}
+
+	GString *chunk = g_string_new("");
+	g_string_append_printf(chunk, "%lx\r\n", (unsigned long) response->content->len);
+	g_string_append_len(chunk, response->content->str, response->content->len);
+	g_string_append(chunk, "\r\n");
+	bool result = socketWriteRaw(response->socket, chunk->str, chunk->len);
+	g_string_free(chunk, true);
+	clearHttpResponseContent(response);
+
+	return result;
+}
+
 API HttpResponse *handleHttpRequest(HttpServer *server, HttpRequest *request)
 {
 	if(request->method == HTTP_REQUEST_METHOD_UNKNOWN || request->hierarchical == NULL) {
@@ -220,14 +363,44 @@ API HttpResponse *handleHttpRequest(HttpServer *server, HttpRequest *request)
 		return createHttpResponse(BAD_REQUEST_STATUS_STRING, BAD_REQUEST_STATUS_STRING);
 	}
 
-	// Go through all handlers and execute the first one which matches the requested URI
-	GArray *mappings = server->handler_mappings;
-	for(int i = 0; i < mappings->len; ++i) {
-		RequestHandlerMapping *mapping = g_array_index(mappings, RequestHandlerMapping*, i);
-		if(g_regex_match_simple(mapping->regexp, request->hierarchical, 0, 0)) {
+	// Collect the handlers whose literal prefix matches the requested URI by walking down the trie. Literal handlers only match the full URI.
+	GPtrArray *candidates = g_ptr_array_new();
+	HttpHandlerTrieNode *node = server->handler_trie;
+	const char *iter = request->hierarchical;
+
+	while(node != NULL) {
+		for(GList *mappingIter = node->mappings->head; mappingIter != NULL; mappingIter = mappingIter->next) {
+			RequestHandlerMapping *mapping = mappingIter->data;
+			if(mapping->compiled != NULL || *iter == '\0') {
+				g_ptr_array_add(candidates, mapping);
+			}
+		}
+
+		if(*iter == '\0' || node->children == NULL) {
+			break;
+		}
+
+		node = g_hash_table_lookup(node->children, GINT_TO_POINTER((unsigned char) *iter++));
+	}
+
+	// Restore the registration order and execute the first handler which matches the requested URI
+	g_ptr_array_sort(candidates, &compareRequestHandlerMappings);
+
+	for(int i = 0; i < candidates->len; ++i) {
+		RequestHandlerMapping *mapping = g_ptr_array_index(candidates, i);
+		if(mapping->compiled == NULL || g_regex_match(mapping->compiled, request->hierarchical, 0, NULL)) {
 			logInfo("%s matches %s", request->hierarchical, mapping->regexp);
 			HttpResponse *response = createHttpResponse(OK_STATUS_STRING, "");
+			response->version = request->version;
+			response->keep_alive = request->keep_alive;
+			response->socket = request->socket;
 			if(mapping->handler(request, response, mapping->userdata)) {
+				g_ptr_array_free(candidates, true);
+				return response;
+			}
+			if(response->streaming) {
+				// The handler already started sending this response, so it can't be passed on to another handler anymore
+				g_ptr_array_free(candidates, true);
 				return response;
 			}
 			destroyHttpResponse(response);
@@ -236,47 +409,214 @@ API HttpResponse *handleHttpRequest(HttpServer *server, HttpRequest *request)
 		}
 	}
 
+	g_ptr_array_free(candidates, true);
+
 	logInfo("No handler for hierarchical part %s, returning file not found", request->hierarchical);
 	return createHttpResponse(FILE_NOT_FOUND_STATUS_STRING, FILE_NOT_FOUND_STATUS_STRING);
 }
 
 static RequestHandlerMapping *createRequestHandlerMapping(char *regexp, HttpRequestHandler *handler, void *userdata)
 {
-	RequestHandlerMapping *mapping = ALLOCATE_OBJECT(RequestHandlerMapping);
+	bool literal;
+	char *prefix = getLiteralPrefix(regexp, &literal);
+	GRegex *compiled = NULL;
+
+	if(!literal) {
+		// Add leading and trailing metasymbols in order to force an exact match.
+		char *anchored = g_strdup_printf("^%s$", regexp);
+		GError *error = NULL;
+		compiled = g_regex_new(anchored, G_REGEX_OPTIMIZE, 0, &error);
+		free(anchored);
+
+		if(compiled == NULL) {
+			logError("Failed to compile HTTP request handler regexp %s: %s", regexp, error->message);
+			g_error_free(error);
+			free(prefix);
+			return NULL;
+		}
+	}
 
-	// Add leading and trailing metasymbols in order to force an exact match.
-	mapping->regexp = g_strdup_printf("^%s$", regexp);
+	RequestHandlerMapping *mapping = ALLOCATE_OBJECT(RequestHandlerMapping);
+	mapping->regexp = strdup(regexp);
+	mapping->compiled = compiled;
+	mapping->prefix = prefix;
+	mapping->sequence = handlerSequence++;
 	mapping->handler = handler;
 	mapping->userdata = userdata;
 	return mapping;
 }
 
 /**
- * Takes a void pointer in order to pass it as free function to g_array (without warnings). WARNING: this does not free the pointer itself. This is the behavior requested by g_array
+ * Takes a void pointer in order to pass it as free function to g_ptr_array (without warnings)
  */
-static void freeRequestHandlerMappingContent(void *mapping)
+static void freeRequestHandlerMapping(void *mapping)
 {
 	RequestHandlerMapping *rhm = mapping;
 	free(rhm->regexp);
+	free(rhm->prefix);
+	if(rhm->compiled != NULL) {
+		g_regex_unref(rhm->compiled);
+	}
+	free(rhm);
+}
+
+/**
+ * Determines the literal prefix every string matched by an anchored regular expression must start with
+ *
+ * @param regexp			the regular expression to analyze
+ * @param literal_p			set to true if the regular expression matches nothing but its literal prefix
+ * @result					the literal prefix, must be freed by the caller
+ */
+static char *getLiteralPrefix(const char *regexp, bool *literal_p)
+{
+	GString *prefix = g_string_new("");
+	*literal_p = false;
+
+	if(strchr(regexp, '|') != NULL) { // an alternation might bypass any prefix
+		return g_string_free(prefix, false);
+	}
+
+	const char *iter = regexp;
+	while(*iter == '^') {
+		iter++;
+	}
+
+	for(; *iter != '\0' && strchr(REGEXP_METACHARACTERS, *iter) == NULL; iter++) {
+		g_string_append_c(prefix, *iter);
+	}
+
+	if(*iter == '*' || *iter == '?' || *iter == '{') { // the last literal character is optional
+		if(prefix->len > 0) {
+			g_string_truncate(prefix, prefix->len - 1);
+		}
+	} else {
+		const char *end = iter;
+		while(*end == '$') {
+			end++;
+		}
+
+		*literal_p = *end == '\0';
+	}
+
+	return g_string_free(prefix, false);
+}
+
+static HttpHandlerTrieNode *createHandlerTrieNode()
+{
+	HttpHandlerTrieNode *node = ALLOCATE_OBJECT(HttpHandlerTrieNode);
+	node->children = NULL;
+	node->mappings = g_queue_new();
+	return node;
+}
+
+/**
+ * Takes a void pointer in order to pass it as value free function to g_hash_table (without warnings). The mappings referenced by the node are not freed.
+ */
+static void freeHandlerTrieNode(void *node)
+{
+	HttpHandlerTrieNode *trie = node;
+	if(trie->children != NULL) {
+		g_hash_table_destroy(trie->children); // Frees all child nodes
+	}
+	g_queue_free(trie->mappings);
+	free(trie);
 }
 
-static ServerRequestMapping *createServerRequestMapping(HttpServer *server, HttpRequest *request)
+/**
+ * Looks up the trie node corresponding to a literal prefix
+ *
+ * @param root				the root node of the trie
+ * @param prefix			the prefix to look up
+ * @param create			if true, missing nodes are created along the way
+ * @result					the node for the prefix, or NULL if it doesn't exist and create is false
+ */
+static HttpHandlerTrieNode *lookupHandlerTrieNode(HttpHandlerTrieNode *root, const char *prefix, bool create)
+{
+	HttpHandlerTrieNode *node = root;
+
+	for(const char *iter = prefix; *iter != '\0' && node != NULL; iter++) {
+		void *key = GINT_TO_POINTER((unsigned char) *iter);
+		HttpHandlerTrieNode *child = node->children == NULL ? NULL : g_hash_table_lookup(node->children, key);
+
+		if(child == NULL && create) {
+			if(node->children == NULL) {
+				node->children = g_hash_table_new_full(NULL, NULL, NULL, &freeHandlerTrieNode);
+			}
+
+			child = createHandlerTrieNode();
+			g_hash_table_insert(node->children, key, child);
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+/**
+ * Orders handler mappings by their registration sequence. Takes void pointers in order to pass it as compare function to g_ptr_array_sort.
+ */
+static int compareRequestHandlerMappings(const void *a, const void *b)
+{
+	const RequestHandlerMapping *first = *((RequestHandlerMapping * const *) a);
+	const RequestHandlerMapping *second = *((RequestHandlerMapping * const *) b);
+
+	return (first->sequence > second->sequence) - (first->sequence < second->sequence);
+}
+
+static ServerRequestMapping *createServerRequestMapping(HttpServer *server, HttpRequest *request, Socket *socket)
 {
 	ServerRequestMapping *mapping = ALLOCATE_OBJECT(ServerRequestMapping);
 	mapping->server = server;
 	mapping->request = request;
+	mapping->socket = socket;
+	mapping->idle_timer = NULL;
 	return mapping;
 }
 
 static void freeServerRequestMapping(ServerRequestMapping *mapping)
 {
+	if(mapping->idle_timer != NULL) {
+		TIMER_DEL(mapping->idle_timer);
+	}
 	free(mapping);
 }
 
+/**
+ * Takes a void pointer in order to pass it as free function to g_queue_free_full (without warnings)
+ */
+static void freeHttpHeader(void *header)
+{
+	HttpHeader *hh = header;
+	free(hh->name);
+	free(hh->value);
+	free(hh);
+}
+
+/**
+ * Looks up a response header by its case-insensitive name
+ *
+ * @param response			the HTTP response to look up the header in
+ * @param name				the name of the header to look up
+ * @result					the header or NULL if the response doesn't have such a header
+ */
+static HttpHeader *lookupHttpResponseHeader(HttpResponse *response, const char *name)
+{
+	for(GList *iter = response->headers->head; iter != NULL; iter = iter->next) {
+		HttpHeader *header = iter->data;
+		if(g_ascii_strcasecmp(header->name, name) == 0) {
+			return header;
+		}
+	}
+
+	return NULL;
+}
+
 static void tryFreeServer(HttpServer *server)
 {
 	if(server->state == SERVER_STATE_FREEING && server->open_connections == 0) {
-		g_array_free(server->handler_mappings, true); // Frees all RequestHandlerMapping structs
+		g_ptr_array_free(server->handler_mappings, true); // Frees all RequestHandlerMapping structs
+		freeHandlerTrieNode(server->handler_trie);
 		free(server);
 	}
 }
@@ -284,14 +624,16 @@ static void tryFreeServer(HttpServer *server)
 static void clientAccepted(void *subject, const char *event, void *data, va_list args)
 {
 	HttpServer *server = data;
+	Socket *s = va_arg(args, Socket *);
 	HttpRequest *request = createHttpRequest();
-	ServerRequestMapping *mapping = createServerRequestMapping(server, request);
+	request->socket = s;
+	ServerRequestMapping *mapping = createServerRequestMapping(server, request, s);
 	server->open_connections++;
 
-	Socket *s = va_arg(args, Socket *);
 	attachEventListener(s, "read", mapping, &clientSocketRead);
 	attachEventListener(s, "disconnect", mapping, &clientSocketDisconnected);
 	enableSocketPolling(s);
+	resetIdleTimer(mapping);
 }
 
 /**
@@ -299,45 +641,161 @@ static void clientAccepted(void *subject, const char *event, void *data, va_list
  */
 static void processAvailableLines(HttpRequest *request)
 {
-	char *message = request->line_buffer->str;
+	char *line;
 
-	if(request->got_empty_line) {
-		// Accumulating content body in buffer, do nothing
-		return;
+	// Once the empty line occurred, the rest of the buffer is the content body and stays where it is
+	while(!request->got_empty_line && readLineBufferLine(request->line_buffer, &line, NULL)) {
+		g_strstrip(line); // the line buffer already removed the trailing \r characters
+		parseHttpRequestLine(request, line);
 	}
+}
 
-	if(strstr(message, "\n") == NULL) {
-		// No newline in the string, just do nothing
-		return;
+/**
+ * Handles all complete requests in the buffer of a connection. Requests pipelined by the client are answered in order. After answering a request that
+ * doesn't keep the connection alive, the connection is closed.
+ *
+ * @param mapping			the connection to process
+ */
+static void processAvailableRequests(ServerRequestMapping *mapping)
+{
+	HttpRequest *request = mapping->request;
+	HttpServer *server = mapping->server;
+
+	while(mapping->socket->connected) {
+		processAvailableLines(request);
+
+		if(!request->got_empty_line) {
+			// Still no empty line, so nothing to do yet
+			return;
+		}
+
+		if(request->method == HTTP_REQUEST_METHOD_POST) {
+			// A request without a content length doesn't have a body
+			unsigned int length = request->content_length < 0 ? 0 : request->content_length;
+
+			if(getLineBufferLength(request->line_buffer) < length) {
+				// Still waiting for the rest of the body
+				return;
+			}
+
+			char *body = g_strndup(readLineBufferBytes(request->line_buffer, length), length);
+			parseHttpRequestBody(request, body);
+			free(body);
+		}
+
+		if(request->method == HTTP_REQUEST_METHOD_UNKNOWN || server->state != SERVER_STATE_RUNNING) {
+			// The rest of the stream can't be trusted after a malformed request, and a server being freed shouldn't keep connections around
+			request->keep_alive = false;
+		}
+
+		if(!handleAndRespond(mapping->socket, server, request)) {
+			disconnectSocket(mapping->socket);
+			return;
+		}
+
+		if(!request->keep_alive) {
+			// Let a slow client receive the rest of the response before closing
+			disconnectSocketWhenDrained(mapping->socket);
+			return;
+		}
+
+		resetHttpRequest(request);
 	}
+}
 
-	g_string_free(request->line_buffer, false);
-	char **parts = g_strsplit(message, "\n", 0);
-	int count = 0;
-	for(char **iter = parts; *iter != NULL; ++iter) {
-		++count;
+/**
+ * Resets a request so that the next request on the same persistent connection can be parsed into it. Unprocessed data in the line buffer is kept.
+ *
+ * @param request			the request to reset
+ */
+static void resetHttpRequest(HttpRequest *request)
+{
+	free(request->uri);
+	request->uri = NULL;
+	free(request->hierarchical);
+	request->hierarchical = NULL;
+	g_hash_table_remove_all(request->parameters);
+	request->method = HTTP_REQUEST_METHOD_UNKNOWN;
+	request->content_length = -1;
+	request->got_request_line = false;
+	request->got_empty_line = false;
+	request->version = HTTP_VERSION_1_0;
+	request->keep_alive = false;
+}
+
+/**
+ * (Re)starts the timer closing a connection after it has been idle for the server's idle timeout
+ *
+ * @param mapping			the connection to restart the idle timer for
+ */
+static void resetIdleTimer(ServerRequestMapping *mapping)
+{
+	if(mapping->idle_timer != NULL) {
+		TIMER_DEL(mapping->idle_timer);
+		mapping->idle_timer = NULL;
 	}
 
-	// Put the last part back into the buffer and process all complete lines
-	request->line_buffer = g_string_new(parts[count - 1]);
-	for(int i = 0; i < count - 1; i++) {
-		if(request->got_empty_line) {
-			// Empty line occurred, switch to accumulating content body, just put the string back into the buffer
-			g_string_append(request->line_buffer, message);
-		} else {
-			// Remove all leading and trailing \r characters. In lack of a removeTrailingChars function, we first transform \r into spaces and then call strstrip()
-			g_strdelimit(parts[i], "\r", ' ');
-			g_strstrip(parts[i]);
-			parseHttpRequestLine(request, parts[i]);
-		}
+	if(mapping->server->idle_timeout > 0) {
+		mapping->idle_timer = TIMER_ADD_TIMEOUT_EX(mapping->server->idle_timeout * G_USEC_PER_SEC, IDLE_TIMEOUT, mapping);
+	}
+}
+
+TIMER_CALLBACK(IDLE_TIMEOUT)
+{
+	ServerRequestMapping *mapping = custom_data;
+	mapping->idle_timer = NULL;
+
+	if(mapping->socket->output_length > 0) { // still sending a response to a slow client, so the connection isn't idle
+		resetIdleTimer(mapping);
+	} else if(mapping->socket->connected) {
+		logInfo("Closing HTTP connection %d after being idle for %d seconds", mapping->socket->fd, mapping->server->idle_timeout);
+		disconnectSocket(mapping->socket);
 	}
+}
+
+/**
+ * Sends the status line and headers of a response to the client
+ *
+ * @param client			the client socket to send the response head to
+ * @param response			the HTTP response to send the head for
+ * @param head				additional header lines describing how the content is framed
+ * @param content			content to send right after the head or NULL if the content is sent separately
+ * @result					true if successful
+ */
+static bool sendResponseHead(Socket *client, HttpResponse *response, GString *head, GString *content)
+{
+	GString *answer = g_string_new("");
+	g_string_append_printf(answer, "HTTP/%s %s\r\n", response->version == HTTP_VERSION_1_0 ? "1.0" : "1.1", response->status);
+
+	for(GList *iter = response->headers->head; iter != NULL; iter = iter->next) {
+		HttpHeader *header = iter->data;
+		g_string_append_printf(answer, "%s: %s\r\n", header->name, header->value);
+	}
+
+	g_string_append_len(answer, head->str, head->len);
+
+	// HTTP/1.1 connections are persistent and HTTP/1.0 connections aren't unless stated otherwise
+	if(response->version == HTTP_VERSION_1_0 && response->keep_alive) {
+		g_string_append(answer, "Connection: keep-alive\r\n");
+	} else if(response->version == HTTP_VERSION_1_1 && !response->keep_alive) {
+		g_string_append(answer, "Connection: close\r\n");
+	}
+
+	g_string_append(answer, "\r\n");
 
-	g_strfreev(parts);
-	free(message);
+	if(content != NULL) { // write head and content at once so a small response doesn't get split into two segments delayed by Nagle's algorithm
+		g_string_append_len(answer, content->str, content->len);
+	}
+
+	bool result = socketWriteRaw(client, answer->str, answer->len * sizeof(char));
+	g_string_free(answer, true);
+
+	return result;
 }
 
 /**
- * Sends the provided response to the client
+ * Sends the provided response to the client. If the response was already partially flushed, the remaining content is sent and the response is
+ * terminated.
  *
  * @param client			the client socket to send the response to
  * @param response			the HTTP response to send to the client
@@ -345,10 +803,18 @@ static void processAvailableLines(HttpRequest *request)
  */
 static bool sendResponse(Socket *client, HttpResponse *response)
 {
-	GString *answer = g_string_new("");
-	g_string_append_printf(answer, "HTTP/1.0 %s \r\nContent-Type: text/html; charset=utf-8\r\nContent-length: %lu\r\n\r\n%s", response->status, (unsigned long) response->content->len, response->content->str);
-	bool result = socketWriteRaw(client, answer->str, answer->len * sizeof(char));
-	g_string_free(answer, true);
+	if(response->streaming) {
+		if(!flushHttpResponseContent(response)) {
+			return false;
+		}
+
+		return socketWriteRaw(client, "0\r\n\r\n", 5);
+	}
+
+	GString *head = g_string_new("");
+	g_string_append_printf(head, "Content-Length: %lu\r\n", (unsigned long) response->content->len);
+	bool result = sendResponseHead(client, response, head, response->content);
+	g_string_free(head, true);
 
 	return result;
 }
@@ -364,43 +830,95 @@ static void clientSocketDisconnected(void *subject, const char *event, void *dat
 	detachEventListener(client_socket, "disconnect", mapping, &clientSocketDisconnected);
 	freeSocket(client_socket);
 	destroyHttpRequest(request);
-	freeServerRequestMapping(mapping);
+	freeServerRequestMapping(mapping); // Also deletes a pending idle timer
 
 	server->open_connections--;
 	tryFreeServer(server); // This might have been the last request, attempt to free the server
 }
 
-static void handleAndRespond(Socket *client, HttpServer *server, HttpRequest *request)
+static bool handleAndRespond(Socket *client, HttpServer *server, HttpRequest *request)
 {
 	HttpResponse *response = handleHttpRequest(server, request);
-	sendResponse(client, response);
+	response->version = request->version;
+	response->keep_alive = request->keep_alive;
+	bool result = sendResponse(client, response);
 	destroyHttpResponse(response);
+
+	return result;
 }
 
 static void clientSocketRead(void *subject, const char *event, void *data, va_list args)
 {
 	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
 	ServerRequestMapping *mapping = data;
-	HttpRequest *request = mapping->request;
-	HttpServer *server = mapping->server;
 
-	g_string_append(request->line_buffer, message);
-	processAvailableLines(request);
+	appendLineBuffer(mapping->request->line_buffer, message, size);
+	resetIdleTimer(mapping);
+	processAvailableRequests(mapping);
+}
 
-	if(!request->got_empty_line) {
-		// Still no empty line, so nothing to do yet
-		return;
+/**
+ * Spawns additional socket shards serving our HTTP servers if configured to. Instead of duplicating the whole process, the shards only load the
+ * modules listed in http_server/shardModules, which should be the ones registering the HTTP request handlers.
+ *
+ * @result			true if successful or if no shards are configured
+ */
+static bool spawnHttpServerShards()
+{
+	if($(unsigned int, socket, getSocketShard)() != 0) { // we're a shard ourselves
+		return true;
 	}
 
-	if(request->method == HTTP_REQUEST_METHOD_GET) {
-		// Empty line in GET request indicates the end of the request.
-		handleAndRespond(subject, server, request);
-		return;
+	Store *configShards = $(Store *, config, getConfigPath)("http_server/shards");
+	if(configShards == NULL || configShards->type != STORE_INTEGER || configShards->content.integer <= 1) {
+		return true;
 	}
 
-	if(request->method == HTTP_REQUEST_METHOD_POST && request->line_buffer->len >= request->content_length) {
-		parseHttpRequestBody(request, request->line_buffer->str);
-		handleAndRespond(subject, server, request);
-		return;
+	Store *configModules = $(Store *, config, getConfigPath)("http_server/shardModules");
+	if(configModules == NULL || configModules->type != STORE_LIST || g_queue_is_empty(configModules->content.list)) {
+		logError("Config value http_server/shardModules must list the modules to load in HTTP server shards");
+		return false;
 	}
+
+	GString *modules = g_string_new("--load-modules=");
+	for(GList *iter = configModules->content.list->head; iter != NULL; iter = iter->next) {
+		Store *module = iter->data;
+
+		if(module->type != STORE_STRING) {
+			logError("Every list value of config value http_server/shardModules must be a string");
+			g_string_free(modules, true);
+			return false;
+		}
+
+		if(iter != configModules->content.list->head) {
+			g_string_append_c(modules, ',');
+		}
+
+		g_string_append(modules, module->content.string);
+	}
+
+	// Run the shards with our own arguments, but replace the modules to load with the configured ones
+	char **argv = $$(char **, getArgv)();
+	int argc = $$(int, getArgc)();
+
+	GPtrArray *args = g_ptr_array_new();
+	g_ptr_array_add(args, argv[0]);
+	g_ptr_array_add(args, modules->str);
+	g_ptr_array_add(args, "--append-modules=");
+
+	for(int i = 1; i < argc; i++) {
+		if(!g_str_has_prefix(argv[i], "--load-modules") && !g_str_has_prefix(argv[i], "--append-modules")) {
+			g_ptr_array_add(args, argv[i]);
+		}
+	}
+
+	g_ptr_array_add(args, NULL);
+
+	bool result = $(bool, socket, spawnSocketShards)(configShards->content.integer, (char **) args->pdata);
+
+	g_ptr_array_free(args, true);
+	g_string_free(modules, true);
+
+	return result;
 }
@@ -25,6 +25,7 @@
 #include <glib.h>
 #include <stdarg.h>
 #include "modules/socket/socket.h"
+#include "modules/socket/linebuffer.h"
 
 /**
  * Enum to represent the types of http request which can come in
@@ -36,6 +37,15 @@ typedef enum
 	HTTP_REQUEST_METHOD_POST
 } HttpRequestMethod;
 
+/**
+ * Enum to represent the HTTP protocol versions understood by the server
+ */
+typedef enum
+{
+	HTTP_VERSION_1_0,
+	HTTP_VERSION_1_1
+} HttpVersion;
+
 /**
  * Struct to represent an HTTP request
  */
@@ -50,11 +60,19 @@ typedef struct
 	/** Stores the parameters of the request */
 	GHashTable *parameters;
 	/** Used as intermediate storage for incomplete lines coming out of the socket stream */
-	GString *line_buffer;
+	LineBuffer *line_buffer;
 	/** Stores the body content length (only applicable to requests with a body) */
 	int content_length;
+	/** Stores whether the request line has been parsed for this request */
+	bool got_request_line;
 	/** Stores whether an empty line has been seen for this request */
 	bool got_empty_line;
+	/** Stores the HTTP version of the request */
+	HttpVersion version;
+	/** Stores whether the client wants the connection to stay open after the response */
+	bool keep_alive;
+	/** The client socket the request came in on, or NULL if the request wasn't received by a server */
+	Socket *socket;
 } HttpRequest;
 
 /**
@@ -67,6 +85,17 @@ API HttpRequest *createHttpRequest();
  */
 API void destroyHttpRequest(HttpRequest *request);
 
+/**
+ * Struct to represent an HTTP header
+ */
+typedef struct
+{
+	/** The name of the header, for instance "Content-Type" */
+	char *name;
+	/** The value of the header */
+	char *value;
+} HttpHeader;
+
 /**
  * Struct to represent an HTTP response
  */
@@ -74,8 +103,18 @@ typedef struct
 {
 	/** Contains the variable part of the status line, for instance "200 OK" */
 	char *status;
-	/** Contains the string sent to the client as response body */
+	/** Contains the string sent to the client as response body, or the part of it not flushed yet */
 	GString *content;
+	/** Contains the HttpHeader structs sent with the response */
+	GQueue *headers;
+	/** The HTTP version to respond with */
+	HttpVersion version;
+	/** Whether the connection stays open after the response */
+	bool keep_alive;
+	/** The client socket the response is sent to, or NULL if the response can't be flushed before it is complete */
+	Socket *socket;
+	/** Whether the response head was already sent and the content is being streamed with chunked transfer encoding */
+	bool streaming;
 } HttpResponse;
 
 /**
@@ -88,6 +127,36 @@ API HttpResponse *createHttpResponse(const char *status, const char *content);
  */
 API void destroyHttpResponse(HttpResponse *response);
 
+/**
+ * Sets a header of the response, replacing a previously set header of the same (case-insensitive) name. New responses have a "Content-Type" header
+ * for UTF-8 encoded HTML. Headers can't be changed anymore once the response was flushed.
+ *
+ * @param response			the HTTP response to set the header for
+ * @param name				the name of the header
+ * @param value				the value of the header
+ * @result					true if successful
+ */
+API bool setHttpResponseHeader(HttpResponse *response, const char *name, const char *value);
+
+/**
+ * Returns the value of a response header
+ *
+ * @param response			the HTTP response to get the header from
+ * @param name				the case-insensitive name of the header
+ * @result					the value of the header or NULL if the response doesn't have such a header
+ */
+API const char *getHttpResponseHeader(HttpResponse *response, const char *name);
+
+/**
+ * Sends the content appended to the response so far to the client and clears it, allowing handlers to emit large bodies incrementally. The first call
+ * sends the status line and headers and switches the response to chunked transfer encoding. If the client doesn't support chunked transfer encoding,
+ * the content is kept and sent as a whole once the handler returns.
+ *
+ * @param response			the HTTP response to flush
+ * @result					true if successful
+ */
+API bool flushHttpResponseContent(HttpResponse *response);
+
 /** 
  * A type of function which can respond to Http requests by populating a response struct
  */
@@ -103,6 +172,9 @@ typedef enum
 	SERVER_STATE_FREEING
 } HttpServerState;
 
+struct HttpHandlerTrieNodeStruct;
+typedef struct HttpHandlerTrieNodeStruct HttpHandlerTrieNode;
+
 /**
  * Struct to represent an HTTP server
  */
@@ -114,8 +186,12 @@ typedef struct
 	unsigned long open_connections;
 	/** Accepts new client connections */
 	Socket *server_socket;
-	/** Stores pairs of regular expressions and request handlers */
-	GArray *handler_mappings;
+	/** Seconds after which idle client connections are closed, or 0 to keep them open */
+	int idle_timeout;
+	/** Stores pairs of regular expressions and request handlers in registration order */
+	GPtrArray *handler_mappings;
+	/** Indexes the request handlers by the literal prefixes of their regular expressions */
+	HttpHandlerTrieNode *handler_trie;
 } HttpServer;
 
 
@@ -142,6 +218,15 @@ API void destroyHttpServer(HttpServer *server);
  */
 API bool startHttpServer(HttpServer *server);
 
+/**
+ * Sets the time after which client connections without any incoming data are closed. Client connections are kept open between requests if the client
+ * supports persistent connections.
+ *
+ * @param server		the server in question
+ * @param timeout		the idle timeout in seconds, or 0 to never close idle connections
+ */
+API void setHttpServerIdleTimeout(HttpServer *server, int timeout);
+
 /**
  * Causes the server to process the request and return a response object. The caller takes
  * ownership of the returned response object and is responsible for eventually calling
@@ -156,7 +241,8 @@ API HttpResponse *handleHttpRequest(HttpServer *server, HttpRequest *request);
 /**
  * Causes the passed request handler to be called when an HttpRequest with a matching URI comes in.
  * In order to determine the matching precedence, matches are tested in the order in which they were
- * registered. Note that the caller retains ownership of all passed parameters (the regexp is copied).
+ * registered. Note that the caller retains ownership of all passed parameters (the regexp is copied). The regexp is compiled once at registration time,
+ * and requests are only matched against handlers whose literal regexp prefix matches the requested URI.
  * It is *NOT* necessary to unregister every handler before decommissioning a server, all remaining
  * handlers are removed automatically.
  *
@@ -217,4 +303,6 @@ API void appendHttpResponseContent(HttpResponse *response, char *content, ...);
  */
 API void clearHttpResponseContent(HttpResponse *response);
 
+#define HTTP_SERVER_DEFAULT_IDLE_TIMEOUT 30
+
 #endif
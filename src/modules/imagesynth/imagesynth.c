@@ -28,9 +28,9 @@
 MODULE_NAME("imagesynth");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Module to synthesize procedural images");
-MODULE_VERSION(0, 2, 4);
+MODULE_VERSION(0, 2, 7);
 MODULE_BCVERSION(0, 2, 2);
-MODULE_DEPENDS(MODULE_DEPENDENCY("image", 0, 5, 16), MODULE_DEPENDENCY("random", 0, 6, 2), MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("linalg", 0, 3, 4));
+MODULE_DEPENDS(MODULE_DEPENDENCY("image", 0, 5, 16), MODULE_DEPENDENCY("random", 0, 9, 0), MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("linalg", 0, 5, 0));
 
 /**
  * Hash table associating string names with their corresponding image synthesizers
@@ -63,6 +63,15 @@ API Image *synthesizeImagePerlin(const char *name, unsigned int width, unsigned
 		frequencyY = frequencyYParam->type == STORE_FLOAT_NUMBER ? frequencyYParam->content.float_number : frequencyYParam->content.integer;
 	}
 
+	// parse seed
+	uint64_t seed;
+	Store *seedParam;
+	if((seedParam = $(Store *, store, getStorePath)(parameters, "seed")) != NULL && seedParam->type == STORE_INTEGER) {
+		seed = seedParam->content.integer;
+	} else {
+		seed = $(uint64_t, random, createRandomSeed)();
+	}
+
 	// parse low color
 	Vector *colorLow;
 	Store *colorLowParam;
@@ -87,22 +96,15 @@ API Image *synthesizeImagePerlin(const char *name, unsigned int width, unsigned
 	float *lowData = $(float *, linalg, getVectorData)(colorLow);
 	unsigned int highSize = $(unsigned int, linalg, getVectorSize)(colorHigh);
 	float *highData = $(float *, linalg, getVectorData)(colorHigh);
-	float z = 255 * randomUniform();
-
-	// generate fBm/turbulence image
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			float value = 0.0f;
-
-			if(useFBm) {
-				value = $(float, random, noiseFBm)((double) y * frequencyY / height, (double) x * frequencyX / width, z, persistence, depth);
-			} else { // otherwise use turbulence
-				value = $(float, random, noiseTurbulence)((double) y * frequencyY / height, (double) x * frequencyX / width, z, persistence, depth);
-			}
-
-			setImage(image, x, y, 0, value);
-		}
-	}
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(seed);
+	float z = 255 * randomGeneratorUniform(generator);
+	$(void, random, freeRandomGenerator)(generator);
+
+	// generate fBm/turbulence image, the pixel y coordinate goes to the first noise dimension
+	double origin[3] = {0.0, 0.0, z};
+	double stepX[3] = {0.0, (double) frequencyX / width, 0.0};
+	double stepY[3] = {(double) frequencyY / height, 0.0, 0.0};
+	$(void, random, noiseImage)(image, 0, useFBm ? RANDOM_PERLIN_NOISE_FBM : RANDOM_PERLIN_NOISE_TURBULENCE, origin, stepX, stepY, persistence, depth);
 
 	// normalize it
 	$(void, image, normalizeImageChannel)(image, 0);
@@ -35,6 +35,7 @@
  *  * float frequencyY		the frequency in Y direction to use for the underlying perlin noise
  *  * vector colorLow		the low color to use for the noise image (dimensions must equal channel value)
  *  * vector colorHigh		the high color to use for the noise image (dimensions must equal channel value)
+ *  * int seed				the seed used to pick the slice through the 3D noise, a random one is used if not given
  *
  * @param name				the name of the synthesizer to use
  * @param width				the width of the image to synthesize
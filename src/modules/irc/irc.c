@@ -27,7 +27,7 @@
 #include "modules/store/path.h"
 #include "modules/socket/socket.h"
 #include "modules/socket/poll.h"
-#include "modules/string_util/string_util.h"
+#include "modules/socket/linebuffer.h"
 #include "modules/irc_parser/irc_parser.h"
 #include "modules/event/event.h"
 #define API
@@ -36,9 +36,9 @@
 MODULE_NAME("irc");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("This module connects to an IRC server and does basic communication to keep the connection alive");
-MODULE_VERSION(0, 5, 2);
+MODULE_VERSION(0, 5, 3);
 MODULE_BCVERSION(0, 5, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 0), MODULE_DEPENDENCY("socket", 0, 7, 0), MODULE_DEPENDENCY("string_util", 0, 1, 1), MODULE_DEPENDENCY("irc_parser", 0, 1, 0), MODULE_DEPENDENCY("event", 0, 1, 2));
+MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 0), MODULE_DEPENDENCY("socket", 0, 9, 0), MODULE_DEPENDENCY("irc_parser", 0, 1, 0), MODULE_DEPENDENCY("event", 0, 1, 2));
 
 static void listener_throttlePoll(void *subject, const char *event, void *data, va_list args);
 static void listener_ircConnected(void *subject, const char *event, void *data, va_list args);
@@ -131,10 +131,11 @@ static void listener_ircRead(void *subject, const char *event, void *data, va_li
 {
 	Socket *socket = subject;
 	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
 
 	IrcConnection *irc;
 	if((irc = g_hash_table_lookup(connections, socket)) != NULL) {
-		g_string_append(irc->ibuffer, message);
+		appendLineBuffer(irc->ibuffer, message, size);
 		checkForBufferLine(irc);
 	}
 }
@@ -183,7 +184,7 @@ API IrcConnection *createIrcConnection(char *server, char *port, char *password,
 	}
 	irc->real = strdup(real);
 	irc->nick = strdup(nick);
-	irc->ibuffer = g_string_new("");
+	irc->ibuffer = createLineBuffer(true); // skip empty lines, since server could send \r\n
 	irc->throttle = false;
 	irc->obuffer = NULL;
 	irc->socket = createClientSocket(server, port);
@@ -343,7 +344,7 @@ API void freeIrcConnection(IrcConnection *irc)
 	free(irc->user);
 	free(irc->real);
 	free(irc->nick);
-	g_string_free(irc->ibuffer, true);
+	freeLineBuffer(irc->ibuffer);
 
 	// Last, free the irc connection object itself
 	free(irc);
@@ -415,38 +416,20 @@ API IrcConnection *getIrcConnectionBySocket(Socket *socket)
 }
 
 /**
- * Checks for a new newline terminated line in the buffer and parses it
+ * Checks for new newline terminated lines in the buffer and parses them
  *
  * @param irc			the IRC connection to check for buffer lines
  */
 static void checkForBufferLine(IrcConnection *irc)
 {
-	char *message = irc->ibuffer->str;
-
-	if(strstr(message, "\n") != NULL) { // message has at least one newline
-		g_string_free(irc->ibuffer, false);
-		stripDuplicateNewlines(message); // remove duplicate newlines, since server could send \r\n
-		char **parts = g_strsplit(message, "\n", 0);
-		int count = 0;
-		for(char **iter = parts; *iter != NULL; iter++) {
-			count++;
-		}
+	char *line;
 
-		for(int i = 0; i < count - 1; i++) { // Don't trigger the last part, it's not yet complete
-			char *part = parts[i];
-			if(strlen(part) > 0) {
-				IrcMessage *ircMessage = parseIrcMessage(part);
+	while(readLineBufferLine(irc->ibuffer, &line, NULL)) {
+		IrcMessage *ircMessage = parseIrcMessage(line);
 
-				if(ircMessage != NULL) {
-					triggerEvent(irc, "line", ircMessage);
-					freeIrcMessage(ircMessage);
-				}
-			}
+		if(ircMessage != NULL) {
+			triggerEvent(irc, "line", ircMessage);
+			freeIrcMessage(ircMessage);
 		}
-
-		irc->ibuffer = g_string_new(parts[count-1]); // reinitialize buffer
-
-		g_strfreev(parts);
-		free(message);
 	}
 }
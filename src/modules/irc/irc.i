@@ -24,6 +24,7 @@
 #include <glib.h>
 #include "modules/store/store.h"
 #include "modules/socket/socket.h"
+#include "modules/socket/linebuffer.h"
 
 /**
  * Struct to represent an IRC connection
@@ -39,7 +40,7 @@ typedef struct
 	/** the nick to use */
 	char *nick;
 	/** input buffer for IRC messages */
-	GString *ibuffer;
+	LineBuffer *ibuffer;
 	/** true if IRC output should be throttled */
 	bool throttle;
 	/** output buffer for IRC messages */
@@ -26,7 +26,6 @@
 #include "memory_alloc.h"
 #include "util.h"
 #include "log.h"
-#include "modules/string_util/string_util.h"
 
 #define API
 #include "irc_parser.h"
@@ -34,9 +33,9 @@
 MODULE_NAME("irc_parser");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Parses and creates IRC messages");
-MODULE_VERSION(0, 1, 4);
+MODULE_VERSION(0, 2, 0);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("string_util", 0, 1, 0));
+MODULE_NODEPS;
 
 MODULE_INIT
 {
@@ -49,78 +48,168 @@ MODULE_FINALIZE
 
 API IrcMessage *parseIrcMessage(char *message)
 {
+	IrcMessageView view;
+
+	if(!parseIrcMessageView(message, strlen(message), &view)) {
+		logError("Malformed IRC message: '%s'", message);
+		return NULL;
+	}
+
 	IrcMessage *ircMessage = ALLOCATE_OBJECT(IrcMessage);
 	memset(ircMessage, 0, sizeof(IrcMessage));
 
 	ircMessage->raw_message = g_strdup(message);
+	ircMessage->command = g_strndup(message + view.command.offset, view.command.length);
 
-	char *prefixEnd = message;
+	if(view.prefix.length > 0) {
+		ircMessage->prefix = g_strndup(message + view.prefix.offset, view.prefix.length);
+	}
+
+	if(view.params_count > 0) {
+		ircMessage->params = ALLOCATE_OBJECTS(char *, view.params_count + 1);
+		ircMessage->params_count = view.params_count;
 
-	if(message[0] == ':') {
-		// message has a prefix
-		prefixEnd = strchr(message, ' ');
-		if(prefixEnd == NULL) {
-			logError("Malformed IRC message: '%s'", message);
-			freeIrcMessage(ircMessage);
-			return NULL;
+		for(unsigned int i = 0; i < view.params_count; i++) {
+			ircMessage->params[i] = g_strndup(message + view.params[i].offset, view.params[i].length);
 		}
 
-		message++; // Get rid of trailing colon
-		ircMessage->prefix = g_strndup(message, prefixEnd - message);
+		ircMessage->params[view.params_count] = NULL;
 	}
 
-	// extracting the command
-	char *commandPart = g_strdup(prefixEnd);
-	g_strchug(commandPart);
-	char *commandEnd = strchr(commandPart, ' ');
-	if(commandEnd == NULL) { // just a command
-		ircMessage->command = g_strdup(commandPart);
+	if(view.has_trailing) {
+		ircMessage->trailing = g_strndup(message + view.trailing.offset, view.trailing.length);
+	}
+
+	return ircMessage;
+}
 
-		free(commandPart);
-		return ircMessage;
+API bool parseIrcMessageView(const char *message, unsigned int length, IrcMessageView *view)
+{
+	unsigned int pos = 0;
+
+	view->line = message;
+	view->tags_count = 0;
+	view->prefix.offset = 0;
+	view->prefix.length = 0;
+	view->params_count = 0;
+	view->trailing.offset = 0;
+	view->trailing.length = 0;
+	view->has_trailing = false;
+
+	while(length > 0 && g_ascii_isspace(message[length - 1])) { // ignore trailing whitespace and line terminators
+		length--;
 	}
 
-	ircMessage->command = g_strndup(commandPart, commandEnd - commandPart);
+	if(length > 0 && message[0] == '@') { // message has IRCv3 tags
+		pos = 1;
+
+		while(true) {
+			if(view->tags_count == IRC_MESSAGE_VIEW_MAX_TAGS) {
+				return false;
+			}
 
-	// extracting the params
-	char *paramsEnd = strstr(commandEnd, " :");
+			IrcTagView *tag = &view->tags[view->tags_count++];
+			tag->key.offset = pos;
 
-	char *paramsText = NULL;
-	if(paramsEnd == NULL) {
-		paramsText = g_strdup(commandEnd);
-	} else {
-		int paramsTextLength = paramsEnd - commandEnd;
+			while(pos < length && message[pos] != '=' && message[pos] != ';' && message[pos] != ' ') {
+				pos++;
+			}
+
+			tag->key.length = pos - tag->key.offset;
+
+			if(pos < length && message[pos] == '=') {
+				pos++;
+			}
+
+			tag->value.offset = pos;
+
+			while(pos < length && message[pos] != ';' && message[pos] != ' ') {
+				pos++;
+			}
+
+			tag->value.length = pos - tag->value.offset;
+
+			if(tag->key.length == 0) { // skip empty tags, e.g. caused by a trailing ';'
+				view->tags_count--;
+			}
+
+			if(pos >= length) { // tags without a command
+				return false;
+			}
+
+			if(message[pos++] == ' ') {
+				break;
+			}
+		}
 
-		if(paramsTextLength > 0) { // It is possible that the IRC message does not have a parameter (like PING)
-			paramsText = g_strndup(commandEnd, paramsTextLength);
+		while(pos < length && message[pos] == ' ') {
+			pos++;
 		}
 	}
 
-	if(paramsText) {
-		g_strstrip(paramsText);
-		$(void, string_util, stripDuplicateWhitespace)(paramsText);
+	if(pos < length && message[pos] == ':') { // message has a prefix
+		view->prefix.offset = ++pos;
 
-		ircMessage->params = g_strsplit(paramsText, " ", 0);
-		// I haven't found any glib function doing this, so I'll count manually
-		for(ircMessage->params_count = 0; ircMessage->params[ircMessage->params_count] != NULL; ircMessage->params_count++) {
-			// Nothing left to do
+		while(pos < length && message[pos] != ' ') {
+			pos++;
 		}
 
-		free(paramsText);
+		if(pos >= length) { // prefix without a command
+			return false;
+		}
+
+		view->prefix.length = pos - view->prefix.offset;
 	}
 
-	// extracting trailing
-	if(paramsEnd) {
-		char *trailingPart = g_strdup(paramsEnd);
-		g_strchomp(trailingPart);
-		ircMessage->trailing = g_strdup(trailingPart + 2); // Remove whitespace & trailing colon
+	while(pos < length && message[pos] == ' ') {
+		pos++;
+	}
 
-		free(trailingPart);
+	// extracting the command
+	view->command.offset = pos;
+
+	while(pos < length && message[pos] != ' ') {
+		pos++;
 	}
 
-	free(commandPart);
+	view->command.length = pos - view->command.offset;
 
-	return ircMessage;
+	if(view->command.length == 0) {
+		return false;
+	}
+
+	// extracting the params and trailing
+	while(true) {
+		while(pos < length && message[pos] == ' ') {
+			pos++;
+		}
+
+		if(pos >= length) {
+			break;
+		}
+
+		if(message[pos] == ':') { // everything after " :" is the trailing part
+			view->trailing.offset = pos + 1;
+			view->trailing.length = length - view->trailing.offset;
+			view->has_trailing = true;
+			break;
+		}
+
+		if(view->params_count == IRC_MESSAGE_VIEW_MAX_PARAMS) {
+			return false;
+		}
+
+		IrcStringView *param = &view->params[view->params_count++];
+		param->offset = pos;
+
+		while(pos < length && message[pos] != ' ') {
+			pos++;
+		}
+
+		param->length = pos - param->offset;
+	}
+
+	return true;
 }
 
 API IrcUserMask *parseIrcUserMask(char *prefix)
@@ -21,6 +21,12 @@
 #ifndef IRC_PARSER_IRC_PARSER_H
 #define IRC_PARSER_IRC_PARSER_H
 
+#include <string.h>
+#include "types.h"
+
+#define IRC_MESSAGE_VIEW_MAX_TAGS 32
+#define IRC_MESSAGE_VIEW_MAX_PARAMS 32
+
 /**
  * Represents an IRC user mask.
  */
@@ -124,6 +130,129 @@ typedef struct {
 } IrcMessage;
 
 
+/**
+ * Represents a part of a parsed IRC line by its position instead of a copy.
+ */
+typedef struct {
+	/**
+	 * The offset of the first character of the part in the parsed line.
+	 */
+	unsigned int offset;
+
+	/**
+	 * The length of the part in characters.
+	 */
+	unsigned int length;
+} IrcStringView;
+
+/**
+ * Represents a single IRCv3 message tag. The value is returned as sent by the server, i.e. still escaped.
+ */
+typedef struct {
+	/**
+	 * The tag key, including an optional vendor prefix and the client-only '+' marker.
+	 */
+	IrcStringView key;
+
+	/**
+	 * The escaped tag value, which is empty if the tag has no value.
+	 */
+	IrcStringView value;
+} IrcTagView;
+
+/**
+ * Represents an IRC message that was tokenized in place. All parts are views into the parsed line, which must therefore outlive this struct.
+ * In contrast to IrcMessage, a view doesn't need to be freed and is meant to be allocated on the stack.
+ *
+ * @par Example message
+ * @code @time=2012-01-01T00:00:00.000Z :Gregor!kalisko@kalisko.org PRIVMSG #kalisko :Hello World @endcode
+ * Views: tag "time" with value "2012-01-01T00:00:00.000Z", prefix "Gregor!kalisko@kalisko.org", command "PRIVMSG", param "#kalisko",
+ * trailing "Hello World"
+ */
+typedef struct {
+	/**
+	 * The line the views point into.
+	 */
+	const char *line;
+
+	/**
+	 * The IRCv3 tags of the message.
+	 */
+	IrcTagView tags[IRC_MESSAGE_VIEW_MAX_TAGS];
+
+	/**
+	 * Amount of given tags (in tags)
+	 */
+	unsigned int tags_count;
+
+	/**
+	 * The prefix of the message, which is empty if the message has no prefix.
+	 */
+	IrcStringView prefix;
+
+	/**
+	 * The command of the message.
+	 */
+	IrcStringView command;
+
+	/**
+	 * The parameters of the message, not including the trailing part.
+	 */
+	IrcStringView params[IRC_MESSAGE_VIEW_MAX_PARAMS];
+
+	/**
+	 * Amount of given parameters (in params)
+	 */
+	unsigned int params_count;
+
+	/**
+	 * The trailing part of the message without its leading ':'.
+	 */
+	IrcStringView trailing;
+
+	/**
+	 * True if the message has a trailing part. This allows to distinguish an empty trailing part from a missing one.
+	 */
+	bool has_trailing;
+} IrcMessageView;
+
+
+/**
+ * Tokenizes an IRC message as described in RFC 1459 (Chapter 2.3.1) and the IRCv3 message tags extension in place. In contrast to parseIrcMessage,
+ * this function neither modifies nor copies the message and doesn't allocate any memory. Trailing whitespace such as "\r\n" is ignored.
+ *
+ * @param message	the IRC message to tokenize, doesn't need to be NUL-terminated
+ * @param length	the length of the IRC message
+ * @param view		the view to tokenize the message into
+ * @result			true if successful, false if the message is malformed or has more tags or parameters than a view can hold
+ */
+API bool parseIrcMessageView(const char *message, unsigned int length, IrcMessageView *view);
+
+/**
+ * Returns a pointer to the first character of a part of a tokenized IRC message. Note that the returned string is NOT NUL-terminated.
+ *
+ * @param view		the tokenized IRC message
+ * @param string	the part of the message to retrieve
+ * @result			a pointer to the first character of the part
+ */
+static inline const char *getIrcMessageViewString(IrcMessageView *view, IrcStringView string)
+{
+	return view->line + string.offset;
+}
+
+/**
+ * Checks whether a part of a tokenized IRC message equals a string
+ *
+ * @param view		the tokenized IRC message
+ * @param string	the part of the message to compare
+ * @param compare	the NUL-terminated string to compare with
+ * @result			true if the part equals the string
+ */
+static inline bool isIrcMessageViewString(IrcMessageView *view, IrcStringView string, const char *compare)
+{
+	return strncmp(view->line + string.offset, compare, string.length) == 0 && compare[string.length] == '\0';
+}
+
 /**
  * This function parses an IRC message as described in RFC 1459 (Chapter 2.3.1).
  *
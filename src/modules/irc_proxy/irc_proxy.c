@@ -31,7 +31,7 @@
 #include "modules/irc/irc.h"
 #include "modules/socket/socket.h"
 #include "modules/socket/poll.h"
-#include "modules/string_util/string_util.h"
+#include "modules/socket/linebuffer.h"
 #include "modules/irc_parser/irc_parser.h"
 #include "modules/config/config.h"
 #include "modules/event/event.h"
@@ -41,9 +41,9 @@
 MODULE_NAME("irc_proxy");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The IRC proxy module relays IRC traffic from and to an IRC server through a server socket");
-MODULE_VERSION(0, 3, 11);
+MODULE_VERSION(0, 3, 13);
 MODULE_BCVERSION(0, 3, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("irc", 0, 5, 0), MODULE_DEPENDENCY("socket", 0, 4, 4), MODULE_DEPENDENCY("string_util", 0, 1, 1), MODULE_DEPENDENCY("irc_parser", 0, 1, 0), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("event", 0, 1, 2));
+MODULE_DEPENDS(MODULE_DEPENDENCY("irc", 0, 5, 0), MODULE_DEPENDENCY("socket", 0, 10, 0), MODULE_DEPENDENCY("irc_parser", 0, 1, 0), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("event", 0, 1, 2));
 
 static void freeIrcProxyClient(void *client_p, void *quitmsg_p);
 static void checkForBufferLine(IrcProxyClient *client);
@@ -68,11 +68,18 @@ static GHashTable *clients;
  */
 static Socket *server;
 
+/**
+ * True if clients that can't keep up with our output should be disconnected instead of having relaying to them paused
+ */
+static bool dropSlowClients;
+
 static void listener_remoteLine(void *subject, const char *event, void *data, va_list args);
 static void listener_clientAccept(void *subject, const char *event, void *data, va_list args);
 static void listener_clientRead(void *subject, const char *event, void *data, va_list args);
 static void listener_clientDisconnect(void *subject, const char *event, void *data, va_list args);
 static void listener_clientLine(void *subject, const char *event, void *data, va_list args);
+static void listener_clientWriteBackpressure(void *subject, const char *event, void *data, va_list args);
+static void listener_clientWriteDrained(void *subject, const char *event, void *data, va_list args);
 
 MODULE_INIT
 {
@@ -89,6 +96,16 @@ MODULE_INIT
 		logNotice("Could not determine config value irc/proxy/port, using default of '%s'", port);
 	}
 
+	char *slowClients = "pause";
+
+	if((config = getConfigPath("irc/proxy/slowClients")) != NULL && config->type == STORE_STRING) {
+		slowClients = config->content.string;
+	} else {
+		logNotice("Could not determine config value irc/proxy/slowClients, using default of '%s'", slowClients);
+	}
+
+	dropSlowClients = g_strcmp0(slowClients, "drop") == 0;
+
 	// Create and connect our listening server socket
 	server = createServerSocket(port);
 
@@ -135,8 +152,12 @@ static void listener_remoteLine(void *subject, const char *event, void *data, va
 		for(GList *iter = proxy->clients->head; iter != NULL; iter = iter->next) { // iterate over all clients
 			IrcProxyClient *client = iter->data; // retrieve client
 
-			if(client->authenticated && g_strcmp0(message->command, "PING") != 0) { // only relay to authenticated clients, don't relay ping messages
-				proxyClientIrcSend(client, "%s", message->raw_message); // relay message to client
+			if(client->authenticated && client->socket->connected && g_strcmp0(message->command, "PING") != 0) { // only relay to authenticated clients, don't relay ping messages
+				if(client->paused) { // the client doesn't keep up, so don't make its output queue grow any further
+					client->skipped++;
+				} else {
+					proxyClientIrcSend(client, "%s", message->raw_message); // relay message to client
+				}
 			}
 		}
 	}
@@ -156,11 +177,15 @@ static void listener_clientAccept(void *subject, const char *event, void *data,
 		pc->proxy = NULL;
 		pc->socket = client;
 		pc->authenticated = false;
-		pc->ibuffer = g_string_new("");
+		pc->ibuffer = createLineBuffer(true); // skip empty lines, since clients could send \r\n
+		pc->paused = false;
+		pc->skipped = 0;
 
 		attachEventListener(pc, "line", NULL, &listener_clientLine);
 		attachEventListener(client, "read", NULL, &listener_clientRead);
 		attachEventListener(client, "disconnect", NULL, &listener_clientDisconnect);
+		attachEventListener(client, "write_backpressure", NULL, &listener_clientWriteBackpressure);
+		attachEventListener(client, "write_drained", NULL, &listener_clientWriteDrained);
 
 		g_hash_table_insert(clients, client, pc); // connect the client socket to the proxy client object
 
@@ -172,10 +197,11 @@ static void listener_clientRead(void *subject, const char *event, void *data, va
 {
 	Socket *socket = subject;
 	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
 
 	IrcProxyClient *client;
 	if((client = g_hash_table_lookup(clients, socket)) != NULL) {
-		g_string_append(client->ibuffer, message);
+		appendLineBuffer(client->ibuffer, message, size);
 		checkForBufferLine(client);
 	}
 }
@@ -196,6 +222,40 @@ static void listener_clientDisconnect(void *subject, const char *event, void *da
 	}
 }
 
+static void listener_clientWriteBackpressure(void *subject, const char *event, void *data, va_list args)
+{
+	Socket *socket = subject;
+	unsigned int queued = va_arg(args, unsigned int);
+
+	IrcProxyClient *client;
+	if((client = g_hash_table_lookup(clients, socket)) != NULL) {
+		if(dropSlowClients) {
+			// The disconnect event is delivered by the next poll, so it's safe to disconnect while relaying to the client
+			logWarning("IRC proxy client %d doesn't keep up with %u bytes of queued output, disconnecting...", socket->fd, queued);
+			disconnectSocket(socket);
+		} else {
+			logNotice("IRC proxy client %d doesn't keep up with %u bytes of queued output, pausing relay...", socket->fd, queued);
+			client->paused = true;
+		}
+	}
+}
+
+static void listener_clientWriteDrained(void *subject, const char *event, void *data, va_list args)
+{
+	Socket *socket = subject;
+
+	IrcProxyClient *client;
+	if((client = g_hash_table_lookup(clients, socket)) != NULL && client->paused) {
+		logNotice("IRC proxy client %d caught up after skipping %u lines, resuming relay", socket->fd, client->skipped);
+		client->paused = false;
+
+		if(client->skipped > 0) {
+			proxyClientIrcSend(client, ":kalisko.proxy NOTICE %s :*** Your connection was too slow, %u lines were not relayed to you", client->proxy != NULL ? client->proxy->irc->nick : "AUTH", client->skipped);
+			client->skipped = 0;
+		}
+	}
+}
+
 static void listener_clientLine(void *subject, const char *event, void *data, va_list args)
 {
 	IrcProxyClient *client = subject;
@@ -408,48 +468,32 @@ static void freeIrcProxyClient(void *client_p, void *quitmsg_p)
 	detachEventListener(client, "line", NULL, &listener_clientLine);
 	detachEventListener(client->socket, "read", NULL, &listener_clientRead);
 	detachEventListener(client->socket, "disconnect", NULL, &listener_clientDisconnect);
+	detachEventListener(client->socket, "write_backpressure", NULL, &listener_clientWriteBackpressure);
+	detachEventListener(client->socket, "write_drained", NULL, &listener_clientWriteDrained);
 
 	g_hash_table_remove(clients, client->socket); // remove ourselves from the irc proxy client sockets table
 
 	freeSocket(client->socket); // free the socket
-	g_string_free(client->ibuffer, true); // free the input buffer
+	freeLineBuffer(client->ibuffer); // free the input buffer
 
 	free(client); // actually free the client
 }
 
 /**
- * Checks for a new newline terminated line in the buffer and parses it
+ * Checks for new newline terminated lines in the buffer and parses them
  *
  * @param client			the IRC proxy client to check for buffer lines
  */
 static void checkForBufferLine(IrcProxyClient *client)
 {
-	char *message = client->ibuffer->str;
-
-	if(strstr(message, "\n") != NULL) { // message has at least one newline
-		g_string_free(client->ibuffer, false);
-		stripDuplicateNewlines(message); // remove duplicate newlines, since server could send \r\n
-		char **parts = g_strsplit(message, "\n", 0);
-		int count = 0;
-		for(char **iter = parts; *iter != NULL; iter++) {
-			count++;
-		}
+	char *line;
 
-		for(int i = 0; i < count - 1; i++) { // Don't trigger the last part, it's not yet complete
-			char *part = parts[i];
-			if(strlen(part) > 0) {
-				IrcMessage *ircMessage = parseIrcMessage(part);
+	while(readLineBufferLine(client->ibuffer, &line, NULL)) {
+		IrcMessage *ircMessage = parseIrcMessage(line);
 
-				if(ircMessage != NULL) {
-					triggerEvent(client, "line", ircMessage);
-					freeIrcMessage(ircMessage);
-				}
-			}
+		if(ircMessage != NULL) {
+			triggerEvent(client, "line", ircMessage);
+			freeIrcMessage(ircMessage);
 		}
-
-		client->ibuffer = g_string_new(parts[count-1]); // reinitialize buffer
-
-		g_strfreev(parts);
-		free(message);
 	}
 }
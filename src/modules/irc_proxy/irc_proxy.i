@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include "modules/socket/socket.h"
+#include "modules/socket/linebuffer.h"
 #include "modules/irc/irc.h"
 
 /**
@@ -53,7 +54,11 @@ typedef struct {
 		/** true if the client passed the password challenge */
 		bool authenticated;
 		/** the line input buffer for the client */
-		GString *ibuffer;
+		LineBuffer *ibuffer;
+		/** true if the client doesn't keep up with reading and relaying to it is paused */
+		bool paused;
+		/** the number of remote lines that weren't relayed to the client while it was paused */
+		unsigned int skipped;
 } IrcProxyClient;
 
 
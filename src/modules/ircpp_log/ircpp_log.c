@@ -28,14 +28,15 @@
 #include "modules/irc_proxy_plugin/irc_proxy_plugin.h"
 #include "modules/irc_parser/irc_parser.h"
 #include "modules/event/event.h"
+#include "modules/log_event/log_event.h"
 #define API
 
 MODULE_NAME("ircpp_log");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("An IRC proxy plugin that allows log messages to be relayed to IRC proxy clients");
-MODULE_VERSION(0, 2, 6);
+MODULE_VERSION(0, 2, 7);
 MODULE_BCVERSION(0, 2, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("irc_proxy", 0, 3, 0), MODULE_DEPENDENCY("irc_proxy_plugin", 0, 2, 0), MODULE_DEPENDENCY("irc_parser", 0, 1, 1), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 1, 1));
+MODULE_DEPENDS(MODULE_DEPENDENCY("irc_proxy", 0, 3, 0), MODULE_DEPENDENCY("irc_proxy_plugin", 0, 2, 0), MODULE_DEPENDENCY("irc_parser", 0, 1, 1), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 2, 0));
 
 static void listener_log(void *subject, const char *event, void *data, va_list args);
 static bool initPlugin(IrcProxy *proxy, char *name);
@@ -108,6 +109,7 @@ MODULE_INIT
 		return false;
 	}
 
+	$(void, log_event, addLogListenerLevels)(LOG_LEVEL_INFO_UP); // trace messages aren't relayed
 	$(void, event, attachEventListener)(NULL, "log", NULL, &listener_log);
 
 	return true;
@@ -121,6 +123,7 @@ MODULE_FINALIZE
 	g_queue_free(proxies_error);
 
 	$(void, event, detachEventListener)(NULL, "log", NULL, &listener_log);
+	$(void, log_event, removeLogListenerLevels)(LOG_LEVEL_INFO_UP);
 
 	$(void, irc_proxy_plugin, delIrcProxyPlugin)(&plugin_debug);
 	$(void, irc_proxy_plugin, delIrcProxyPlugin)(&plugin_info);
@@ -155,8 +158,9 @@ static void listener_log(void *subject, const char *event, void *data, va_list a
 			g_string_append_printf(msg, "[%s] (%c4ERROR%c) %s", module, (char) 3, (char) 0x0f, message);
 			proxies = proxies_error;
 		break;
-		default:
-		break;
+		default: // trace messages are still passed to us if another log listener wants them
+			g_string_free(msg, true);
+		return;
 	}
 
 	for(GList *iter = proxies->head; iter != NULL; iter = iter->next) {
@@ -21,10 +21,12 @@
 
 #include <glib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "dll.h"
 #include "log.h"
 #include "types.h"
+#include "memory_alloc.h"
 #include "modules/irc_proxy/irc_proxy.h"
 #include "modules/irc_proxy_plugin/irc_proxy_plugin.h"
 #include "modules/irc_parser/irc_parser.h"
@@ -34,11 +36,12 @@
 #include "modules/store/store.h"
 #include "modules/store/path.h"
 #define API
+#include "ring.h"
 
 MODULE_NAME("ircpp_messagebuffer");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("An IRC proxy plugin that sends the last few lines to new connected clients");
-MODULE_VERSION(0, 2, 2);
+MODULE_VERSION(0, 4, 0);
 MODULE_BCVERSION(0, 1, 0);
 MODULE_DEPENDS(MODULE_DEPENDENCY("irc_proxy", 0, 3, 5), MODULE_DEPENDENCY("irc_proxy_plugin", 0, 2, 2), MODULE_DEPENDENCY("irc_parser", 0, 1, 4), MODULE_DEPENDENCY("string_util", 0, 1, 3), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3));
 
@@ -47,7 +50,7 @@ MODULE_DEPENDS(MODULE_DEPENDENCY("irc_proxy", 0, 3, 5), MODULE_DEPENDENCY("irc_p
  */
 typedef struct {
 	/**
-	 * A HashTable with the channel/query name as the key and a Queue as the value.
+	 * A HashTable with the channel/query name as the key and a MessageRing as the value.
 	 */
 	GHashTable *chansBuffer;
 
@@ -62,9 +65,16 @@ typedef struct {
 	 * Contains the default value for how many lines should be saved.
 	 */
 	int defaultMaxLines;
+
+	/**
+	 * The memory budget all message arenas of the proxy share.
+	 */
+	MessageRingBudget memory;
 } ProxyBuffer;
 
 #define MESSAGEBUF_MAX_LINES 50
+/** The default memory limit for the message arenas of a proxy */
+#define MESSAGEBUF_MAX_MEMORY (1024 * 1024)
 
 static bool initPlugin(IrcProxy *proxy, char *name);
 static void finiPlugin(IrcProxy *proxy, char *name);
@@ -73,6 +83,9 @@ static void listener_remoteLine(void *subject, const char *event, void *data, va
 static void listener_clientReattached(void *subject, const char *event, void *data, va_list args);
 static void listener_clientLine(void *subject, const char *event, void *data, va_list args);
 
+static void bufferMessage(ProxyBuffer *buffer, const char *target, const char *prefix, const char *trailing);
+static void freeProxyBuffer(ProxyBuffer *buffer);
+
 
 static IrcProxyPlugin plugin;
 
@@ -84,23 +97,25 @@ static GHashTable *buffers;
 
 MODULE_INIT
 {
+	buffers = g_hash_table_new(g_str_hash, g_str_equal);
+
 	plugin.name = "messagebuffer";
 	plugin.handlers = g_queue_new();
 	plugin.initialize = &initPlugin;
 	plugin.finalize = &finiPlugin;
 
 	if(!$(bool, irc_proxy_plugin, addIrcProxyPlugin)(&plugin)) {
+		g_hash_table_destroy(buffers);
 		return false;
 	}
 
-	buffers = g_hash_table_new(g_str_hash, g_str_equal);
-
 	return true;
 }
 
 MODULE_FINALIZE
 {
 	$(void, irc_proxy_plugin, delIrcProxyPlugin)(&plugin);
+	g_hash_table_destroy(buffers);
 }
 
 /**
@@ -126,49 +141,7 @@ static void listener_clientLine(void *subject, const char *event, void *data, va
 		message->trailing != NULL) {
 
 		ProxyBuffer *buffer = g_hash_table_lookup(buffers, client->proxy->name);
-
-		// build string for buffer
-		char *msgTarget = strdup(message->params[0]);
-
-		// get the amount of lines we wanna save for the specific target
-		int maxLines = buffer->defaultMaxLines;
-		int *specificMaxLines = NULL;
-		if((specificMaxLines = g_hash_table_lookup(buffer->chanMaxLines, msgTarget)) != NULL) {
-			maxLines = GPOINTER_TO_INT(specificMaxLines);
-		}
-
-		// check if we can ignore the target
-		if(maxLines <= 0) {
-			return;
-		}
-
-		// date and time
-		GDateTime *now = g_date_time_new_now_local();
-		unsigned int day = g_date_time_get_day_of_month(now);
-		unsigned int month = g_date_time_get_month(now);
-		unsigned int year = g_date_time_get_year(now);
-		unsigned int hour = g_date_time_get_hour(now);
-		unsigned int minute = g_date_time_get_minute(now);
-		unsigned int second = g_date_time_get_second(now);
-	    g_date_time_unref(now);
-
-		char *bufferStr = g_strdup_printf(":%s PRIVMSG %s :[%02u.%02u.%04u-%02u:%02u:%02u] %s", client->proxy->irc->nick, msgTarget, day, month, year, hour, minute, second, message->trailing);
-
-		// create queue if needed
-		GQueue *queue = NULL;
-		if((queue = g_hash_table_lookup(buffer->chansBuffer, msgTarget)) == NULL) {
-			queue = g_queue_new();
-			g_hash_table_insert(buffer->chansBuffer, msgTarget, queue);
-		}
-
-		// add message to queue
-		g_queue_push_tail(queue, bufferStr);
-
-		// remove line if we have one too much
-		if(queue->length > maxLines) {
-			// as we only add one line we have to remove only one to meet the maxLines
-			g_queue_pop_head(queue);
-		}
+		bufferMessage(buffer, message->params[0], client->proxy->irc->nick, message->trailing);
 	}
 }
 
@@ -196,69 +169,24 @@ static void listener_remoteLine(void *subject, const char *event, void *data, va
 		// check if we wanna save the message
 		if(g_strcmp0(message->command, "PRIVMSG") == 0 && message->params_count > 0 &&
 			!$(bool, irc_proxy, hasIrcProxyRelayException)(proxy, message->params[0]) &&
-			message->trailing != NULL) {
+			message->trailing != NULL && message->prefix != NULL) {
 
 			ProxyBuffer *buffer = g_hash_table_lookup(buffers, proxy->name);
 
-			// get the user mask for the message
-			IrcUserMask *usrMask;
-			if((usrMask = $(IrcUserMask *, irc_parser, parseIrcUserMask)(message->prefix)) == NULL) {
-				return;
-			}
-
 			// filter out the target of the message
-			char *msgTarget;
 			if(g_strcmp0(message->params[0], proxy->irc->nick) == 0) {
-				// it is a query
-				msgTarget = strdup(usrMask->nick);
+				// it is a query, so buffer it for the nick of the sender
+				IrcUserMask *usrMask;
+				if((usrMask = $(IrcUserMask *, irc_parser, parseIrcUserMask)(message->prefix)) == NULL) {
+					return;
+				}
+
+				bufferMessage(buffer, usrMask->nick, message->prefix, message->trailing);
+				$(void, irc_parser, freeIrcUserMask)(usrMask);
 			} else {
 				// it is a channel
-				msgTarget = strdup(message->params[0]);
-			}
-
-			// get the amount of lines we wanna save for the specific target
-			int maxLines = buffer->defaultMaxLines;
-			int *specificMaxLines = NULL;
-			if((specificMaxLines = g_hash_table_lookup(buffer->chanMaxLines, msgTarget)) != NULL) {
-				maxLines = GPOINTER_TO_INT(specificMaxLines);
-			}
-
-			// check if we can ignore the target
-			if(maxLines <= 0) {
-				return;
+				bufferMessage(buffer, message->params[0], message->prefix, message->trailing);
 			}
-
-			// date and time
-			GDateTime *now = g_date_time_new_now_local();
-			unsigned int day = g_date_time_get_day_of_month(now);
-			unsigned int month = g_date_time_get_month(now);
-			unsigned int year = g_date_time_get_year(now);
-			unsigned int hour = g_date_time_get_hour(now);
-			unsigned int minute = g_date_time_get_minute(now);
-			unsigned int second = g_date_time_get_second(now);
-		    g_date_time_unref(now);
-
-			// build string for buffer
-			char *bufferStr = g_strdup_printf(":%s PRIVMSG %s :[%02u.%02u.%04u-%02u:%02u:%02u] %s", message->prefix, msgTarget, day, month, year, hour, minute, second, message->trailing);
-
-			// create queue if needed
-			GQueue *queue = NULL;
-			if((queue = g_hash_table_lookup(buffer->chansBuffer, msgTarget)) == NULL) {
-				queue = g_queue_new();
-				g_hash_table_insert(buffer->chansBuffer, msgTarget, queue);
-			}
-
-			// add message to queue
-			g_queue_push_tail(queue, bufferStr);
-
-			// remove line if we have one too much
-			if(queue->length > maxLines) {
-				// as we only add one line we have to remove only one to meet the maxLines
-				g_queue_pop_head(queue);
-			}
-
-			// clean up
-			$(void, irc_parser, freeIrcUserMask)(usrMask);
 		}
 	}
 }
@@ -288,12 +216,16 @@ static void listener_clientReattached(void *subject, const char *event, void *da
 	void *key = NULL;
 	void *value = NULL;
 
+	// the timestamp only changes once per second, so only format it then
+	gint64 timestampTime = -1;
+	char timestamp[32];
+
 	g_hash_table_iter_init(&iter, buffer->chansBuffer);
 	while(g_hash_table_iter_next(&iter, &key, &value)) {
 		char *target = key;
-		GQueue *messages = value;
+		MessageRing *ring = value;
 
-		if(messages->length > 0) {
+		if(ring->count > 0) {
 			char *infoSender = NULL;
 			if(g_str_has_prefix(target, "#")) {
 				infoSender = "*messagebuffer!kalisko@kalisko.org";
@@ -301,12 +233,29 @@ static void listener_clientReattached(void *subject, const char *event, void *da
 				infoSender = target;
 			}
 
-			$(bool, irc_proxy, proxyClientIrcSend)(client, ":%s PRIVMSG %s :Message buffer playback...", infoSender, target);
-			char *message = NULL;
-			while((message = g_queue_pop_head(messages)) != NULL) {
-				$(bool, irc_proxy, proxyClientIrcSend)(client, "%s", message);
+			if(ring->dropped > 0) {
+				$(bool, irc_proxy, proxyClientIrcSend)(client, ":%s PRIVMSG %s :Message buffer playback, %u newer messages were dropped because the memory limit was reached...", infoSender, target, ring->dropped);
+			} else {
+				$(bool, irc_proxy, proxyClientIrcSend)(client, ":%s PRIVMSG %s :Message buffer playback...", infoSender, target);
+			}
+			for(unsigned int i = 0; i < ring->count; i++) {
+				MessageRecord *record = getMessageRingRecord(ring, i);
+
+				if(record->time != timestampTime) {
+					GDateTime *time = g_date_time_new_from_unix_local(record->time);
+					snprintf(timestamp, sizeof(timestamp), "[%02u.%02u.%04u-%02u:%02u:%02u]", g_date_time_get_day_of_month(time), g_date_time_get_month(time), g_date_time_get_year(time), g_date_time_get_hour(time), g_date_time_get_minute(time), g_date_time_get_second(time));
+					g_date_time_unref(time);
+					timestampTime = record->time;
+				}
+
+				char *prefix = ring->arena + record->offset;
+				char *trailing = prefix + record->prefixLength;
+				$(bool, irc_proxy, proxyClientIrcSend)(client, ":%.*s PRIVMSG %s :%s %.*s", (int) record->prefixLength, prefix, target, timestamp, (int) record->trailingLength, trailing);
 			}
 			$(bool, irc_proxy, proxyClientIrcSend)(client, ":%s PRIVMSG %s :...buffer playback complete!", infoSender, target);
+
+			// the buffer was played back, so release its memory
+			clearMessageRing(&buffer->memory, ring);
 		}
 	}
 }
@@ -325,6 +274,50 @@ static void listener_clientDisconnected(void *subject, const char *event, void *
 	$(void, event, detachEventListener)(client, "line", NULL, &listener_clientLine);
 }
 
+/**
+ * Adds a message to the backlog of a channel or query, dropping the oldest buffered messages if the backlog is full
+ *
+ * @param buffer		the proxy buffer to add the message to
+ * @param target		the channel or query the message belongs to
+ * @param prefix		the prefix of the message, i.e. its sender
+ * @param trailing		the message text
+ */
+static void bufferMessage(ProxyBuffer *buffer, const char *target, const char *prefix, const char *trailing)
+{
+	MessageRing *ring;
+
+	if((ring = g_hash_table_lookup(buffer->chansBuffer, target)) == NULL) {
+		// get the amount of lines we wanna save for the specific target
+		int maxLines = buffer->defaultMaxLines;
+		void *specificMaxLines = NULL;
+		if(g_hash_table_lookup_extended(buffer->chanMaxLines, target, NULL, &specificMaxLines)) {
+			maxLines = GPOINTER_TO_INT(specificMaxLines);
+		}
+
+		// check if we can ignore the target
+		if(maxLines <= 0) {
+			return;
+		}
+
+		ring = createMessageRing(target, maxLines);
+		g_hash_table_insert(buffer->chansBuffer, ring->target, ring);
+	}
+
+	pushMessageRing(&buffer->memory, ring, prefix, trailing);
+}
+
+/**
+ * Frees a proxy buffer with all its message rings
+ *
+ * @param buffer		the proxy buffer to free
+ */
+static void freeProxyBuffer(ProxyBuffer *buffer)
+{
+	g_hash_table_destroy(buffer->chansBuffer);
+	g_hash_table_destroy(buffer->chanMaxLines);
+	free(buffer);
+}
+
 static bool initPlugin(IrcProxy *proxy, char *name)
 {
 	// Attach to existing clients
@@ -337,9 +330,11 @@ static bool initPlugin(IrcProxy *proxy, char *name)
 	if(g_hash_table_lookup(buffers, proxy->name) == NULL) {
 		ProxyBuffer *buffer = ALLOCATE_OBJECT(ProxyBuffer);
 
-		buffer->chansBuffer = g_hash_table_new(g_str_hash, g_str_equal);
-		buffer->chanMaxLines = g_hash_table_new(g_str_hash, g_str_equal);
+		buffer->chansBuffer = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, &freeMessageRing);
+		buffer->chanMaxLines = g_hash_table_new_full(g_str_hash, g_str_equal, &free, NULL);
 		buffer->defaultMaxLines = MESSAGEBUF_MAX_LINES;
+		buffer->memory.max = MESSAGEBUF_MAX_MEMORY;
+		buffer->memory.used = 0;
 
 		// read settings from config
 		Store *config = NULL;
@@ -356,6 +351,16 @@ static bool initPlugin(IrcProxy *proxy, char *name)
 				}
 			}
 
+			// irc/bouncers/maxMemory
+			Store *maxMemoryConfig = NULL;
+			if((maxMemoryConfig = $(Store *, store, getStorePath)(config, "maxMemory")) != NULL) {
+				if(maxMemoryConfig->type == STORE_INTEGER && maxMemoryConfig->content.integer >= 0) {
+					buffer->memory.max = maxMemoryConfig->content.integer;
+				} else {
+					logNotice("Found 'maxMemory' setting but it is not a non-negative Integer. Using internal default.");
+				}
+			}
+
 			// irc/bouncers/specific
 			Store *specificLinesConfig = NULL;
 			if((specificLinesConfig = $(Store *, store, getStorePath)(config, "specific")) != NULL) {
@@ -409,33 +414,6 @@ static void finiPlugin(IrcProxy *proxy, char *name)
 	ProxyBuffer *buffer = NULL;
 	if((buffer = g_hash_table_lookup(buffers, proxy->name)) != NULL) {
 		g_hash_table_remove(buffers, proxy->name);
-
-		GHashTableIter iter;
-		void *key;
-		void *value;
-
-		// clean up 'chansBuffer'
-		g_hash_table_iter_init(&iter, buffer->chansBuffer);
-		while(g_hash_table_iter_next(&iter, &key, &value)) {
-			GQueue *queue = value;
-			for(GList *iter = queue->head; iter != NULL; iter = iter->next) {
-				free(iter->data);
-			}
-
-			free(key);
-			g_queue_free(queue);
-		}
-
-		g_hash_table_destroy(buffer->chansBuffer);
-
-		// clean up 'chanMaxLines'
-		g_hash_table_iter_init(&iter, buffer->chanMaxLines);
-		while(g_hash_table_iter_next(&iter, &key, &value)) {
-			free(key);
-		}
-
-		g_hash_table_destroy(buffer->chanMaxLines);
-
-		free(buffer);
+		freeProxyBuffer(buffer);
 	}
 }
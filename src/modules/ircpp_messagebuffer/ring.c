@@ -0,0 +1,197 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dll.h"
+#include "log.h"
+#include "types.h"
+#include "memory_alloc.h"
+#define API
+#include "ring.h"
+
+static void growMessageRing(MessageRingBudget *budget, MessageRing *ring, unsigned int size);
+
+API MessageRing *createMessageRing(const char *target, unsigned int capacity)
+{
+	MessageRing *ring = ALLOCATE_OBJECT(MessageRing);
+	ring->target = strdup(target);
+	ring->records = ALLOCATE_OBJECTS(MessageRecord, capacity);
+	ring->capacity = capacity;
+	ring->first = 0;
+	ring->count = 0;
+	ring->arena = NULL;
+	ring->arenaSize = 0;
+	ring->arenaHead = 0;
+	ring->arenaUsed = 0;
+	ring->dropped = 0;
+
+	return ring;
+}
+
+API void freeMessageRing(void *ring_p)
+{
+	MessageRing *ring = ring_p;
+
+	free(ring->arena);
+	free(ring->records);
+	free(ring->target);
+	free(ring);
+}
+
+API bool pushMessageRing(MessageRingBudget *budget, MessageRing *ring, const char *prefix, const char *trailing)
+{
+	size_t prefixLength = strlen(prefix);
+	size_t trailingLength = strlen(trailing);
+	unsigned int length = prefixLength + trailingLength;
+
+	if(prefixLength > G_MAXUSHORT || trailingLength > G_MAXUSHORT) {
+		logWarning("Not buffering overlong message for %s", ring->target);
+		return false;
+	}
+
+	// grow the arena if the message doesn't fit and both the ring's and the budget's limits allow it
+	if(ring->arenaUsed + length > ring->arenaSize) {
+		unsigned int maxSize = ring->capacity * MESSAGEBUF_MAX_LINE_LENGTH;
+		unsigned int size = ring->arenaSize > 0 ? ring->arenaSize : MESSAGEBUF_ARENA_INITIAL_SIZE;
+		while(size < ring->arenaUsed + length && size < maxSize) {
+			size *= 2;
+		}
+		if(size > maxSize) {
+			size = maxSize;
+		}
+
+		if(size > ring->arenaSize && budget->used - ring->arenaSize + size > budget->max) { // stay within the budget
+			size = budget->max - (budget->used - ring->arenaSize);
+		}
+
+		if(size > ring->arenaSize) {
+			growMessageRing(budget, ring, size);
+		}
+	}
+
+	if(length > ring->arenaSize) {
+		if(ring->dropped++ == 0) { // only warn when reaching the limit instead of for every dropped message
+			logWarning("Message buffer memory limit reached, dropping messages for %s until memory is available again", ring->target);
+		}
+
+		return false;
+	}
+
+	if(ring->dropped > 0) {
+		logNotice("Message buffer for %s is buffering messages again after dropping %u of them", ring->target, ring->dropped);
+		ring->dropped = 0;
+	}
+
+	// find a place for the message, wrapping around if it doesn't fit at the end of the arena
+	unsigned int position = ring->arenaHead;
+	bool wrapped = false;
+	if(position + length > ring->arenaSize) {
+		position = 0;
+		wrapped = true;
+	}
+
+	// drop the oldest messages until there's room for the new one
+	while(ring->count > 0) {
+		MessageRecord *oldest = &ring->records[ring->first];
+		unsigned int oldestLength = oldest->prefixLength + oldest->trailingLength;
+		bool full = ring->count == ring->capacity;
+		bool skipped = wrapped && oldest->offset >= ring->arenaHead; // the message is in the tail we're wrapping over
+		bool overlaps = oldest->offset < position + length && oldest->offset + oldestLength > position;
+
+		if(!full && !skipped && !overlaps) {
+			break;
+		}
+
+		ring->arenaUsed -= oldestLength;
+		ring->first = (ring->first + 1) % ring->capacity;
+		ring->count--;
+	}
+
+	if(ring->count == 0) {
+		position = 0;
+		ring->arenaUsed = 0;
+	}
+
+	memcpy(ring->arena + position, prefix, prefixLength);
+	memcpy(ring->arena + position + prefixLength, trailing, trailingLength);
+
+	MessageRecord *record = &ring->records[(ring->first + ring->count) % ring->capacity];
+	record->time = time(NULL);
+	record->offset = position;
+	record->prefixLength = prefixLength;
+	record->trailingLength = trailingLength;
+
+	ring->count++;
+	ring->arenaHead = position + length;
+	ring->arenaUsed += length;
+
+	return true;
+}
+
+API MessageRecord *getMessageRingRecord(MessageRing *ring, unsigned int index)
+{
+	return &ring->records[(ring->first + index) % ring->capacity];
+}
+
+API void clearMessageRing(MessageRingBudget *budget, MessageRing *ring)
+{
+	free(ring->arena);
+	budget->used -= ring->arenaSize;
+
+	ring->arena = NULL;
+	ring->arenaSize = 0;
+	ring->arenaHead = 0;
+	ring->arenaUsed = 0;
+	ring->first = 0;
+	ring->count = 0;
+	ring->dropped = 0; // the released memory is available again
+}
+
+/**
+ * Grows the arena of a message ring, compacting the buffered messages to its start
+ *
+ * @param budget		the memory budget the ring is charged to
+ * @param ring			the message ring to grow
+ * @param size			the new size of the arena
+ */
+static void growMessageRing(MessageRingBudget *budget, MessageRing *ring, unsigned int size)
+{
+	char *arena = ALLOCATE_OBJECTS(char, size);
+	unsigned int position = 0;
+
+	for(unsigned int i = 0; i < ring->count; i++) {
+		MessageRecord *record = getMessageRingRecord(ring, i);
+		unsigned int length = record->prefixLength + record->trailingLength;
+
+		memcpy(arena + position, ring->arena + record->offset, length);
+		record->offset = position;
+		position += length;
+	}
+
+	free(ring->arena);
+	budget->used = budget->used - ring->arenaSize + size;
+
+	ring->arena = arena;
+	ring->arenaSize = size;
+	ring->arenaHead = position;
+}
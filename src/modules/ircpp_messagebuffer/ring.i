@@ -0,0 +1,128 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef IRCPP_MESSAGEBUFFER_RING_H
+#define IRCPP_MESSAGEBUFFER_RING_H
+
+#include <glib.h>
+
+/**
+ * A buffered message. The prefix and trailing strings are stored back to back in the arena of the MessageRing, without NUL terminators.
+ */
+typedef struct {
+	/** the time the message was received */
+	gint64 time;
+	/** the offset of the prefix in the arena */
+	unsigned int offset;
+	/** the length of the prefix */
+	unsigned short prefixLength;
+	/** the length of the trailing part */
+	unsigned short trailingLength;
+} MessageRecord;
+
+/**
+ * The message backlog of a single channel or query. Records are kept in a fixed-capacity ring and their strings in a circular arena that
+ * grows on demand up to the limit of the MessageRingBudget it's charged to. If a new message doesn't fit, the oldest messages are dropped.
+ */
+typedef struct {
+	/** the name of the channel or query */
+	char *target;
+	/** ring of the buffered messages, holding up to capacity records */
+	MessageRecord *records;
+	/** the maximum number of buffered messages */
+	unsigned int capacity;
+	/** the index of the oldest buffered message in records */
+	unsigned int first;
+	/** the number of buffered messages */
+	unsigned int count;
+	/** the string storage of the buffered messages */
+	char *arena;
+	/** the size of the arena */
+	unsigned int arenaSize;
+	/** the offset in the arena at which the next message is stored */
+	unsigned int arenaHead;
+	/** the number of arena bytes used by buffered messages */
+	unsigned int arenaUsed;
+	/** the number of messages dropped since the memory limit was reached, or 0 if the ring is within the limit */
+	unsigned int dropped;
+} MessageRing;
+
+/**
+ * The memory budget shared by the message arenas of several message rings
+ */
+typedef struct {
+	/** the maximum number of bytes the arenas may use together */
+	unsigned long max;
+	/** the number of bytes the arenas currently use together */
+	unsigned long used;
+} MessageRingBudget;
+
+/** The initial arena size of a message ring */
+#define MESSAGEBUF_ARENA_INITIAL_SIZE 1024
+/** The maximum length of an IRC line, used to bound the arena size of a message ring */
+#define MESSAGEBUF_MAX_LINE_LENGTH 512
+
+
+/**
+ * Creates an empty message ring
+ *
+ * @param target		the channel or query the ring buffers messages for
+ * @param capacity		the maximum number of messages to buffer
+ * @result				the created message ring
+ */
+API MessageRing *createMessageRing(const char *target, unsigned int capacity);
+
+/**
+ * Frees a message ring. The memory of its arena must already have been released from its budget.
+ *
+ * @param ring_p		a pointer to the message ring to free
+ */
+API void freeMessageRing(void *ring_p);
+
+/**
+ * Adds a message to a message ring, dropping the oldest buffered messages if the ring is full or there's no room for it in the arena. If the
+ * arena can't grow enough because the budget is exhausted, the new message is dropped instead.
+ *
+ * @param budget		the memory budget the ring is charged to
+ * @param ring			the message ring to add the message to
+ * @param prefix		the prefix of the message, i.e. its sender
+ * @param trailing		the message text
+ * @result				true if the message was buffered, false if it was dropped
+ */
+API bool pushMessageRing(MessageRingBudget *budget, MessageRing *ring, const char *prefix, const char *trailing);
+
+/**
+ * Returns a buffered message of a message ring
+ *
+ * @param ring			the message ring to retrieve the message from
+ * @param index			the index of the message, where 0 is the oldest one and must be less than the ring's count
+ * @result				the record of the message, whose strings start at its offset in the ring's arena
+ */
+API MessageRecord *getMessageRingRecord(MessageRing *ring, unsigned int index);
+
+/**
+ * Drops all messages of a message ring and releases its arena from its budget
+ *
+ * @param budget		the memory budget the ring is charged to
+ * @param ring			the message ring to clear
+ */
+API void clearMessageRing(MessageRingBudget *budget, MessageRing *ring);
+
+#endif
@@ -20,11 +20,16 @@
 
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "dll.h"
 #include "log.h"
 #include "types.h"
+#include "timer.h"
+#include "memory_alloc.h"
 #include "modules/irc_proxy/irc_proxy.h"
 #include "modules/irc_proxy_plugin/irc_proxy_plugin.h"
 #include "modules/irc_parser/irc_parser.h"
@@ -32,10 +37,37 @@
 #include "modules/event/event.h"
 #define API
 
+/** The maximum number of message log files kept open at the same time */
+#define MESSAGELOG_MAX_OPEN_FILES 32
+/** The buffer size of each open message log file */
+#define MESSAGELOG_BUFFER_SIZE 8192
+/** The time in microseconds after which written message log lines are flushed to disk */
+#define MESSAGELOG_FLUSH_INTERVAL G_USEC_PER_SEC
+
+/**
+ * An open message log file for a target of an IRC proxy
+ */
+typedef struct {
+	/** the cache key of the log file, i.e. "<proxy>/<target>" */
+	char *key;
+	/** the path of the log file */
+	char *path;
+	/** the IRC proxy the log file belongs to */
+	IrcProxy *proxy;
+	/** the open file to append lines to */
+	FILE *file;
+	/** the day the lines in the file were logged on, formatted as YYYY-MM-DD */
+	char day[16];
+	/** true if lines were written since the file was last flushed */
+	bool dirty;
+	/** the link of the log file in the LRU queue */
+	GList *link;
+} MessageLogFile;
+
 MODULE_NAME("ircpp_messagelog");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("An IRC proxy plugin that allows IRC messages to be logged to the hard drive");
-MODULE_VERSION(0, 2, 0);
+MODULE_VERSION(0, 3, 1);
 MODULE_BCVERSION(0, 1, 0);
 MODULE_DEPENDS(MODULE_DEPENDENCY("irc_proxy", 0, 3, 5), MODULE_DEPENDENCY("irc_proxy_plugin", 0, 2, 2), MODULE_DEPENDENCY("irc_parser", 0, 1, 4), MODULE_DEPENDENCY("string_util", 0, 1, 3), MODULE_DEPENDENCY("event", 0, 1, 2));
 
@@ -43,20 +75,50 @@ static void listener_clientLine(void *subject, const char *event, void *data, va
 static void listener_clientAuthenticated(void *subject, const char *event, void *data, va_list args);
 static void listener_clientDisconnected(void *subject, const char *event, void *data, va_list args);
 static void listener_remoteLine(void *subject, const char *event, void *data, va_list args);
+TIMER_CALLBACK(flush);
 
 static bool initPlugin(IrcProxy *proxy, char *name);
 static void finiPlugin(IrcProxy *proxy, char *name);
+static void updateTimestamps();
+static void appendMessageLog(IrcProxy *proxy, const char *target, const char *timestamp, const char *nick, const char *text);
+static MessageLogFile *getMessageLogFile(IrcProxy *proxy, const char *target);
+static bool openMessageLogFile(MessageLogFile *logFile);
+static void rollMessageLogFile(const char *path, const char *day);
+static void freeMessageLogFile(void *logFile_p);
 static IrcProxyPlugin plugin;
 static char *messagelog_folder = ".";
 
+/** Table of open message log files by their cache key */
+static GHashTable *files;
+/** Queue of open message log files with the most recently used at its head */
+static GQueue *lru;
+/** The timer that flushes written lines, or NULL if no flush is scheduled */
+static GTimeVal *flushTimer = NULL;
+
+/** The second for which the cached timestamps were formatted */
+static time_t timestampSecond = -1;
+/** The cached local timestamp used for lines sent by our clients */
+static char localTimestamp[32];
+/** The cached bracketed ISO 8601 timestamp used for lines received from the remote server */
+static char isoTimestamp[32];
+/** The cached current day formatted as YYYY-MM-DD */
+static char today[16];
+
 MODULE_INIT
 {
+	files = g_hash_table_new_full(&g_str_hash, &g_str_equal, NULL, &freeMessageLogFile);
+	lru = g_queue_new();
+	flushTimer = NULL;
+	timestampSecond = -1;
+
 	plugin.name = "messagelog";
 	plugin.handlers = g_queue_new();
 	plugin.initialize = &initPlugin;
 	plugin.finalize = &finiPlugin;
 
 	if(!$(bool, irc_proxy_plugin, addIrcProxyPlugin)(&plugin)) {
+		g_hash_table_destroy(files);
+		g_queue_free(lru);
 		return false;
 	}
 
@@ -66,6 +128,14 @@ MODULE_INIT
 MODULE_FINALIZE
 {
 	$(void, irc_proxy_plugin, delIrcProxyPlugin)(&plugin);
+
+	if(flushTimer != NULL) {
+		TIMER_DEL(flushTimer);
+		flushTimer = NULL;
+	}
+
+	g_hash_table_destroy(files); // closes all remaining files
+	g_queue_free(lru);
 }
 
 static void listener_clientLine(void *subject, const char *event, void *data, va_list args)
@@ -75,43 +145,8 @@ static void listener_clientLine(void *subject, const char *event, void *data, va
 
 	if($(bool, irc_proxy_plugin, isIrcProxyPluginEnabled)(client->proxy, "messagelog")) { // plugin is enabled for this proxy
 		if(g_strcmp0(message->command, "PRIVMSG") == 0 && message->params_count > 0 && !$(bool, irc_proxy, hasIrcProxyRelayException)(client->proxy, message->params[0]) && message->trailing != NULL) {
-			GString *path = g_string_new(messagelog_folder);
-			g_string_append_printf(path, "/%s", client->proxy->name);
-
-			if(!g_file_test(path->str, G_FILE_TEST_IS_DIR)) {
-				if(g_mkdir_with_parents(path->str, 0750) == -1) {
-					logSystemError("Failed to create IRC proxy message log folder %s", path->str);
-					g_string_free(path, true);
-					return;
-				}
-			}
-
-			char *target = g_ascii_strdown(message->params[0], strlen(message->params[0]));
-			$(void, string_util, convertToFilename)(target);
-			g_string_append_printf(path, "/%s.log", target);
-			free(target);
-
-			FILE *file;
-
-			if((file = fopen(path->str, "a")) == NULL) {
-				logSystemError("Failed to open IRC proxy message log file %s", path->str);
-				g_string_free(path, true);
-				return;
-			}
-
-			GDateTime *now = g_date_time_new_now_local();
-			unsigned int day = g_date_time_get_day_of_month(now);
-			unsigned int month = g_date_time_get_month(now);
-			unsigned int year = g_date_time_get_year(now);
-			unsigned int hour = g_date_time_get_hour(now);
-			unsigned int minute = g_date_time_get_minute(now);
-			unsigned int second = g_date_time_get_second(now);
-		    g_date_time_unref(now);
-
-			fprintf(file, "[%02u.%02u.%04u-%02u:%02u:%02u] <%s> %s\n", day, month, year, hour, minute, second, client->proxy->irc->nick, message->trailing);
-
-			fclose(file);
-			g_string_free(path, true);
+			updateTimestamps();
+			appendMessageLog(client->proxy, message->params[0], localTimestamp, client->proxy->irc->nick, message->trailing);
 		}
 	}
 }
@@ -125,53 +160,21 @@ static void listener_remoteLine(void *subject, const char *event, void *data, va
 	if((proxy = $(IrcProxy *, irc_proxy, getIrcProxyByIrcConnection)(irc)) != NULL) {
 		if($(bool, irc_proxy_plugin, isIrcProxyPluginEnabled)(proxy, "messagelog")) { // plugin is enabled for this proxy
 			if(g_strcmp0(message->command, "PRIVMSG") == 0 && message->params_count > 0 && !$(bool, irc_proxy, hasIrcProxyRelayException)(proxy, message->params[0]) && message->trailing != NULL) {
-				GString *path = g_string_new(messagelog_folder);
-				g_string_append_printf(path, "/%s", proxy->name);
-
-				if(!g_file_test(path->str, G_FILE_TEST_IS_DIR)) {
-					if(g_mkdir_with_parents(path->str, 0750) == -1) {
-						logSystemError("Failed to create IRC proxy message log folder %s", path->str);
-						g_string_free(path, true);
-						return;
-					}
-				}
-
 				IrcUserMask *mask;
 
 				if((mask = $(IrcUserMask *, irc_parser, parseIrcUserMask)(message->prefix)) == NULL) {
-					g_string_free(path, true);
 					return;
 				}
 
-				char *target;
+				const char *target;
 				if(g_strcmp0(message->params[0], proxy->irc->nick) == 0) { // no channel message, query!
-					target = g_ascii_strdown(mask->nick, strlen(mask->nick));
+					target = mask->nick;
 				} else {
-					target = g_ascii_strdown(message->params[0], strlen(message->params[0]));
+					target = message->params[0];
 				}
 
-				$(void, string_util, convertToFilename)(target);
-				g_string_append_printf(path, "/%s.log", target);
-				free(target);
-
-				FILE *file;
-
-				if((file = fopen(path->str, "a")) == NULL) {
-					logSystemError("Failed to open IRC proxy message log file %s", path->str);
-					g_string_free(path, true);
-					$(void, irc_parser, freeIrcUserMask)(mask);
-					return;
-				}
-
-				GTimeVal now;
-				g_get_current_time(&now);
-
-				char *nowstr = g_time_val_to_iso8601(&now);
-				fprintf(file, "[%s] <%s> %s\n", nowstr, mask->nick, message->trailing);
-
-				free(nowstr);
-				fclose(file);
-				g_string_free(path, true);
+				updateTimestamps();
+				appendMessageLog(proxy, target, isoTimestamp, mask->nick, message->trailing);
 				$(void, irc_parser, freeIrcUserMask)(mask);
 			}
 		}
@@ -192,6 +195,217 @@ static void listener_clientDisconnected(void *subject, const char *event, void *
 	$(void, event, detachEventListener)(client, "line", NULL, &listener_clientLine);
 }
 
+TIMER_CALLBACK(flush)
+{
+	flushTimer = NULL;
+
+	for(GList *iter = lru->head; iter != NULL; iter = iter->next) {
+		MessageLogFile *logFile = iter->data;
+
+		if(logFile->dirty) {
+			fflush(logFile->file);
+			logFile->dirty = false;
+		}
+	}
+}
+
+/**
+ * Updates the cached timestamps if the current second changed since they were last formatted
+ */
+static void updateTimestamps()
+{
+	time_t now = time(NULL);
+
+	if(now == timestampSecond) {
+		return;
+	}
+
+	GDateTime *date = g_date_time_new_from_unix_local(now);
+	snprintf(localTimestamp, sizeof(localTimestamp), "[%02u.%02u.%04u-%02u:%02u:%02u]", g_date_time_get_day_of_month(date), g_date_time_get_month(date), g_date_time_get_year(date), g_date_time_get_hour(date), g_date_time_get_minute(date), g_date_time_get_second(date));
+	snprintf(today, sizeof(today), "%04u-%02u-%02u", g_date_time_get_year(date), g_date_time_get_month(date), g_date_time_get_day_of_month(date));
+	g_date_time_unref(date);
+
+	GTimeVal timeval = {now, 0};
+	char *iso = g_time_val_to_iso8601(&timeval);
+	snprintf(isoTimestamp, sizeof(isoTimestamp), "[%s]", iso); // bracketed just like the local timestamp
+	free(iso);
+
+	timestampSecond = now;
+}
+
+/**
+ * Appends a message to the message log of a target. Lines are buffered and flushed to disk within MESSAGELOG_FLUSH_INTERVAL.
+ *
+ * @param proxy			the IRC proxy the message belongs to
+ * @param target		the channel or query partner the message belongs to
+ * @param timestamp		the timestamp to prefix the line with
+ * @param nick			the nick of the sender of the message
+ * @param text			the message text
+ */
+static void appendMessageLog(IrcProxy *proxy, const char *target, const char *timestamp, const char *nick, const char *text)
+{
+	MessageLogFile *logFile;
+
+	if((logFile = getMessageLogFile(proxy, target)) == NULL) {
+		return;
+	}
+
+	if(strcmp(logFile->day, today) != 0) { // a new day started since the file was opened, so roll it over
+		fclose(logFile->file);
+		logFile->file = NULL;
+		rollMessageLogFile(logFile->path, logFile->day);
+
+		if(!openMessageLogFile(logFile)) {
+			g_hash_table_remove(files, logFile->key);
+			return;
+		}
+	}
+
+	fprintf(logFile->file, "%s <%s> %s\n", timestamp, nick, text);
+	logFile->dirty = true;
+
+	if(flushTimer == NULL) {
+		flushTimer = TIMER_ADD_TIMEOUT(MESSAGELOG_FLUSH_INTERVAL, flush);
+	}
+}
+
+/**
+ * Retrieves the open message log file of a target, opening it if it isn't cached yet. If too many files are open, the least recently used
+ * one is closed.
+ *
+ * @param proxy			the IRC proxy to retrieve the message log file for
+ * @param target		the channel or query partner to retrieve the message log file for
+ * @result				the message log file or NULL on failure
+ */
+static MessageLogFile *getMessageLogFile(IrcProxy *proxy, const char *target)
+{
+	char *filename = g_ascii_strdown(target, strlen(target));
+	$(void, string_util, convertToFilename)(filename);
+	char *key = g_strdup_printf("%s/%s", proxy->name, filename);
+	free(filename);
+
+	MessageLogFile *logFile;
+
+	if((logFile = g_hash_table_lookup(files, key)) != NULL) {
+		free(key);
+
+		// move it to the front of the LRU queue
+		g_queue_unlink(lru, logFile->link);
+		g_queue_push_head_link(lru, logFile->link);
+
+		return logFile;
+	}
+
+	char *folder = g_strdup_printf("%s/%s", messagelog_folder, proxy->name);
+	if(!g_file_test(folder, G_FILE_TEST_IS_DIR)) {
+		if(g_mkdir_with_parents(folder, 0750) == -1) {
+			logSystemError("Failed to create IRC proxy message log folder %s", folder);
+			free(folder);
+			free(key);
+			return NULL;
+		}
+	}
+	free(folder);
+
+	logFile = ALLOCATE_OBJECT(MessageLogFile);
+	logFile->key = key;
+	logFile->path = g_strdup_printf("%s/%s.log", messagelog_folder, key);
+	logFile->proxy = proxy;
+	logFile->file = NULL;
+	logFile->dirty = false;
+
+	// if the file is left over from an earlier day, roll it over before we append to it
+	GStatBuf info;
+	if(g_stat(logFile->path, &info) == 0 && info.st_size > 0) {
+		GDateTime *modified = g_date_time_new_from_unix_local(info.st_mtime);
+		char day[16];
+		snprintf(day, sizeof(day), "%04u-%02u-%02u", g_date_time_get_year(modified), g_date_time_get_month(modified), g_date_time_get_day_of_month(modified));
+		g_date_time_unref(modified);
+
+		if(strcmp(day, today) != 0) {
+			rollMessageLogFile(logFile->path, day);
+		}
+	}
+
+	if(!openMessageLogFile(logFile)) {
+		free(logFile->path);
+		free(logFile->key);
+		free(logFile);
+		return NULL;
+	}
+
+	g_queue_push_head(lru, logFile);
+	logFile->link = lru->head;
+	g_hash_table_insert(files, logFile->key, logFile);
+
+	if(lru->length > MESSAGELOG_MAX_OPEN_FILES) { // close the least recently used file
+		MessageLogFile *oldest = g_queue_peek_tail(lru);
+		g_hash_table_remove(files, oldest->key);
+	}
+
+	return logFile;
+}
+
+/**
+ * Opens a message log file for appending
+ *
+ * @param logFile		the message log file to open
+ * @result				true if successful
+ */
+static bool openMessageLogFile(MessageLogFile *logFile)
+{
+	if((logFile->file = fopen(logFile->path, "a")) == NULL) {
+		logSystemError("Failed to open IRC proxy message log file %s", logFile->path);
+		return false;
+	}
+
+	setvbuf(logFile->file, NULL, _IOFBF, MESSAGELOG_BUFFER_SIZE);
+	g_strlcpy(logFile->day, today, sizeof(logFile->day));
+
+	return true;
+}
+
+/**
+ * Moves a message log file out of the way by renaming it to "<name>.<day>.log"
+ *
+ * @param path			the path of the message log file to roll over
+ * @param day			the day the lines in the message log file were logged on, formatted as YYYY-MM-DD
+ */
+static void rollMessageLogFile(const char *path, const char *day)
+{
+	GString *rolled = g_string_new(path);
+	g_string_truncate(rolled, rolled->len - strlen(".log"));
+	g_string_append_printf(rolled, ".%s.log", day);
+
+	if(g_file_test(rolled->str, G_FILE_TEST_EXISTS)) {
+		logWarning("Not rolling over IRC proxy message log file %s since %s already exists", path, rolled->str);
+	} else if(g_rename(path, rolled->str) == -1) {
+		logSystemError("Failed to roll over IRC proxy message log file %s to %s", path, rolled->str);
+	}
+
+	g_string_free(rolled, true);
+}
+
+/**
+ * Closes and frees a message log file. This is called when it is removed from the files table.
+ *
+ * @param logFile_p		a pointer to the message log file to free
+ */
+static void freeMessageLogFile(void *logFile_p)
+{
+	MessageLogFile *logFile = logFile_p;
+
+	g_queue_delete_link(lru, logFile->link);
+
+	if(logFile->file != NULL) {
+		fclose(logFile->file);
+	}
+
+	free(logFile->path);
+	free(logFile->key);
+	free(logFile);
+}
+
 /**
  * Initializes the plugin
  *
@@ -231,4 +445,15 @@ static void finiPlugin(IrcProxy *proxy, char *name)
 		IrcProxyClient *client = iter->data;
 		$(void, event, detachEventListener)(client, "line", NULL, &listener_clientLine);
 	}
+
+	// Close the message log files of the proxy
+	GList *iter = lru->head;
+	while(iter != NULL) {
+		MessageLogFile *logFile = iter->data;
+		iter = iter->next;
+
+		if(logFile->proxy == proxy) {
+			g_hash_table_remove(files, logFile->key);
+		}
+	}
 }
@@ -36,9 +36,9 @@
 MODULE_NAME("landscape");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Module to display randomly generated landscapes");
-MODULE_VERSION(0, 2, 12);
+MODULE_VERSION(0, 2, 15);
 MODULE_BCVERSION(0, 2, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("heightmap", 0, 4, 4), MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("opengl", 0, 29, 6), MODULE_DEPENDENCY("scene", 0, 8, 0), MODULE_DEPENDENCY("image", 0, 5, 16), MODULE_DEPENDENCY("random", 0, 6, 2), MODULE_DEPENDENCY("erosion", 0, 1, 2), MODULE_DEPENDENCY("image_pnm", 0, 2, 5));
+MODULE_DEPENDS(MODULE_DEPENDENCY("heightmap", 0, 4, 4), MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("opengl", 0, 29, 6), MODULE_DEPENDENCY("scene", 0, 8, 0), MODULE_DEPENDENCY("image", 0, 5, 16), MODULE_DEPENDENCY("random", 0, 9, 0), MODULE_DEPENDENCY("erosion", 0, 1, 2), MODULE_DEPENDENCY("image_pnm", 0, 2, 5));
 
 MODULE_INIT
 {
@@ -64,17 +64,12 @@ API Image *generateLandscapeHeightmap(unsigned int width, unsigned int height, u
     erosionThermalTalusAngle = erosionThermalTalusAngle / 180.f * M_PI;
 
 	// 1. create worley noise for the overall map structure (valleys, peaks and ridges)
-	RandomWorleyContext* worleyContext = createWorleyContext(worleyPoints, 2);
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			Vector *point = createVector2((double) x / width, (double) y / height);
-			float value = randomWorleyDifference21(worleyContext, point, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
-			freeVector(point);
-
-			setImage(worley, x, y, 0, value);
-		}
-	}
+	RandomGenerator *generator = createRandomGenerator(createRandomSeed());
+	RandomWorleyContext* worleyContext = createWorleyContext(generator, worleyPoints, 2);
+	int worleyWeights[2] = {-1, 1}; // F2 - F1
+	randomWorleyImage(worleyContext, worley, 0, worleyWeights, 2, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
 	freeWorleyContext(worleyContext);
+	freeRandomGenerator(generator);
 
 	normalizeImageChannel(worley, 0);
 
@@ -82,12 +77,10 @@ API Image *generateLandscapeHeightmap(unsigned int width, unsigned int height, u
 	assert(writeImageToFile(worley, "01_worley.pgm"));
 #endif
 	// 2. create fBm noise to get interresting features of different frequencies
-	for(unsigned int y = 0; y < height; y++) {
-		for(unsigned int x = 0; x < width; x++) {
-			float value = noiseFBm((double) x * fbmFrequency / width, (double) y * fbmFrequency / height, 0.0, fbmPersistance, fbmDepth);
-			setImage(fBm, x, y, 0, value);
-		}
-	}
+	double fbmOrigin[3] = {0.0, 0.0, 0.0};
+	double fbmStepX[3] = {fbmFrequency / width, 0.0, 0.0};
+	double fbmStepY[3] = {0.0, fbmFrequency / height, 0.0};
+	noiseImage(fBm, 0, RANDOM_PERLIN_NOISE_FBM, fbmOrigin, fbmStepX, fbmStepY, fbmPersistance, fbmDepth);
 
 	normalizeImageChannel(fBm, 0);
 
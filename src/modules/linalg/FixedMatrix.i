@@ -0,0 +1,283 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINALG_FIXEDMATRIX_H
+#define LINALG_FIXEDMATRIX_H
+
+#include "Matrix.h"
+#include "FixedVector.h"
+
+#ifdef __cplusplus
+#include <iostream>
+#include <cassert>
+
+/**
+ * Matrix of a fixed size known at compile time, stored inline in row-major order. Like FixedVector, it never allocates, so it can be used
+ * freely as a temporary inside inner loops.
+ */
+template<unsigned int R, unsigned int C>
+class FixedMatrix
+{
+	public:
+		FixedMatrix()
+		{
+			clear();
+		}
+
+		explicit FixedMatrix(const Matrix& other)
+		{
+			assert(other.getRows() == R && other.getCols() == C);
+
+			for(unsigned int i = 0; i < R; i++) {
+				for(unsigned int j = 0; j < C; j++) {
+					(*this)(i, j) = other(i, j);
+				}
+			}
+		}
+
+		Matrix toMatrix() const
+		{
+			Matrix result(R, C);
+
+			for(unsigned int i = 0; i < R; i++) {
+				for(unsigned int j = 0; j < C; j++) {
+					result(i, j) = (*this)(i, j);
+				}
+			}
+
+			return result;
+		}
+
+		FixedMatrix& clear()
+		{
+			for(unsigned int i = 0; i < R * C; i++) {
+				data[i] = 0.0f;
+			}
+
+			return *this;
+		}
+
+		FixedMatrix& identity()
+		{
+			for(unsigned int i = 0; i < R; i++) {
+				for(unsigned int j = 0; j < C; j++) {
+					(*this)(i, j) = (i == j ? 1.0f : 0.0f);
+				}
+			}
+
+			return *this;
+		}
+
+		FixedMatrix<C, R> transpose() const
+		{
+			FixedMatrix<C, R> result;
+
+			for(unsigned int i = 0; i < R; i++) {
+				for(unsigned int j = 0; j < C; j++) {
+					result(j, i) = (*this)(i, j);
+				}
+			}
+
+			return result;
+		}
+
+		FixedMatrix operator+(const FixedMatrix& other) const
+		{
+			FixedMatrix result(*this);
+			return result += other;
+		}
+
+		FixedMatrix& operator+=(const FixedMatrix& other)
+		{
+			for(unsigned int i = 0; i < R * C; i++) {
+				data[i] += other.data[i];
+			}
+
+			return *this;
+		}
+
+		FixedMatrix operator-(const FixedMatrix& other) const
+		{
+			FixedMatrix result(*this);
+			return result -= other;
+		}
+
+		FixedMatrix& operator-=(const FixedMatrix& other)
+		{
+			for(unsigned int i = 0; i < R * C; i++) {
+				data[i] -= other.data[i];
+			}
+
+			return *this;
+		}
+
+		template<unsigned int K>
+		FixedMatrix<R, K> operator*(const FixedMatrix<C, K>& other) const
+		{
+			FixedMatrix<R, K> result;
+
+			for(unsigned int i = 0; i < R; i++) {
+				for(unsigned int j = 0; j < K; j++) {
+					float sum = 0.0f;
+					for(unsigned int k = 0; k < C; k++) {
+						sum += (*this)(i, k) * other(k, j);
+					}
+					result(i, j) = sum;
+				}
+			}
+
+			return result;
+		}
+
+		FixedMatrix& operator*=(const FixedMatrix& other)
+		{
+			assert(R == C);
+
+			return (*this) = (*this) * other;
+		}
+
+		FixedVector<R> operator*(const FixedVector<C>& vector) const
+		{
+			FixedVector<R> result;
+
+			for(unsigned int i = 0; i < R; i++) {
+				float sum = 0.0f;
+				for(unsigned int j = 0; j < C; j++) {
+					sum += (*this)(i, j) * vector[j];
+				}
+				result[i] = sum;
+			}
+
+			return result;
+		}
+
+		FixedMatrix operator*(float factor) const
+		{
+			FixedMatrix result(*this);
+			return result *= factor;
+		}
+
+		FixedMatrix& operator*=(float factor)
+		{
+			for(unsigned int i = 0; i < R * C; i++) {
+				data[i] *= factor;
+			}
+
+			return *this;
+		}
+
+		FixedMatrix operator/(float factor) const
+		{
+			FixedMatrix result(*this);
+			return result /= factor;
+		}
+
+		FixedMatrix& operator/=(float factor)
+		{
+			assert(factor != 0.0);
+
+			return (*this) *= 1.0f / factor;
+		}
+
+		bool operator==(const FixedMatrix& other) const
+		{
+			for(unsigned int i = 0; i < R * C; i++) {
+				if(data[i] != other.data[i]) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		float& operator()(unsigned int i, unsigned int j)
+		{
+			assert(i < R && j < C);
+			return data[i * C + j];
+		}
+
+		const float& operator()(unsigned int i, unsigned int j) const
+		{
+			assert(i < R && j < C);
+			return data[i * C + j];
+		}
+
+		unsigned int getRows() const
+		{
+			return R;
+		}
+
+		unsigned int getCols() const
+		{
+			return C;
+		}
+
+		float *getData()
+		{
+			return data;
+		}
+
+		const float *getData() const
+		{
+			return data;
+		}
+
+	private:
+		float data[R * C];
+};
+
+template<unsigned int R, unsigned int C>
+inline FixedMatrix<R, C> operator*(float factor, const FixedMatrix<R, C>& matrix)
+{
+	return matrix * factor;
+}
+
+template<unsigned int R, unsigned int C>
+inline std::ostream& operator<<(std::ostream& stream, const FixedMatrix<R, C>& matrix)
+{
+	stream << "[";
+
+	for(unsigned int i = 0; i < R; i++) {
+		if(i != 0) {
+			stream << " ";
+		}
+
+		for(unsigned int j = 0; j < C; j++) {
+			if(j != 0) {
+				stream << "\t";
+			}
+
+			stream << matrix(i, j);
+		}
+
+		if(i != R - 1) {
+			stream << std::endl;
+		}
+	}
+
+	return stream << "]" << std::endl;
+}
+
+typedef FixedMatrix<3, 3> FixedMatrix3;
+typedef FixedMatrix<4, 4> FixedMatrix4;
+
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINALG_FIXEDVECTOR_H
+#define LINALG_FIXEDVECTOR_H
+
+#include "Vector.h"
+
+#ifdef __cplusplus
+#include <iostream>
+#include <cassert>
+#include <cmath>
+
+/**
+ * Only defined for a true condition, so that the dimension checks of FixedVector fail to compile rather than at runtime if one of its
+ * dimension specific members is used with the wrong N
+ */
+template<bool condition>
+struct FixedVectorDimensionCheck;
+
+template<>
+struct FixedVectorDimensionCheck<true>
+{
+};
+
+/**
+ * Vector of a fixed size known at compile time. In contrast to Vector, its components are stored inline, so temporaries live on the stack
+ * and arithmetic never touches the heap. Use it in inner loops where the dimension is known.
+ */
+template<unsigned int N>
+class FixedVector
+{
+	public:
+		FixedVector()
+		{
+			clear();
+		}
+
+		FixedVector(float x, float y)
+		{
+			(void) sizeof(FixedVectorDimensionCheck<N == 2>);
+			data[0] = x;
+			data[1] = y;
+		}
+
+		FixedVector(float x, float y, float z)
+		{
+			(void) sizeof(FixedVectorDimensionCheck<N == 3>);
+			data[0] = x;
+			data[1] = y;
+			data[2] = z;
+		}
+
+		FixedVector(float x, float y, float z, float w)
+		{
+			(void) sizeof(FixedVectorDimensionCheck<N == 4>);
+			data[0] = x;
+			data[1] = y;
+			data[2] = z;
+			data[3] = w;
+		}
+
+		explicit FixedVector(const Vector& other)
+		{
+			assert(other.getSize() == N);
+
+			for(unsigned int i = 0; i < N; i++) {
+				data[i] = other[i];
+			}
+		}
+
+		Vector toVector() const
+		{
+			Vector result(N);
+
+			for(unsigned int i = 0; i < N; i++) {
+				result[i] = data[i];
+			}
+
+			return result;
+		}
+
+		FixedVector& clear()
+		{
+			for(unsigned int i = 0; i < N; i++) {
+				data[i] = 0.0f;
+			}
+
+			return *this;
+		}
+
+		FixedVector& normalize()
+		{
+			float length = getLength();
+
+			if(length == 0) {
+				return *this;
+			}
+
+			return (*this) /= length;
+		}
+
+		FixedVector& homogenize()
+		{
+			if(data[N - 1] == 0.0f) {
+				return *this;
+			}
+
+			return (*this) /= data[N - 1];
+		}
+
+		float getLength2() const
+		{
+			return (*this) * (*this);
+		}
+
+		float getLength() const
+		{
+			return std::sqrt(getLength2());
+		}
+
+		FixedVector operator+(const FixedVector& other) const
+		{
+			FixedVector result(*this);
+			return result += other;
+		}
+
+		FixedVector& operator+=(const FixedVector& other)
+		{
+			for(unsigned int i = 0; i < N; i++) {
+				data[i] += other[i];
+			}
+
+			return *this;
+		}
+
+		FixedVector operator-(const FixedVector& other) const
+		{
+			FixedVector result(*this);
+			return result -= other;
+		}
+
+		FixedVector& operator-=(const FixedVector& other)
+		{
+			for(unsigned int i = 0; i < N; i++) {
+				data[i] -= other[i];
+			}
+
+			return *this;
+		}
+
+		FixedVector operator-() const
+		{
+			FixedVector result(*this);
+			return result *= -1.0f;
+		}
+
+		float operator*(const FixedVector& other) const
+		{
+			float dot = 0.0f;
+
+			for(unsigned int i = 0; i < N; i++) {
+				dot += data[i] * other[i];
+			}
+
+			return dot;
+		}
+
+		FixedVector operator%(const FixedVector& other) const
+		{
+			(void) sizeof(FixedVectorDimensionCheck<N == 3>);
+
+			FixedVector result;
+			result[0] = data[1] * other[2] - data[2] * other[1];
+			result[1] = data[2] * other[0] - data[0] * other[2];
+			result[2] = data[0] * other[1] - data[1] * other[0];
+
+			return result;
+		}
+
+		FixedVector& operator%=(const FixedVector& other)
+		{
+			return (*this) = (*this) % other;
+		}
+
+		FixedVector operator*(float factor) const
+		{
+			FixedVector result(*this);
+			return result *= factor;
+		}
+
+		FixedVector& operator*=(float factor)
+		{
+			for(unsigned int i = 0; i < N; i++) {
+				data[i] *= factor;
+			}
+
+			return *this;
+		}
+
+		FixedVector operator/(float factor) const
+		{
+			FixedVector result(*this);
+			return result /= factor;
+		}
+
+		FixedVector& operator/=(float factor)
+		{
+			assert(factor != 0.0);
+
+			return (*this) *= 1.0f / factor;
+		}
+
+		bool operator==(const FixedVector& other) const
+		{
+			for(unsigned int i = 0; i < N; i++) {
+				if(data[i] != other[i]) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		float& operator[](unsigned int i)
+		{
+			assert(i < N);
+			return data[i];
+		}
+
+		const float& operator[](unsigned int i) const
+		{
+			assert(i < N);
+			return data[i];
+		}
+
+		unsigned int getSize() const
+		{
+			return N;
+		}
+
+		float *getData()
+		{
+			return data;
+		}
+
+		const float *getData() const
+		{
+			return data;
+		}
+
+	private:
+		float data[N];
+};
+
+template<unsigned int N>
+inline FixedVector<N> operator*(float factor, const FixedVector<N>& vector)
+{
+	return vector * factor;
+}
+
+template<unsigned int N>
+inline std::ostream& operator<<(std::ostream& stream, const FixedVector<N>& vector)
+{
+	stream << "[";
+
+	for(unsigned int i = 0; i < N; i++) {
+		if(i != 0) {
+			stream << "\t";
+		}
+
+		stream << vector[i];
+	}
+
+	return stream << "]";
+}
+
+typedef FixedVector<2> FixedVector2;
+typedef FixedVector<3> FixedVector3;
+typedef FixedVector<4> FixedVector4;
+
+#endif
+
+#endif
@@ -281,3 +281,21 @@ API float *getMatrixData(Matrix *matrix)
 {
 	return matrix->getData();
 }
+
+/**
+ * Transforms a batch of 3D points by a 4x4 matrix, using the fastest instruction set supported by the CPU. The points' w coordinate is
+ * assumed to be 1 and the matrix is assumed to be an affine transformation, i.e. its bottom row is ignored.
+ *
+ * @param matrix		the 4x4 matrix to transform the points with
+ * @param in			the first point to transform
+ * @param out			the location to write the first transformed point to, may be the same as in to transform the points in place
+ * @param n				the number of points to transform
+ * @param stride		the distance between two consecutive points in floats for both in and out, e.g. 3 for tightly packed points
+ */
+API void transformPoints(Matrix *matrix, const float *in, float *out, size_t n, unsigned int stride)
+{
+	assert(matrix->getRows() == 4 && matrix->getCols() == 4);
+	assert(stride >= 3);
+
+	transformPointsData(matrix->getData(), in, out, n, stride);
+}
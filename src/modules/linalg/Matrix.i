@@ -31,6 +31,7 @@ extern "C" {
 #endif
 
 #include "Vector.h"
+#include "simd.h"
 
 #ifdef __cplusplus
 #include <string>
@@ -38,30 +39,52 @@ extern "C" {
 #include <cassert>
 #include <cmath>
 
+/** Matrices with up to this many elements (i.e. up to 4x4) store them inline instead of allocating them on the heap */
+#define LINALG_MATRIX_INLINE_SIZE 16
+
 class Matrix
 {
 	public:
 		Matrix(unsigned int r, unsigned int c) :
 			rows(r), cols(c)
 		{
-			data = new float[rows * cols];
+			allocate();
 		}
 
 		Matrix(const Matrix& other) :
 			rows(other.getRows()), cols(other.getCols())
 		{
-			data = new float[rows * cols];
+			allocate();
 
-			for(unsigned int i = 0; i < rows; i++) {
-				for(unsigned int j = 0; j < cols; j++) {
-					(*this)(i, j) = other(i, j);
+			for(unsigned int i = 0; i < rows * cols; i++) {
+				data[i] = other.data[i];
+			}
+		}
+
+#if __cplusplus >= 201103L
+		Matrix(Matrix&& other) :
+			rows(other.getRows()), cols(other.getCols())
+		{
+			if(other.isInline()) {
+				data = inlineData;
+
+				for(unsigned int i = 0; i < rows * cols; i++) {
+					data[i] = other.data[i];
 				}
+			} else { // steal the other matrix's heap storage
+				data = other.data;
+				other.data = other.inlineData;
+				other.rows = 0;
+				other.cols = 0;
 			}
 		}
+#endif
 
 		~Matrix()
 		{
-			delete[] data;
+			if(!isInline()) {
+				delete[] data;
+			}
 		}
 
 		Matrix& operator=(const Matrix& from)
@@ -72,15 +95,29 @@ class Matrix
 
 			assert(rows == from.getRows() && cols == from.getCols());
 
-			for(unsigned int i = 0; i < rows; i++) {
-				for(unsigned int j = 0; j < cols; j++) {
-					(*this)(i, j) = from(i, j);
-				}
+			for(unsigned int i = 0; i < rows * cols; i++) {
+				data[i] = from.data[i];
 			}
 
 			return *this;
 		}
 
+#if __cplusplus >= 201103L
+		Matrix& operator=(Matrix&& from)
+		{
+			assert(rows == from.getRows() && cols == from.getCols());
+
+			if(!isInline() && !from.isInline()) { // swap heap storage, the other matrix frees ours
+				float *swap = data;
+				data = from.data;
+				from.data = swap;
+				return *this;
+			}
+
+			return (*this) = static_cast<const Matrix&>(from);
+		}
+#endif
+
 		Matrix& clear()
 		{
 			for(unsigned int i = 0; i < rows; i++) {
@@ -124,7 +161,7 @@ class Matrix
 		{
 			assert(rows == other.getRows() && cols == other.getCols());
 
-			Matrix result(cols, rows);
+			Matrix result(rows, cols);
 
 			for(unsigned int i = 0; i < rows; i++) {
 				for(unsigned int j = 0; j < cols; j++) {
@@ -152,7 +189,7 @@ class Matrix
 		{
 			assert(rows == other.getRows() && cols == other.getCols());
 
-			Matrix result(cols, rows);
+			Matrix result(rows, cols);
 
 			for(unsigned int i = 0; i < rows; i++) {
 				for(unsigned int j = 0; j < cols; j++) {
@@ -177,10 +214,29 @@ class Matrix
 		}
 
 		Matrix operator*(const Matrix& other) const
+		{
+			Matrix result(rows, other.getCols());
+			multiply(other, result);
+			return result;
+		}
+
+		/**
+		 * Multiplies this matrix with another one and writes the product into an existing matrix instead of creating a new one
+		 *
+		 * @param other			the matrix to multiply with from the right
+		 * @param result		the matrix to write the product to, must have matching dimensions and not be one of the factors
+		 * @result				the result matrix
+		 */
+		Matrix& multiply(const Matrix& other, Matrix& result) const
 		{
 			assert(cols == other.getRows());
+			assert(result.getRows() == rows && result.getCols() == other.getCols());
+			assert(&result != this && &result != &other);
 
-			Matrix result(rows, other.getCols());
+			if(rows == 4 && cols == 4 && other.getCols() == 4) {
+				multiplyMatrix4Data(data, other.data, result.data);
+				return result;
+			}
 
 			for(unsigned int i = 0; i < rows; i++) {
 				for(unsigned int j = 0; j < other.getCols(); j++) {
@@ -202,11 +258,32 @@ class Matrix
 			return (*this) = (*this) * other;
 		}
 
-		Vector operator*(Vector vector) const
+		Vector operator*(const Vector& vector) const
+		{
+			Vector result(rows);
+			multiply(vector, result);
+			return result;
+		}
+
+		/**
+		 * Multiplies this matrix with a vector and writes the product into an existing vector instead of creating a new one. If the vector has
+		 * less elements than the matrix has columns, all missing elements are assumed to be 1.
+		 *
+		 * @param vector		the vector to multiply
+		 * @param result		the vector to write the product to, must have as many elements as the matrix has rows and not be the multiplied vector
+		 * @result				the result vector
+		 */
+		Vector& multiply(const Vector& vector, Vector& result) const
 		{
 			assert(cols >= vector.getSize());
+			assert(result.getSize() == rows);
+			assert(&result != &vector);
 
-			Vector result(rows);
+			if(rows == 4 && cols == 4 && vector.getSize() >= 3) {
+				float padded[4] = {vector[0], vector[1], vector[2], vector.getSize() == 4 ? vector[3] : 1.0f};
+				multiplyMatrix4VectorData(data, padded, result.getData());
+				return result;
+			}
 
 			for(unsigned int i = 0; i < rows; i++) {
 				result[i] = 0.0;
@@ -316,10 +393,37 @@ class Matrix
 			return data;
 		}
 
+		bool isInline() const
+		{
+			return data == inlineData;
+		}
+
+		static void *operator new(size_t bytes)
+		{
+			countLinalgAllocation();
+			return ::operator new(bytes);
+		}
+
+		static void operator delete(void *matrix)
+		{
+			::operator delete(matrix);
+		}
+
 	private:
+		void allocate()
+		{
+			if(rows * cols <= LINALG_MATRIX_INLINE_SIZE) {
+				data = inlineData;
+			} else {
+				countLinalgAllocation();
+				data = new float[rows * cols];
+			}
+		}
+
 		unsigned int rows;
 		unsigned int cols;
 		float *data;
+		float inlineData[LINALG_MATRIX_INLINE_SIZE];
 };
 
 inline Matrix operator*(float factor, const Matrix& matrix)
@@ -382,6 +486,7 @@ API unsigned int getMatrixRows(Matrix *matrix);
 API unsigned int getMatrixCols(Matrix *matrix);
 API GString *dumpMatrix(Matrix *matrix);
 API float *getMatrixData(Matrix *matrix);
+API void transformPoints(Matrix *matrix, const float *in, float *out, size_t n, unsigned int stride);
 
 #ifdef __cplusplus
 }
@@ -31,6 +31,29 @@ extern "C" {
 #define API
 #include "Vector.h"
 
+/** The number of heap allocations made by dynamic vectors and matrices so far */
+static volatile gsize allocations = 0;
+
+/**
+ * Records a heap allocation made by a dynamic vector or matrix, i.e. of the object itself or of its non-inline element storage
+ */
+API void countLinalgAllocation()
+{
+	g_atomic_pointer_add(&allocations, 1);
+}
+
+/**
+ * Returns the number of heap allocations made by dynamic vectors and matrices since the linalg module was loaded. Fixed size vectors and
+ * matrices never allocate and are therefore not counted, so comparing this value before and after a computation tells how many dynamic
+ * linear algebra objects it created.
+ *
+ * @result			the number of heap allocations made by dynamic vectors and matrices
+ */
+API unsigned long getLinalgAllocations()
+{
+	return (unsigned long) (gsize) g_atomic_pointer_get(&allocations);
+}
+
 /**
  * Creates a vector
  *
@@ -25,6 +25,9 @@
 extern "C" {
 #endif
 #include <glib.h>
+
+API void countLinalgAllocation();
+API unsigned long getLinalgAllocations();
 #ifdef __cplusplus
 }
 #endif
@@ -36,28 +39,51 @@ extern "C" {
 #include <cassert>
 #include <cmath>
 
+/** Vectors with up to this many elements store them inline instead of allocating them on the heap */
+#define LINALG_VECTOR_INLINE_SIZE 4
+
 class Vector
 {
 	public:
 		Vector(unsigned int n) :
 			size(n)
 		{
-			data = new float[size];
+			allocate();
 		}
 
 		Vector(const Vector& other) :
 			size(other.getSize())
 		{
-			data = new float[size];
+			allocate();
 
 			for(unsigned int i = 0; i < size; i++) {
 				data[i] = other[i];
 			}
 		}
 
+#if __cplusplus >= 201103L
+		Vector(Vector&& other) :
+			size(other.getSize())
+		{
+			if(other.isInline()) {
+				data = inlineData;
+
+				for(unsigned int i = 0; i < size; i++) {
+					data[i] = other[i];
+				}
+			} else { // steal the other vector's heap storage
+				data = other.data;
+				other.data = other.inlineData;
+				other.size = 0;
+			}
+		}
+#endif
+
 		~Vector()
 		{
-			delete[] data;
+			if(!isInline()) {
+				delete[] data;
+			}
 		}
 
 		Vector& operator=(const Vector& from)
@@ -73,6 +99,20 @@ class Vector
 			return *this;
 		}
 
+#if __cplusplus >= 201103L
+		Vector& operator=(Vector&& from)
+		{
+			if(size == from.getSize() && !isInline() && !from.isInline()) { // swap heap storage, the other vector frees ours
+				float *swap = data;
+				data = from.data;
+				from.data = swap;
+				return *this;
+			}
+
+			return (*this) = static_cast<const Vector&>(from);
+		}
+#endif
+
 		Vector& clear()
 		{
 			for(unsigned int i = 0; i < size; i++) {
@@ -197,10 +237,30 @@ class Vector
 		{
 			assert(size == 3 && size == other.getSize());
 
-			Vector result = *this % other;
-			data[0] = result[0];
-			data[1] = result[1];
-			data[2] = result[2];
+			float x = data[1] * other[2] - data[2] * other[1];
+			float y = data[2] * other[0] - data[0] * other[2];
+			float z = data[0] * other[1] - data[1] * other[0];
+			data[0] = x;
+			data[1] = y;
+			data[2] = z;
+
+			return *this;
+		}
+
+		/**
+		 * Adds a scaled vector to this one without creating a temporary for the scaled vector, i.e. a fused version of "*this += factor * other"
+		 *
+		 * @param other			the vector to scale and add
+		 * @param factor		the factor by which to scale the other vector
+		 * @result				this vector
+		 */
+		Vector& addScaled(const Vector& other, float factor)
+		{
+			assert(size == other.getSize());
+
+			for(unsigned int i = 0; i < size; i++) {
+				data[i] += factor * other[i];
+			}
 
 			return *this;
 		}
@@ -218,8 +278,6 @@ class Vector
 
 		Vector& operator*=(float factor)
 		{
-			Vector result = Vector(size);
-
 			for(unsigned int i = 0; i < size; i++) {
 				data[i] *= factor;
 			}
@@ -227,9 +285,9 @@ class Vector
 			return *this;
 		}
 
-		Vector& operator-()
+		Vector operator-() const
 		{
-			return *this *= -1;
+			return (*this) * -1.0f;
 		}
 
 		Vector operator/(float factor) const
@@ -249,8 +307,6 @@ class Vector
 		{
 			assert(factor != 0.0);
 
-			Vector result = Vector(size);
-
 			for(unsigned int i = 0; i < size; i++) {
 				data[i] /= factor;
 			}
@@ -293,9 +349,36 @@ class Vector
 			return data;
 		}
 
+		bool isInline() const
+		{
+			return data == inlineData;
+		}
+
+		static void *operator new(size_t bytes)
+		{
+			countLinalgAllocation();
+			return ::operator new(bytes);
+		}
+
+		static void operator delete(void *vector)
+		{
+			::operator delete(vector);
+		}
+
 	private:
+		void allocate()
+		{
+			if(size <= LINALG_VECTOR_INLINE_SIZE) {
+				data = inlineData;
+			} else {
+				countLinalgAllocation();
+				data = new float[size];
+			}
+		}
+
 		unsigned int size;
 		float *data;
+		float inlineData[LINALG_VECTOR_INLINE_SIZE];
 };
 
 inline Vector operator*(float factor, const Vector& vector)
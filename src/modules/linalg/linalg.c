@@ -33,8 +33,8 @@
 MODULE_NAME("linalg");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Basic linear algebra module providing matrix and vector classes");
-MODULE_VERSION(0, 3, 5);
-MODULE_BCVERSION(0, 2, 3);
+MODULE_VERSION(0, 8, 1);
+MODULE_BCVERSION(0, 5, 0);
 MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 11));
 
 MODULE_INIT
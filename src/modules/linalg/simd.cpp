@@ -0,0 +1,331 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+extern "C" {
+#include <glib.h>
+}
+
+#include "dll.h"
+#define API
+#include "simd.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+// AVX isn't part of the default build flags, so the AVX kernels are compiled separately and only picked at runtime if the CPU supports them
+#define LINALG_SIMD_DISPATCH_AVX
+#include <immintrin.h>
+#endif
+
+typedef void (TransformPointsKernel)(const float *matrix, const float *in, float *out, size_t n, unsigned int stride);
+
+static TransformPointsKernelType detectTransformPointsKernel();
+static TransformPointsKernel *lookupTransformPointsKernel(TransformPointsKernelType type);
+static void transformPointsScalar(const float *matrix, const float *in, float *out, size_t n, unsigned int stride);
+#ifdef __SSE2__
+static void transformPointsSSE(const float *matrix, const float *in, float *out, size_t n, unsigned int stride);
+static inline void storePoint(float *out, __m128 point);
+#endif
+#ifdef LINALG_SIMD_DISPATCH_AVX
+static void transformPointsAVX(const float *matrix, const float *in, float *out, size_t n, unsigned int stride) __attribute__((target("avx")));
+#endif
+
+/** The TransformPointsKernelType transformPointsData currently runs on, LINALG_TRANSFORM_POINTS_AUTO until it is determined on first use */
+static gint transformPointsKernel = LINALG_TRANSFORM_POINTS_AUTO;
+
+/**
+ * Multiplies two row-major 4x4 matrices
+ *
+ * @param a				the left factor
+ * @param b				the right factor
+ * @param result		the 16 floats to write the product to, must not overlap with one of the factors
+ */
+API void multiplyMatrix4Data(const float *a, const float *b, float *result)
+{
+#ifdef __SSE2__
+	__m128 b0 = _mm_loadu_ps(b);
+	__m128 b1 = _mm_loadu_ps(b + 4);
+	__m128 b2 = _mm_loadu_ps(b + 8);
+	__m128 b3 = _mm_loadu_ps(b + 12);
+
+	// every row of the result is a linear combination of the rows of b
+	for(unsigned int i = 0; i < 4; i++) {
+		const float *row = a + 4 * i;
+		__m128 sum = _mm_mul_ps(_mm_set1_ps(row[0]), b0);
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[1]), b1));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[2]), b2));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(row[3]), b3));
+		_mm_storeu_ps(result + 4 * i, sum);
+	}
+#else
+	for(unsigned int i = 0; i < 4; i++) {
+		for(unsigned int j = 0; j < 4; j++) {
+			float sum = 0.0f;
+			for(unsigned int k = 0; k < 4; k++) {
+				sum += a[4 * i + k] * b[4 * k + j];
+			}
+			result[4 * i + j] = sum;
+		}
+	}
+#endif
+}
+
+/**
+ * Multiplies a row-major 4x4 matrix with a 4-vector
+ *
+ * @param matrix		the matrix to multiply
+ * @param vector		the vector to multiply
+ * @param result		the 4 floats to write the product to, must not overlap with the vector
+ */
+API void multiplyMatrix4VectorData(const float *matrix, const float *vector, float *result)
+{
+#ifdef __SSE2__
+	__m128 v = _mm_loadu_ps(vector);
+	__m128 p0 = _mm_mul_ps(_mm_loadu_ps(matrix), v);
+	__m128 p1 = _mm_mul_ps(_mm_loadu_ps(matrix + 4), v);
+	__m128 p2 = _mm_mul_ps(_mm_loadu_ps(matrix + 8), v);
+	__m128 p3 = _mm_mul_ps(_mm_loadu_ps(matrix + 12), v);
+
+	// transpose the row products so that adding them up yields all four dot products at once
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	_mm_storeu_ps(result, _mm_add_ps(_mm_add_ps(p0, p1), _mm_add_ps(p2, p3)));
+#else
+	for(unsigned int i = 0; i < 4; i++) {
+		result[i] = matrix[4 * i] * vector[0] + matrix[4 * i + 1] * vector[1] + matrix[4 * i + 2] * vector[2] + matrix[4 * i + 3] * vector[3];
+	}
+#endif
+}
+
+/**
+ * Transforms a batch of 3D points by a row-major 4x4 matrix. The points' w coordinate is assumed to be 1 and the matrix is assumed to be an
+ * affine transformation, i.e. its bottom row is ignored. The points may be embedded in an array of larger vertex records.
+ *
+ * @param matrix		the matrix to transform the points with
+ * @param in			the first point to transform
+ * @param out			the location to write the first transformed point to, may be the same as in to transform the points in place
+ * @param n				the number of points to transform
+ * @param stride		the distance between two consecutive points in floats for both in and out, at least 3
+ */
+API void transformPointsData(const float *matrix, const float *in, float *out, size_t n, unsigned int stride)
+{
+	TransformPointsKernelType type = (TransformPointsKernelType) g_atomic_int_get(&transformPointsKernel);
+
+	if(type == LINALG_TRANSFORM_POINTS_AUTO) {
+		type = detectTransformPointsKernel();
+		// don't overwrite a kernel forced by setTransformPointsKernel in the meantime
+		if(!g_atomic_int_compare_and_exchange(&transformPointsKernel, LINALG_TRANSFORM_POINTS_AUTO, type)) {
+			type = (TransformPointsKernelType) g_atomic_int_get(&transformPointsKernel);
+		}
+	}
+
+	lookupTransformPointsKernel(type)(matrix, in, out, n, stride);
+}
+
+/**
+ * Forces transformPointsData to run on a specific kernel, e.g. to compare the kernels against each other
+ *
+ * @param type			the kernel to run on, or LINALG_TRANSFORM_POINTS_AUTO to go back to the best one for the CPU we're running on
+ * @result				true if successful, false if the kernel isn't available in this build or on this CPU
+ */
+API bool setTransformPointsKernel(TransformPointsKernelType type)
+{
+	if(type == LINALG_TRANSFORM_POINTS_AUTO) {
+		type = detectTransformPointsKernel();
+	} else if(lookupTransformPointsKernel(type) == NULL) {
+		return false;
+	}
+
+	g_atomic_int_set(&transformPointsKernel, type);
+	return true;
+}
+
+/**
+ * Returns the kernel transformPointsData runs on
+ *
+ * @result				the kernel transformPointsData runs on
+ */
+API TransformPointsKernelType getTransformPointsKernel()
+{
+	TransformPointsKernelType type = (TransformPointsKernelType) g_atomic_int_get(&transformPointsKernel);
+
+	if(type == LINALG_TRANSFORM_POINTS_AUTO) {
+		return detectTransformPointsKernel();
+	}
+
+	return type;
+}
+
+/**
+ * Determines the best transformPointsData kernel for the CPU we're running on
+ *
+ * @result				the best kernel available
+ */
+static TransformPointsKernelType detectTransformPointsKernel()
+{
+#ifdef LINALG_SIMD_DISPATCH_AVX
+	if(__builtin_cpu_supports("avx")) {
+		return LINALG_TRANSFORM_POINTS_AVX;
+	}
+#endif
+
+#ifdef __SSE2__
+	return LINALG_TRANSFORM_POINTS_SSE;
+#else
+	return LINALG_TRANSFORM_POINTS_SCALAR;
+#endif
+}
+
+/**
+ * Looks up the function implementing a transformPointsData kernel
+ *
+ * @param type			the kernel to look up, must not be LINALG_TRANSFORM_POINTS_AUTO
+ * @result				the kernel function or NULL if the kernel isn't available in this build or on this CPU
+ */
+static TransformPointsKernel *lookupTransformPointsKernel(TransformPointsKernelType type)
+{
+	switch(type) {
+		case LINALG_TRANSFORM_POINTS_SCALAR:
+			return &transformPointsScalar;
+#ifdef __SSE2__
+		case LINALG_TRANSFORM_POINTS_SSE:
+			return &transformPointsSSE;
+#endif
+#ifdef LINALG_SIMD_DISPATCH_AVX
+		case LINALG_TRANSFORM_POINTS_AVX:
+			if(__builtin_cpu_supports("avx")) {
+				return &transformPointsAVX;
+			}
+			return NULL;
+#endif
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Portable transformPointsData kernel
+ *
+ * @param matrix		the matrix to transform the points with
+ * @param in			the first point to transform
+ * @param out			the location to write the first transformed point to
+ * @param n				the number of points to transform
+ * @param stride		the distance between two consecutive points in floats
+ */
+static void transformPointsScalar(const float *matrix, const float *in, float *out, size_t n, unsigned int stride)
+{
+	for(size_t i = 0; i < n; i++, in += stride, out += stride) {
+		float x = in[0];
+		float y = in[1];
+		float z = in[2];
+
+		for(unsigned int k = 0; k < 3; k++) {
+			const float *row = matrix + 4 * k;
+			out[k] = row[0] * x + row[1] * y + row[2] * z + row[3];
+		}
+	}
+}
+
+#ifdef __SSE2__
+/**
+ * SSE2 transformPointsData kernel computing every point as a linear combination of the matrix columns
+ *
+ * @param matrix		the matrix to transform the points with
+ * @param in			the first point to transform
+ * @param out			the location to write the first transformed point to
+ * @param n				the number of points to transform
+ * @param stride		the distance between two consecutive points in floats
+ */
+static void transformPointsSSE(const float *matrix, const float *in, float *out, size_t n, unsigned int stride)
+{
+	__m128 c0 = _mm_loadu_ps(matrix);
+	__m128 c1 = _mm_loadu_ps(matrix + 4);
+	__m128 c2 = _mm_loadu_ps(matrix + 8);
+	__m128 c3 = _mm_loadu_ps(matrix + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	for(size_t i = 0; i < n; i++, in += stride, out += stride) {
+		__m128 point = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[0])), c3);
+		point = _mm_add_ps(point, _mm_mul_ps(c1, _mm_set1_ps(in[1])));
+		point = _mm_add_ps(point, _mm_mul_ps(c2, _mm_set1_ps(in[2])));
+		storePoint(out, point);
+	}
+}
+
+/**
+ * Stores the first three components of a point. Storing all four would overwrite the next point if they are tightly packed.
+ *
+ * @param out			the location to store the point to
+ * @param point			the point to store
+ */
+static inline void storePoint(float *out, __m128 point)
+{
+	_mm_storel_pi((__m64 *) out, point);
+	_mm_store_ss(out + 2, _mm_movehl_ps(point, point));
+}
+#endif
+
+#ifdef LINALG_SIMD_DISPATCH_AVX
+/**
+ * AVX transformPointsData kernel that works like the SSE2 one, but transforms two points per iteration
+ *
+ * @param matrix		the matrix to transform the points with
+ * @param in			the first point to transform
+ * @param out			the location to write the first transformed point to
+ * @param n				the number of points to transform
+ * @param stride		the distance between two consecutive points in floats
+ */
+static void transformPointsAVX(const float *matrix, const float *in, float *out, size_t n, unsigned int stride)
+{
+	__m128 c0 = _mm_loadu_ps(matrix);
+	__m128 c1 = _mm_loadu_ps(matrix + 4);
+	__m128 c2 = _mm_loadu_ps(matrix + 8);
+	__m128 c3 = _mm_loadu_ps(matrix + 12);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+	// both 128 bit lanes hold the same column, the low lane transforms the first point and the high lane the second one
+	__m256 d0 = _mm256_insertf128_ps(_mm256_castps128_ps256(c0), c0, 1);
+	__m256 d1 = _mm256_insertf128_ps(_mm256_castps128_ps256(c1), c1, 1);
+	__m256 d2 = _mm256_insertf128_ps(_mm256_castps128_ps256(c2), c2, 1);
+	__m256 d3 = _mm256_insertf128_ps(_mm256_castps128_ps256(c3), c3, 1);
+
+	size_t i = 0;
+	for(; i + 1 < n; i += 2, in += 2 * stride, out += 2 * stride) {
+		const float *next = in + stride;
+		__m256 x = _mm256_setr_ps(in[0], in[0], in[0], in[0], next[0], next[0], next[0], next[0]);
+		__m256 y = _mm256_setr_ps(in[1], in[1], in[1], in[1], next[1], next[1], next[1], next[1]);
+		__m256 z = _mm256_setr_ps(in[2], in[2], in[2], in[2], next[2], next[2], next[2], next[2]);
+
+		__m256 points = _mm256_add_ps(_mm256_mul_ps(d0, x), d3);
+		points = _mm256_add_ps(points, _mm256_mul_ps(d1, y));
+		points = _mm256_add_ps(points, _mm256_mul_ps(d2, z));
+
+		storePoint(out, _mm256_castps256_ps128(points));
+		storePoint(out + stride, _mm256_extractf128_ps(points, 1));
+	}
+
+	if(i < n) {
+		transformPointsSSE(matrix, in, out, 1, stride);
+	}
+
+	_mm256_zeroupper();
+}
+#endif
@@ -0,0 +1,55 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LINALG_SIMD_H
+#define LINALG_SIMD_H
+
+#include <stddef.h>
+#include "types.h"
+
+/**
+ * Enum of the kernels transformPointsData can run on
+ */
+typedef enum {
+	/** the best kernel supported by the CPU we're running on */
+	LINALG_TRANSFORM_POINTS_AUTO,
+	/** the portable kernel */
+	LINALG_TRANSFORM_POINTS_SCALAR,
+	/** the SSE2 kernel, only available if linalg was built with SSE2 support */
+	LINALG_TRANSFORM_POINTS_SSE,
+	/** the AVX kernel, only available on x86 CPUs supporting AVX */
+	LINALG_TRANSFORM_POINTS_AVX
+} TransformPointsKernelType;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+API void multiplyMatrix4Data(const float *a, const float *b, float *result);
+API void multiplyMatrix4VectorData(const float *matrix, const float *vector, float *result);
+API void transformPointsData(const float *matrix, const float *in, float *out, size_t n, unsigned int stride);
+API bool setTransformPointsKernel(TransformPointsKernelType type);
+API TransformPointsKernelType getTransformPointsKernel();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -110,7 +110,7 @@ API void updateLookIntoDirectionMatrix(Matrix *target, Vector *eye, Vector *f, V
 	transform(2, 2) = -(*f)[2];
 
 	// Create look at matrix
-	*target = transform * shift;
+	transform.multiply(shift, *target);
 }
 
 /**
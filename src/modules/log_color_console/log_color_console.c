@@ -32,6 +32,7 @@
 #include "module.h"
 #include "modules/config/config.h"
 #include "modules/event/event.h"
+#include "modules/log_event/log_event.h"
 
 #include "log.h"
 #define API
@@ -39,9 +40,9 @@
 MODULE_NAME("log_color_console");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Kalisko console log provider with colored output.");
-MODULE_VERSION(0, 3, 2);
+MODULE_VERSION(0, 3, 3);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 1, 1));
+MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 2, 0));
 
 #ifdef WIN32
 	typedef int ColorCode;
@@ -92,6 +93,7 @@ static ColorCode traceColor = STD_TRACE_COLOR;
 
 MODULE_INIT
 {
+	$(void, log_event, addLogListenerLevels)(LOG_LEVEL_ALL);
 	$(void, event, attachEventListener)(NULL, "log", NULL, &listener_log);
 	$(void, event, attachEventListener)(NULL, "reloadedConfig", NULL, &listener_reloadedConfig);
 
@@ -103,6 +105,7 @@ MODULE_INIT
 MODULE_FINALIZE
 {
 	$(void, event, detachEventListener)(NULL, "log", NULL, &listener_log);
+	$(void, log_event, removeLogListenerLevels)(LOG_LEVEL_ALL);
 	$(void, event, detachEventListener)(NULL, "reloadedConfig", NULL, &listener_reloadedConfig);
 }
 
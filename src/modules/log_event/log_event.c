@@ -20,6 +20,7 @@
 
 
 #include <glib.h>
+#include <string.h>
 
 #include "dll.h"
 #include "log.h"
@@ -27,19 +28,28 @@
 #include "modules/event/event.h"
 
 #define API
+#include "log_event.h"
+
+/** The number of log levels that listeners can declare interest in */
+#define LOG_EVENT_LEVELS 5
 
 MODULE_NAME("log_event");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The log_event module provides access to the Kalisko log system using a global event that clients can attach to");
-MODULE_VERSION(0, 1, 3);
+MODULE_VERSION(0, 2, 0);
 MODULE_BCVERSION(0, 1, 0);
 MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 2, 0));
 
 static void listener_attached(void *subject, const char *event, void *data, va_list args);
 static void listener_detached(void *subject, const char *event, void *data, va_list args);
 static void eventLogHandler(const char *module, LogLevel level, const char *message);
+static void updateLogLevels();
 
 static int count = 0;
+/** The number of listeners that declared the log levels they're interested in */
+static int declared = 0;
+/** For each log level, the number of listeners that declared interest in it */
+static int levelListeners[LOG_EVENT_LEVELS];
 
 MODULE_INIT
 {
@@ -47,6 +57,8 @@ MODULE_INIT
 	$(void, event, attachEventListener)(NULL, "listener_detached", NULL, &listener_detached);
 
 	count = $(int, event, getEventListenerCount)(NULL, "log");
+	declared = 0;
+	memset(levelListeners, 0, sizeof(levelListeners));
 
 	if(count > 0) {
 		$$(void, setLogHandler)(&eventLogHandler); // set log handler
@@ -78,6 +90,7 @@ static void listener_attached(void *subject, const char *event, void *data, va_l
 		}
 
 		count++;
+		updateLogLevels();
 	}
 }
 
@@ -92,7 +105,56 @@ static void listener_detached(void *subject, const char *event, void *data, va_l
 		}
 
 		count--;
+		updateLogLevels();
+	}
+}
+
+API void addLogListenerLevels(LogLevel levels)
+{
+	for(int i = 0; i < LOG_EVENT_LEVELS; i++) {
+		if(levels & (1 << i)) {
+			levelListeners[i]++;
+		}
+	}
+
+	declared++;
+	updateLogLevels();
+}
+
+API void removeLogListenerLevels(LogLevel levels)
+{
+	for(int i = 0; i < LOG_EVENT_LEVELS; i++) {
+		if(levels & (1 << i)) {
+			levelListeners[i]--;
+		}
 	}
+
+	declared--;
+	updateLogLevels();
+}
+
+/**
+ * Tells the core log system which log levels the attached log listeners are interested in, so it can discard all other messages early
+ */
+static void updateLogLevels()
+{
+	if(count == 0) {
+		return; // the default log handler is in use
+	}
+
+	LogLevel levels = LOG_LEVEL_NONE;
+
+	if(count > declared) { // some listener didn't tell us what it wants, so it gets everything
+		levels = LOG_LEVEL_ALL;
+	} else {
+		for(int i = 0; i < LOG_EVENT_LEVELS; i++) {
+			if(levelListeners[i] > 0) {
+				levels |= 1 << i;
+			}
+		}
+	}
+
+	$$(void, setLogHandlerLevels)(levels);
 }
 
 /**
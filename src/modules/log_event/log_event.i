@@ -0,0 +1,42 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2009, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef LOG_EVENT_LOG_EVENT_H
+#define LOG_EVENT_LOG_EVENT_H
+
+#include "log.h"
+
+/**
+ * Declares that a listener of the global "log" event is only interested in the given log levels. As long as every log listener declared its
+ * levels, messages of levels no listener is interested in are discarded before they are formatted. Listeners that don't declare their levels
+ * receive all messages. Call this when attaching your log listener and removeLogListenerLevels with the same levels when detaching it.
+ *
+ * @param levels		a bitmask of the log levels the listener is interested in
+ */
+API void addLogListenerLevels(LogLevel levels);
+
+/**
+ * Revokes a declaration previously made with addLogListenerLevels
+ *
+ * @param levels		the bitmask of log levels that was passed to addLogListenerLevels
+ */
+API void removeLogListenerLevels(LogLevel levels);
+
+#endif
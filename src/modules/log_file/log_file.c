@@ -19,8 +19,10 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "dll.h"
 #include "log.h"
@@ -28,7 +30,9 @@
 #include "memory_alloc.h"
 #include "util.h"
 #include "modules/config/config.h"
+#include "modules/store/store.h"
 #include "modules/event/event.h"
+#include "modules/log_event/log_event.h"
 
 #define API
 #include "log_file.h"
@@ -36,6 +40,8 @@
 #define LOG_FILES_CONFIG_PATH "kalisko/logfiles"
 #define LOG_FILES_CONFIG_FILEPATH_KEY "filepath"
 #define LOG_FILES_CONFIG_LOGTYPE_KEY "logtype"
+#define LOG_FILES_CONFIG_MAXSIZE_KEY "maxsize"
+#define LOG_FILES_CONFIG_ROTATIONS_KEY "rotations"
 
 #define LOG_FILES_LOGTYPE_TRACE "trace"
 #define LOG_FILES_LOGTYPE_INFO "info"
@@ -45,25 +51,110 @@
 
 #define LOGFILE_DIR_PERMISSION 0700
 
+/** The number of records the log queue can hold, must be a power of two */
+#define LOG_FILE_QUEUE_SIZE 4096
+/** The size of the inline text buffer of a log record, longer messages are allocated separately */
+#define LOG_FILE_RECORD_SIZE 256
+/** The buffer size of each log file stream */
+#define LOG_FILE_BUFFER_SIZE 65536
+/** The number of unflushed bytes after which the log files are flushed */
+#define LOG_FILE_FLUSH_BYTES 32768
+/** The time in microseconds after which unflushed log lines are flushed */
+#define LOG_FILE_FLUSH_INTERVAL 100000
+/** The time in microseconds to wait before trying to open a log file again that couldn't be opened */
+#define LOG_FILE_RETRY_INTERVAL G_USEC_PER_SEC
+
+/**
+ * A preformatted log line waiting in the log queue
+ */
+typedef struct {
+	/** the sequence number of the slot used to synchronize producers and the writer */
+	volatile gint sequence;
+	/** the wall clock time in seconds when the message was logged */
+	gint64 time;
+	/** the log level of the message */
+	LogLevel level;
+	/** the formatted message if it didn't fit into text, or NULL */
+	char *overflow;
+	/** the formatted message "[module:level] message" */
+	char text[LOG_FILE_RECORD_SIZE];
+} LogFileRecord;
+
 static void listener_log(void *subject, const char *event, void *data, va_list args);
 static void finalize();
-
+static gpointer runLogWriter(gpointer data);
+static bool dequeueLogRecord(LogFileRecord *record);
+static void writeLogLine(LogLevel level, const char *timestamp, const char *text, int length);
+static void writeLogFileLine(LogFileConfig *logFile, const char *timestamp, const char *text, int length);
+static bool openLogFile(LogFileConfig *logFile);
+static void rotateLogFile(LogFileConfig *logFile);
+static void flushLogFiles();
+static void updateMinimumLogLevel();
+
+/** The list of log files, protected by filesMutex */
 static GList *logFiles = NULL;
+static GMutex filesMutex;
+
+/** The bounded multi producer, single consumer ring of log records */
+static LogFileRecord *queue = NULL;
+static volatile gint enqueuePosition = 0;
+static gint dequeuePosition = 0;
+/** The number of messages dropped because the queue was full */
+static volatile gint dropped = 0;
+/** Paths of log files that failed to open and still need to be reported. Only accessed by the writer thread with the files mutex held. */
+static GQueue *openFailures = NULL;
+/** The lowest log level of any log file, messages below it aren't queued at all */
+static volatile gint minimumLevel = LOG_LEVEL_ALL + 1;
+/** The log levels we declared interest in to the log_event module */
+static LogLevel listenerLevels = LOG_LEVEL_NONE;
+
+static GThread *writer = NULL;
+static GMutex writerMutex;
+static GCond writerCondition;
+/** 1 if the writer thread is waiting for new records and needs to be woken up */
+static volatile gint writerSleeping = 0;
+/** 1 if the writer thread should exit after draining the queue */
+static volatile gint writerStop = 0;
+
+/** The number of bytes written since the last flush, only accessed by the writer thread */
+static unsigned long unflushedBytes = 0;
 
 MODULE_NAME("log_file");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("This log provider writes log messages to a user-defined file from the standard config");
-MODULE_VERSION(0, 3, 0);
+MODULE_VERSION(0, 4, 2);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 1, 1));
+MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3), MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 2, 0));
 
 MODULE_INIT
 {
+	g_mutex_init(&filesMutex);
+	g_mutex_init(&writerMutex);
+	g_cond_init(&writerCondition);
+
+	queue = ALLOCATE_OBJECTS(LogFileRecord, LOG_FILE_QUEUE_SIZE);
+	for(int i = 0; i < LOG_FILE_QUEUE_SIZE; i++) {
+		queue[i].sequence = i;
+		queue[i].overflow = NULL;
+	}
+	enqueuePosition = 0;
+	dequeuePosition = 0;
+	dropped = 0;
+	openFailures = g_queue_new();
+	writerStop = 0;
+	writerSleeping = 0;
+	minimumLevel = LOG_LEVEL_ALL + 1;
+	listenerLevels = LOG_LEVEL_NONE;
+	$(void, log_event, addLogListenerLevels)(listenerLevels);
+
 	// Go trough the standard configuration files and search for log file settings
 	Store *configFiles = $(Store *, config, getConfigPath)(LOG_FILES_CONFIG_PATH);
 	if(configFiles != NULL) {
 		if(configFiles->type != STORE_LIST) {
 			logWarning("Found log files configuration but it is not a list and can not be processed");
+			$(void, log_event, removeLogListenerLevels)(listenerLevels);
+			free(queue);
+			queue = NULL;
 			return false;
 		}
 		for(int i = 0; i < configFiles->content.list->length; i++) {
@@ -72,6 +163,8 @@ MODULE_INIT
 				GHashTable *settings = fileConfig->content.array;
 				Store *filePath = g_hash_table_lookup(settings, LOG_FILES_CONFIG_FILEPATH_KEY);
 				Store *logType = g_hash_table_lookup(settings, LOG_FILES_CONFIG_LOGTYPE_KEY);
+				Store *maxSize = g_hash_table_lookup(settings, LOG_FILES_CONFIG_MAXSIZE_KEY);
+				Store *rotations = g_hash_table_lookup(settings, LOG_FILES_CONFIG_ROTATIONS_KEY);
 
 				if(filePath == NULL) {
 					logWarning("The filepath is not set in the configuration. Ignoring log file");
@@ -106,13 +199,32 @@ MODULE_INIT
 					continue;
 				}
 
-				addLogFile(filePath->content.string, level);
+				LogFileConfig *logFile = addLogFile(filePath->content.string, level);
+
+				if(logFile != NULL && maxSize != NULL) {
+					if(maxSize->type == STORE_INTEGER && maxSize->content.integer >= 0) {
+						unsigned int keep = 1;
+						if(rotations != NULL) {
+							if(rotations->type == STORE_INTEGER && rotations->content.integer >= 0) {
+								keep = rotations->content.integer;
+							} else {
+								logWarning("The rotations value of log file '%s' is not a non-negative integer, keeping one rotated file", filePath->content.string);
+							}
+						}
+
+						setLogFileRotation(logFile, maxSize->content.integer, keep);
+					} else {
+						logWarning("The maxsize value of log file '%s' is not a non-negative integer, disabling rotation", filePath->content.string);
+					}
+				}
 			} else {
 				logWarning("Found list of log file configurations but one of the elements is not an array");
 			}
 		}
 	}
 
+	writer = g_thread_new("log_file", &runLogWriter, NULL);
+
 	$(void, event, attachEventListener)(NULL, "log", NULL, &listener_log);
 
 	return true;
@@ -130,83 +242,400 @@ API LogFileConfig *addLogFile(char *filePath, LogLevel level)
 	logFile->level = level;
 	logFile->ignoreNextLog = false;
 	logFile->fileAppend = NULL;
+	logFile->maxSize = 0;
+	logFile->rotations = 0;
+	logFile->size = 0;
+	logFile->retryTime = 0;
 
 	// checking the directory exists and if not try to create it
 	char *dirPath = $$(char *, getDirectoryPath)(logFile->filePath);
 	if(!g_file_test(dirPath, G_FILE_TEST_IS_DIR | G_FILE_TEST_EXISTS) && !g_mkdir_with_parents(dirPath, LOGFILE_DIR_PERMISSION)) {
 		logError("Could not create parent directory for the log file '%s'.", logFile->filePath);
-		removeLogFile(logFile);
+		free(dirPath);
+		free(logFile->filePath);
+		free(logFile);
 
 		return NULL;
 	}
 
 	free(dirPath);
 
+	g_mutex_lock(&filesMutex);
 	logFiles = g_list_append(logFiles, logFile);
+	updateMinimumLogLevel();
+	g_mutex_unlock(&filesMutex);
+
 	return logFile;
 }
 
 API void removeLogFile(LogFileConfig *logFile)
 {
+	g_mutex_lock(&filesMutex);
 	logFiles = g_list_remove(logFiles, logFile);
+	updateMinimumLogLevel();
 
 	if(logFile->fileAppend) {
 		fclose(logFile->fileAppend);
 	}
+	g_mutex_unlock(&filesMutex);
 
 	free(logFile->filePath);
 	free(logFile);
 }
 
+API void setLogFileRotation(LogFileConfig *logFile, unsigned long maxSize, unsigned int rotations)
+{
+	g_mutex_lock(&filesMutex);
+	logFile->maxSize = maxSize;
+	logFile->rotations = rotations;
+	g_mutex_unlock(&filesMutex);
+}
+
+API unsigned long getDroppedLogMessages()
+{
+	return (guint) g_atomic_int_get(&dropped);
+}
+
 static void listener_log(void *subject, const char *event, void *data, va_list args)
 {
 	const char *module = va_arg(args, const char *);
 	LogLevel level = va_arg(args, LogLevel);
 	char *message = va_arg(args, char *);
 
-	GDateTime *now = g_date_time_new_now_local();
-	unsigned int day = g_date_time_get_day_of_month(now);
-	unsigned int month = g_date_time_get_month(now);
-	unsigned int year = g_date_time_get_year(now);
-	unsigned int hour = g_date_time_get_hour(now);
-	unsigned int minute = g_date_time_get_minute(now);
-	unsigned int second = g_date_time_get_second(now);
-    g_date_time_unref(now);
+	if((gint) level < g_atomic_int_get(&minimumLevel)) {
+		return; // no log file is interested in this message
+	}
+
+	// claim a free slot in the ring, see Dmitry Vyukov's bounded MPMC queue
+	LogFileRecord *record;
+	gint position = g_atomic_int_get(&enqueuePosition);
+	while(true) {
+		record = &queue[position & (LOG_FILE_QUEUE_SIZE - 1)];
+		gint difference = (gint) ((guint) g_atomic_int_get(&record->sequence) - (guint) position);
+
+		if(difference == 0) {
+			if(g_atomic_int_compare_and_exchange(&enqueuePosition, position, position + 1)) {
+				break;
+			}
+		} else if(difference < 0) { // the queue is full, drop the message instead of blocking the logging thread
+			g_atomic_int_inc(&dropped);
+			return;
+		}
+
+		position = g_atomic_int_get(&enqueuePosition);
+	}
+
+	record->time = g_get_real_time() / G_USEC_PER_SEC;
+	record->level = level;
+	int length = snprintf(record->text, LOG_FILE_RECORD_SIZE, "[%s:%s] %s", module, getStaticLogLevelName(level), message);
+	record->overflow = length >= LOG_FILE_RECORD_SIZE ? g_strdup_printf("[%s:%s] %s", module, getStaticLogLevelName(level), message) : NULL;
+
+	// publish the record to the writer
+	g_atomic_int_set(&record->sequence, position + 1);
+
+	if(g_atomic_int_get(&writerSleeping)) {
+		g_mutex_lock(&writerMutex);
+		g_cond_signal(&writerCondition);
+		g_mutex_unlock(&writerMutex);
+	}
+}
+
+/**
+ * Takes the next record out of the log queue. Must only be called from the writer thread.
+ *
+ * @param record		the record to copy the dequeued record into
+ * @result				true if a record was dequeued, false if the queue is empty
+ */
+static bool dequeueLogRecord(LogFileRecord *record)
+{
+	LogFileRecord *slot = &queue[dequeuePosition & (LOG_FILE_QUEUE_SIZE - 1)];
+	gint difference = (gint) ((guint) g_atomic_int_get(&slot->sequence) - (guint) (dequeuePosition + 1));
+
+	if(difference < 0) {
+		return false;
+	}
+
+	record->time = slot->time;
+	record->level = slot->level;
+	record->overflow = slot->overflow;
+	if(slot->overflow == NULL) {
+		memcpy(record->text, slot->text, LOG_FILE_RECORD_SIZE);
+	}
+	slot->overflow = NULL;
+
+	// release the slot for the producer one lap ahead
+	g_atomic_int_set(&slot->sequence, dequeuePosition + LOG_FILE_QUEUE_SIZE);
+	dequeuePosition++;
+
+	return true;
+}
+
+/**
+ * The log writer thread draining the log queue into the log files
+ *
+ * @param data			unused
+ * @result				NULL
+ */
+static gpointer runLogWriter(gpointer data)
+{
+	LogFileRecord record;
+	gint64 cachedSecond = -1;
+	char timestamp[32] = "";
+	gint reportedDrops = 0;
+	gint64 lastFlush = g_get_monotonic_time();
+
+	while(true) {
+		bool flushNow = false;
+		int count = 0;
+
+		g_mutex_lock(&filesMutex);
+		while(dequeueLogRecord(&record)) {
+			if(record.time != cachedSecond) { // the timestamp only changes once per second, so only format it then
+				GDateTime *now = g_date_time_new_from_unix_local(record.time);
+				snprintf(timestamp, sizeof(timestamp), "[%02u.%02u.%04u-%02u:%02u:%02u]", g_date_time_get_day_of_month(now), g_date_time_get_month(now), g_date_time_get_year(now), g_date_time_get_hour(now), g_date_time_get_minute(now), g_date_time_get_second(now));
+				g_date_time_unref(now);
+				cachedSecond = record.time;
+			}
+
+			const char *text = record.overflow != NULL ? record.overflow : record.text;
+			writeLogLine(record.level, timestamp, text, strlen(text));
+			free(record.overflow);
+
+			if(record.level >= LOG_LEVEL_ERROR) {
+				flushNow = true; // make sure errors hit the disk even if we crash right afterwards
+			}
+
+			count++;
+		}
+
+		gint drops = g_atomic_int_get(&dropped);
+		if(drops != reportedDrops) {
+			char *text = g_strdup_printf("[log_file:%s] Dropped %d log messages because the log queue was full", getStaticLogLevelName(LOG_LEVEL_WARNING), drops - reportedDrops);
+			writeLogLine(LOG_LEVEL_WARNING, timestamp, text, strlen(text));
+			free(text);
+			reportedDrops = drops;
+		}
+
+		char *failedPath;
+		while((failedPath = g_queue_pop_head(openFailures)) != NULL) { // report to all other log files, the failed one doesn't retry opening yet
+			char *text = g_strdup_printf("[log_file:%s] Could not open log file %s", getStaticLogLevelName(LOG_LEVEL_WARNING), failedPath);
+			writeLogLine(LOG_LEVEL_WARNING, timestamp, text, strlen(text));
+			free(text);
+			free(failedPath);
+		}
+
+		gint64 now = g_get_monotonic_time();
+		if(unflushedBytes > 0 && (flushNow || unflushedBytes >= LOG_FILE_FLUSH_BYTES || now - lastFlush >= LOG_FILE_FLUSH_INTERVAL)) {
+			flushLogFiles();
+			lastFlush = now;
+		}
+		g_mutex_unlock(&filesMutex);
+
+		if(count > 0) {
+			continue; // keep draining until the queue is empty
+		}
+
+		if(g_atomic_int_get(&writerStop)) {
+			break;
+		}
+
+		g_mutex_lock(&writerMutex);
+		g_atomic_int_set(&writerSleeping, 1);
+		// check again now that producers see us sleeping, they might have published a record in the meantime
+		LogFileRecord *next = &queue[dequeuePosition & (LOG_FILE_QUEUE_SIZE - 1)];
+		if((gint) ((guint) g_atomic_int_get(&next->sequence) - (guint) (dequeuePosition + 1)) < 0 && !g_atomic_int_get(&writerStop)) {
+			gint64 timeout = unflushedBytes > 0 ? lastFlush + LOG_FILE_FLUSH_INTERVAL : now + G_USEC_PER_SEC;
+			g_cond_wait_until(&writerCondition, &writerMutex, timeout);
+		}
+		g_atomic_int_set(&writerSleeping, 0);
+		g_mutex_unlock(&writerMutex);
+	}
+
+	g_mutex_lock(&filesMutex);
+	flushLogFiles();
+	g_mutex_unlock(&filesMutex);
+
+	return NULL;
+}
+
+/**
+ * Writes a log line to all log files interested in its level. Must be called from the writer thread with the files mutex held.
+ *
+ * @param level			the log level of the line
+ * @param timestamp		the formatted timestamp of the line
+ * @param text			the formatted log message
+ * @param length		the length of the formatted log message
+ */
+static void writeLogLine(LogLevel level, const char *timestamp, const char *text, int length)
+{
+	for(GList *item = logFiles; item != NULL; item = item->next) {
+		LogFileConfig *logFile = item->data;
+
+		if(level >= logFile->level) {
+			writeLogFileLine(logFile, timestamp, text, length);
+		}
+	}
+}
+
+/**
+ * Writes a log line to a log file and rotates it if it grew too large. Must be called from the writer thread with the files mutex held.
+ *
+ * @param logFile		the log file to write to
+ * @param timestamp		the formatted timestamp of the line
+ * @param text			the formatted log message
+ * @param length		the length of the formatted log message
+ */
+static void writeLogFileLine(LogFileConfig *logFile, const char *timestamp, const char *text, int length)
+{
+	if(logFile->fileAppend == NULL && !openLogFile(logFile)) {
+		return;
+	}
+
+	int timestampLength = strlen(timestamp);
+	fwrite(timestamp, 1, timestampLength, logFile->fileAppend);
+	fputc(' ', logFile->fileAppend);
+	fwrite(text, 1, length, logFile->fileAppend);
+	fputc('\n', logFile->fileAppend);
+
+	unsigned long written = timestampLength + length + 2;
+	logFile->size += written;
+	unflushedBytes += written;
+
+	if(logFile->maxSize > 0 && logFile->size >= logFile->maxSize) {
+		rotateLogFile(logFile);
+	}
+}
+
+/**
+ * Opens a log file for appending. If opening fails, it isn't retried until LOG_FILE_RETRY_INTERVAL has passed.
+ *
+ * @param logFile		the log file to open
+ * @result				true if successful
+ */
+static bool openLogFile(LogFileConfig *logFile)
+{
+	gint64 now = g_get_monotonic_time();
+	if(logFile->ignoreNextLog && now < logFile->retryTime) {
+		return false;
+	}
+
+	if((logFile->fileAppend = fopen(logFile->filePath, "a")) == NULL) {
+		if(!logFile->ignoreNextLog) { // we're on the writer thread, which must not dispatch log events, so let the writer loop report it
+			g_queue_push_tail(openFailures, strdup(logFile->filePath));
+		}
+
+		logFile->ignoreNextLog = true;
+		logFile->retryTime = now + LOG_FILE_RETRY_INTERVAL;
+		return false;
+	}
+
+	logFile->ignoreNextLog = false;
+	setvbuf(logFile->fileAppend, NULL, _IOFBF, LOG_FILE_BUFFER_SIZE);
+
+	fseek(logFile->fileAppend, 0, SEEK_END);
+	long size = ftell(logFile->fileAppend);
+	logFile->size = size > 0 ? size : 0;
+
+	return true;
+}
+
+/**
+ * Rotates a log file by shifting filePath.1 ... filePath.N-1 up by one, moving the current file to filePath.1 and starting a new one.
+ *
+ * @param logFile		the log file to rotate
+ */
+static void rotateLogFile(LogFileConfig *logFile)
+{
+	fclose(logFile->fileAppend);
+	logFile->fileAppend = NULL;
+	logFile->size = 0;
+
+	if(logFile->rotations == 0) {
+		g_unlink(logFile->filePath);
+		return;
+	}
+
+	for(unsigned int i = logFile->rotations - 1; i > 0; i--) {
+		char *from = g_strdup_printf("%s.%u", logFile->filePath, i);
+		char *to = g_strdup_printf("%s.%u", logFile->filePath, i + 1);
+		g_rename(from, to);
+		free(from);
+		free(to);
+	}
+
+	char *to = g_strdup_printf("%s.1", logFile->filePath);
+	g_rename(logFile->filePath, to);
+	free(to);
+}
+
+/**
+ * Flushes all open log files. Must be called from the writer thread with the files mutex held.
+ */
+static void flushLogFiles()
+{
+	for(GList *item = logFiles; item != NULL; item = item->next) {
+		LogFileConfig *logFile = item->data;
 
-    for(GList *item = logFiles; item != NULL; item = item->next) {
-    	LogFileConfig *logFile = item->data;
+		if(logFile->fileAppend != NULL) {
+			fflush(logFile->fileAppend);
+		}
+	}
 
-    	if(logFile->ignoreNextLog) {
-    		logFile->ignoreNextLog = false;
-    		continue;
-    	}
+	unflushedBytes = 0;
+}
 
-    	if(logFile->fileAppend == NULL) {
-    		if((logFile->fileAppend = fopen(logFile->filePath, "a")) == NULL) {
-    			logFile->ignoreNextLog = true;
-    			logWarning("Could not open logfile: %s", logFile->filePath);
+/**
+ * Recomputes the lowest log level any log file is interested in. Must be called with the files mutex held.
+ */
+static void updateMinimumLogLevel()
+{
+	gint minimum = LOG_LEVEL_ALL + 1;
 
-    			continue;
-    		}
-    	}
+	for(GList *item = logFiles; item != NULL; item = item->next) {
+		LogFileConfig *logFile = item->data;
 
-    	if(level >= logFile->level) {
-    		fprintf(logFile->fileAppend, "[%02u.%02u.%04u-%02u:%02u:%02u] [%s:%s] %s\n", day, month, year, hour, minute, second, module, getStaticLogLevelName(level), message);
-    	}
+		if((gint) logFile->level < minimum) {
+			minimum = logFile->level;
+		}
+	}
 
-    	fflush(logFile->fileAppend);
-    }
+	g_atomic_int_set(&minimumLevel, minimum);
+
+	// tell the core that we want the levels from the minimum up, so it doesn't even format the others for us
+	LogLevel levels = LOG_LEVEL_ALL & ~(minimum - 1);
+	if(levels != listenerLevels) {
+		$(void, log_event, addLogListenerLevels)(levels);
+		$(void, log_event, removeLogListenerLevels)(listenerLevels);
+		listenerLevels = levels;
+	}
 }
 
 static void finalize()
 {
 	$(void, event, detachEventListener)(NULL, "log", NULL, &listener_log);
 
-	if(logFiles) {
-		for(GList *item = logFiles; item != NULL; item = item->next) {
-			removeLogFile(item->data);
-		}
+	// let the writer drain what's left in the queue and wait for it to finish
+	g_mutex_lock(&writerMutex);
+	g_atomic_int_set(&writerStop, 1);
+	g_cond_signal(&writerCondition);
+	g_mutex_unlock(&writerMutex);
+
+	g_thread_join(writer);
+	writer = NULL;
 
-		g_list_free(logFiles);
+	while(logFiles != NULL) {
+		removeLogFile(logFiles->data);
 	}
+
+	$(void, log_event, removeLogListenerLevels)(listenerLevels);
+
+	free(queue);
+	queue = NULL;
+
+	g_queue_free_full(openFailures, &free);
+	openFailures = NULL;
+
+	g_cond_clear(&writerCondition);
+	g_mutex_clear(&writerMutex);
+	g_mutex_clear(&filesMutex);
 }
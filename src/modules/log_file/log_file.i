@@ -22,6 +22,8 @@
 #define LOG_FILE_LOG_FILE_H
 
 #include <stdio.h>
+#include <glib.h>
+#include "log.h"
 
 /**
  * Configuration information for a single log file.
@@ -38,15 +40,35 @@ typedef struct {
 	LogLevel level;
 
 	/**
-	 * FILE descriptor to append new lines.
+	 * FILE descriptor to append new lines. Only accessed by the log writer thread.
 	 */
 	FILE *fileAppend;
 
 	/**
-	 * If this is true the next log entry has to be ignored. This is used by config.c to prevent endless
-	 * loops in case of errors.
+	 * If this is true, the log file couldn't be opened and the failure was already reported. Opening is retried every second, but the
+	 * failure isn't reported again until the file was opened successfully. This prevents endless loops of failure messages.
 	 */
 	bool ignoreNextLog;
+
+	/**
+	 * The size in bytes after which the log file is rotated, or 0 if it should grow forever.
+	 */
+	unsigned long maxSize;
+
+	/**
+	 * The number of rotated log files to keep, named filePath.1 (newest) to filePath.N (oldest).
+	 */
+	unsigned int rotations;
+
+	/**
+	 * The current size of the log file in bytes.
+	 */
+	unsigned long size;
+
+	/**
+	 * The monotonic time in microseconds after which opening the log file should be retried if it failed.
+	 */
+	gint64 retryTime;
 } LogFileConfig;
 
 
@@ -67,4 +89,21 @@ API LogFileConfig *addLogFile(char *filePath, LogLevel level);
  */
 API void removeLogFile(LogFileConfig *logFile);
 
+/**
+ * Enables size-based rotation for a log file. Once the file grows beyond the given size, it is renamed to filePath.1, previously rotated
+ * files are shifted up by one, and a new file is started.
+ *
+ * @param logFile	The LogFileConfig to enable rotation for
+ * @param maxSize	The size in bytes after which to rotate the log file, or 0 to disable rotation
+ * @param rotations	The number of rotated log files to keep
+ */
+API void setLogFileRotation(LogFileConfig *logFile, unsigned long maxSize, unsigned int rotations);
+
+/**
+ * Returns the number of log messages that were dropped so far because the log writer couldn't keep up and its queue was full.
+ *
+ * @return			The number of dropped log messages
+ */
+API unsigned long getDroppedLogMessages();
+
 #endif
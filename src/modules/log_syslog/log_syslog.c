@@ -24,6 +24,7 @@
 
 #include "dll.h"
 #include "modules/event/event.h"
+#include "modules/log_event/log_event.h"
 /*
  * Now we do some nasty stuff because of name conflicts between log.h and syslog.h.
  * First we undef some macros which are defined by log.h in dll.h. After that we
@@ -42,9 +43,9 @@
 MODULE_NAME("log_syslog");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Kalisko log provider for syslog on POSIX.1-2001 systems.");
-MODULE_VERSION(0, 0, 2);
+MODULE_VERSION(0, 0, 3);
 MODULE_BCVERSION(0, 0, 2);
-MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 1, 1));
+MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 1, 2), MODULE_DEPENDENCY("log_event", 0, 2, 0));
 
 static void listener_log(void *subject, const char *event, void *data, va_list args);
 
@@ -53,6 +54,7 @@ MODULE_INIT
 {
 	openlog("kalisko", LOG_CONS, LOG_USER);
 
+	$(void, log_event, addLogListenerLevels)(LOG_LEVEL_INFO_UP); // syslog doesn't get trace messages
 	$(void, event, attachEventListener)(NULL, "log", NULL, &listener_log);
 
 	return true;
@@ -61,6 +63,7 @@ MODULE_INIT
 MODULE_FINALIZE
 {
 	$(void, event, detachEventListener)(NULL, "log", NULL, &listener_log);
+	$(void, log_event, removeLogListenerLevels)(LOG_LEVEL_INFO_UP);
 
 	closelog();
 }
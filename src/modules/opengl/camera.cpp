@@ -59,33 +59,29 @@ API OpenGLCamera *createOpenGLCamera()
  */
 API void moveOpenGLCamera(OpenGLCamera *camera, OpenGLCameraMove move, double amount)
 {
-	Vector step(3);
-
 	switch(move) {
 		case OPENGL_CAMERA_MOVE_FORWARD:
-			step = amount * *camera->direction;
+			camera->position->addScaled(*camera->direction, amount);
 		break;
 		case OPENGL_CAMERA_MOVE_BACK:
-			step = -amount * *camera->direction;
+			camera->position->addScaled(*camera->direction, -amount);
 		break;
 		case OPENGL_CAMERA_MOVE_LEFT:
-			step = -amount * (*camera->direction % *camera->up);
+			camera->position->addScaled(*camera->direction % *camera->up, -amount);
 		break;
 		case OPENGL_CAMERA_MOVE_RIGHT:
-			step = amount * (*camera->direction % *camera->up);
+			camera->position->addScaled(*camera->direction % *camera->up, amount);
 		break;
 		case OPENGL_CAMERA_MOVE_UP:
-			step = amount * *camera->up;
+			camera->position->addScaled(*camera->up, amount);
 		break;
 		case OPENGL_CAMERA_MOVE_DOWN:
-			step = -amount * *camera->up;
+			camera->position->addScaled(*camera->up, -amount);
 		break;
 		default:
 			logError("Trying to move OpenGL camera into unspecified direction %d", move);
 		break;
 	}
-
-	*camera->position += step;
 }
 
 /**
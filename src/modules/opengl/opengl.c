@@ -41,9 +41,9 @@
 MODULE_NAME("opengl");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The opengl module supports hardware accelerated graphics rendering and interaction");
-MODULE_VERSION(0, 29, 13);
+MODULE_VERSION(0, 29, 14);
 MODULE_BCVERSION(0, 29, 6);
-MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 2, 1), MODULE_DEPENDENCY("linalg", 0, 2, 3), MODULE_DEPENDENCY("image", 0, 5, 20));
+MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 2, 1), MODULE_DEPENDENCY("linalg", 0, 5, 0), MODULE_DEPENDENCY("image", 0, 5, 20));
 
 MODULE_INIT
 {
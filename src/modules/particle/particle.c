@@ -40,9 +40,9 @@
 MODULE_NAME("particle");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Module for OpenGL particle effects");
-MODULE_VERSION(0, 6, 16);
+MODULE_VERSION(0, 7, 1);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("scene", 0, 8, 0), MODULE_DEPENDENCY("opengl", 0, 29, 6), MODULE_DEPENDENCY("random", 0, 6, 0), MODULE_DEPENDENCY("linalg", 0, 3, 3));
+MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 11), MODULE_DEPENDENCY("scene", 0, 8, 0), MODULE_DEPENDENCY("opengl", 0, 29, 6), MODULE_DEPENDENCY("random", 0, 7, 0), MODULE_DEPENDENCY("linalg", 0, 5, 0));
 
 MODULE_INIT
 {
@@ -63,6 +63,7 @@ API OpenGLPrimitive *createOpenGLPrimitiveParticles(unsigned int num_particles)
 	particles->sprites = ALLOCATE_OBJECTS(ParticleSprite, num_particles);
 	particles->num_particles = num_particles;
 	particles->time = 0.0f;
+	particles->random = $(RandomGenerator *, random, createRandomGenerator)($(uint64_t, random, createRandomSeed)());
 	particles->primitive.type = "particles";
 	particles->primitive.data = particles;
 	particles->primitive.setup_function = &setupOpenGLPrimitiveParticles;
@@ -104,7 +105,7 @@ API bool initOpenGLPrimitiveParticles(OpenGLPrimitive *primitive)
 
 	for(unsigned int i = 0; i < particles->num_particles; i++) {
 		initParticle(particles, i);
-		float birth = -randomUniform() * particles->properties.lifetime;
+		float birth = -randomGeneratorUniform(particles->random) * particles->properties.lifetime;
 		particles->vertices[4*i+0].birth = birth;
 		particles->vertices[4*i+1].birth = birth;
 		particles->vertices[4*i+2].birth = birth;
@@ -259,6 +260,7 @@ API void freeOpenGLPrimitiveParticles(OpenGLPrimitive *primitive)
 	glDeleteBuffers(1, &particles->indexBuffer);
 	free(particles->vertices);
 	free(particles->sprites);
+	$(void, random, freeRandomGenerator)(particles->random);
 	$(void, linalg, freeVector)(particles->properties.positionMean);
 	$(void, linalg, freeVector)(particles->properties.positionStd);
 	$(void, linalg, freeVector)(particles->properties.velocityMean);
@@ -274,13 +276,13 @@ API void freeOpenGLPrimitiveParticles(OpenGLPrimitive *primitive)
  */
 static void initParticle(OpenGLParticles *particles, unsigned int i)
 {
-	float positionx = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.positionMean, 0), $(float, linalg, getVector)(particles->properties.positionStd, 0));
-	float positiony = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.positionMean, 1), $(float, linalg, getVector)(particles->properties.positionStd, 1));
-	float positionz = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.positionMean, 2), $(float, linalg, getVector)(particles->properties.positionStd, 2));
-	float velocityx = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.velocityMean, 0), $(float, linalg, getVector)(particles->properties.velocityStd, 0));
-	float velocityy = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.velocityMean, 1), $(float, linalg, getVector)(particles->properties.velocityStd, 1));
-	float velocityz = $(float, random, randomGaussian)($(float, linalg, getVector)(particles->properties.velocityMean, 2), $(float, linalg, getVector)(particles->properties.velocityStd, 2));
-	float angularVelocity = $(float, random, randomGaussian)(particles->properties.angularVelocityMean, particles->properties.angularVelocityStd);
+	float positionx = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.positionMean, 0), $(float, linalg, getVector)(particles->properties.positionStd, 0));
+	float positiony = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.positionMean, 1), $(float, linalg, getVector)(particles->properties.positionStd, 1));
+	float positionz = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.positionMean, 2), $(float, linalg, getVector)(particles->properties.positionStd, 2));
+	float velocityx = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.velocityMean, 0), $(float, linalg, getVector)(particles->properties.velocityStd, 0));
+	float velocityy = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.velocityMean, 1), $(float, linalg, getVector)(particles->properties.velocityStd, 1));
+	float velocityz = $(float, random, randomGaussian)(particles->random, $(float, linalg, getVector)(particles->properties.velocityMean, 2), $(float, linalg, getVector)(particles->properties.velocityStd, 2));
+	float angularVelocity = $(float, random, randomGaussian)(particles->random, particles->properties.angularVelocityMean, particles->properties.angularVelocityStd);
 
 	particles->vertices[4*i+0].corner[0] = 0.0f;
 	particles->vertices[4*i+0].corner[1] = 0.0f;
@@ -25,6 +25,7 @@
 #include "modules/opengl/primitive.h"
 #include "modules/opengl/model.h"
 #include "modules/linalg/Vector.h"
+#include "modules/random/random.h"
 
 /**
  * Struct representing a particle vertex
@@ -91,6 +92,8 @@ typedef struct {
 		/** The standard deviation of a new particle's angular velocity */
 		float angularVelocityStd;
 	} properties;
+	/** The random generator used to initialize particles */
+	RandomGenerator *random;
 } OpenGLParticles;
 
 
@@ -20,11 +20,21 @@
 
 #include <math.h>
 #include <assert.h>
+#include <glib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "dll.h"
+#include "modules/image/image.h"
 #define API
 #include "random.h"
 #include "perlin.h"
 
+/** The number of samples evaluated together by the batched noise functions */
+#define PERLIN_BLOCK_SIZE 64
+/** The number of image rows filled by a noise image worker at once */
+#define PERLIN_TILE_ROWS 16
+
 /**
  * The permutation array used for the perlin noise
  */
@@ -33,25 +43,63 @@ static unsigned int *permutation;
 /**
  * The gradients used for the perlin noise
  */
-static int gradients[] = {
-	(4 << 6) + (4 << 3) + 0, // (1,1,0)
-	(2 << 6) + (4 << 3) + 0, // (-1,1,0)
-	(4 << 6) + (2 << 3) + 0, // (1,-1,0)
-	(2 << 6) + (2 << 3) + 0, // (-1,-1,0)
-	(4 << 6) + (0 << 3) + 4, // (1,0,1)
-	(2 << 6) + (0 << 3) + 4, // (-1,0,1)
-	(4 << 6) + (0 << 3) + 2, // (1,0,-1)
-	(2 << 6) + (0 << 3) + 2, // (-1,0,-1)
-	(0 << 6) + (4 << 3) + 4, // (0,1,1)
-	(0 << 6) + (2 << 3) + 4, // (0,-1,1)
-	(0 << 6) + (4 << 3) + 2, // (0,1,-1)
-	(0 << 6) + (2 << 3) + 2, // (0,-1,-1)
-	(4 << 6) + (4 << 3) + 0, // (1,1,0)
-	(2 << 6) + (4 << 3) + 0, // (-1,1,0)
-	(0 << 6) + (2 << 3) + 4, // (0,-1,1)
-	(0 << 6) + (2 << 3) + 2  // (0,-1,-1)
+static const float gradients[16][3] = {
+	{1, 1, 0},
+	{-1, 1, 0},
+	{1, -1, 0},
+	{-1, -1, 0},
+	{1, 0, 1},
+	{-1, 0, 1},
+	{1, 0, -1},
+	{-1, 0, -1},
+	{0, 1, 1},
+	{0, -1, 1},
+	{0, 1, -1},
+	{0, -1, -1},
+	{1, 1, 0},
+	{-1, 1, 0},
+	{0, -1, 1},
+	{0, -1, -1}
 };
 
+/**
+ * Parameters of a noise image fill shared by all its tiles
+ */
+typedef struct {
+	/** the image to fill */
+	Image *image;
+	/** the channel to fill */
+	unsigned int channel;
+	/** the type of noise to fill the image with */
+	RandomPerlinNoise type;
+	/** the noise coordinates of pixel (0, 0) */
+	double origin[3];
+	/** the noise coordinate offset between two horizontally adjacent pixels */
+	double stepX[3];
+	/** the noise coordinate offset between two vertically adjacent pixels */
+	double stepY[3];
+	/** the persistence of the noise */
+	double persistence;
+	/** the number of octaves of the noise */
+	unsigned int depth;
+} PerlinImageJob;
+
+/**
+ * Block of samples whose corner gradients have been looked up, ready to be interpolated
+ */
+typedef struct {
+	/** the fractional x coordinates of the samples within their cubes */
+	float dx[PERLIN_BLOCK_SIZE];
+	/** the fractional y coordinates of the samples within their cubes */
+	float dy[PERLIN_BLOCK_SIZE];
+	/** the fractional z coordinates of the samples within their cubes */
+	float dz[PERLIN_BLOCK_SIZE];
+	/** for each sample, the index of its cube in the cubes array, which is non-decreasing along the block */
+	unsigned char cube[PERLIN_BLOCK_SIZE];
+	/** the gradients of the eight corners (x + 2y + 4z) of each distinct cube in the block */
+	float cubes[PERLIN_BLOCK_SIZE][8][3];
+} PerlinBlock;
+
 static inline float fade(float t)
 {
 	return t * t * t * (t * (t * 6 - 15) + 10);
@@ -62,11 +110,22 @@ static inline float lerp(float t, float a, float b)
 	return a + t * (b - a);
 }
 
+static inline int floorInteger(double t)
+{
+	int i = (int) t;
+	return i - (t < i); // truncation rounds negative numbers up
+}
+
 static float gradientProduct(unsigned int corner, float dx, float dy, float dz);
+static void noiseRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, bool turbulence, float *values, unsigned int count);
+static void accumulatePerlinBlock(double x, double y, double z, double stepX, double stepY, double stepZ, float weight, bool absolute, float *values, unsigned int count);
+static void fillPerlinImageTile(void *tile, void *job);
 
 API void initPerlin()
 {
-	permutation = randomPermutation(256);
+	RandomGenerator *generator = createRandomGenerator(createRandomSeed());
+	permutation = randomPermutation(generator, 256);
+	freeRandomGenerator(generator);
 }
 
 API void freePerlin()
@@ -135,44 +194,58 @@ API float randomPerlin(double x, double y, double z)
  */
 static float gradientProduct(unsigned int corner, float dx, float dy, float dz)
 {
-	int gradient = gradients[corner & 15]; // extract lower 4 bits = modulo 16, then lookup gradient
-
-	float result = 0.0f;
+	const float *gradient = gradients[corner & 15]; // extract lower 4 bits = modulo 16, then lookup gradient
 
-	// Check x coordinate
-	if(gradient & (4 << 6)) { // (1,_,_)
-		result += dx;
-	} else if(gradient & (2 << 6)) { // (-1,_,_)
-		result -= dx;
-	}
+	return gradient[0] * dx + gradient[1] * dy + gradient[2] * dz;
+}
 
-	// Check y coordinate
-	if(gradient & (4 << 3)) { // (_,1,_)
-		result += dy;
-	} else if(gradient & (2 << 3)) { // (_,-1,_)
-		result -= dy;
-	}
+#ifdef __SSE2__
+/**
+ * Computes the dot products between the difference vectors of four samples and a corner gradient of their cubes
+ *
+ * @param block			the block containing the samples
+ * @param cube			the cube indices of the four samples
+ * @param corner		the corner (x + 2y + 4z) for which the gradients should be looked up and multiplied
+ * @param dx			the x components of the difference vectors
+ * @param dy			the y components of the difference vectors
+ * @param dz			the z components of the difference vectors
+ * @result				the dot products between the vectors
+ */
+static inline __m128 gradientProducts(PerlinBlock *block, const unsigned char *cube, unsigned int corner, __m128 dx, __m128 dy, __m128 dz)
+{
+	__m128 gx, gy, gz;
 
-	// Check z coordinate
-	if(gradient & 4) { // (_,_,1)
-		result += dz;
-	} else if(gradient & 2) { // (_,_,-1)
-		result -= dz;
+	if(cube[0] == cube[3]) { // cube indices never decrease, so all four samples share their cube
+		const float *gradient = block->cubes[cube[0]][corner];
+		gx = _mm_set1_ps(gradient[0]);
+		gy = _mm_set1_ps(gradient[1]);
+		gz = _mm_set1_ps(gradient[2]);
+	} else {
+		const float *g0 = block->cubes[cube[0]][corner];
+		const float *g1 = block->cubes[cube[1]][corner];
+		const float *g2 = block->cubes[cube[2]][corner];
+		const float *g3 = block->cubes[cube[3]][corner];
+		gx = _mm_setr_ps(g0[0], g1[0], g2[0], g3[0]);
+		gy = _mm_setr_ps(g0[1], g1[1], g2[1], g3[1]);
+		gz = _mm_setr_ps(g0[2], g1[2], g2[2], g3[2]);
 	}
 
-	return result;
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, dx), _mm_mul_ps(gy, dy)), _mm_mul_ps(gz, dz));
 }
+#endif
 
 API float noiseFBm(double x, double y, double z, double persistence, unsigned int depth)
 {
 	float ret = 0.0f;
+	double contribution = 1.0;
+	double frequency = 1.0;
 
 	for(unsigned int i = 0; i < depth; i++) {
-		float contribution = pow(persistence, (double) i);
-		float frequency = pow(2.0, (double) i);
 		float octave = randomPerlin(frequency * x, frequency * y, frequency * z);
 
 		ret += contribution * octave;
+		contribution *= persistence;
+		frequency *= 2.0;
 	}
 
 	return ret;
@@ -181,14 +254,301 @@ API float noiseFBm(double x, double y, double z, double persistence, unsigned in
 API float noiseTurbulence(double x, double y, double z, double persistence, unsigned int depth)
 {
 	float ret = 0.0f;
+	double contribution = 1.0;
+	double frequency = 1.0;
 
 	for(unsigned int i = 0; i < depth; i++) {
-		float contribution = pow(persistence, (double) i);
-		float frequency = pow(2.0, (double) i);
 		float octave = ABS(randomPerlin(frequency * x, frequency * y, frequency * z));
 
 		ret += contribution * octave;
+		contribution *= persistence;
+		frequency *= 2.0;
 	}
 
 	return ret;
 }
+
+API void randomPerlinRow(double x, double y, double z, double stepX, double stepY, double stepZ, float *values, unsigned int count)
+{
+	noiseRow(x, y, z, stepX, stepY, stepZ, 0.0, 1, false, values, count);
+}
+
+API void noiseFBmRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, float *values, unsigned int count)
+{
+	noiseRow(x, y, z, stepX, stepY, stepZ, persistence, depth, false, values, count);
+}
+
+API void noiseTurbulenceRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, float *values, unsigned int count)
+{
+	noiseRow(x, y, z, stepX, stepY, stepZ, persistence, depth, true, values, count);
+}
+
+API void noiseImage(Image *image, unsigned int channel, RandomPerlinNoise type, double *origin, double *stepX, double *stepY, double persistence, unsigned int depth)
+{
+	assert(channel < image->channels);
+
+	PerlinImageJob job;
+	job.image = image;
+	job.channel = channel;
+	job.type = type;
+	job.persistence = persistence;
+	job.depth = depth;
+	for(unsigned int d = 0; d < 3; d++) {
+		job.origin[d] = origin[d];
+		job.stepX[d] = stepX[d];
+		job.stepY[d] = stepY[d];
+	}
+
+	unsigned int tiles = (image->height + PERLIN_TILE_ROWS - 1) / PERLIN_TILE_ROWS;
+	unsigned int threads = MIN(g_get_num_processors(), tiles);
+
+	if(threads <= 1) { // not worth spawning any threads
+		for(unsigned int tile = 0; tile < tiles; tile++) {
+			fillPerlinImageTile(GUINT_TO_POINTER(tile + 1), &job);
+		}
+		return;
+	}
+
+	// rows are handed out in tiles so that threads finishing early pick up the remaining work
+	GThreadPool *pool = g_thread_pool_new(&fillPerlinImageTile, &job, threads, true, NULL);
+	for(unsigned int tile = 0; tile < tiles; tile++) {
+		g_thread_pool_push(pool, GUINT_TO_POINTER(tile + 1), NULL); // offset by one since NULL can't be pushed
+	}
+	g_thread_pool_free(pool, false, true);
+}
+
+/**
+ * Evaluates fBm or turbulence noise for a row of evenly spaced samples, one block of samples at a time
+ *
+ * @param x					the x coordinate of the first sample
+ * @param y					the y coordinate of the first sample
+ * @param z					the z coordinate of the first sample
+ * @param stepX				the x offset between two consecutive samples
+ * @param stepY				the y offset between two consecutive samples
+ * @param stepZ				the z offset between two consecutive samples
+ * @param persistence		the persistence of the noise
+ * @param depth				the number of octaves to overlay
+ * @param turbulence		true to accumulate absolute octave values for turbulence noise
+ * @param values			the array to write the noise values to
+ * @param count				the number of samples to evaluate
+ */
+static void noiseRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, bool turbulence, float *values, unsigned int count)
+{
+	if(depth == 0) {
+		for(unsigned int i = 0; i < count; i++) {
+			values[i] = 0.0f;
+		}
+		return;
+	}
+
+	// the octave weights are the same for all samples
+	float weights[depth];
+	double frequencies[depth];
+	double contribution = 1.0;
+	double frequency = 1.0;
+	for(unsigned int i = 0; i < depth; i++) {
+		weights[i] = contribution;
+		frequencies[i] = frequency;
+		contribution *= persistence;
+		frequency *= 2.0;
+	}
+
+	float block[PERLIN_BLOCK_SIZE];
+
+	for(unsigned int start = 0; start < count; start += PERLIN_BLOCK_SIZE) {
+		unsigned int blockCount = MIN(count - start, PERLIN_BLOCK_SIZE);
+
+		for(unsigned int i = 0; i < PERLIN_BLOCK_SIZE; i++) {
+			block[i] = 0.0f;
+		}
+
+		double bx = x + start * stepX;
+		double by = y + start * stepY;
+		double bz = z + start * stepZ;
+
+		for(unsigned int i = 0; i < depth; i++) {
+			double f = frequencies[i];
+			accumulatePerlinBlock(f * bx, f * by, f * bz, f * stepX, f * stepY, f * stepZ, weights[i], turbulence, block, blockCount);
+		}
+
+		for(unsigned int i = 0; i < blockCount; i++) {
+			values[start + i] = block[i];
+		}
+	}
+}
+
+/**
+ * Adds weighted perlin noise of a block of evenly spaced samples to an array. The permutation lookups are done sample by sample, while the
+ * gradient products and the interpolation are evaluated for several samples at once without any branches.
+ *
+ * @param x					the x coordinate of the first sample
+ * @param y					the y coordinate of the first sample
+ * @param z					the z coordinate of the first sample
+ * @param stepX				the x offset between two consecutive samples
+ * @param stepY				the y offset between two consecutive samples
+ * @param stepZ				the z offset between two consecutive samples
+ * @param weight			the weight with which to add the noise
+ * @param absolute			true to add the absolute noise values
+ * @param values			the array of PERLIN_BLOCK_SIZE values to add the noise to
+ * @param count				the number of samples to evaluate, at most PERLIN_BLOCK_SIZE
+ */
+static void accumulatePerlinBlock(double x, double y, double z, double stepX, double stepY, double stepZ, float weight, bool absolute, float *values, unsigned int count)
+{
+	PerlinBlock block;
+
+	// round up to whole vectors, the additional samples are valid noise coordinates as well and just get ignored by the caller
+	unsigned int padded = MIN((count + 3) & ~3u, PERLIN_BLOCK_SIZE);
+	int cubes = 0;
+	int X = floorInteger(x);
+	int Y = floorInteger(y);
+	int Z = floorInteger(z);
+	double fx = x - X;
+	double fy = y - Y;
+	double fz = z - Z;
+
+	for(unsigned int i = 0; i < padded; i++) {
+		bool moved = cubes == 0;
+
+		// walk along the row, only recomputing the cube when leaving the current one
+		if(i > 0) {
+			fx += stepX;
+			fy += stepY;
+			fz += stepZ;
+
+			if(fx < 0.0 || fx >= 1.0) {
+				int shift = floorInteger(fx);
+				X += shift;
+				fx -= shift;
+				moved = true;
+			}
+			if(fy < 0.0 || fy >= 1.0) {
+				int shift = floorInteger(fy);
+				Y += shift;
+				fy -= shift;
+				moved = true;
+			}
+			if(fz < 0.0 || fz >= 1.0) {
+				int shift = floorInteger(fz);
+				Z += shift;
+				fz -= shift;
+				moved = true;
+			}
+		}
+
+		block.dx[i] = fx;
+		block.dy[i] = fy;
+		block.dz[i] = fz;
+
+		if(moved) { // consecutive samples usually share their cube, so only look up new ones
+			float (*gradient)[3] = block.cubes[cubes++];
+			unsigned int cx[2] = {permutation[X & 255], permutation[(X + 1) & 255]};
+
+			for(unsigned int corner = 0; corner < 8; corner++) {
+				unsigned int cy = permutation[(cx[corner & 1] + Y + ((corner >> 1) & 1)) & 255];
+				unsigned int cz = permutation[(cy + Z + (corner >> 2)) & 255];
+
+				gradient[corner][0] = gradients[cz & 15][0];
+				gradient[corner][1] = gradients[cz & 15][1];
+				gradient[corner][2] = gradients[cz & 15][2];
+			}
+		}
+
+		block.cube[i] = cubes - 1;
+	}
+
+#ifdef __SSE2__
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 six = _mm_set1_ps(6.0f);
+	const __m128 fifteen = _mm_set1_ps(15.0f);
+	const __m128 ten = _mm_set1_ps(10.0f);
+	const __m128 weights = _mm_set1_ps(weight);
+	const __m128 signMask = _mm_set1_ps(absolute ? -0.0f : 0.0f);
+
+	for(unsigned int i = 0; i < padded; i += 4) {
+		__m128 dx = _mm_loadu_ps(block.dx + i);
+		__m128 dy = _mm_loadu_ps(block.dy + i);
+		__m128 dz = _mm_loadu_ps(block.dz + i);
+		__m128 dx1 = _mm_sub_ps(dx, one);
+		__m128 dy1 = _mm_sub_ps(dy, one);
+		__m128 dz1 = _mm_sub_ps(dz, one);
+
+		// Compute dot products with corner gradients
+		const unsigned char *cube = block.cube + i;
+		__m128 dxlylzl = gradientProducts(&block, cube, 0, dx, dy, dz);
+		__m128 dxhylzl = gradientProducts(&block, cube, 1, dx1, dy, dz);
+		__m128 dxlyhzl = gradientProducts(&block, cube, 2, dx, dy1, dz);
+		__m128 dxhyhzl = gradientProducts(&block, cube, 3, dx1, dy1, dz);
+		__m128 dxlylzh = gradientProducts(&block, cube, 4, dx, dy, dz1);
+		__m128 dxhylzh = gradientProducts(&block, cube, 5, dx1, dy, dz1);
+		__m128 dxlyhzh = gradientProducts(&block, cube, 6, dx, dy1, dz1);
+		__m128 dxhyhzh = gradientProducts(&block, cube, 7, dx1, dy1, dz1);
+
+		__m128 fadex = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(dx, dx), dx), _mm_add_ps(_mm_mul_ps(dx, _mm_sub_ps(_mm_mul_ps(dx, six), fifteen)), ten));
+		__m128 fadey = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(dy, dy), dy), _mm_add_ps(_mm_mul_ps(dy, _mm_sub_ps(_mm_mul_ps(dy, six), fifteen)), ten));
+		__m128 fadez = _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(dz, dz), dz), _mm_add_ps(_mm_mul_ps(dz, _mm_sub_ps(_mm_mul_ps(dz, six), fifteen)), ten));
+
+		// Trilinear interpolation between corners using fade function
+		__m128 iylzl = _mm_add_ps(dxlylzl, _mm_mul_ps(fadex, _mm_sub_ps(dxhylzl, dxlylzl)));
+		__m128 iyhzl = _mm_add_ps(dxlyhzl, _mm_mul_ps(fadex, _mm_sub_ps(dxhyhzl, dxlyhzl)));
+		__m128 iylzh = _mm_add_ps(dxlylzh, _mm_mul_ps(fadex, _mm_sub_ps(dxhylzh, dxlylzh)));
+		__m128 iyhzh = _mm_add_ps(dxlyhzh, _mm_mul_ps(fadex, _mm_sub_ps(dxhyhzh, dxlyhzh)));
+		__m128 izl = _mm_add_ps(iylzl, _mm_mul_ps(fadey, _mm_sub_ps(iyhzl, iylzl)));
+		__m128 izh = _mm_add_ps(iylzh, _mm_mul_ps(fadey, _mm_sub_ps(iyhzh, iylzh)));
+		__m128 noise = _mm_add_ps(izl, _mm_mul_ps(fadez, _mm_sub_ps(izh, izl)));
+
+		noise = _mm_andnot_ps(signMask, noise); // clears the sign bit for absolute values
+		_mm_storeu_ps(values + i, _mm_add_ps(_mm_loadu_ps(values + i), _mm_mul_ps(weights, noise)));
+	}
+#else
+	for(unsigned int i = 0; i < padded; i++) {
+		float dl[3] = {block.dx[i], block.dy[i], block.dz[i]};
+		float (*gradient)[3] = block.cubes[block.cube[i]];
+		float products[8];
+
+		for(unsigned int corner = 0; corner < 8; corner++) {
+			products[corner] = gradient[corner][0] * (dl[0] - (corner & 1)) + gradient[corner][1] * (dl[1] - ((corner >> 1) & 1)) + gradient[corner][2] * (dl[2] - (corner >> 2));
+		}
+
+		float fadex = fade(dl[0]);
+		float iyz[4];
+		for(unsigned int corner = 0; corner < 4; corner++) {
+			iyz[corner] = lerp(fadex, products[2 * corner], products[2 * corner + 1]);
+		}
+
+		float fadey = fade(dl[1]);
+		float noise = lerp(fade(dl[2]), lerp(fadey, iyz[0], iyz[1]), lerp(fadey, iyz[2], iyz[3]));
+
+		values[i] += weight * (absolute ? ABS(noise) : noise);
+	}
+#endif
+}
+
+/**
+ * Thread pool worker filling a tile of rows of a noise image
+ *
+ * @param tile				the index of the tile to fill plus one
+ * @param job				the PerlinImageJob describing the image to fill
+ */
+static void fillPerlinImageTile(void *tile, void *job)
+{
+	PerlinImageJob *imageJob = job;
+	Image *image = imageJob->image;
+	unsigned int start = (GPOINTER_TO_UINT(tile) - 1) * PERLIN_TILE_ROWS;
+	unsigned int end = MIN(start + PERLIN_TILE_ROWS, image->height);
+	float *row = ALLOCATE_OBJECTS(float, image->width);
+
+	for(unsigned int y = start; y < end; y++) {
+		double rowOrigin[3];
+		for(unsigned int d = 0; d < 3; d++) {
+			rowOrigin[d] = imageJob->origin[d] + y * imageJob->stepY[d];
+		}
+
+		noiseRow(rowOrigin[0], rowOrigin[1], rowOrigin[2], imageJob->stepX[0], imageJob->stepX[1], imageJob->stepX[2], imageJob->persistence, imageJob->depth, imageJob->type == RANDOM_PERLIN_NOISE_TURBULENCE, row, image->width);
+
+		for(unsigned int x = 0; x < image->width; x++) {
+			setImage(image, x, y, imageJob->channel, row[x]);
+		}
+	}
+
+	free(row);
+}
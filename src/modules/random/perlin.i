@@ -21,6 +21,17 @@
 #ifndef RANDOM_PERLIN_H
 #define RANDOM_PERLIN_H
 
+#include "modules/image/image.h"
+
+/**
+ * Enum listing the types of noise that can be composed from perlin noise octaves
+ */
+typedef enum {
+	/** Fractional Brownian motion noise, see noiseFBm */
+	RANDOM_PERLIN_NOISE_FBM,
+	/** Turbulence noise, see noiseTurbulence */
+	RANDOM_PERLIN_NOISE_TURBULENCE
+} RandomPerlinNoise;
 
 /**
  * Initialized the perlin noise generator
@@ -68,4 +79,70 @@ API float noiseFBm(double x, double y, double z, double persistence, unsigned in
  */
 API float noiseTurbulence(double x, double y, double z, double persistence, unsigned int depth);
 
+
+/**
+ * Generates perlin noise values for a row of evenly spaced samples, which is a lot faster than calling randomPerlin for each of them
+ *
+ * @see randomPerlin
+ * @param x					the x coordinate of the first sample
+ * @param y					the y coordinate of the first sample
+ * @param z					the z coordinate of the first sample
+ * @param stepX				the x offset between two consecutive samples
+ * @param stepY				the y offset between two consecutive samples
+ * @param stepZ				the z offset between two consecutive samples
+ * @param values			the array to write the count noise values to
+ * @param count				the number of samples to generate
+ */
+API void randomPerlinRow(double x, double y, double z, double stepX, double stepY, double stepZ, float *values, unsigned int count);
+
+/**
+ * Generates fractional Brownian motion (fBm) noise for a row of evenly spaced samples
+ *
+ * @see noiseFBm
+ * @param x					the x coordinate of the first sample
+ * @param y					the y coordinate of the first sample
+ * @param z					the z coordinate of the first sample
+ * @param stepX				the x offset between two consecutive samples
+ * @param stepY				the y offset between two consecutive samples
+ * @param stepZ				the z offset between two consecutive samples
+ * @param persistence		the persistence of the franctional Brownian noise to generate
+ * @param depth				the number of octaves to overlay for the fractional Brownian noise
+ * @param values			the array to write the count noise values to
+ * @param count				the number of samples to generate
+ */
+API void noiseFBmRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, float *values, unsigned int count);
+
+/**
+ * Generates turbulence noise for a row of evenly spaced samples
+ *
+ * @see noiseTurbulence
+ * @param x					the x coordinate of the first sample
+ * @param y					the y coordinate of the first sample
+ * @param z					the z coordinate of the first sample
+ * @param stepX				the x offset between two consecutive samples
+ * @param stepY				the y offset between two consecutive samples
+ * @param stepZ				the z offset between two consecutive samples
+ * @param persistence		the persistence of the turbulence noise to generate
+ * @param depth				the number of octaves to overlay for the turbulence noise
+ * @param values			the array to write the count noise values to
+ * @param count				the number of samples to generate
+ */
+API void noiseTurbulenceRow(double x, double y, double z, double stepX, double stepY, double stepZ, double persistence, unsigned int depth, float *values, unsigned int count);
+
+/**
+ * Fills an image channel with fBm or turbulence noise, spreading the rows over all available processors
+ *
+ * Pixel (x, y) is assigned the noise at origin + x * stepX + y * stepY.
+ *
+ * @param image				the image to fill
+ * @param channel			the image channel to fill
+ * @param type				the type of noise to fill the channel with
+ * @param origin			the three noise coordinates of pixel (0, 0)
+ * @param stepX				the three noise coordinate offsets between two horizontally adjacent pixels
+ * @param stepY				the three noise coordinate offsets between two vertically adjacent pixels
+ * @param persistence		the persistence of the noise to generate
+ * @param depth				the number of octaves to overlay
+ */
+API void noiseImage(Image *image, unsigned int channel, RandomPerlinNoise type, double *origin, double *stepX, double *stepY, double persistence, unsigned int depth);
+
 #endif
@@ -20,6 +20,7 @@
 
 #include <math.h>
 #include <assert.h>
+#include <string.h>
 #include <glib.h>
 #include "dll.h"
 #define API
@@ -29,9 +30,15 @@
 MODULE_NAME("random");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Randomness functions");
-MODULE_VERSION(0, 6, 4);
-MODULE_BCVERSION(0, 6, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("linalg", 0, 3, 4));
+MODULE_VERSION(0, 9, 1);
+MODULE_BCVERSION(0, 7, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("linalg", 0, 5, 0), MODULE_DEPENDENCY("image", 0, 5, 16));
+
+/** Incremented for every seed created by createRandomSeed so seeds requested within the same microsecond still differ */
+static volatile gint seedCounter = 0;
+
+static uint64_t splitMix(uint64_t *state);
+static void gaussianPairs(float *values, size_t count, double mean, double std);
 
 MODULE_INIT
 {
@@ -49,27 +56,85 @@ MODULE_FINALIZE
 	freePerlin();
 }
 
-API float randomGaussian(double mean, double std)
+API RandomGenerator *createRandomGenerator(uint64_t seed)
+{
+	RandomGenerator *generator = ALLOCATE_OBJECT(RandomGenerator);
+	seedRandomGenerator(generator, seed);
+
+	return generator;
+}
+
+API void freeRandomGenerator(RandomGenerator *generator)
+{
+	free(generator);
+}
+
+API void seedRandomGenerator(RandomGenerator *generator, uint64_t seed)
+{
+	// expand the seed with SplitMix64 as recommended for xoshiro, which also guarantees a state that isn't all zeros
+	for(int i = 0; i < 4; i++) {
+		generator->state[i] = splitMix(&seed);
+	}
+
+	generator->hasGaussian = false;
+	generator->gaussian = 0.0f;
+}
+
+API void jumpRandomGenerator(RandomGenerator *generator)
 {
+	static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+	uint64_t state[4] = {0, 0, 0, 0};
+
+	for(int i = 0; i < 4; i++) {
+		for(int b = 0; b < 64; b++) {
+			if(jump[i] & ((uint64_t) 1 << b)) {
+				for(int j = 0; j < 4; j++) {
+					state[j] ^= generator->state[j];
+				}
+			}
+
+			randomNext(generator);
+		}
+	}
+
+	for(int j = 0; j < 4; j++) {
+		generator->state[j] = state[j];
+	}
+
+	generator->hasGaussian = false;
+}
+
+API uint64_t createRandomSeed()
+{
+	uint64_t state = (uint64_t) g_get_real_time() ^ ((uint64_t) g_atomic_int_add(&seedCounter, 1) << 40);
+	return splitMix(&state);
+}
+
+API float randomGaussian(RandomGenerator *generator, double mean, double std)
+{
+	if(generator->hasGaussian) {
+		generator->hasGaussian = false;
+		return mean + std * generator->gaussian;
+	}
+
 	float x1, x2, w;
 
 	do {
-		x1 = 2.0f * randomUniform() - 1.0f;
-		x2 = 2.0f * randomUniform() - 1.0f;
+		x1 = 2.0f * randomGeneratorUniform(generator) - 1.0f;
+		x2 = 2.0f * randomGeneratorUniform(generator) - 1.0f;
 		w = x1 * x1 + x2 * x2;
-	} while(w >= 1.0f);
+	} while(w >= 1.0f || w == 0.0f);
 
 	w = sqrt((-2.0f * log(w)) / w);
+
+	// the polar method generates two independent samples, so keep the second one for the next call
+	generator->gaussian = x2 * w;
+	generator->hasGaussian = true;
+
 	return mean + std * x1 * w;
 }
 
-/**
- * Computes a random permutation of the specified size
- *
- * @param size			the size of the permutation
- * @result				an allocated array containing the permutation with size elements, must be freed by the caller after use
- */
-API unsigned int *randomPermutation(unsigned int size)
+API unsigned int *randomPermutation(RandomGenerator *generator, unsigned int size)
 {
 	unsigned int *permutation = ALLOCATE_OBJECTS(unsigned int, size);
 
@@ -77,8 +142,8 @@ API unsigned int *randomPermutation(unsigned int size)
 		permutation[i] = i;
 	}
 
-	for(unsigned int i = size - 1; i > 0; i--) {
-		int j = randomUniformInteger(0, i);
+	for(unsigned int i = size - 1; i > 0 && i < size; i--) {
+		int j = randomGeneratorUniformInteger(generator, 0, i);
 		unsigned int temp = permutation[j];
 		permutation[j] = permutation[i];
 		permutation[i] = temp;
@@ -86,3 +151,110 @@ API unsigned int *randomPermutation(unsigned int size)
 
 	return permutation;
 }
+
+API void randomFillUniform(RandomGenerator *generator, float *values, size_t count)
+{
+	size_t i = 0;
+
+	// every 64 bit output yields two floats with 24 bits of randomness each
+	for(; i + 1 < count; i += 2) {
+		uint64_t bits = randomNext(generator);
+		values[i] = (bits >> 40) * (1.0f / 16777216.0f);
+		values[i + 1] = ((bits >> 8) & 0xFFFFFF) * (1.0f / 16777216.0f);
+	}
+
+	if(i < count) {
+		values[i] = randomGeneratorUniform(generator);
+	}
+}
+
+API void randomFillGaussian(RandomGenerator *generator, float *values, size_t count, double mean, double std)
+{
+	randomFillUniform(generator, values, count);
+
+	if(count % 2 == 1) { // the pairwise transform below needs an even count
+		values[count - 1] = randomGaussian(generator, mean, std);
+		count--;
+	}
+
+	gaussianPairs(values, count, mean, std);
+}
+
+API void randomFillUniformCounter(uint64_t key, uint64_t offset, float *values, size_t count)
+{
+	size_t i = 0;
+
+	// unaligned head until the stream position is a multiple of four
+	for(; i < count && ((offset + i) & 3) != 0; i++) {
+		values[i] = randomCounterUniform(key, offset + i);
+	}
+
+	// full blocks of four values per counter
+	for(; i + 4 <= count; i += 4) {
+		uint32_t bits[4];
+		randomPhilox(key, (offset + i) >> 2, bits);
+
+		for(int lane = 0; lane < 4; lane++) {
+			values[i + lane] = (bits[lane] >> 8) * (1.0f / 16777216.0f);
+		}
+	}
+
+	for(; i < count; i++) {
+		values[i] = randomCounterUniform(key, offset + i);
+	}
+}
+
+API void randomFillGaussianCounter(uint64_t key, uint64_t offset, float *values, size_t count, double mean, double std)
+{
+	// each gaussian is computed from its pair of uniforms at stream positions (2k, 2k+1), so generate the pairs covering the range
+	uint64_t first = offset & ~(uint64_t) 1;
+	size_t padded = (size_t) (((offset + count + 1) & ~(uint64_t) 1) - first);
+	float *pairs = g_new(float, padded > 0 ? padded : 1);
+
+	randomFillUniformCounter(key, first, pairs, padded);
+	gaussianPairs(pairs, padded, mean, std);
+	memcpy(values, pairs + (offset - first), count * sizeof(float));
+
+	g_free(pairs);
+}
+
+/**
+ * Advances a SplitMix64 state and returns its next output
+ *
+ * @param state			the state to advance
+ * @result				64 well mixed bits
+ */
+static uint64_t splitMix(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Transforms pairs of uniform random numbers in place into pairs of gaussian random numbers using the Box-Muller transform. Unlike the polar
+ * method, this doesn't reject samples, so the loop has no data dependent control flow and can be vectorized by the compiler.
+ *
+ * @param values		the uniform random numbers to transform
+ * @param count			the number of values to transform, must be even
+ * @param mean			the mean value of the gaussian distribution
+ * @param std			the standard deviation of the gaussian distribution
+ */
+static void gaussianPairs(float *values, size_t count, double mean, double std)
+{
+	assert(count % 2 == 0);
+
+	float m = mean;
+	float s = std;
+
+	for(size_t i = 0; i < count; i += 2) {
+		float u1 = 1.0f - values[i]; // in (0, 1], so the logarithm is finite
+		float u2 = values[i + 1];
+		float r = sqrtf(-2.0f * logf(u1));
+		float theta = 2.0f * (float) M_PI * u2;
+
+		values[i] = m + s * r * cosf(theta);
+		values[i + 1] = m + s * r * sinf(theta);
+	}
+}
@@ -22,9 +22,23 @@
 #define RANDOM_RANDOM_H
 
 #include <stdlib.h>
+#include <stdint.h>
 
 /**
- * Returns a random float number between 0 and 1
+ * A seedable pseudo random number generator (xoshiro256**). Generators aren't synchronized, so every thread should use its own generator.
+ */
+typedef struct {
+	/** the internal state of the generator */
+	uint64_t state[4];
+	/** true if a second gaussian sample from the last computation is cached */
+	bool hasGaussian;
+	/** the cached gaussian sample */
+	float gaussian;
+} RandomGenerator;
+
+/**
+ * Returns a random float number between 0 and 1 from the process-global C library generator.
+ * This generator isn't thread-safe and its results aren't reproducible, prefer using a RandomGenerator instead.
  *
  * @result			the generated random number
  */
@@ -34,7 +48,8 @@ static inline float randomUniform()
 }
 
 /**
- * Returns a random integer number between specified min and max values
+ * Returns a random integer number between specified min and max values from the process-global C library generator.
+ * This generator isn't thread-safe and its results aren't reproducible, prefer using a RandomGenerator instead.
  *
  * @param min		the minimum number to generate
  * @param max		the maximum number to generate
@@ -45,15 +60,214 @@ static inline int randomUniformInteger(int min, int max)
 	return min + (max - min) * randomUniform();
 }
 
+/**
+ * Rotates a 64 bit integer to the left
+ *
+ * @param x			the integer to rotate
+ * @param k			the number of bits to rotate by
+ * @result			the rotated integer
+ */
+static inline uint64_t randomRotate(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * Advances a random generator and returns 64 random bits
+ *
+ * @param generator		the random generator to use
+ * @result				64 random bits
+ */
+static inline uint64_t randomNext(RandomGenerator *generator)
+{
+	uint64_t *s = generator->state;
+	uint64_t result = randomRotate(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = randomRotate(s[3], 45);
+
+	return result;
+}
+
+/**
+ * Returns a random float number between 0 (inclusive) and 1 (exclusive) from a random generator
+ *
+ * @param generator		the random generator to use
+ * @result				the generated random number
+ */
+static inline float randomGeneratorUniform(RandomGenerator *generator)
+{
+	return (randomNext(generator) >> 40) * (1.0f / 16777216.0f);
+}
+
+/**
+ * Returns a random integer number between specified min and max values from a random generator
+ *
+ * @param generator		the random generator to use
+ * @param min			the minimum number to generate
+ * @param max			the maximum number to generate
+ * @result				the generated random number between min and max (inclusive)
+ */
+static inline int randomGeneratorUniformInteger(RandomGenerator *generator, int min, int max)
+{
+	uint64_t range = (uint64_t) ((int64_t) max - min + 1);
+	return min + (int) (((randomNext(generator) >> 32) * range) >> 32);
+}
+
+/**
+ * Computes the Philox4x32-10 counter-based random function. The result only depends on the key and the counter, so random numbers can be
+ * generated in parallel and in any order while staying reproducible.
+ *
+ * @param key			the key (seed) of the random stream
+ * @param counter		the position in the random stream
+ * @param result		array into which the 128 random bits for the counter are written
+ */
+static inline void randomPhilox(uint64_t key, uint64_t counter, uint32_t result[4])
+{
+	uint32_t c0 = (uint32_t) counter;
+	uint32_t c1 = (uint32_t) (counter >> 32);
+	uint32_t c2 = 0;
+	uint32_t c3 = 0;
+	uint32_t k0 = (uint32_t) key;
+	uint32_t k1 = (uint32_t) (key >> 32);
+
+	for(int round = 0; round < 10; round++) {
+		uint64_t p0 = (uint64_t) 0xD2511F53u * c0;
+		uint64_t p1 = (uint64_t) 0xCD9E8D57u * c2;
+
+		c0 = (uint32_t) (p1 >> 32) ^ c1 ^ k0;
+		c1 = (uint32_t) p1;
+		c2 = (uint32_t) (p0 >> 32) ^ c3 ^ k1;
+		c3 = (uint32_t) p0;
+
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+
+	result[0] = c0;
+	result[1] = c1;
+	result[2] = c2;
+	result[3] = c3;
+}
+
+/**
+ * Returns a random float number between 0 (inclusive) and 1 (exclusive) from a counter-based random stream.
+ * This is equivalent to the element at the same position written by randomFillUniformCounter.
+ *
+ * @param key			the key (seed) of the random stream
+ * @param index			the position in the random stream
+ * @result				the generated random number
+ */
+static inline float randomCounterUniform(uint64_t key, uint64_t index)
+{
+	uint32_t bits[4];
+	randomPhilox(key, index >> 2, bits);
+	return (bits[index & 3] >> 8) * (1.0f / 16777216.0f);
+}
+
+/**
+ * Creates a random generator
+ *
+ * @param seed			the seed for the random generator, equal seeds result in equal random sequences
+ * @result				the created random generator, must be freed with freeRandomGenerator
+ */
+API RandomGenerator *createRandomGenerator(uint64_t seed);
+
+/**
+ * Frees a random generator
+ *
+ * @param generator		the random generator to free
+ */
+API void freeRandomGenerator(RandomGenerator *generator);
+
+/**
+ * Reseeds a random generator
+ *
+ * @param generator		the random generator to reseed
+ * @param seed			the seed for the random generator
+ */
+API void seedRandomGenerator(RandomGenerator *generator, uint64_t seed);
+
+/**
+ * Advances a random generator by 2^128 steps. Calling this n times on copies of a generator creates n non-overlapping streams for parallel use.
+ *
+ * @param generator		the random generator to advance
+ */
+API void jumpRandomGenerator(RandomGenerator *generator);
+
+/**
+ * Returns a seed that is different on every call, for when reproducibility isn't required
+ *
+ * @result				a new seed
+ */
+API uint64_t createRandomSeed();
 
 /**
  * Returns a random gaussian number with specified distribution
  *
- * @param mean		the mean value of the gaussian distribution
- * @param std		the standard deviation of the gaussian distribution
- * @result			the gaussian random number
+ * @param generator		the random generator to use
+ * @param mean			the mean value of the gaussian distribution
+ * @param std			the standard deviation of the gaussian distribution
+ * @result				the gaussian random number
+ */
+API float randomGaussian(RandomGenerator *generator, double mean, double std);
+
+/**
+ * Computes a random permutation of the specified size
+ *
+ * @param generator		the random generator to use
+ * @param size			the size of the permutation
+ * @result				an allocated array containing the permutation with size elements, must be freed by the caller after use
+ */
+API unsigned int *randomPermutation(RandomGenerator *generator, unsigned int size);
+
+/**
+ * Fills an array with uniformly distributed random numbers between 0 (inclusive) and 1 (exclusive)
+ *
+ * @param generator		the random generator to use
+ * @param values		the array to fill
+ * @param count			the number of values to generate
+ */
+API void randomFillUniform(RandomGenerator *generator, float *values, size_t count);
+
+/**
+ * Fills an array with gaussian random numbers
+ *
+ * @param generator		the random generator to use
+ * @param values		the array to fill
+ * @param count			the number of values to generate
+ * @param mean			the mean value of the gaussian distribution
+ * @param std			the standard deviation of the gaussian distribution
+ */
+API void randomFillGaussian(RandomGenerator *generator, float *values, size_t count, double mean, double std);
+
+/**
+ * Fills an array with uniformly distributed random numbers between 0 (inclusive) and 1 (exclusive) from a counter-based random stream.
+ * Element i is the number at position offset + i of the stream, so disjoint parts of the stream may be generated by different threads.
+ *
+ * @param key			the key (seed) of the random stream
+ * @param offset		the position in the random stream of the first value
+ * @param values		the array to fill
+ * @param count			the number of values to generate
+ */
+API void randomFillUniformCounter(uint64_t key, uint64_t offset, float *values, size_t count);
+
+/**
+ * Fills an array with gaussian random numbers from a counter-based random stream.
+ * Element i is the number at position offset + i of the stream, so disjoint parts of the stream may be generated by different threads.
+ *
+ * @param key			the key (seed) of the random stream
+ * @param offset		the position in the random stream of the first value
+ * @param values		the array to fill
+ * @param count			the number of values to generate
+ * @param mean			the mean value of the gaussian distribution
+ * @param std			the standard deviation of the gaussian distribution
  */
-API float randomGaussian(double mean, double std);
-API unsigned int *randomPermutation(unsigned int size);
+API void randomFillGaussianCounter(uint64_t key, uint64_t offset, float *values, size_t count, double mean, double std);
 
 #endif
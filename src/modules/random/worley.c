@@ -23,22 +23,37 @@
 #include <assert.h>
 #include "dll.h"
 #include "modules/linalg/Vector.h"
+#include "modules/image/image.h"
 #define API
 #include "random.h"
 #include "worley.h"
 
+/** The maximum number of dimensions for which the points are indexed by a grid, higher dimensional contexts are searched exhaustively */
+#define WORLEY_GRID_MAX_DIMENSIONS 3
+/** The average number of points per grid cell */
+#define WORLEY_GRID_POINTS_PER_CELL 2
+
 /**
  * Private Woley noise context struct
  */
 struct RandomWorleyContextStruct {
-	/** array of all surface centers */
-	GPtrArray *points;
+	/** coordinates of all surface centers, dimensions floats per point, ordered by grid cell */
+	float *points;
 	/** number of points to use */
 	unsigned int count;
 	/** number of spacial dimensions */
 	unsigned int dimensions;
+	/** number of grid cells along each dimension of the unit cube, or 0 if the points aren't indexed by a grid */
+	unsigned int resolution;
+	/** for each grid cell, the index of its first point, followed by the total number of points */
+	unsigned int *cells;
 };
 
+static unsigned int getWorleyCell(RandomWorleyContext *context, float coordinate);
+static float computeWorley(RandomWorleyContext *context, const float *query, const int *weights, unsigned int weight_count, RandomWorleyDistance method);
+static void searchWorleyCell(RandomWorleyContext *context, unsigned int cell, const float *query, float *best, unsigned int k, unsigned int *found);
+static void insertWorleyDistance(float distance, float *best, unsigned int k, unsigned int *found);
+
 /**
  * Compare function for float distances
  *
@@ -55,24 +70,66 @@ static int compareDistances(const void *a, const void *b)
 	}
 }
 
-API RandomWorleyContext* createWorleyContext(unsigned int count, unsigned int dimensions)
+API RandomWorleyContext* createWorleyContext(RandomGenerator *generator, unsigned int count, unsigned int dimensions)
 {
 	RandomWorleyContext* context = ALLOCATE_OBJECT(RandomWorleyContext);
-	context->points = g_ptr_array_new();
 	context->count = count;
 	context->dimensions = dimensions;
+	context->resolution = 0;
+	context->cells = NULL;
 
-	for(unsigned int i = 0; i < count; i++) {
-		Vector *point = $(Vector *, linalg, createVector)(dimensions);
-		float *pointData = $(float *, linalg, getVectorData)(point);
+	float *points = ALLOCATE_OBJECTS(float, count * dimensions);
+	randomFillUniform(generator, points, count * dimensions);
 
-		for(unsigned int d = 0; d < dimensions; d++) {
-			pointData[d] = randomUniform();
+	if(dimensions == 0 || dimensions > WORLEY_GRID_MAX_DIMENSIONS || count < WORLEY_GRID_POINTS_PER_CELL) {
+		context->points = points; // too few points or too many dimensions to be worth a grid
+		return context;
+	}
+
+	// choose the grid resolution so that each cell contains a few points on average
+	unsigned int resolution = pow((double) count / WORLEY_GRID_POINTS_PER_CELL, 1.0 / dimensions);
+	if(resolution < 1) {
+		resolution = 1;
+	}
+
+	unsigned int numCells = 1;
+	for(unsigned int d = 0; d < dimensions; d++) {
+		numCells *= resolution;
+	}
+
+	context->resolution = resolution;
+	context->cells = ALLOCATE_OBJECTS(unsigned int, numCells + 1);
+	memset(context->cells, 0, (numCells + 1) * sizeof(unsigned int));
+
+	// sort the points into their grid cells with a counting sort
+	unsigned int *pointCells = ALLOCATE_OBJECTS(unsigned int, count);
+	for(unsigned int i = 0; i < count; i++) {
+		unsigned int cell = 0;
+		for(int d = dimensions - 1; d >= 0; d--) {
+			cell = cell * resolution + getWorleyCell(context, points[i * dimensions + d]);
 		}
 
-		g_ptr_array_add(context->points, point);
+		pointCells[i] = cell;
+		context->cells[cell + 1]++;
+	}
+
+	for(unsigned int cell = 0; cell < numCells; cell++) {
+		context->cells[cell + 1] += context->cells[cell];
+	}
+
+	unsigned int *next = ALLOCATE_OBJECTS(unsigned int, numCells);
+	memcpy(next, context->cells, numCells * sizeof(unsigned int));
+
+	context->points = ALLOCATE_OBJECTS(float, count * dimensions);
+	for(unsigned int i = 0; i < count; i++) {
+		unsigned int target = next[pointCells[i]]++;
+		memcpy(context->points + target * dimensions, points + i * dimensions, dimensions * sizeof(float));
 	}
 
+	free(next);
+	free(pointCells);
+	free(points);
+
 	return context;
 }
 
@@ -80,93 +137,267 @@ API void freeWorleyContext(RandomWorleyContext *context)
 {
 	assert(context != NULL);
 
-	for(unsigned int i = 0; i < context->points->len; i++) {
-		$(void, linalg, freeVector)(context->points->pdata[i]);
-	}
-	g_ptr_array_free(context->points, true);
+	free(context->points);
+	free(context->cells);
 	free(context);
 }
 
+API float randomWorley(RandomWorleyContext *context, Vector *query, unsigned int neighbour, RandomWorleyDistance method)
+{
+	assert(context != NULL);
+	assert(neighbour > 0 && neighbour <= context->count);
+	assert($(unsigned int, linalg, getVectorSize)(query) == context->dimensions);
+
+	int weights[neighbour];
+
+	for(unsigned int i=0; i<neighbour-1; i++) {
+			weights[i] = 0;
+	}
+	weights[neighbour-1] = 1;
+
+	return computeWorley(context, $(float *, linalg, getVectorData)(query), weights, neighbour, method);
+}
+
+API float randomWorleyDifference21(RandomWorleyContext *context, Vector *query, RandomWorleyDistance method)
+{
+	assert(context != NULL);
+	assert($(unsigned int, linalg, getVectorSize)(query) == context->dimensions);
+
+	int weights[2] = {-1, 1};
+
+	return computeWorley(context, $(float *, linalg, getVectorData)(query), weights, 2, method);
+}
+
+API float randomWorleyDifference32(RandomWorleyContext *context, Vector *query, RandomWorleyDistance method)
+{
+	assert(context != NULL);
+	assert($(unsigned int, linalg, getVectorSize)(query) == context->dimensions);
+
+	int weights[3] = {0, -1, 1};
+
+	return computeWorley(context, $(float *, linalg, getVectorData)(query), weights, 3, method);
+}
+
+API bool randomWorleyImage(RandomWorleyContext *context, Image *image, unsigned int channel, const int *weights, unsigned int weight_count, RandomWorleyDistance method)
+{
+	assert(context != NULL);
+
+	if(context->dimensions != 2) {
+		logError("Failed to compute Worley noise image: Worley context has %u dimensions instead of 2", context->dimensions);
+		return false;
+	}
+
+	if(channel >= image->channels) {
+		logError("Failed to compute Worley noise image: Channel %u doesn't exist in an image with %u channels", channel, image->channels);
+		return false;
+	}
+
+	if(weight_count == 0 || weight_count > context->count) {
+		logError("Failed to compute Worley noise image: Can't weight %u neighbours with a Worley context of %u points", weight_count, context->count);
+		return false;
+	}
+
+	for(unsigned int y = 0; y < image->height; y++) {
+		for(unsigned int x = 0; x < image->width; x++) {
+			float query[2] = {(double) x / image->width, (double) y / image->height};
+			setImage(image, x, y, channel, computeWorley(context, query, weights, weight_count, method));
+		}
+	}
+
+	return true;
+}
+
+API float randomWorleyExhaustive(RandomWorleyContext *context, Vector *query, unsigned int neighbour, RandomWorleyDistance method)
+{
+	assert(context != NULL);
+	assert(neighbour > 0 && neighbour <= context->count);
+
+	float *queryData = $(float *, linalg, getVectorData)(query);
+	float *distances = ALLOCATE_OBJECTS(float, context->count);
+
+	// compute all distances to the sample point
+	for(unsigned int i = 0; i < context->count; i++) {
+		float distance = 0.0f;
+		for(unsigned int d = 0; d < context->dimensions; d++) {
+			float diff = context->points[i * context->dimensions + d] - queryData[d];
+			distance += diff * diff;
+		}
+
+		distances[i] = method == RANDOM_WORLEY_DISTANCE_EUCLIDEAN ? sqrtf(distance) : distance;
+	}
+
+	// sort neighbours by the distance
+	qsort(distances, context->count, sizeof(float), &compareDistances);
+
+	float result = distances[neighbour - 1];
+	free(distances);
+
+	return result;
+}
+
 /**
- * Computes a sample in a Worley / Voronoi noise pattern
+ * Returns the grid cell index along one dimension for a coordinate, clamped to the grid
  *
- * Returns the distance to the n'th closest neighbour.
+ * @param context		a pointer to a Woley noise context with a grid
+ * @param coordinate	the coordinate to look up
+ * @result				the cell index along the dimension of the coordinate
+ */
+static unsigned int getWorleyCell(RandomWorleyContext *context, float coordinate)
+{
+	float cell = floorf(coordinate * context->resolution);
+
+	if(cell < 0.0f) {
+		return 0;
+	} else if(cell >= context->resolution) {
+		return context->resolution - 1;
+	}
+
+	return cell;
+}
+
+/**
+ * Computes a weighted sum of the distances to the closest neighbours of a query point without allocating any memory. If the points are
+ * indexed by a grid, only the rings of cells around the query's cell are searched that may still contain one of the closest neighbours.
  *
  * @param context		a pointer to a Woley noise context
- * @param query			the query point to lookup
+ * @param query			the coordinates of the query point
  * @param weights		array of neighbour weights
- * @param weight_count	length of the weight array
+ * @param weight_count	length of the weight array, i.e. the number of closest neighbours to find
  * @param method		distance measurement method
  * @return				Worley noise (> 0.0)
  */
-static float randomWorleyArray(RandomWorleyContext *context, Vector *query, int* weights, unsigned int weight_count, RandomWorleyDistance method)
+static float computeWorley(RandomWorleyContext *context, const float *query, const int *weights, unsigned int weight_count, RandomWorleyDistance method)
 {
 	assert(weight_count <= context->count);
 
-	float distances[context->count];
+	if(method != RANDOM_WORLEY_DISTANCE_EUCLIDEAN && method != RANDOM_WORLEY_DISTANCE_EUCLIDEAN_SQUARED) {
+		logError("Tried to compute Worley noise with invalid distance method '%d', aborting", method);
+		return 0.0f;
+	}
 
-	// compute all distances to the sample point
-	for(unsigned int i = 0; i < context->count; i++) {
-		Vector *point = context->points->pdata[i];
-		Vector *diff = $(Vector *, linalg, diffVectors)(point, query);
-
-		switch(method) {
-			case RANDOM_WORLEY_DISTANCE_EUCLIDEAN:
-				distances[i] = $(float, linalg, getVectorLength)(diff);
-			break;
-			case RANDOM_WORLEY_DISTANCE_EUCLIDEAN_SQUARED:
-				distances[i] = $(float, linalg, getVectorLength2)(diff);
-			break;
-			default:
-				logError("Tried to compute Worley noise with invalid distance method '%d', aborting", method);
-				return 0.0f;
-			break;
+	// squared distances of the closest neighbours found so far in ascending order
+	float best[weight_count];
+	unsigned int found = 0;
+
+	if(context->resolution == 0) { // no grid, so check every point
+		for(unsigned int i = 0; i < context->count; i++) {
+			float distance = 0.0f;
+			for(unsigned int d = 0; d < context->dimensions; d++) {
+				float diff = context->points[i * context->dimensions + d] - query[d];
+				distance += diff * diff;
+			}
+
+			insertWorleyDistance(distance, best, weight_count, &found);
 		}
+	} else {
+		unsigned int dimensions = context->dimensions;
+		int resolution = context->resolution;
+		float cellSize = 1.0f / resolution;
+		int center[WORLEY_GRID_MAX_DIMENSIONS] = {0, 0, 0};
+		int maxRing = 0;
 
-		$(void, linalg, freeVector)(diff);
-	}
+		// the distance from the query to the closest face of its cell bounds the distance to any cell in the next ring
+		float margin = cellSize;
+		for(unsigned int d = 0; d < dimensions; d++) {
+			center[d] = getWorleyCell(context, query[d]);
 
-	// sort neighbours by the distance
-	qsort(distances, context->count, sizeof(float), &compareDistances);
+			float low = query[d] - center[d] * cellSize;
+			float high = (center[d] + 1) * cellSize - query[d];
+			margin = MIN(margin, MIN(low, high));
+			maxRing = MAX(maxRing, MAX(center[d], resolution - 1 - center[d]));
+		}
+		margin = MAX(margin, 0.0f);
+
+		for(int ring = 0; ring <= maxRing; ring++) {
+			// visit all cells with a Chebyshev distance of exactly ring to the center cell
+			int low[WORLEY_GRID_MAX_DIMENSIONS] = {0, 0, 0};
+			int high[WORLEY_GRID_MAX_DIMENSIONS] = {0, 0, 0};
+			for(unsigned int d = 0; d < dimensions; d++) {
+				low[d] = center[d] - ring;
+				high[d] = center[d] + ring;
+			}
+
+			for(int z = MAX(low[2], 0); z <= MIN(high[2], dimensions > 2 ? resolution - 1 : 0); z++) {
+				for(int y = MAX(low[1], 0); y <= MIN(high[1], dimensions > 1 ? resolution - 1 : 0); y++) {
+					bool onShell = (dimensions > 2 && (z == low[2] || z == high[2])) || (dimensions > 1 && (y == low[1] || y == high[1]));
+					// inside the shell, only the two cells at the ends of the x range belong to the ring
+					int step = (onShell || ring == 0) ? 1 : 2 * ring;
+
+					for(int x = low[0]; x <= high[0]; x += step) {
+						if(x < 0 || x >= resolution) {
+							continue;
+						}
+
+						searchWorleyCell(context, (z * resolution + y) * resolution + x, query, best, weight_count, &found);
+					}
+				}
+			}
+
+			if(found == weight_count) {
+				float bound = ring * cellSize + margin;
+				if(best[weight_count - 1] <= bound * bound) {
+					break; // no point in the next ring can be closer than the ones we already have
+				}
+			}
+		}
+	}
 
 	// sum weighted neighbour distances
 	float result = 0;
 	for(unsigned int i=0; i<weight_count; i++) {
-		result += weights[i]*distances[i];
+		float distance = method == RANDOM_WORLEY_DISTANCE_EUCLIDEAN ? sqrtf(best[i]) : best[i];
+		result += weights[i]*distance;
 	}
 
 	return result;
 }
 
-API float randomWorley(RandomWorleyContext *context, Vector *query, unsigned int neighbour, RandomWorleyDistance method)
+/**
+ * Checks all points of a grid cell for closest neighbours of a query point
+ *
+ * @param context		a pointer to a Woley noise context with a grid
+ * @param cell			the index of the grid cell to search
+ * @param query			the coordinates of the query point
+ * @param best			sorted array of the squared distances of the closest neighbours found so far
+ * @param k				the number of closest neighbours to find
+ * @param found			pointer to the number of closest neighbours found so far
+ */
+static void searchWorleyCell(RandomWorleyContext *context, unsigned int cell, const float *query, float *best, unsigned int k, unsigned int *found)
 {
-	assert(context != NULL);
-	assert(neighbour > 0 && neighbour <= context->count);
-
-	int weights[neighbour];
-
-	for(unsigned int i=0; i<neighbour-1; i++) {
-			weights[i] = 0;
-	}
-	weights[neighbour-1] = 1;
+	unsigned int dimensions = context->dimensions;
 
-	return randomWorleyArray(context, query, weights, neighbour, method);
-}
-
-API float randomWorleyDifference21(RandomWorleyContext *context, Vector *query, RandomWorleyDistance method)
-{
-	assert(context != NULL);
+	for(unsigned int i = context->cells[cell]; i < context->cells[cell + 1]; i++) {
+		const float *point = context->points + i * dimensions;
+		float distance = 0.0f;
 
-	int weights[2] = {-1, 1};
+		for(unsigned int d = 0; d < dimensions; d++) {
+			float diff = point[d] - query[d];
+			distance += diff * diff;
+		}
 
-	return randomWorleyArray(context, query, weights, 2, method);
+		insertWorleyDistance(distance, best, k, found);
+	}
 }
 
-API float randomWorleyDifference32(RandomWorleyContext *context, Vector *query, RandomWorleyDistance method)
+/**
+ * Inserts a distance into the sorted array of the k smallest distances found so far, dropping the largest one if the array is full
+ *
+ * @param distance		the distance to insert
+ * @param best			sorted array of the smallest distances found so far
+ * @param k				the capacity of the array
+ * @param found			pointer to the number of distances in the array
+ */
+static void insertWorleyDistance(float distance, float *best, unsigned int k, unsigned int *found)
 {
-	assert(context != NULL);
+	if(*found == k && distance >= best[k - 1]) {
+		return;
+	}
 
-	int weights[3] = {0, -1, 1};
+	unsigned int i = *found < k ? (*found)++ : k - 1;
+	while(i > 0 && best[i - 1] > distance) {
+		best[i] = best[i - 1];
+		i--;
+	}
 
-	return randomWorleyArray(context, query, weights, 3, method);
+	best[i] = distance;
 }
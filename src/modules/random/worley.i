@@ -22,6 +22,8 @@
 #define RANDOM_WORLEY_H
 
 #include "modules/linalg/Vector.h"
+#include "modules/image/image.h"
+#include "random.h"
 
 /**
  * Enum listing possible distance functions for worley noise
@@ -41,14 +43,16 @@ typedef struct RandomWorleyContextStruct RandomWorleyContext;
 /**
  * Initializes a Worley noise context
  *
- * The caller has to free it with 'freeWorleyContext' after use.
+ * The caller has to free it with 'freeWorleyContext' after use. For up to three dimensions, the points are sorted into a uniform grid
+ * over the unit cube so that queries only have to look at the few cells around the query point.
  *
  * @see freeWorleyContext
+ * @param generator			the random generator to place the points with
  * @param count				number of points in space
  * @param dimensions		number of spacial dimensions
  * @return 					a new worley context
  */
-API RandomWorleyContext* createWorleyContext(unsigned int count, unsigned int dimensions);
+API RandomWorleyContext* createWorleyContext(RandomGenerator *generator, unsigned int count, unsigned int dimensions);
 
 /**
  * Frees a Worley noise context
@@ -94,4 +98,34 @@ API float randomWorleyDifference21(RandomWorleyContext *context, Vector *query,
  */
 API float randomWorleyDifference32(RandomWorleyContext *context, Vector *query, RandomWorleyDistance method);
 
+
+/**
+ * Computes a weighted Worley / Voronoi noise sample for every pixel of an image channel without any per pixel allocations
+ *
+ * Pixel (x, y) is mapped to the query point (x / width, y / height), so the context must have two dimensions.
+ *
+ * @param context		a pointer to a two dimensional Woley noise context
+ * @param image			the image to write the noise to
+ * @param channel		the image channel to write the noise to
+ * @param weights		array of weights for the distances to the closest, second closest, ... neighbour
+ * @param weight_count	length of the weight array
+ * @param method		distance measurement method
+ * @result				true if successful
+ */
+API bool randomWorleyImage(RandomWorleyContext *context, Image *image, unsigned int channel, const int *weights, unsigned int weight_count, RandomWorleyDistance method);
+
+/**
+ * Computes a sample in a Worley / Voronoi noise pattern by sorting the distances to all points
+ *
+ * This is much slower than randomWorley and only useful as a reference for it.
+ *
+ * @see randomWorley
+ * @param context		a pointer to a Woley noise context
+ * @param query			the query point to lookup
+ * @param neighbour		n'th closest neighbour that has influence
+ * @param method		distance measurement method
+ * @return				Worley noise (> 0.0)
+ */
+API float randomWorleyExhaustive(RandomWorleyContext *context, Vector *query, unsigned int neighbour, RandomWorleyDistance method);
+
 #endif
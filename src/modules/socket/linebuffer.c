@@ -0,0 +1,204 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h> // memchr, memcpy
+#include <stdlib.h> // free
+#include <glib.h>
+
+#include "dll.h"
+#define API
+#include "linebuffer.h"
+
+static void resizeLineBuffer(LineBuffer *buffer, unsigned int size);
+static void consumeLineBuffer(LineBuffer *buffer, unsigned int size);
+static bool findLineBufferTerminator(LineBuffer *buffer, unsigned int *offset_p);
+
+API LineBuffer *createLineBuffer(bool skip_empty)
+{
+	LineBuffer *buffer = ALLOCATE_OBJECT(LineBuffer);
+	buffer->data = ALLOCATE_OBJECTS(char, LINE_BUFFER_INITIAL_SIZE);
+	buffer->size = LINE_BUFFER_INITIAL_SIZE;
+	buffer->start = 0;
+	buffer->length = 0;
+	buffer->scanned = 0;
+	buffer->skip_empty = skip_empty;
+
+	return buffer;
+}
+
+API void freeLineBuffer(LineBuffer *buffer)
+{
+	free(buffer->data);
+	free(buffer);
+}
+
+API void appendLineBuffer(LineBuffer *buffer, const char *data, unsigned int size)
+{
+	if(buffer->length + size >= buffer->size) { // always keep at least one byte free so a full buffer can be told apart from an empty one
+		unsigned int newSize = buffer->size;
+		while(buffer->length + size >= newSize) {
+			newSize *= 2;
+		}
+
+		resizeLineBuffer(buffer, newSize);
+	}
+
+	unsigned int end = (buffer->start + buffer->length) & (buffer->size - 1);
+	unsigned int first = buffer->size - end;
+
+	if(size <= first) {
+		memcpy(buffer->data + end, data, size);
+	} else { // the appended data wraps around the end of the ring
+		memcpy(buffer->data + end, data, first);
+		memcpy(buffer->data, data + first, size - first);
+	}
+
+	buffer->length += size;
+}
+
+API bool readLineBufferLine(LineBuffer *buffer, char **line_p, unsigned int *length_p)
+{
+	unsigned int offset;
+
+	while(findLineBufferTerminator(buffer, &offset)) {
+		if(buffer->start + offset >= buffer->size) { // the line wraps around the end of the ring, move it to the front so it can be returned as one piece
+			resizeLineBuffer(buffer, buffer->size);
+		}
+
+		char *line = buffer->data + buffer->start;
+		unsigned int length = offset;
+
+		while(length > 0 && line[length - 1] == '\r') {
+			length--;
+		}
+
+		line[length] = '\0'; // overwrites the terminator, so the line stays intact
+		consumeLineBuffer(buffer, offset + 1);
+
+		if(length == 0 && buffer->skip_empty) {
+			continue;
+		}
+
+		*line_p = line;
+
+		if(length_p != NULL) {
+			*length_p = length;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+API char *readLineBufferBytes(LineBuffer *buffer, unsigned int size)
+{
+	if(size > buffer->length) {
+		return NULL;
+	}
+
+	if(buffer->start + size > buffer->size) { // the requested bytes wrap around the end of the ring
+		resizeLineBuffer(buffer, buffer->size);
+	}
+
+	char *bytes = buffer->data + buffer->start;
+	consumeLineBuffer(buffer, size);
+
+	return bytes;
+}
+
+API void clearLineBuffer(LineBuffer *buffer)
+{
+	buffer->start = 0;
+	buffer->length = 0;
+	buffer->scanned = 0;
+}
+
+/**
+ * Moves the unread contents of a line buffer into a new ring storage of the given size, starting at offset zero
+ *
+ * @param buffer			the line buffer to resize
+ * @param size				the new size of the ring storage, must be a power of two larger than the buffer's length
+ */
+static void resizeLineBuffer(LineBuffer *buffer, unsigned int size)
+{
+	char *data = ALLOCATE_OBJECTS(char, size);
+	unsigned int first = buffer->size - buffer->start;
+
+	if(buffer->length <= first) {
+		memcpy(data, buffer->data + buffer->start, buffer->length);
+	} else {
+		memcpy(data, buffer->data + buffer->start, first);
+		memcpy(data + first, buffer->data, buffer->length - first);
+	}
+
+	free(buffer->data);
+	buffer->data = data;
+	buffer->size = size;
+	buffer->start = 0;
+}
+
+/**
+ * Marks bytes at the start of a line buffer as read
+ *
+ * @param buffer			the line buffer to consume from
+ * @param size				the number of bytes to consume
+ */
+static void consumeLineBuffer(LineBuffer *buffer, unsigned int size)
+{
+	buffer->length -= size;
+	buffer->scanned = 0;
+
+	if(buffer->length == 0) { // rewind an empty buffer so following lines are unlikely to wrap
+		buffer->start = 0;
+	} else {
+		buffer->start = (buffer->start + size) & (buffer->size - 1);
+	}
+}
+
+/**
+ * Searches the unread contents of a line buffer for a line terminator, skipping bytes already scanned by previous calls
+ *
+ * @param buffer			the line buffer to search
+ * @param offset_p			a pointer to be set to the terminator's offset relative to the buffer's start
+ * @result					true if a terminator was found
+ */
+static bool findLineBufferTerminator(LineBuffer *buffer, unsigned int *offset_p)
+{
+	while(buffer->scanned < buffer->length) {
+		unsigned int position = (buffer->start + buffer->scanned) & (buffer->size - 1);
+		unsigned int chunk = buffer->length - buffer->scanned;
+
+		if(position + chunk > buffer->size) { // only scan up to the end of the ring, the rest is handled by the next iteration
+			chunk = buffer->size - position;
+		}
+
+		char *found = memchr(buffer->data + position, '\n', chunk);
+
+		if(found != NULL) {
+			*offset_p = buffer->scanned + (found - (buffer->data + position));
+			return true;
+		}
+
+		buffer->scanned += chunk;
+	}
+
+	return false;
+}
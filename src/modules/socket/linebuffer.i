@@ -0,0 +1,112 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SOCKET_LINEBUFFER_H
+#define SOCKET_LINEBUFFER_H
+
+#include "types.h"
+
+/**
+ * A line buffer frames a stream of incoming socket data into lines. Data is stored in a growable ring buffer and lines are handed out as views into
+ * that storage, so reading a line neither copies nor allocates. Only bytes that have not been searched for a line terminator before are scanned when
+ * looking for the next line.
+ */
+typedef struct {
+	/** the ring storage of the buffer */
+	char *data;
+	/** the capacity of the ring storage, always a power of two */
+	unsigned int size;
+	/** the offset of the first unread byte in the ring storage */
+	unsigned int start;
+	/** the number of unread bytes in the buffer */
+	unsigned int length;
+	/** the number of unread bytes that are already known not to contain a line terminator */
+	unsigned int scanned;
+	/** whether empty lines should be skipped instead of being returned */
+	bool skip_empty;
+} LineBuffer;
+
+
+/**
+ * Creates a line buffer
+ *
+ * @param skip_empty		if true, empty lines are silently dropped instead of being returned
+ * @result					the created line buffer
+ */
+API LineBuffer *createLineBuffer(bool skip_empty);
+
+/**
+ * Frees a line buffer. All line views previously returned from it become invalid.
+ *
+ * @param buffer			the line buffer to free
+ */
+API void freeLineBuffer(LineBuffer *buffer);
+
+/**
+ * Appends raw data received from a socket to a line buffer, growing it if necessary. All line views previously returned from the buffer become invalid.
+ *
+ * @param buffer			the line buffer to append to
+ * @param data				the data to append
+ * @param size				the number of bytes to append
+ */
+API void appendLineBuffer(LineBuffer *buffer, const char *data, unsigned int size);
+
+/**
+ * Reads the next complete line from a line buffer. Lines are terminated by "\n", and trailing "\r" characters are stripped. The returned line is
+ * NUL-terminated in place and stays valid until the next operation on the buffer.
+ *
+ * @param buffer			the line buffer to read from
+ * @param line_p			a pointer to be set to the start of the line
+ * @param length_p			a pointer to be set to the length of the line, or NULL if not needed
+ * @result					true if a line was read, false if the buffer doesn't contain a complete line yet
+ */
+API bool readLineBufferLine(LineBuffer *buffer, char **line_p, unsigned int *length_p);
+
+/**
+ * Reads a fixed number of raw bytes from a line buffer regardless of line terminators, e.g. to retrieve a message body following a header. The returned
+ * bytes are NOT NUL-terminated and stay valid until the next operation on the buffer.
+ *
+ * @param buffer			the line buffer to read from
+ * @param size				the number of bytes to read
+ * @result					a pointer to the bytes read, or NULL if the buffer doesn't contain that many bytes yet
+ */
+API char *readLineBufferBytes(LineBuffer *buffer, unsigned int size);
+
+/**
+ * Discards all unread data in a line buffer
+ *
+ * @param buffer			the line buffer to clear
+ */
+API void clearLineBuffer(LineBuffer *buffer);
+
+/**
+ * Returns the number of unread bytes in a line buffer
+ *
+ * @param buffer			the line buffer to check
+ * @result					the number of unread bytes
+ */
+static inline unsigned int getLineBufferLength(LineBuffer *buffer)
+{
+	return buffer->length;
+}
+
+#define LINE_BUFFER_INITIAL_SIZE 512
+
+#endif
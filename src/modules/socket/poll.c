@@ -30,13 +30,19 @@
 #include <netdb.h> // getaddrinfo, addrinfo, freeaddrinfo
 #include <fcntl.h>
 #include <sys/select.h> // select, timeval
+#include <sys/poll.h> // poll, pollfd, not poll.h which would resolve to our own header
 #include <netinet/in.h> // FreeBSD needs this, linux doesn't care ;)
 #endif
+#ifdef __linux__
+#include <sys/epoll.h> // epoll_create1, epoll_ctl, epoll_wait
+#define SOCKET_POLL_EPOLL
+#endif
 #include <glib.h> // GList
 #include <stdlib.h> // malloc, free
 #include <unistd.h> // close
 #include <sys/types.h> // recv, send, getaddrinfo, socket, connect
 #include <errno.h> // errno, EINTR
+#include <string.h> // memset
 #include <assert.h>
 
 #include "dll.h"
@@ -50,6 +56,18 @@
 #include "poll.h"
 #include "util.h"
 
+/** Struct to store a file descriptor polled for readiness on behalf of its owner */
+typedef struct {
+	/** The polled file descriptor */
+	int fd;
+	/** What the descriptor is polled for as a combination of FdPollFlags */
+	int flags;
+	/** The callback to notify when the descriptor is ready */
+	FdPollCallback *callback;
+	/** Custom userdata to pass to the callback */
+	void *userdata;
+} FdPollEntry;
+
 /** Struct to handle asynchronous connection timeouts */
 typedef struct {
 	/** The creation time of the connection timer */
@@ -58,13 +76,43 @@ typedef struct {
 	int timeout;
 } AsyncConnectionTimer;
 
+static void pollConnectingSockets();
 static bool pollConnectingSocket(Socket *socket);
-static bool pollSocket(Socket *socket, int *fd_p);
+static bool pollSocket(Socket *socket, int *fd_p, bool *more_p);
+static bool drainSocket(Socket *socket, int *fd_p, bool *pending_p);
+static void pollWritingSockets();
+static void pollDescriptors();
+#ifdef SOCKET_POLL_EPOLL
+static bool watchSocket(int fd, uint32_t events);
+static bool updateSocketWatch(Socket *socket);
+static void processDisconnectedSockets();
+static void dispatchSocketEvent(struct epoll_event *event);
+static void processPendingSockets(GQueue *sockets);
+static void waitSockets(int sleepTime);
+#endif
 
 static GHashTable *poll_table;
+
+/**
+ * Table of sockets with queued output that are waiting to become writable
+ */
+static GHashTable *write_table;
+
+/**
+ * Table of file descriptors polled for readiness on behalf of their owners
+ */
+static GHashTable *fd_table;
+
+static EventId readEventId;
+static EventId acceptEventId;
 static char poll_buffer[SOCKET_POLL_BUFSIZE];
 static int pollInterval;
 
+/**
+ * The maximum number of reads or accepts performed on a single socket per polling round
+ */
+static int pollBudget;
+
 /**
  * True if we're currently polling
  */
@@ -75,15 +123,65 @@ static bool polling;
  */
 static GQueue *connecting;
 
+#ifdef SOCKET_POLL_EPOLL
+/**
+ * The epoll instance used to wait for socket readiness, or -1 if we fall back to timer-driven polling
+ */
+static int epollFd = -1;
+
+/**
+ * Buffer to retrieve ready epoll events into
+ */
+static struct epoll_event epollEvents[SOCKET_POLL_EPOLL_EVENTS];
+
+/**
+ * Queue of file descriptors of polled sockets that were disconnected locally and still need to deliver their "disconnect" event
+ */
+static GQueue *disconnected;
+
+/**
+ * Queue of file descriptors of polled sockets that exhausted their polling budget and still have data or clients ready. Since they are watched
+ * edge-triggered, epoll won't report them again, so we have to continue draining them in the next round ourselves.
+ */
+static GQueue *pending;
+
+/**
+ * Queue of file descriptors of polled server sockets that failed to accept a client for a lack of resources, e.g. because we ran out of file
+ * descriptors. The pending client still makes them ready, but since they are watched edge-triggered, epoll won't report them again, so we retry
+ * accepting from the poll timer until the resources are available again.
+ */
+static GQueue *throttled;
+#endif
+
 TIMER_CALLBACK(poll);
 
-API void initPoll(int interval)
+API void initPoll(int interval, int budget)
 {
 	pollInterval = interval;
+	pollBudget = budget;
 
 	poll_table = g_hash_table_new_full(&g_int_hash, &g_int_equal, &free, NULL);
+	write_table = g_hash_table_new_full(&g_int_hash, &g_int_equal, &free, NULL);
+	fd_table = g_hash_table_new_full(&g_int_hash, &g_int_equal, NULL, &free); // keys point into the entries
 	connecting = g_queue_new();
 
+	// Resolve the events triggered for every read and accept only once
+	readEventId = getEventId("read");
+	acceptEventId = getEventId("accept");
+
+#ifdef SOCKET_POLL_EPOLL
+	disconnected = g_queue_new();
+	pending = g_queue_new();
+	throttled = g_queue_new();
+
+	if((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		logSystemError("Failed to create epoll instance, falling back to timer-driven socket polling");
+	} else {
+		setTimerSleepHandler(&waitSockets); // block in epoll_wait instead of sleeping in the main loop
+		logInfo("Using epoll for socket polling");
+	}
+#endif
+
 	TIMER_ADD_TIMEOUT(pollInterval, poll);
 
 	polling = false;
@@ -91,10 +189,71 @@ API void initPoll(int interval)
 
 API void freePoll()
 {
+#ifdef SOCKET_POLL_EPOLL
+	if(epollFd >= 0) {
+		setTimerSleepHandler(NULL);
+		close(epollFd);
+		epollFd = -1;
+	}
+
+	g_queue_free(disconnected);
+	g_queue_free(pending);
+	g_queue_free(throttled);
+#endif
+
 	g_hash_table_destroy(poll_table);
+	g_hash_table_destroy(write_table);
+	g_hash_table_destroy(fd_table);
 	g_queue_free(connecting);
 }
 
+API void resetPoll()
+{
+#ifdef SOCKET_POLL_EPOLL
+	if(epollFd < 0) {
+		return;
+	}
+
+	close(epollFd); // only drops our reference, our parent still uses it
+
+	if((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		logSystemError("Failed to recreate epoll instance, falling back to timer-driven socket polling");
+		setTimerSleepHandler(NULL);
+		return;
+	}
+
+	unsigned int inherited = 0;
+	GList *sockets = g_hash_table_get_values(poll_table);
+	for(GList *iter = sockets; iter != NULL; iter = iter->next) {
+		updateSocketWatch(iter->data);
+		inherited++;
+	}
+	g_list_free(sockets);
+
+	sockets = g_hash_table_get_values(write_table);
+	for(GList *iter = sockets; iter != NULL; iter = iter->next) {
+		updateSocketWatch(iter->data);
+	}
+	g_list_free(sockets);
+
+	for(GList *iter = connecting->head; iter != NULL; iter = iter->next) {
+		Socket *connectingSocket = iter->data;
+		watchSocket(connectingSocket->fd, EPOLLOUT | EPOLLET);
+	}
+
+	GList *entries = g_hash_table_get_values(fd_table);
+	for(GList *iter = entries; iter != NULL; iter = iter->next) {
+		FdPollEntry *entry = iter->data;
+		watchSocket(entry->fd, ((entry->flags & FD_POLL_READ) ? EPOLLIN : 0) | ((entry->flags & FD_POLL_WRITE) ? EPOLLOUT : 0));
+	}
+	g_list_free(entries);
+
+	if(inherited > 0) {
+		logWarning("Inherited %u polled sockets from parent process, they are now polled by both processes", inherited);
+	}
+#endif
+}
+
 API bool connectClientSocketAsync(Socket *s, int timeout)
 {
 	if(s->connected) {
@@ -148,6 +307,9 @@ API bool connectClientSocketAsync(Socket *s, int timeout)
 			s->custom = timer;
 
 			g_queue_push_tail(connecting, s); // add to connecting list
+#ifdef SOCKET_POLL_EPOLL
+			watchSocket(s->fd, EPOLLOUT | EPOLLET); // get notified as soon as the socket becomes writable (connected)
+#endif
 			logInfo("Socket %d delayed connection, queueing...", s->fd);
 		} else {
 #ifdef WIN32
@@ -182,6 +344,14 @@ API bool enableSocketPolling(Socket *socket)
 	*fd = socket->fd;
 
 	g_hash_table_insert(poll_table, fd, socket);
+
+#ifdef SOCKET_POLL_EPOLL
+	if(!updateSocketWatch(socket)) {
+		g_hash_table_remove(poll_table, &socket->fd);
+		return false;
+	}
+#endif
+
 	return true;
 }
 
@@ -192,7 +362,111 @@ API bool isSocketPollingEnabled(Socket *socket)
 
 API bool disableSocketPolling(Socket *socket)
 {
-	return g_hash_table_remove(poll_table, &socket->fd) == true;
+	if(!g_hash_table_remove(poll_table, &socket->fd)) {
+		return false;
+	}
+
+#ifdef SOCKET_POLL_EPOLL
+	if(socket->connected) { // disconnected sockets were already removed from the epoll set before their descriptor was closed
+		updateSocketWatch(socket);
+	}
+#endif
+
+	return true;
+}
+
+API bool enableSocketWritePolling(Socket *socket)
+{
+	if(g_hash_table_lookup(write_table, &socket->fd) != NULL) { // already waiting for the socket to become writable
+		return true;
+	}
+
+	int *fd = ALLOCATE_OBJECT(int);
+	*fd = socket->fd;
+
+	g_hash_table_insert(write_table, fd, socket);
+
+#ifdef SOCKET_POLL_EPOLL
+	if(!updateSocketWatch(socket)) {
+		g_hash_table_remove(write_table, &socket->fd);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+API bool disableSocketWritePolling(Socket *socket)
+{
+	if(!g_hash_table_remove(write_table, &socket->fd)) {
+		return false;
+	}
+
+#ifdef SOCKET_POLL_EPOLL
+	if(socket->connected) {
+		updateSocketWatch(socket);
+	}
+#endif
+
+	return true;
+}
+
+API bool enableFdPolling(int fd, int flags, FdPollCallback *callback, void *userdata)
+{
+	FdPollEntry *entry;
+
+	if((entry = g_hash_table_lookup(fd_table, &fd)) == NULL) {
+		entry = ALLOCATE_OBJECT(FdPollEntry);
+		entry->fd = fd;
+		g_hash_table_insert(fd_table, &entry->fd, entry);
+	}
+
+	entry->flags = flags;
+	entry->callback = callback;
+	entry->userdata = userdata;
+
+#ifdef SOCKET_POLL_EPOLL
+	// Watched level-triggered since we don't know whether the owner will consume everything that's ready
+	if(!watchSocket(fd, ((flags & FD_POLL_READ) ? EPOLLIN : 0) | ((flags & FD_POLL_WRITE) ? EPOLLOUT : 0))) {
+		g_hash_table_remove(fd_table, &fd);
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+API bool disableFdPolling(int fd)
+{
+	if(!g_hash_table_remove(fd_table, &fd)) {
+		return false;
+	}
+
+#ifdef SOCKET_POLL_EPOLL
+	if(epollFd >= 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+	}
+#endif
+
+	return true;
+}
+
+API void unwatchSocket(Socket *socket)
+{
+#ifdef SOCKET_POLL_EPOLL
+	if(epollFd >= 0 && socket->fd >= 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, socket->fd, NULL); // fails harmlessly if the descriptor wasn't watched
+	}
+#endif
+}
+
+API void notifySocketDisconnected(Socket *socket)
+{
+#ifdef SOCKET_POLL_EPOLL
+	if(epollFd >= 0 && isSocketPollingEnabled(socket)) {
+		g_queue_push_tail(disconnected, GINT_TO_POINTER(socket->fd));
+	}
+#endif
 }
 
 API void pollSockets()
@@ -200,22 +474,33 @@ API void pollSockets()
 	if(!polling) {
 		polling = true; // set polling flag to lock our poll table in order to make this function reentrancy safe
 
-		if(!g_queue_is_empty(connecting)) {
-			GQueue *connectingSockets = g_queue_copy(connecting); // copy the connecting socket list so we may modify the list while polling
-			for(GList *iter = connectingSockets->head; iter != NULL; iter = iter->next) {
-				if(pollConnectingSocket(iter->data)) { // poll the connecting socket
-					// The socket should no longer be polled
-					g_queue_remove(connecting, iter->data); // remove it from the original connecting queue
-				}
+		pollConnectingSockets();
+		pollWritingSockets(); // the only way to drain output without epoll, and a cheap safety net with it
+
+#ifdef SOCKET_POLL_EPOLL
+		if(epollFd >= 0) { // read readiness is delivered through epoll, so only process locally disconnected and throttled sockets here
+			processDisconnectedSockets();
+
+			if(!g_queue_is_empty(throttled)) {
+				GQueue *throttledSockets = throttled;
+				throttled = g_queue_new(); // sockets still lacking resources requeue themselves
+				processPendingSockets(throttledSockets);
+				g_queue_free(throttledSockets);
 			}
-			g_queue_free(connectingSockets); // remove our temporary iteration list
+
+			polling = false;
+			return;
 		}
+#endif
+
+		pollDescriptors();
 
 		GList *sockets = g_hash_table_get_values(poll_table); // get a static list of sockets so we may modify the hash table while polling
 		for(GList *iter = sockets; iter != NULL; iter = iter->next) {
 			Socket *poll = iter->data;
 			int fd; // storage for the file descriptor that won't be available anymore in case the socket gets freed before we remove it
-			if(pollSocket(poll, &fd)) { // poll the socket
+			bool exhausted; // sockets that exhausted their budget are simply drained further on the next tick
+			if(drainSocket(poll, &fd, &exhausted)) { // poll the socket
 				// The socket should no longer be polled
 				g_hash_table_remove(poll_table, &fd); // remove it from the polling table
 			}
@@ -236,7 +521,8 @@ API Socket *getPolledSocketByFd(int fd)
 }
 
 /**
- * Callback to poll all sockets signed up for polling
+ * Callback to poll all sockets signed up for polling. If epoll is available, this only checks connecting sockets for timeouts since reads are
+ * dispatched by the timer sleep handler, but it still keeps the main loop alive and drives "sockets_polled" listeners.
  */
 TIMER_CALLBACK(poll)
 {
@@ -245,6 +531,124 @@ TIMER_CALLBACK(poll)
 	TIMER_ADD_TIMEOUT(pollInterval, poll);
 }
 
+/**
+ * Polls all connecting sockets and removes those from the connecting queue that either connected or failed
+ */
+static void pollConnectingSockets()
+{
+	if(!g_queue_is_empty(connecting)) {
+		GQueue *connectingSockets = g_queue_copy(connecting); // copy the connecting socket list so we may modify the list while polling
+		for(GList *iter = connectingSockets->head; iter != NULL; iter = iter->next) {
+			if(pollConnectingSocket(iter->data)) { // poll the connecting socket
+				// The socket should no longer be polled
+				g_queue_remove(connecting, iter->data); // remove it from the original connecting queue
+			}
+		}
+		g_queue_free(connectingSockets); // remove our temporary iteration list
+	}
+}
+
+/**
+ * Flushes the output queues of all sockets waiting to become writable
+ */
+static void pollWritingSockets()
+{
+	if(g_hash_table_size(write_table) > 0) {
+		GList *sockets = g_hash_table_get_values(write_table); // get a static list of sockets since flushing removes drained sockets from the table
+		for(GList *iter = sockets; iter != NULL; iter = iter->next) {
+			flushSocketOutput(iter->data);
+		}
+		g_list_free(sockets);
+	}
+}
+
+/**
+ * Checks all file descriptors polled on behalf of their owners for readiness and notifies the owners of those that are ready
+ */
+static void pollDescriptors()
+{
+	if(g_hash_table_size(fd_table) == 0) {
+		return;
+	}
+
+#ifdef WIN32
+	fd_set readset;
+	fd_set writeset;
+	fd_set errorset;
+	FD_ZERO(&readset);
+	FD_ZERO(&writeset);
+	FD_ZERO(&errorset);
+
+	int maxfd = -1;
+	GArray *fds = g_array_new(false, false, sizeof(int)); // static list of descriptors since callbacks may modify the table
+
+	GHashTableIter iter;
+	int *fd_p;
+	FdPollEntry *entry;
+	g_hash_table_iter_init(&iter, fd_table);
+	while(g_hash_table_iter_next(&iter, (void **) &fd_p, (void **) &entry)) {
+		if(entry->flags & FD_POLL_READ) {
+			FD_SET(entry->fd, &readset);
+		}
+
+		if(entry->flags & FD_POLL_WRITE) {
+			FD_SET(entry->fd, &writeset);
+		}
+
+		FD_SET(entry->fd, &errorset);
+
+		if(entry->fd > maxfd) {
+			maxfd = entry->fd;
+		}
+
+		g_array_append_val(fds, entry->fd);
+	}
+
+	struct timeval tv = {0, 0};
+
+	if(select(maxfd + 1, &readset, &writeset, &errorset, &tv) > 0) {
+		for(unsigned int i = 0; i < fds->len; i++) {
+			int fd = g_array_index(fds, int, i);
+			int flags = (FD_ISSET(fd, &readset) ? FD_POLL_READ : 0) | (FD_ISSET(fd, &writeset) ? FD_POLL_WRITE : 0) | (FD_ISSET(fd, &errorset) ? FD_POLL_ERROR : 0);
+
+			if(flags != 0 && (entry = g_hash_table_lookup(fd_table, &fd)) != NULL) { // still polled
+				entry->callback(fd, flags, entry->userdata);
+			}
+		}
+	}
+
+	g_array_free(fds, true);
+#else
+	// poll isn't limited to descriptors below FD_SETSIZE like select, and the array doubles as static list of descriptors since callbacks may modify the table
+	GArray *fds = g_array_sized_new(false, false, sizeof(struct pollfd), g_hash_table_size(fd_table));
+
+	GHashTableIter iter;
+	int *fd_p;
+	FdPollEntry *entry;
+	g_hash_table_iter_init(&iter, fd_table);
+	while(g_hash_table_iter_next(&iter, (void **) &fd_p, (void **) &entry)) {
+		struct pollfd pfd;
+		pfd.fd = entry->fd;
+		pfd.events = ((entry->flags & FD_POLL_READ) ? POLLIN : 0) | ((entry->flags & FD_POLL_WRITE) ? POLLOUT : 0);
+		pfd.revents = 0;
+		g_array_append_val(fds, pfd);
+	}
+
+	if(poll((struct pollfd *) fds->data, fds->len, 0) > 0) {
+		for(unsigned int i = 0; i < fds->len; i++) {
+			struct pollfd *pfd = &g_array_index(fds, struct pollfd, i);
+			int flags = ((pfd->revents & POLLIN) ? FD_POLL_READ : 0) | ((pfd->revents & POLLOUT) ? FD_POLL_WRITE : 0) | ((pfd->revents & (POLLERR | POLLHUP | POLLNVAL)) ? FD_POLL_ERROR : 0);
+
+			if(flags != 0 && (entry = g_hash_table_lookup(fd_table, &pfd->fd)) != NULL) { // still polled
+				entry->callback(pfd->fd, flags, entry->userdata);
+			}
+		}
+	}
+
+	g_array_free(fds, true);
+#endif
+}
+
 /**
  * Polls a connecting socket and notifies the caller of whether it should be removed from the connecting polling queue afterwards
  *
@@ -326,17 +730,23 @@ static bool pollConnectingSocket(Socket *socket)
  *
  * @param socket	the socket to poll
  * @param fd_p		a pointer to an integer field to which the file descriptor of the socket should be written in case the socket should be removed from the polling table and could already be freed at that time
+ * @param more_p	a pointer to a boolean field that is set to true if the socket produced data or a client, or failed to accept a single client, and might have more ready for us
  * @result			true if the socket should be removed from the polling table after polling
  */
-static bool pollSocket(Socket *socket, int *fd_p)
+static bool pollSocket(Socket *socket, int *fd_p, bool *more_p)
 {
 	*fd_p = socket->fd; // backup file descriptor
+	*more_p = false;
 
 	if(!socket->connected) { // Socket is disconnected
 		triggerEvent(socket, "disconnect");
 		return true;
 	}
 
+	if(socket->output_closing) { // the socket is only waiting for its output to drain, so there's no point in reading any further
+		return false;
+	}
+
 	if(socket->type != SOCKET_SERVER && socket->type != SOCKET_SERVER_BLOCK) {
 		int ret;
 		if((ret = socketReadRaw(socket, poll_buffer, SOCKET_POLL_BUFSIZE)) < 0) {
@@ -348,23 +758,302 @@ static bool pollSocket(Socket *socket, int *fd_p)
 				return true;
 			}
 		} else if(ret > 0) { // we actually read something
-			triggerEvent(socket, "read", poll_buffer, ret);
+			*more_p = true;
+			socket->stats.reads++;
+			socket->stats.bytes_read += ret;
+			triggerEventById(socket, readEventId, poll_buffer, ret);
 		} // else nothing to read right now
 	} else {
 		Socket *clientSocket;
 
 		if((clientSocket = socketAccept(socket)) != NULL) {
-			triggerEvent(socket, "accept", clientSocket);
-		} else {
-			if(socket->connected) { // socket is still connected, so the error was not fatal
-				triggerEvent(socket, "error");
-				return false;
-			} else { // socket was disconnected either by the peer or by a fatal error
-				triggerEvent(socket, "disconnect");
-				return true;
+			*more_p = true;
+			socket->stats.accepted++;
+			triggerEventById(socket, acceptEventId, clientSocket);
+		} else if(socket->connected) { // socket is still connected, so either there's nothing to accept or the error was not fatal
+#ifdef WIN32
+			if(WSAGetLastError() == WSAEWOULDBLOCK) {
+#else
+			int error = errno;
+
+			if(error == EAGAIN || error == EWOULDBLOCK) {
+#endif
+				return false; // nothing to accept right now
+			}
+
+#ifdef SOCKET_POLL_EPOLL
+			if(epollFd >= 0 && (error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM) && g_queue_find(throttled, GINT_TO_POINTER(socket->fd)) == NULL) {
+				g_queue_push_tail(throttled, GINT_TO_POINTER(socket->fd)); // the client is still pending, so retry once resources might be available again
 			}
+#endif
+
+#ifndef WIN32
+			if(error == ECONNABORTED || error == EPROTO || error == EINTR) {
+				*more_p = true; // only this client failed, so keep draining the rest of the backlog of our edge-triggered socket
+			}
+#endif
+
+			triggerEvent(socket, "error");
+			return false;
+		} else { // socket was disconnected by a fatal error
+			triggerEvent(socket, "disconnect");
+			return true;
 		}
 	}
 
 	return false;
 }
+
+/**
+ * Drains a socket by polling it until it doesn't produce any more data or clients, but at most as many times as our polling budget allows so
+ * a single busy socket can't starve all the others. Notifies the caller of whether it should be removed from the polling table afterwards.
+ *
+ * @param socket		the socket to drain
+ * @param fd_p			a pointer to an integer field to which the file descriptor of the socket should be written in case the socket should be removed from the polling table and could already be freed at that time
+ * @param exhausted_p	a pointer to a boolean field that is set to true if the socket exhausted its polling budget and might still have data or clients ready for us
+ * @result				true if the socket should be removed from the polling table after polling
+ */
+static bool drainSocket(Socket *socket, int *fd_p, bool *exhausted_p)
+{
+	bool more = false;
+	*exhausted_p = false;
+
+	for(int i = 0; i < pollBudget; i++) {
+		if(pollSocket(socket, fd_p, &more)) {
+			return true; // the socket might be freed already, so don't touch its statistics
+		}
+
+		if(!more) {
+			break;
+		}
+	}
+
+	if(more || socket->stats.burst_rounds > 0) { // the socket is in the middle of a burst
+		socket->stats.burst_rounds++;
+
+		if(socket->stats.burst_rounds > socket->stats.max_burst_rounds) {
+			socket->stats.max_burst_rounds = socket->stats.burst_rounds;
+		}
+	}
+
+	if(more) {
+		socket->stats.budget_exhausted++;
+		*exhausted_p = true;
+	} else {
+		socket->stats.burst_rounds = 0; // burst is over
+	}
+
+	return false;
+}
+
+#ifdef SOCKET_POLL_EPOLL
+
+/**
+ * Adds a file descriptor to our epoll set or modifies the events it is watched for if it's already part of it
+ *
+ * @param fd		the file descriptor to watch
+ * @param events	the epoll events to watch the descriptor for
+ * @result			true if successful
+ */
+static bool watchSocket(int fd, uint32_t events)
+{
+	if(epollFd < 0) {
+		return true; // timer-driven fallback, nothing to do
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = events;
+	event.data.fd = fd;
+
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+		if(errno != EEXIST || epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) != 0) {
+			logSystemError("Failed to add socket %d to epoll set", fd);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Updates the events our epoll set watches a socket's file descriptor for according to whether it is polled for reading and/or writing
+ *
+ * @param socket	the socket to update the watched events for
+ * @result			true if successful
+ */
+static bool updateSocketWatch(Socket *socket)
+{
+	if(epollFd < 0) {
+		return true; // timer-driven fallback, nothing to do
+	}
+
+	uint32_t events = 0;
+
+	if(g_hash_table_lookup(poll_table, &socket->fd) != NULL) {
+		events |= EPOLLIN | EPOLLRDHUP;
+	}
+
+	if(g_hash_table_lookup(write_table, &socket->fd) != NULL) {
+		events |= EPOLLOUT;
+	}
+
+	if(events == 0) {
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, socket->fd, NULL);
+		return true;
+	}
+
+	return watchSocket(socket->fd, events | EPOLLET);
+}
+
+/**
+ * Delivers the "disconnect" event for all polled sockets that were disconnected locally since we last checked and removes them from the polling table
+ */
+static void processDisconnectedSockets()
+{
+	while(!g_queue_is_empty(disconnected)) {
+		int fd = GPOINTER_TO_INT(g_queue_pop_head(disconnected));
+		Socket *socket = g_hash_table_lookup(poll_table, &fd);
+
+		if(socket != NULL && !socket->connected) { // still polled and not reconnected in the meantime
+			bool more;
+			if(pollSocket(socket, &fd, &more)) {
+				g_hash_table_remove(poll_table, &fd);
+			}
+		}
+	}
+}
+
+/**
+ * Continues draining polled sockets that exhausted their polling budget in the last round
+ *
+ * @param sockets		the queue of file descriptors of the sockets to continue draining
+ */
+static void processPendingSockets(GQueue *sockets)
+{
+	for(GList *iter = sockets->head; iter != NULL; iter = iter->next) {
+		int fd = GPOINTER_TO_INT(iter->data);
+
+		if(g_queue_find(pending, iter->data) != NULL) { // already served and requeued by an epoll event in this round
+			continue;
+		}
+
+		Socket *socket = g_hash_table_lookup(poll_table, &fd);
+
+		if(socket != NULL) { // still polled
+			bool exhausted;
+
+			if(drainSocket(socket, &fd, &exhausted)) {
+				g_hash_table_remove(poll_table, &fd);
+			} else if(exhausted) {
+				g_queue_push_tail(pending, GINT_TO_POINTER(fd));
+			}
+		}
+	}
+}
+
+/**
+ * Dispatches a single ready epoll event to its socket. If the socket became writable, its queued output is flushed. Since the socket is watched
+ * edge-triggered, it is then drained until it doesn't produce any more data or clients, or queued for further draining in the next round if it
+ * exhausts its polling budget.
+ *
+ * @param event		the ready epoll event to dispatch
+ */
+static void dispatchSocketEvent(struct epoll_event *event)
+{
+	int fd = event->data.fd;
+	Socket *socket;
+	FdPollEntry *entry;
+	bool flushed = false;
+
+	if((entry = g_hash_table_lookup(fd_table, &fd)) != NULL) { // descriptor polled on behalf of its owner
+		int flags = ((event->events & EPOLLIN) ? FD_POLL_READ : 0) | ((event->events & EPOLLOUT) ? FD_POLL_WRITE : 0) | ((event->events & (EPOLLERR | EPOLLHUP)) ? FD_POLL_ERROR : 0);
+		entry->callback(fd, flags, entry->userdata);
+		return;
+	}
+
+	if((event->events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && (socket = g_hash_table_lookup(write_table, &fd)) != NULL) { // socket with queued output became writable
+		flushSocketOutput(socket);
+		flushed = true;
+	}
+
+	if((socket = g_hash_table_lookup(poll_table, &fd)) != NULL) {
+		if(!(event->events & ~EPOLLOUT)) { // only writable, nothing to read
+			return;
+		}
+
+		bool exhausted;
+
+		if(drainSocket(socket, &fd, &exhausted)) { // poll the socket
+			// The socket should no longer be polled
+			g_hash_table_remove(poll_table, &fd);
+		} else if(exhausted && g_queue_find(pending, GINT_TO_POINTER(fd)) == NULL) {
+			g_queue_push_tail(pending, GINT_TO_POINTER(fd));
+		}
+	} else if(!flushed && (event->events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) { // could be a connecting socket
+		for(GList *iter = connecting->head; iter != NULL; iter = iter->next) {
+			Socket *connectingSocket = iter->data;
+
+			if(connectingSocket->fd == fd) {
+				if(pollConnectingSocket(connectingSocket)) {
+					g_queue_remove(connecting, connectingSocket);
+				}
+
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * A TimerSleepHandler that blocks in epoll_wait until either one of our sockets is ready or the next timer is due, and then dispatches all ready sockets
+ *
+ * @param sleepTime		the maximum time in microseconds to block
+ */
+static void waitSockets(int sleepTime)
+{
+	if(polling) { // someone is already polling, just sleep
+		g_usleep(sleepTime);
+		return;
+	}
+
+	polling = true;
+
+	// Sockets disconnected from timer callbacks should notify their listeners right away instead of after the next wait
+	if(!g_queue_is_empty(disconnected)) {
+		processDisconnectedSockets();
+		sleepTime = 0;
+	}
+
+	// Sockets that still have input left from the last round must not wait for the next timer either
+	GQueue *pendingSockets = NULL;
+	if(!g_queue_is_empty(pending)) {
+		pendingSockets = pending;
+		pending = g_queue_new();
+		sleepTime = 0;
+	}
+
+	int count;
+	if((count = epoll_wait(epollFd, epollEvents, SOCKET_POLL_EPOLL_EVENTS, (sleepTime + 999) / 1000)) < 0) {
+		if(errno != EINTR) {
+			logSystemError("Failed to wait for epoll events");
+		}
+
+		count = 0; // still continue draining our pending sockets
+	}
+
+	for(int i = 0; i < count; i++) {
+		dispatchSocketEvent(&epollEvents[i]);
+	}
+
+	if(pendingSockets != NULL) { // newly ready sockets were served first, now continue with those left over from the last round
+		processPendingSockets(pendingSockets);
+		g_queue_free(pendingSockets);
+	}
+
+	processDisconnectedSockets();
+
+	polling = false;
+}
+
+#endif
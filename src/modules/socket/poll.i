@@ -23,18 +23,45 @@
 
 #include "socket.h"
 
+/**
+ * Flags describing the readiness of a polled file descriptor
+ */
+typedef enum {
+	/** the descriptor is readable */
+	FD_POLL_READ = 1,
+	/** the descriptor is writable */
+	FD_POLL_WRITE = 2,
+	/** an error or hangup occurred on the descriptor */
+	FD_POLL_ERROR = 4
+} FdPollFlags;
+
+/**
+ * Callback notifying the owner of a polled file descriptor that it is ready
+ *
+ * @param fd			the ready file descriptor
+ * @param flags			the readiness of the descriptor as a combination of FdPollFlags
+ * @param userdata		custom userdata passed when enabling polling for the descriptor
+ */
+typedef void (FdPollCallback)(int fd, int flags, void *userdata);
+
 
 /**
  * Initializes socket polling via hooks
  * @param interval		the polling interval to use
+ * @param budget		the maximum number of reads or accepts to perform on a single socket per polling round before moving on to the next one
  */
-API void initPoll(int interval);
+API void initPoll(int interval, int budget);
 
 /**
  * Frees socket polling via hooks
  */
 API void freePoll();
 
+/**
+ * Resets socket polling in a freshly forked process so it no longer shares its epoll instance with its parent
+ */
+API void resetPoll();
+
 
 /**
  * Asynchronously connects a client socket. Instead of waiting for the socket to be connected, this function does not block and returns immediately.
@@ -71,6 +98,60 @@ API bool isSocketPollingEnabled(Socket *socket);
  */
 API bool disableSocketPolling(Socket *socket);
 
+/**
+ * Enables write polling for a socket, i.e. flushes its output queue as soon as it becomes writable. This also works for sockets that aren't polled for reading.
+ * @see flushSocketOutput
+ *
+ * @param socket		the socket to enable write polling for
+ * @result				true if successful
+ */
+API bool enableSocketWritePolling(Socket *socket);
+
+/**
+ * Disables write polling for a socket
+ *
+ * @param socket		the socket to disable write polling for
+ * @result				true if successful
+ */
+API bool disableSocketWritePolling(Socket *socket);
+
+/**
+ * Enables readiness polling for a file descriptor owned by someone else, e.g. a library managing its own connections. Unlike socket polling,
+ * nothing is read from the descriptor, the callback is only notified whenever the descriptor is ready for what it's polled for. If polling is
+ * already enabled for the descriptor, its flags, callback and userdata are replaced.
+ *
+ * @param fd			the file descriptor to enable polling for
+ * @param flags			what to poll the descriptor for as a combination of FD_POLL_READ and FD_POLL_WRITE
+ * @param callback		the callback to notify when the descriptor is ready
+ * @param userdata		custom userdata to pass to the callback
+ * @result				true if successful
+ */
+API bool enableFdPolling(int fd, int flags, FdPollCallback *callback, void *userdata);
+
+/**
+ * Disables readiness polling for a file descriptor. This must be called before the descriptor is closed.
+ *
+ * @param fd			the file descriptor to disable polling for
+ * @result				true if successful
+ */
+API bool disableFdPolling(int fd);
+
+/**
+ * Removes a socket's descriptor from the epoll set. This must be called right before the descriptor is closed, since the kernel only drops the
+ * registration on close once no other descriptor refers to the same open file description, e.g. a copy inherited by a forked or executed child.
+ *
+ * @param socket		the socket whose descriptor is about to be closed
+ */
+API void unwatchSocket(Socket *socket);
+
+/**
+ * Notifies the polling engine that a polled socket was disconnected locally. If sockets are polled through epoll, a closed descriptor no longer produces
+ * readiness events, so the "disconnect" event is queued and delivered on the next poll instead.
+ *
+ * @param socket		the socket that was disconnected
+ */
+API void notifySocketDisconnected(Socket *socket);
+
 /**
  * Poll all sockets signed up for polling if not currently polling already
  */
@@ -102,6 +183,7 @@ static inline bool isSocketActive(Socket *socket)
 	return socket->connected || isSocketPollingEnabled(socket);
 }
 
-#define SOCKET_POLL_BUFSIZE 4096
+#define SOCKET_POLL_BUFSIZE 16384
+#define SOCKET_POLL_EPOLL_EVENTS 256
 
 #endif
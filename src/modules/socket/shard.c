@@ -0,0 +1,245 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE // pipe2, environ
+#endif
+
+#ifndef WIN32
+#include <sys/types.h> // pid_t
+#include <sys/wait.h> // waitpid
+#include <signal.h> // kill, SIGTERM
+#include <unistd.h> // fork, execve, getppid, pipe2, environ
+#include <fcntl.h> // O_CLOEXEC
+#include <errno.h> // errno, EINTR
+#endif
+#ifdef __linux__
+#include <sys/prctl.h> // prctl, PR_SET_PDEATHSIG
+#endif
+#include <stdio.h> // fflush, sscanf
+#include <stdlib.h> // _exit
+#include <string.h> // strlen, strncmp
+#include <glib.h>
+
+#include "dll.h"
+#include "log.h"
+#define API
+#include "shard.h"
+
+/**
+ * The environment variable through which a spawned socket shard learns its index and the total number of shards
+ */
+#define SOCKET_SHARD_ENV "KALISKO_SOCKET_SHARD"
+
+/**
+ * The index of the shard we're running as
+ */
+static unsigned int shard = 0;
+
+/**
+ * The total number of shards
+ */
+static unsigned int shardCount = 1;
+
+#ifndef WIN32
+/**
+ * Process IDs of the shards spawned by the main process
+ */
+static GArray *shardPids = NULL;
+#endif
+
+#ifdef __linux__
+static pid_t startSocketShard(unsigned int index, unsigned int count, char **args);
+#endif
+
+API void initSocketShards()
+{
+	const char *value = g_getenv(SOCKET_SHARD_ENV);
+
+	if(value == NULL) {
+		return;
+	}
+
+	unsigned int index;
+	unsigned int count;
+
+	if(sscanf(value, "%u/%u", &index, &count) != 2 || index == 0 || index >= count) {
+		logWarning("Ignoring invalid socket shard %s given by environment variable %s", value, SOCKET_SHARD_ENV);
+		return;
+	}
+
+	shard = index;
+	shardCount = count;
+	g_unsetenv(SOCKET_SHARD_ENV); // don't pass it on to processes we start ourselves
+
+	logNotice("Running as socket shard %u of %u", shard, shardCount);
+}
+
+API bool spawnSocketShards(unsigned int count, char **args)
+{
+	if(shard != 0) {
+		logError("Cannot spawn socket shards from within socket shard %u", shard);
+		return false;
+	}
+
+	if(shardCount > 1) {
+		logError("Cannot spawn socket shards more than once");
+		return false;
+	}
+
+	if(count <= 1) {
+		return true;
+	}
+
+#ifndef __linux__
+	logError("Socket shards are only supported on Linux");
+	return false;
+#else
+	shardPids = g_array_new(false, false, sizeof(pid_t));
+
+	fflush(NULL); // don't let every shard write out the same buffered output
+
+	for(unsigned int i = 1; i < count; i++) {
+		pid_t pid;
+
+		if((pid = startSocketShard(i, count, args)) < 0) {
+			break;
+		}
+
+		g_array_append_val(shardPids, pid);
+	}
+
+	if(shardPids->len + 1 < count) {
+		logError("Only %u of %u socket shards could be started, terminating them again", shardPids->len, count - 1);
+		freeSocketShards();
+		return false;
+	}
+
+	shardCount = count;
+	logNotice("Spawned %u socket shards", shardPids->len);
+
+	return true;
+#endif
+}
+
+API void freeSocketShards()
+{
+#ifndef WIN32
+	if(shardPids == NULL) {
+		return;
+	}
+
+	for(unsigned int i = 0; i < shardPids->len; i++) {
+		kill(g_array_index(shardPids, pid_t, i), SIGTERM);
+	}
+
+	for(unsigned int i = 0; i < shardPids->len; i++) {
+		waitpid(g_array_index(shardPids, pid_t, i), NULL, 0);
+	}
+
+	logNotice("Terminated %u socket shards", shardPids->len);
+
+	g_array_free(shardPids, true);
+	shardPids = NULL;
+	shardCount = 1;
+#endif
+}
+
+API unsigned int getSocketShard()
+{
+	return shard;
+}
+
+API unsigned int getSocketShardCount()
+{
+	return shardCount;
+}
+
+#ifdef __linux__
+/**
+ * Starts a single socket shard by forking and executing our own binary again. Since other threads might be running, everything the child needs
+ * is prepared before forking and the child only makes async-signal-safe calls until it is replaced by the new image.
+ *
+ * @param index		the index of the shard to start
+ * @param count		the total number of shards
+ * @param args		the NULL-terminated argument vector to run the shard with, including the program name
+ * @result			the process ID of the started shard, or -1 on failure
+ */
+static pid_t startSocketShard(unsigned int index, unsigned int count, char **args)
+{
+	// Pass on our environment, but tell the shard who it is
+	GPtrArray *env = g_ptr_array_new_with_free_func(&g_free);
+	for(char **var = environ; *var != NULL; var++) {
+		if(strncmp(*var, SOCKET_SHARD_ENV "=", strlen(SOCKET_SHARD_ENV "=")) != 0) {
+			g_ptr_array_add(env, g_strdup(*var));
+		}
+	}
+
+	g_ptr_array_add(env, g_strdup_printf("%s=%u/%u", SOCKET_SHARD_ENV, index, count));
+	g_ptr_array_add(env, NULL);
+
+	// The child reports a failed exec through this pipe, which is closed without a report if the exec succeeds
+	int status[2];
+	if(pipe2(status, O_CLOEXEC) < 0) {
+		logSystemError("Failed to create status pipe for socket shard %u", index);
+		g_ptr_array_free(env, true);
+		return -1;
+	}
+
+	pid_t parent = getpid();
+	pid_t pid;
+
+	if((pid = fork()) < 0) {
+		logSystemError("Failed to fork socket shard %u", index);
+	} else if(pid == 0) { // child
+		close(status[0]);
+		prctl(PR_SET_PDEATHSIG, SIGTERM); // don't outlive the main process, this survives the exec below
+
+		if(getppid() == parent) { // otherwise the main process died before we could ask to be notified
+			execve("/proc/self/exe", args, (char **) env->pdata); // start over with a fresh process that only loads what the shard needs
+		}
+
+		int error = errno;
+		while(write(status[1], &error, sizeof(int)) < 0 && errno == EINTR); // let the main process know why we failed
+		_exit(EXIT_FAILURE);
+	}
+
+	close(status[1]);
+	g_ptr_array_free(env, true);
+
+	if(pid > 0) {
+		int error;
+		ssize_t ret;
+
+		while((ret = read(status[0], &error, sizeof(int))) < 0 && errno == EINTR);
+
+		if(ret > 0) {
+			errno = error;
+			logSystemError("Failed to execute socket shard %u", index);
+			waitpid(pid, NULL, 0);
+			pid = -1;
+		}
+	}
+
+	close(status[0]);
+
+	return pid;
+}
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SOCKET_SHARD_H
+#define SOCKET_SHARD_H
+
+#include <glib.h>
+
+
+/**
+ * Initializes the socket shard we're running as if we were spawned by spawnSocketShards. Server sockets connected in socket shards are bound
+ * with SO_REUSEPORT so they share their port with the main process and the other shards.
+ */
+API void initSocketShards();
+
+/**
+ * Spawns additional socket shards, each of which is a fresh process running its own event loop. Every shard executes our own binary again with
+ * the given arguments, so they can restrict it to the modules actually serving requests instead of duplicating the whole process. Server sockets
+ * connected afterwards are bound with SO_REUSEPORT so every shard listens on the same port and the kernel balances incoming connections between
+ * them. If the main process is shut down, all other shards are terminated as well. The shards get their identity through their environment
+ * without modifying ours, so this may be called while other threads are running. If not every shard can be started, the ones that were are
+ * terminated again. Only supported on Linux.
+ *
+ * @param count		the total number of shards to run including the calling process
+ * @param args		the NULL-terminated argument vector to run the shards with, including the program name
+ * @result			true if successful
+ */
+API bool spawnSocketShards(unsigned int count, char **args);
+
+/**
+ * Terminates all socket shards spawned by the calling process and waits for them to exit
+ */
+API void freeSocketShards();
+
+/**
+ * Returns the index of the socket shard the calling process is running as
+ *
+ * @result			the socket shard index, where 0 is the main process
+ */
+API unsigned int getSocketShard();
+
+/**
+ * Returns the total number of socket shards
+ *
+ * @result			the socket shard count, which is 1 if the process wasn't forked into shards
+ */
+API unsigned int getSocketShardCount();
+
+#endif
@@ -18,6 +18,10 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE // accept4
+#endif
+
 #ifdef WIN32
 #include <stdio.h> // _fdopen
 #include <fcntl.h> // _open_osfhandle
@@ -31,6 +35,7 @@
 #include <fcntl.h>
 #include <sys/select.h> // select, timeval
 #include <netinet/in.h> // FreeBSD needs this, linux doesn't care ;)
+#include <sys/uio.h> // iovec
 #endif
 #include <glib.h> // GList
 #include <stdlib.h> // malloc, free
@@ -52,18 +57,42 @@
 #define API
 #include "socket.h"
 #include "poll.h"
+#include "shard.h"
 #include "util.h"
 
 #define IP_STR_LEN 16
+#define SOCKET_OUTPUT_CHUNK_SIZE 4096
+#define SOCKET_OUTPUT_IOV_MAX 64
 
 MODULE_NAME("socket");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The socket module provides an API to establish network connections and transfer data over them");
-MODULE_VERSION(0, 7, 6);
+MODULE_VERSION(0, 15, 3);
 MODULE_BCVERSION(0, 4, 2);
-MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3), MODULE_DEPENDENCY("event", 0, 1, 2));
+MODULE_DEPENDS(MODULE_DEPENDENCY("config", 0, 3, 8), MODULE_DEPENDENCY("store", 0, 5, 3), MODULE_DEPENDENCY("event", 0, 5, 0));
+
+/** A chunk of socket output that couldn't be written right away */
+typedef struct {
+	/** the number of bytes allocated for the chunk's data */
+	unsigned int capacity;
+	/** the number of bytes stored in the chunk */
+	unsigned int size;
+	/** the number of bytes at the beginning of the chunk that were already written */
+	unsigned int offset;
+	/** the chunk's data */
+	char data[];
+} SocketOutputChunk;
+
+static void initSocketState(Socket *s);
+static void queueSocketOutput(Socket *s, char *buffer, unsigned int size);
+static void clearSocketOutput(Socket *s);
+static int sendSocketBuffer(Socket *s, char *buffer, unsigned int size);
+static int sendSocketOutput(Socket *s);
+static bool checkSocketWriteError(Socket *s);
 
 static int connectionTimeout = 10; // set default connection timeout to 10 seconds
+static int outputHighWatermark = 262144; // trigger backpressure if more than 256 KiB are queued for a socket
+static int outputLowWatermark = 65536; // and report the socket drained once it's back to 64 KiB
 
 MODULE_INIT
 {
@@ -77,6 +106,7 @@ MODULE_INIT
 #endif
 
 	int pollInterval = 100000;
+	int pollBudget = 64;
 
 	Store *configPollInterval = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "socket/pollInterval");
 	if(configPollInterval != NULL && configPollInterval->type == STORE_INTEGER) {
@@ -85,6 +115,13 @@ MODULE_INIT
 		logNotice("Could not determine config value socket/pollInterval, using default");
 	}
 
+	Store *configPollBudget = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "socket/pollBudget");
+	if(configPollBudget != NULL && configPollBudget->type == STORE_INTEGER && configPollBudget->content.integer > 0) {
+		pollBudget = configPollBudget->content.integer;
+	} else {
+		logNotice("Could not determine config value socket/pollBudget, using default");
+	}
+
 	Store *configConnectionTimeout = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "socket/connectionTimeout");
 	if(configConnectionTimeout != NULL && configConnectionTimeout->type == STORE_INTEGER) {
 		connectionTimeout = configConnectionTimeout->content.integer;
@@ -92,7 +129,28 @@ MODULE_INIT
 		logNotice("Could not determine config value socket/connectionTimeout, using default");
 	}
 
-	initPoll(pollInterval);
+	Store *configOutputHighWatermark = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "socket/outputHighWatermark");
+	if(configOutputHighWatermark != NULL && configOutputHighWatermark->type == STORE_INTEGER) {
+		outputHighWatermark = configOutputHighWatermark->content.integer;
+	} else {
+		logNotice("Could not determine config value socket/outputHighWatermark, using default");
+	}
+
+	Store *configOutputLowWatermark = $(Store *, store, getStorePath)($(Store *, config, getConfig)(), "socket/outputLowWatermark");
+	if(configOutputLowWatermark != NULL && configOutputLowWatermark->type == STORE_INTEGER) {
+		outputLowWatermark = configOutputLowWatermark->content.integer;
+	} else {
+		logNotice("Could not determine config value socket/outputLowWatermark, using default");
+	}
+
+	if(outputLowWatermark > outputHighWatermark) {
+		logWarning("Socket output low watermark %d exceeds high watermark %d, using the high watermark for both", outputLowWatermark, outputHighWatermark);
+		outputLowWatermark = outputHighWatermark;
+	}
+
+	initPoll(pollInterval, pollBudget);
+	initSocketShards();
+
 	return true;
 }
 
@@ -102,6 +160,7 @@ MODULE_FINALIZE
 	WSACleanup();
 #endif
 
+	freeSocketShards();
 	freePoll();
 }
 
@@ -119,6 +178,7 @@ API Socket *createClientSocket(char *host, char *port)
 	s->in = NULL;
 	s->out = NULL;
 #endif
+	initSocketState(s);
 
 	return s;
 }
@@ -137,6 +197,7 @@ API Socket *createServerSocket(char *port)
 	s->in = NULL;
 	s->out = NULL;
 #endif
+	initSocketState(s);
 
 	return s;
 }
@@ -155,6 +216,31 @@ API Socket *createShellSocket(char **args)
 	s->in = NULL;
 	s->out = NULL;
 #endif
+	initSocketState(s);
+
+	return s;
+}
+
+API Socket *createFdSocket(int fd)
+{
+	if(!setSocketNonBlocking(fd)) {
+		logSystemError("Failed to set socket non-blocking");
+		return NULL;
+	}
+
+	Socket *s = ALLOCATE_OBJECT(Socket);
+
+	s->fd = fd;
+	s->host = NULL;
+	s->port = NULL;
+	s->custom = NULL;
+	s->type = SOCKET_SHELL;
+	s->connected = true;
+#ifdef WIN32
+	s->in = NULL;
+	s->out = NULL;
+#endif
+	initSocketState(s);
 
 	return s;
 }
@@ -203,13 +289,25 @@ API bool connectSocket(Socket *s)
 				return false;
 			}
 
+			if(s->reuse_port) {
+#ifdef SO_REUSEPORT
+				if(setsockopt(s->fd, SOL_SOCKET, SO_REUSEPORT, (void *) &param, sizeof(int)) == -1) {
+					logSystemError("Failed to set SO_REUSEPORT for socket %d", s->fd);
+					freeSocket(s);
+					return false;
+				}
+#else
+				logWarning("SO_REUSEPORT is not supported on this platform, binding server socket %d exclusively", s->fd);
+#endif
+			}
+
 			if(bind(s->fd, server->ai_addr, server->ai_addrlen) == -1) {
 				logSystemError("Failed to bind server socket %d", s->fd);
 				freeSocket(s);
 				return false;
 			}
 
-			if(listen(s->fd, 5) == -1) {
+			if(listen(s->fd, SOMAXCONN) == -1) { // a short backlog makes clients retry their SYNs during connection bursts
 				logSystemError("Failed to listen server socket %d", s->fd);
 				freeSocket(s);
 				return false;
@@ -472,8 +570,13 @@ API bool disconnectSocket(Socket *s)
 	logInfo("Disconnecting socket %d", s->fd);
 
 	if(s->connected) {
+		// Whatever is still queued can't be delivered anymore
+		disableSocketWritePolling(s);
+		clearSocketOutput(s);
+
 		closeSocket(s);
 		s->connected = false;
+		notifySocketDisconnected(s);
 
 		return true;
 	} else {
@@ -482,6 +585,23 @@ API bool disconnectSocket(Socket *s)
 	}
 }
 
+API bool disconnectSocketWhenDrained(Socket *s)
+{
+	if(!s->connected) {
+		logError("Cannot disconnect already disconnected socket %d", s->fd);
+		return false;
+	}
+
+	if(g_queue_is_empty(s->output)) {
+		return disconnectSocket(s);
+	}
+
+	logInfo("Disconnecting socket %d after writing its remaining %u bytes of output", s->fd, s->output_length);
+	s->output_closing = true;
+
+	return true;
+}
+
 API void freeSocket(Socket *s)
 {
 	// disconnect the socket first if it's still connected
@@ -491,6 +611,10 @@ API void freeSocket(Socket *s)
 
 	// Disable socket polling for this socket. In usual cases, this is not necessary and is done automatically by the polling engine, but do this just to be sure no orphaned sockets remain in the polling table
 	disableSocketPolling(s);
+	disableSocketWritePolling(s);
+
+	clearSocketOutput(s);
+	g_queue_free(s->output);
 
 	if(s->host) {
 		free(s->host);
@@ -513,9 +637,6 @@ API void freeSocket(Socket *s)
 
 API bool socketWriteRaw(Socket *s, void *buffer, int size)
 {
-	int left = size;
-	int ret;
-
 	assert(size >= 0);
 
 	if(!s->connected) {
@@ -528,9 +649,21 @@ API bool socketWriteRaw(Socket *s, void *buffer, int size)
 		return false;
 	}
 
-	while(left > 0) {
+	if(s->output_closing) {
+		logError("Cannot write to socket %d that is being disconnected", s->fd);
+		return false;
+	}
+
+	if(size == 0) {
+		return true;
+	}
+
 #ifdef WIN32
-		if(s->in != NULL) {
+	if(s->in != NULL) { // pipe sockets can't be written to asynchronously
+		int left = size;
+		int ret;
+
+		while(left > 0) {
 			if((ret = fwrite(buffer, sizeof(char), left, s->in)) > 0) {
 				left -= ret;
 				buffer += ret;
@@ -538,24 +671,54 @@ API bool socketWriteRaw(Socket *s, void *buffer, int size)
 				logSystemError("Failed to write to pipe socket %d", s->fd);
 				return false;
 			}
-		} else
-#endif
-#ifdef MSG_NOSIGNAL // prevent SIGPIPE if we can...
-		if((ret = send(s->fd, buffer, left, MSG_NOSIGNAL)) > 0) { // wrote ret characters
-#else
-		if((ret = send(s->fd, buffer, left, 0)) > 0) { // wrote ret characters
+		}
+
+		return true;
+	}
 #endif
-			left -= ret;
-			buffer += ret;
-		} else if(errno == EINTR) { // interrupted
-			continue;
-		} else if(errno == EPIPE) { // broken pipe means the connection broke down but we didn't get the disconnect event yet
-			logNotice("Broken pipe for socket %d on write, disconnecting...", s->fd);
-			disconnectSocket(s);
-			return false;
-		} else { // error
-			logSystemError("Failed to write to socket %d", s->fd);
+
+	if(g_queue_is_empty(s->output)) { // nothing queued before us, so try to write straight from the caller's buffer
+		int ret;
+		if((ret = sendSocketBuffer(s, buffer, size)) < 0) {
 			return false;
+		} else if(ret == size) { // the kernel took everything
+			return true;
+		}
+
+		buffer += ret;
+		size -= ret;
+	}
+
+	queueSocketOutput(s, buffer, size);
+
+	return true;
+}
+
+API bool flushSocketOutput(Socket *s)
+{
+	if(!s->connected) {
+		return false;
+	}
+
+	while(!g_queue_is_empty(s->output)) {
+		int ret;
+		if((ret = sendSocketOutput(s)) < 0) {
+			return false; // the socket might have been disconnected, so don't touch its queue anymore
+		} else if(ret == 0) { // the socket doesn't take any more data right now
+			break;
+		}
+	}
+
+	if(s->output_congested && s->output_length <= s->output_low_watermark) {
+		s->output_congested = false;
+		triggerEvent(s, "write_drained", s->output_length);
+	}
+
+	if(s->connected && g_queue_is_empty(s->output)) {
+		disableSocketWritePolling(s);
+
+		if(s->output_closing) {
+			disconnectSocket(s);
 		}
 	}
 
@@ -629,11 +792,20 @@ API Socket *socketAccept(Socket *server)
 
 	int fd;
 
+#ifdef __linux__
+	if((fd = accept4(server->fd, (struct sockaddr *) &address, &addressSize, SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1) { // saves the fcntl calls to make the client non-blocking
+#else
 	if((fd = accept(server->fd, (struct sockaddr *) &address, &addressSize)) == -1) {
+#endif
 #ifdef WIN32
 		if(WSAGetLastError() == WSAEWOULDBLOCK) {
 #else
 		if(errno == EAGAIN || errno == EWOULDBLOCK) {
+		} else if(errno == EINTR || errno == ECONNABORTED || errno == EPROTO || errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+			// Failures concerning a single connection or a temporary lack of resources shouldn't bring down the server socket
+			int error = errno;
+			logSystemError("Failed to accept client socket from server socket %d", server->fd);
+			errno = error; // let the caller tell a lack of resources from a failed connection
 #endif
 		} else {
 			logSystemError("Failed to accept client socket from server socket %d", server->fd);
@@ -643,9 +815,11 @@ API Socket *socketAccept(Socket *server)
 		return NULL;
 	}
 
+#ifndef __linux__
 	if(!setSocketNonBlocking(fd)) {
 		return NULL;
 	}
+#endif
 
 	GString *ip = ip2str(address.sin_addr.s_addr);
 	GString *port = g_string_new("");
@@ -662,6 +836,7 @@ API Socket *socketAccept(Socket *server)
 	client->in = NULL;
 	client->out = NULL;
 #endif
+	initSocketState(client);
 
 	logInfo("Incoming connection %d from %s:%s on server socket %d", fd, client->host, client->port, server->fd);
 
@@ -670,3 +845,196 @@ API Socket *socketAccept(Socket *server)
 
 	return client;
 }
+
+/**
+ * Initializes the output queue and statistics of a newly created socket
+ *
+ * @param s			the socket to initialize
+ */
+static void initSocketState(Socket *s)
+{
+	memset(&s->stats, 0, sizeof(SocketStatistics));
+	s->reuse_port = getSocketShardCount() > 1;
+
+	s->output = g_queue_new();
+	s->output_length = 0;
+	s->output_high_watermark = outputHighWatermark;
+	s->output_low_watermark = outputLowWatermark;
+	s->output_congested = false;
+	s->output_closing = false;
+}
+
+/**
+ * Appends data that couldn't be written right away to the output queue of a socket. Small writes are coalesced into the last queued chunk.
+ *
+ * @param s			the socket to queue the data for
+ * @param buffer	the data to queue
+ * @param size		the number of bytes to queue
+ */
+static void queueSocketOutput(Socket *s, char *buffer, unsigned int size)
+{
+	SocketOutputChunk *chunk = g_queue_peek_tail(s->output);
+
+	if(chunk == NULL || chunk->capacity - chunk->size < size) { // doesn't fit into the last chunk, start a new one
+		unsigned int capacity = size > SOCKET_OUTPUT_CHUNK_SIZE ? size : SOCKET_OUTPUT_CHUNK_SIZE;
+		chunk = $$(void *, allocateMemory)(sizeof(SocketOutputChunk) + capacity);
+		chunk->capacity = capacity;
+		chunk->size = 0;
+		chunk->offset = 0;
+		g_queue_push_tail(s->output, chunk);
+	}
+
+	memcpy(chunk->data + chunk->size, buffer, size);
+	chunk->size += size;
+
+	if(s->output_length == 0) { // the queue was empty, so start waiting for the socket to become writable
+		enableSocketWritePolling(s);
+	}
+
+	s->output_length += size;
+
+	if(!s->output_congested && s->output_length > s->output_high_watermark) {
+		logNotice("Output queue of socket %d exceeded %u bytes", s->fd, s->output_high_watermark);
+		s->output_congested = true;
+		triggerEvent(s, "write_backpressure", s->output_length);
+	}
+}
+
+/**
+ * Drops all queued output of a socket
+ *
+ * @param s			the socket to clear the output queue for
+ */
+static void clearSocketOutput(Socket *s)
+{
+	SocketOutputChunk *chunk;
+	while((chunk = g_queue_pop_head(s->output)) != NULL) {
+		free(chunk);
+	}
+
+	s->output_length = 0;
+	s->output_congested = false;
+	s->output_closing = false;
+}
+
+/**
+ * Writes a buffer to a socket without blocking
+ *
+ * @param s			the socket to write to
+ * @param buffer	the buffer to write
+ * @param size		the buffer's size
+ * @result			the number of bytes written, which might be less than requested or even zero, or -1 on error
+ */
+static int sendSocketBuffer(Socket *s, char *buffer, unsigned int size)
+{
+	int ret;
+
+	do {
+#ifdef MSG_NOSIGNAL // prevent SIGPIPE if we can...
+		ret = send(s->fd, buffer, size, MSG_NOSIGNAL);
+#else
+		ret = send(s->fd, buffer, size, 0);
+#endif
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0) {
+		return checkSocketWriteError(s) ? 0 : -1;
+	}
+
+	return ret;
+}
+
+/**
+ * Writes as much of the head of a socket's output queue as the kernel accepts in a single call and removes the written data from the queue. Where
+ * available, the queued chunks are gathered into a single sendmsg call.
+ *
+ * @param s			the socket to write the output queue for, must have queued output
+ * @result			the number of bytes written, or -1 on error
+ */
+static int sendSocketOutput(Socket *s)
+{
+	int ret;
+
+#ifdef WIN32
+	SocketOutputChunk *head = g_queue_peek_head(s->output);
+	if((ret = sendSocketBuffer(s, head->data + head->offset, head->size - head->offset)) <= 0) {
+		return ret;
+	}
+#else
+	struct iovec iov[SOCKET_OUTPUT_IOV_MAX];
+	int count = 0;
+
+	for(GList *iter = s->output->head; iter != NULL && count < SOCKET_OUTPUT_IOV_MAX; iter = iter->next, count++) {
+		SocketOutputChunk *chunk = iter->data;
+		iov[count].iov_base = chunk->data + chunk->offset;
+		iov[count].iov_len = chunk->size - chunk->offset;
+	}
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(struct msghdr));
+	message.msg_iov = iov;
+	message.msg_iovlen = count;
+
+	do {
+#ifdef MSG_NOSIGNAL // prevent SIGPIPE if we can...
+		ret = sendmsg(s->fd, &message, MSG_NOSIGNAL);
+#else
+		ret = sendmsg(s->fd, &message, 0);
+#endif
+	} while(ret < 0 && errno == EINTR);
+
+	if(ret < 0) {
+		return checkSocketWriteError(s) ? 0 : -1;
+	}
+#endif
+
+	s->output_length -= ret;
+
+	// Drop whatever was written from the head of the queue
+	unsigned int left = ret;
+	while(left > 0) {
+		SocketOutputChunk *chunk = g_queue_peek_head(s->output);
+		unsigned int available = chunk->size - chunk->offset;
+
+		if(left < available) { // partially written chunk
+			chunk->offset += left;
+			break;
+		}
+
+		left -= available;
+		free(g_queue_pop_head(s->output));
+	}
+
+	return ret;
+}
+
+/**
+ * Checks the error of a failed write to a socket and disconnects it if the connection broke down
+ *
+ * @param s			the socket that failed to be written to
+ * @result			true if the socket just isn't writable right now and the write should be retried later, false if writing failed
+ */
+static bool checkSocketWriteError(Socket *s)
+{
+#ifdef WIN32
+	if(WSAGetLastError() == WSAEWOULDBLOCK) {
+		return true;
+	}
+
+	char *error = g_win32_error_message(WSAGetLastError());
+	logError("Failed to write to socket %d: %s", s->fd, error);
+	free(error);
+#else
+	if(errno == EAGAIN || errno == EWOULDBLOCK) { // the kernel buffer is full
+		return true;
+	} else if(errno == EPIPE) { // broken pipe means the connection broke down but we didn't get the disconnect event yet
+		logNotice("Broken pipe for socket %d on write, disconnecting...", s->fd);
+		disconnectSocket(s);
+		return false;
+	}
+
+	logSystemError("Failed to write to socket %d", s->fd);
+#endif
+
+	return false;
+}
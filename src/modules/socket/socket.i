@@ -26,6 +26,7 @@
 #include <stdio.h>
 #endif
 
+#include <glib.h>
 #include "types.h"
 
 typedef enum {
@@ -41,6 +42,24 @@ typedef enum {
 	SOCKET_SHELL
 } SocketType;
 
+/**
+ * Struct to collect polling statistics of a socket
+ */
+typedef struct {
+	/** the number of bytes read from the socket */
+	unsigned long bytes_read;
+	/** the number of reads from the socket that returned data */
+	unsigned long reads;
+	/** the number of clients accepted from the server socket */
+	unsigned long accepted;
+	/** the number of polling rounds in which the socket exhausted its polling budget while it still had data or clients ready */
+	unsigned long budget_exhausted;
+	/** the number of consecutive polling rounds the current burst of input has taken so far */
+	unsigned int burst_rounds;
+	/** the largest number of consecutive polling rounds a burst of input took to drain */
+	unsigned int max_burst_rounds;
+} SocketStatistics;
+
 typedef struct {
 	/** the file descriptor of the socket */
 	int fd;
@@ -49,6 +68,22 @@ typedef struct {
 	SocketType type;
 	bool connected;
 	void *custom;
+	/** queue of buffered output chunks that were accepted for writing but not yet sent */
+	GQueue *output;
+	/** the number of bytes waiting in the output queue */
+	unsigned int output_length;
+	/** if the output queue grows beyond this many bytes, the "write_backpressure" event is triggered */
+	unsigned int output_high_watermark;
+	/** if the output queue of a congested socket drains down to this many bytes, the "write_drained" event is triggered */
+	unsigned int output_low_watermark;
+	/** true if the output queue exceeded the high watermark and hasn't drained to the low watermark yet */
+	bool output_congested;
+	/** true if the socket is disconnected as soon as its output queue is drained */
+	bool output_closing;
+	/** polling statistics of the socket */
+	SocketStatistics stats;
+	/** true if a server socket should be bound with SO_REUSEPORT so several processes can listen on its port, defaults to true if running in socket shards */
+	bool reuse_port;
 #ifdef WIN32
 	FILE *out;
 	FILE *in;
@@ -81,6 +116,15 @@ API Socket *createServerSocket(char *port);
  */
 API Socket *createShellSocket(char **args);
 
+/**
+ * Creates a connected socket for an already open file descriptor such as one end of a socket pair shared with a child process. The descriptor
+ * is set non-blocking and the socket takes ownership of it, i.e. closes it when disconnected.
+ *
+ * @param fd			the file descriptor to create the socket for
+ * @result				the created socket or NULL on failure
+ */
+API Socket *createFdSocket(int fd);
+
 /**
  * Connects a socket
  *
@@ -99,6 +143,16 @@ API bool connectSocket(Socket *s);
  */
 API bool disconnectSocket(Socket *s);
 
+/**
+ * Disconnects a socket as soon as all buffered output has been written. Until then, the socket is no longer read from and further writes are rejected.
+ * If there is no buffered output, the socket is disconnected immediately.
+ * @see disconnectSocket
+ *
+ * @param s			the socket to disconnect
+ * @result			true if successful, false on error
+ */
+API bool disconnectSocketWhenDrained(Socket *s);
+
 /**
  * Frees a socket. Note that this function MUST NOT be called from a (descendent of a) socket_read hook since further listeners expect the socket
  * to still be existing. If you want to get rid of a socket after a read event, listen to the socket_disconnect hook and disconnect it with disconnectSocket().
@@ -110,15 +164,26 @@ API bool disconnectSocket(Socket *s);
 API void freeSocket(Socket *s);
 
 /**
- * Writes directly into a socket
+ * Writes into a socket without blocking. As much data as the kernel accepts is written directly from the passed buffer, the rest is copied into the
+ * socket's output queue and sent as soon as the socket becomes writable again. If the output queue grows beyond the socket's high watermark, the
+ * "write_backpressure" event is triggered with the queued size as argument. Once it drains back to the low watermark, "write_drained" follows.
  *
  * @param s				the socket to write to
  * @param buffer		the buffer to send
  * @param size			the buffer's size
- * @result				true if successful, false on error
+ * @result				true if the data was written or queued, false on error
  */
 API bool socketWriteRaw(Socket *s, void *buffer, int size);
 
+/**
+ * Writes as much of a socket's output queue as possible without blocking. This is called by the polling engine whenever a socket with queued output
+ * becomes writable, so you usually don't need to call it yourself.
+ *
+ * @param s				the socket to flush
+ * @result				true if successful, false on error
+ */
+API bool flushSocketOutput(Socket *s);
+
 /**
  * Reads directly from a socket
  *
@@ -130,10 +195,11 @@ API bool socketWriteRaw(Socket *s, void *buffer, int size);
 API int socketReadRaw(Socket *s, void *buffer, int size);
 
 /**
- * Accepts a client socket from a listening server socket
+ * Accepts a client socket from a listening server socket. If no client could be accepted but the server socket is still connected, errno tells
+ * whether there was simply nothing to accept or why accepting failed.
  *
  * @param server		the server socket
- * @return Socket		the accepted socket
+ * @return Socket		the accepted socket, or NULL if no client could be accepted
  */
 API Socket *socketAccept(Socket *server);
 
@@ -42,6 +42,7 @@
 #include "dll.h"
 #define API
 #include "socket.h"
+#include "poll.h"
 #include "util.h"
 
 
@@ -86,6 +87,8 @@ API bool closeSocket(Socket *s)
 #endif
 
 	if(s->fd >= 0) {
+		unwatchSocket(s); // drop the epoll registration while the descriptor still refers to it
+
 #ifdef WIN32
 		if(closesocket(s->fd) != 0) {
 #else
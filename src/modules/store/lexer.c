@@ -18,7 +18,6 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <ctype.h>
 #include <string.h>
 #include <stdlib.h>
 #include <glib.h>
@@ -43,11 +42,20 @@ typedef enum {
 	LEXER_STATE_READING_NUMBER_FLOAT
 } LexerState;
 
+#define STORE_LEX_NUMBER_BUFSIZE 64
+
 typedef struct {
 	int c;
 	StoreLexCharType type;
 	LexerState state;
+	/** the token text assembled so far if it couldn't be sliced from the input buffer, or NULL */
 	GString *assemble;
+	/** the start of the token text inside the input buffer if it is read directly from one, or NULL */
+	const char *slice;
+	/** the length of the token text slice */
+	int slice_length;
+	/** the error message if the token is -1 */
+	const char *error;
 	int token;
 } LexerStruct;
 
@@ -66,47 +74,47 @@ static LexerAction lexStateReadingStringExtended(LexerStruct *lex);
 static LexerAction lexStateReadingStringExtendedEscaping(LexerStruct *lex);
 static LexerAction lexStateReadingNumberInt(LexerStruct *lex);
 static LexerAction lexStateReadingNumberFloat(LexerStruct *lex);
+static void consumeLexerChar(LexerStruct *lex, const char *position);
+static char *materializeLexerText(LexerStruct *lex, char *buffer, int size);
 static void freeStoreLexResult(void *result_p);
 
 void yyerror(YYLTYPE *lloc, StoreParser *parser, char *error); // this can't go into a header because it doesn't have an API export
 
+/**
+ * Lookup table of the lexing character types of all bytes
+ */
+static const StoreLexCharType lexCharTypes[256] = {
+	[0 ... 255] = STORE_LEX_CHAR_TYPE_LETTER,
+	['\0'] = STORE_LEX_CHAR_TYPE_END,
+	[' '] = STORE_LEX_CHAR_TYPE_SPACE,
+	['\t'] = STORE_LEX_CHAR_TYPE_SPACE,
+	['\n'] = STORE_LEX_CHAR_TYPE_SPACE,
+	['\v'] = STORE_LEX_CHAR_TYPE_SPACE,
+	['\f'] = STORE_LEX_CHAR_TYPE_SPACE,
+	['\r'] = STORE_LEX_CHAR_TYPE_SPACE,
+	[';'] = STORE_LEX_CHAR_TYPE_SPACE,
+	[','] = STORE_LEX_CHAR_TYPE_SPACE,
+	['0' ... '9'] = STORE_LEX_CHAR_TYPE_DIGIT,
+	['-'] = STORE_LEX_CHAR_TYPE_DIGIT,
+	['.'] = STORE_LEX_CHAR_TYPE_DECIMAL,
+	['"'] = STORE_LEX_CHAR_TYPE_QUOTATION,
+	['\\'] = STORE_LEX_CHAR_TYPE_ESCAPE,
+	['/'] = STORE_LEX_CHAR_TYPE_COMMENT,
+	['#'] = STORE_LEX_CHAR_TYPE_COMMENT,
+	['('] = STORE_LEX_CHAR_TYPE_DELIMITER,
+	[')'] = STORE_LEX_CHAR_TYPE_DELIMITER,
+	['{'] = STORE_LEX_CHAR_TYPE_DELIMITER,
+	['}'] = STORE_LEX_CHAR_TYPE_DELIMITER,
+	['='] = STORE_LEX_CHAR_TYPE_DELIMITER
+};
+
 API StoreLexCharType getStoreLexCharType(int c)
 {
-	if(isspace(c)) {
-		return STORE_LEX_CHAR_TYPE_SPACE;
-	}
-
-	if(isdigit(c)) {
-		return STORE_LEX_CHAR_TYPE_DIGIT;
+	if(c == EOF) {
+		return STORE_LEX_CHAR_TYPE_END;
 	}
 
-	switch(c) {
-		case EOF:
-		case '\0':
-			return STORE_LEX_CHAR_TYPE_END;
-		case '.':
-			return STORE_LEX_CHAR_TYPE_DECIMAL;
-		case '"':
-			return STORE_LEX_CHAR_TYPE_QUOTATION;
-		case '\\':
-			return STORE_LEX_CHAR_TYPE_ESCAPE;
-		case '/':
-		case '#':
-			return STORE_LEX_CHAR_TYPE_COMMENT;
-		case '(':
-		case ')':
-		case '{':
-		case '}':
-		case '=':
-			return STORE_LEX_CHAR_TYPE_DELIMITER;
-		case ';':
-		case ',':
-			return STORE_LEX_CHAR_TYPE_SPACE;
-		case '-':
-			return STORE_LEX_CHAR_TYPE_DIGIT;
-		default:
-			return STORE_LEX_CHAR_TYPE_LETTER;
-	}
+	return lexCharTypes[(unsigned char) c];
 }
 
 API int yylex(YYSTYPE *lval, YYLTYPE *lloc, StoreParser *parser)
@@ -115,12 +123,35 @@ API int yylex(YYSTYPE *lval, YYLTYPE *lloc, StoreParser *parser)
 	lex.c = EOF;
 	lex.type = STORE_LEX_CHAR_TYPE_END;
 	lex.state = LEXER_STATE_START;
-	lex.assemble = g_string_new("");
+	lex.assemble = NULL;
+	lex.slice = NULL;
+	lex.slice_length = 0;
+	lex.error = NULL;
 	lex.token = 0;
 
+	// If the parser is a buffer parser, read its buffer directly instead of calling the reader for every character
+	const char *cursor = NULL;
+	const char *end = NULL;
+	if(parser->read == &storeBufferRead) {
+		cursor = parser->const_resource;
+		end = ((StoreBufferParser *) parser)->end;
+	}
+	bool exhausted = false;
+
 	while(true) {
-		lex.c = parser->read(parser);
-		lex.type = getStoreLexCharType(lex.c);
+		if(cursor != NULL) {
+			if(cursor < end) {
+				lex.c = (unsigned char) *cursor++;
+			} else { // the end of the buffer reads like a terminating NUL character without moving the cursor
+				lex.c = '\0';
+				exhausted = true;
+			}
+
+			lex.type = lexCharTypes[lex.c];
+		} else {
+			lex.c = parser->read(parser);
+			lex.type = getStoreLexCharType(lex.c);
+		}
 
 		lloc->last_column++;
 
@@ -155,45 +186,67 @@ API int yylex(YYSTYPE *lval, YYLTYPE *lloc, StoreParser *parser)
 				break;
 		}
 
+		if(action == LEXER_ACTION_REPEAT || action == LEXER_ACTION_PUSHBACK_RETURN) {
+			if(cursor == NULL) {
+				parser->unread(parser, lex.c);
+			} else if(exhausted) {
+				exhausted = false;
+			} else {
+				cursor--;
+			}
+
+			lloc->last_column--;
+		}
+
 		switch(action) {
 			case LEXER_ACTION_REPEAT:
-				parser->unread(parser, lex.c);
-				lloc->last_column--;
 				break;
 			case LEXER_ACTION_CONSUME:
-				g_string_append_c(lex.assemble, lex.c);
+				consumeLexerChar(&lex, cursor != NULL ? cursor - 1 : NULL);
 				break;
 			case LEXER_ACTION_SKIP:
 				break;
 			case LEXER_ACTION_RETURN:
 			case LEXER_ACTION_PUSHBACK_RETURN:
 			{
-				if(action == LEXER_ACTION_PUSHBACK_RETURN) {
-					parser->unread(parser, lex.c);
-					lloc->last_column--;
+				if(cursor != NULL) {
+					parser->const_resource = cursor;
 				}
 
-				bool freeAssemble = true;
+				char number[STORE_LEX_NUMBER_BUFSIZE];
+				char *text;
 
 				switch(lex.token) {
 					case -1:
-						yyerror(lloc, parser, lex.assemble->str);
+						yyerror(lloc, parser, (char *) lex.error);
+						lval->string = NULL;
+						break;
 					case STORE_TOKEN_STRING:
-						freeAssemble = false;
-						lval->string = lex.assemble->str;
+						lval->string = materializeLexerText(&lex, NULL, 0);
 						break;
 					case STORE_TOKEN_INTEGER:
-						lval->integer = atoi(lex.assemble->str);
+						text = materializeLexerText(&lex, number, STORE_LEX_NUMBER_BUFSIZE);
+						lval->integer = atoi(text);
+						if(text != number) {
+							free(text);
+						}
 						break;
 					case STORE_TOKEN_FLOAT_NUMBER:
-						lval->float_number = atof(lex.assemble->str);
+						text = materializeLexerText(&lex, number, STORE_LEX_NUMBER_BUFSIZE);
+						lval->float_number = atof(text);
+						if(text != number) {
+							free(text);
+						}
 						break;
 					default:
 						// nothing to do
 						break;
 				}
 
-				g_string_free(lex.assemble, freeAssemble);
+				if(lex.assemble != NULL) {
+					g_string_free(lex.assemble, true);
+				}
+
 				return lex.token;
 			} break;
 		}
@@ -300,7 +353,7 @@ static LexerAction lexStateReadingStringExtended(LexerStruct *lex)
 			return LEXER_ACTION_SKIP;
 		case STORE_LEX_CHAR_TYPE_END:
 			lex->token = -1;
-			g_string_assign(lex->assemble, "Unexpected end when reading extended string");
+			lex->error = "Unexpected end when reading extended string";
 			return LEXER_ACTION_RETURN;
 	}
 
@@ -323,7 +376,7 @@ static LexerAction lexStateReadingStringExtendedEscaping(LexerStruct *lex)
 		case STORE_LEX_CHAR_TYPE_DIGIT:
 		case STORE_LEX_CHAR_TYPE_LETTER:
 			lex->token = -1;
-			g_string_assign(lex->assemble, "Unexpected escape character without following character to be escaped when reading extended string");
+			lex->error = "Unexpected escape character without following character to be escaped when reading extended string";
 			return LEXER_ACTION_RETURN;
 	}
 
@@ -365,7 +418,7 @@ static LexerAction lexStateReadingNumberFloat(LexerStruct *lex)
 			return LEXER_ACTION_CONSUME;
 		case STORE_LEX_CHAR_TYPE_DECIMAL:
 			lex->token = -1;
-			g_string_assign(lex->assemble, "Encountered double decimal mark when reading float number");
+			lex->error = "Encountered double decimal mark when reading float number";
 			return LEXER_ACTION_RETURN;
 		case STORE_LEX_CHAR_TYPE_LETTER:
 			// actually reading a simple string, we just didn't know yet
@@ -385,6 +438,67 @@ static LexerAction lexStateReadingNumberFloat(LexerStruct *lex)
 	return LEXER_ACTION_RETURN;
 }
 
+/**
+ * Appends the current character to the text of the token being lexed. As long as the token is a contiguous part of the input buffer, it is only
+ * remembered as a slice of it, and copied once it is materialized.
+ *
+ * @param lex			the lexer state
+ * @param position		the position of the current character inside the input buffer, or NULL if the input isn't read from a buffer
+ */
+static void consumeLexerChar(LexerStruct *lex, const char *position)
+{
+	if(lex->assemble == NULL && position != NULL) {
+		if(lex->slice == NULL) { // first character of the token
+			lex->slice = position;
+			lex->slice_length = 1;
+			return;
+		} else if(lex->slice + lex->slice_length == position) { // the token continues contiguously
+			lex->slice_length++;
+			return;
+		}
+	}
+
+	if(lex->assemble == NULL) { // characters were skipped inside the token, e.g. escape characters, so we have to assemble it
+		lex->assemble = g_string_sized_new(lex->slice_length + 16);
+		g_string_append_len(lex->assemble, lex->slice, lex->slice_length);
+	}
+
+	g_string_append_c(lex->assemble, lex->c);
+}
+
+/**
+ * Materializes the text of the token being lexed as a NUL-terminated string
+ *
+ * @param lex			the lexer state
+ * @param buffer		a buffer to copy short texts into, or NULL if the text should always be allocated
+ * @param size			the size of the buffer
+ * @result				the token text, which must be freed unless it is the passed buffer
+ */
+static char *materializeLexerText(LexerStruct *lex, char *buffer, int size)
+{
+	if(lex->assemble != NULL) {
+		char *text = lex->assemble->str;
+		g_string_free(lex->assemble, false);
+		lex->assemble = NULL;
+		return text;
+	}
+
+	if(buffer != NULL && lex->slice_length < size) {
+		if(lex->slice_length > 0) {
+			memcpy(buffer, lex->slice, lex->slice_length);
+		}
+
+		buffer[lex->slice_length] = '\0';
+		return buffer;
+	}
+
+	if(lex->slice == NULL) { // empty token, e.g. an empty extended string
+		return strdup("");
+	}
+
+	return g_strndup(lex->slice, lex->slice_length);
+}
+
 static void freeStoreLexResult(void *result_p)
 {
 	StoreLexResult *result = (StoreLexResult *) result_p;
@@ -417,24 +531,25 @@ API GPtrArray *lexStore(StoreParser *parser)
 
 API GPtrArray *lexStoreString(const char *string)
 {
-	StoreParser parser;
-	parser.resource = (char *) string;
-	parser.read = &storeStringRead;
-	parser.unread = &storeStringUnread;
+	StoreBufferParser parser;
+	initStoreBufferParser(&parser, string, strlen(string));
 
-	return lexStore(&parser);
+	return lexStore(&parser.parser);
 }
 
 API GPtrArray *lexStoreFile(const char *filename)
 {
-	StoreParser parser;
-	parser.resource = fopen(filename, "r");
-	parser.read = &storeFileRead;
-	parser.unread = &storeFileUnread;
+	StoreFileMapping *mapping;
+	if((mapping = mapStoreFile(filename)) == NULL) {
+		return NULL;
+	}
+
+	StoreBufferParser parser;
+	initStoreBufferParser(&parser, mapping->content, mapping->length);
 
-	GPtrArray *ret = lexStore(&parser);
+	GPtrArray *ret = lexStore(&parser.parser);
 
-	fclose(parser.resource);
+	unmapStoreFile(mapping);
 
 	return ret;
 }
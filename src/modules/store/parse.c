@@ -18,6 +18,14 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifndef WIN32
+#include <sys/mman.h> // mmap, munmap, madvise
+#include <sys/stat.h> // fstat
+#include <fcntl.h> // open
+#include <unistd.h> // close
+#endif
+#include <string.h> // strlen
+
 #include "dll.h"
 #include "memory_alloc.h"
 #include "types.h"
@@ -32,42 +40,120 @@ int yyparse(StoreParser *parser); // this can't go into a header because it does
 
 API Store *parseStoreFile(const char *filename)
 {
-	StoreParser parser;
-	parser.resource = fopen(filename, "r");
-	parser.read = &storeFileRead;
-	parser.unread = &storeFileUnread;
-	parser.store = NULL;
-
-	if(parser.resource == NULL) {
-		logSystemError("Could not open store file %s", filename);
+	StoreFileMapping *mapping;
+	if((mapping = mapStoreFile(filename)) == NULL) {
 		return NULL;
 	}
 
-	if(yyparse(&parser) != 0) {
+	StoreBufferParser parser;
+	initStoreBufferParser(&parser, mapping->content, mapping->length);
+
+	if(yyparse(&parser.parser) != 0) {
 		logError("Parsing store file %s failed", filename);
-		fclose(parser.resource);
+		unmapStoreFile(mapping);
 		return NULL;
 	}
 
-	fclose(parser.resource);
+	unmapStoreFile(mapping); // the parsed store holds copies of all values, so it doesn't reference the file content
 
-	return parser.store;
+	return parser.parser.store;
 }
 
 API Store *parseStoreString(const char *string)
 {
-	StoreParser parser;
-	parser.const_resource = string;
-	parser.read = &storeStringRead;
-	parser.unread = &storeStringUnread;
-	parser.store = NULL;
+	StoreBufferParser parser;
+	initStoreBufferParser(&parser, string, strlen(string));
 
-	if(yyparse(&parser) != 0) {
+	if(yyparse(&parser.parser) != 0) {
 		logError("Parsing store string failed: %s", string);
 		return NULL;
 	}
 
-	return parser.store;
+	return parser.parser.store;
+}
+
+API Store *parseStoreBuffer(const char *buffer, size_t length)
+{
+	StoreBufferParser parser;
+	initStoreBufferParser(&parser, buffer, length);
+
+	if(yyparse(&parser.parser) != 0) {
+		logError("Parsing store buffer of length %lu failed", (unsigned long) length);
+		return NULL;
+	}
+
+	return parser.parser.store;
+}
+
+API StoreFileMapping *mapStoreFile(const char *filename)
+{
+	StoreFileMapping *mapping = ALLOCATE_OBJECT(StoreFileMapping);
+	mapping->content = NULL;
+	mapping->length = 0;
+	mapping->mapped = false;
+
+#ifndef WIN32
+	int fd;
+	if((fd = open(filename, O_RDONLY)) < 0) {
+		logSystemError("Could not open store file %s", filename);
+		free(mapping);
+		return NULL;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) == 0 && info.st_size > 0) {
+		void *content;
+		if((content = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED) {
+			madvise(content, info.st_size, MADV_SEQUENTIAL); // the lexer reads it front to back exactly once
+			mapping->content = content;
+			mapping->length = info.st_size;
+			mapping->mapped = true;
+			close(fd);
+			return mapping;
+		}
+
+		logSystemError("Failed to map store file %s, reading it instead", filename);
+	}
+
+	close(fd);
+#endif
+
+	// Either we can't map files or the file can't be mapped, e.g. because it's empty or not a regular file
+	GError *error = NULL;
+	gsize length;
+	if(!g_file_get_contents(filename, &mapping->content, &length, &error)) {
+		logError("Could not read store file %s: %s", filename, error->message);
+		g_error_free(error);
+		free(mapping);
+		return NULL;
+	}
+
+	mapping->length = length;
+
+	return mapping;
+}
+
+API void unmapStoreFile(StoreFileMapping *mapping)
+{
+#ifndef WIN32
+	if(mapping->mapped) {
+		munmap(mapping->content, mapping->length);
+		free(mapping);
+		return;
+	}
+#endif
+
+	free(mapping->content);
+	free(mapping);
+}
+
+API void initStoreBufferParser(StoreBufferParser *parser, const char *buffer, size_t length)
+{
+	parser->parser.const_resource = buffer;
+	parser->parser.read = &storeBufferRead; // identifies the parser as a buffer parser to the lexer, which then reads from the buffer directly
+	parser->parser.unread = &storeBufferUnread;
+	parser->parser.store = NULL;
+	parser->end = buffer + length;
 }
 
 API char storeFileRead(void *parser_p)
@@ -86,6 +172,26 @@ API void storeFileUnread(void *parser_p, int c)
 	}
 }
 
+API char storeBufferRead(void *parser_p)
+{
+	StoreBufferParser *parser = parser_p;
+
+	if(parser->parser.const_resource >= (const void *) parser->end) {
+		return '\0';
+	}
+
+	return *((const char *) parser->parser.const_resource++);
+}
+
+API void storeBufferUnread(void *parser_p, int c)
+{
+	StoreBufferParser *parser = parser_p;
+
+	if(c != '\0') { // reading the end of the buffer didn't move it
+		parser->parser.const_resource--;
+	}
+}
+
 API char storeStringRead(void *parser_p)
 {
 	StoreParser *parser = parser_p;
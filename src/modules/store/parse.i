@@ -69,6 +69,30 @@ typedef struct
 	Store *store;
 } StoreParser;
 
+/**
+ * Struct to represent a store parser reading from a buffer that the lexer accesses directly instead of calling read and unread
+ */
+typedef struct
+{
+	/** The underlying store parser, its reader must be storeBufferRead */
+	StoreParser parser;
+	/** The end of the buffer starting at the parser's const_resource */
+	const char *end;
+} StoreBufferParser;
+
+/**
+ * Struct to represent the content of a store file loaded into memory
+ */
+typedef struct
+{
+	/** The file's content, not NUL-terminated */
+	char *content;
+	/** The length of the file's content */
+	size_t length;
+	/** True if the content is memory mapped, false if it was read into a heap buffer */
+	bool mapped;
+} StoreFileMapping;
+
 /**
  * Parses a store file
  *
@@ -85,6 +109,39 @@ API Store *parseStoreFile(const char *filename);
  */
 API Store *parseStoreString(const char *string);
 
+/**
+ * Parses a store from a buffer that doesn't need to be NUL-terminated
+ *
+ * @param buffer		the buffer to parse
+ * @param length		the length of the buffer
+ * @result				the parsed store
+ */
+API Store *parseStoreBuffer(const char *buffer, size_t length);
+
+/**
+ * Loads the content of a store file into memory, preferably by mapping it
+ *
+ * @param filename		the file name of the store file to load
+ * @result				the loaded store file, must be freed with unmapStoreFile, or NULL on failure
+ */
+API StoreFileMapping *mapStoreFile(const char *filename);
+
+/**
+ * Frees a store file loaded into memory
+ *
+ * @param mapping		the loaded store file to free
+ */
+API void unmapStoreFile(StoreFileMapping *mapping);
+
+/**
+ * Initializes a parser to read directly from a buffer
+ *
+ * @param parser		the parser to initialize
+ * @param buffer		the buffer to read from, which doesn't need to be NUL-terminated
+ * @param length		the length of the buffer
+ */
+API void initStoreBufferParser(StoreBufferParser *parser, const char *buffer, size_t length);
+
 /**
  * A StoreReader function for files
  *
@@ -101,6 +158,22 @@ API char storeFileRead(void *parser_p);
  */
 API void storeFileUnread(void *parser_p, int c);
 
+/**
+ * A StoreReader function for buffers, the parser must be a StoreBufferParser
+ *
+ * @param parser_p		the parser to to read from
+ * @result				the read character, or '\0' at the end of the buffer
+ */
+API char storeBufferRead(void *parser_p);
+
+/**
+ * A StoreUnreader function for buffers, the parser must be a StoreBufferParser
+ *
+ * @param parser_p		the parser to to unread to
+ * @param c				the character to unread
+ */
+API void storeBufferUnread(void *parser_p, int c);
+
 /**
  * A StoreReader function for strings
  *
@@ -31,85 +31,101 @@
 #include "path.h"
 
 #define MAX_PATH_LEN 4096
+#define STORE_PATH_BUFFER_SIZE 256
+
+static char *cutStorePathElement(char **path_p);
+static Store *getStoreChild(Store *parent, const char *key, int index);
 
 API Store *getStorePath(Store *parent, const char *pathFormat, ...)
 {
 	va_list va;
-	char path[MAX_PATH_LEN];
+	char buffer[STORE_PATH_BUFFER_SIZE];
+	char *path = buffer;
 
 	va_start(va, pathFormat);
-	vsnprintf(path, MAX_PATH_LEN, pathFormat, va);
+	int length = vsnprintf(buffer, STORE_PATH_BUFFER_SIZE, pathFormat, va);
+	va_end(va);
+
+	if(length < 0) {
+		return NULL;
+	} else if(length >= STORE_PATH_BUFFER_SIZE) { // too long for our stack buffer
+		va_start(va, pathFormat);
+		path = g_strdup_vprintf(pathFormat, va);
+		va_end(va);
+	}
 
-	if(strlen(path) == 0) { // empty path means the parent itself
-		return parent;
+	Store *value = parent; // empty path means the parent itself
+	char *iter = path;
+
+	while(value != NULL && *iter != '\0') {
+		char *key;
+		if((key = cutStorePathElement(&iter)) == NULL) { // invalid escape sequence
+			value = NULL;
+			break;
+		}
+
+		value = getStoreChild(value, key, value->type == STORE_LIST ? atoi(key) : -1);
 	}
 
-	GString *pathnode = g_string_new("");
-	bool escaping = false;
-	const char *iter;
+	if(path != buffer) {
+		free(path);
+	}
 
-	for(iter = path; *iter != '\0'; iter++) { // Read until next unescaped slash or end
+	return value;
+}
+
+API StorePath *compileStorePath(const char *pathFormat, ...)
+{
+	va_list va;
+	va_start(va, pathFormat);
+	char *buffer = g_strdup_vprintf(pathFormat, va);
+	va_end(va);
+
+	// Every unescaped slash delimits an element, so this is an upper bound for their number
+	unsigned int count = 1;
+	for(char *iter = buffer; *iter != '\0'; iter++) {
 		if(*iter == '/') {
-			if(!escaping) {
-				iter++;
-				break;
-			} else {
-				escaping = false;
-			}
-		} else if(*iter == '\\') {
-			if(!escaping) {
-				escaping = true;
-				continue;
-			} else {
-				escaping = false;
-			}
+			count++;
 		}
+	}
 
-		if(escaping) { // we're still escaping, that's not possible
-			g_string_free(pathnode, TRUE);
+	StorePath *path = ALLOCATE_OBJECT(StorePath);
+	path->buffer = buffer;
+	path->elements = ALLOCATE_OBJECTS(StorePathElement, count);
+	path->length = 0;
+
+	char *iter = buffer;
+	while(*iter != '\0') {
+		char *key;
+		if((key = cutStorePathElement(&iter)) == NULL) { // invalid escape sequence
+			freeStorePath(path);
 			return NULL;
 		}
 
-		g_string_append_c(pathnode, *iter);
+		path->elements[path->length].key = key;
+		path->elements[path->length].index = atoi(key);
+		path->length++;
 	}
 
-	Store *value;
-	int i;
-
-	switch(parent->type) {
-		case STORE_ARRAY:
-			value = g_hash_table_lookup(parent->content.array, pathnode->str);
-
-			if(value == NULL) {
-				g_string_free(pathnode, TRUE);
-				return NULL;
-			}
-		break;
-		case STORE_LIST:
-			i = atoi(pathnode->str);
+	return path;
+}
 
-			if(i < 0 || i >= g_queue_get_length(parent->content.list)) { // out of bounds
-				g_string_free(pathnode, TRUE);
-				return NULL;
-			} else {
-				value = g_queue_peek_nth(parent->content.list, i);
+API Store *getCompiledStorePath(Store *parent, StorePath *path)
+{
+	Store *value = parent;
 
-				assert(value != NULL);
-			}
-		break;
-		default:
-			g_string_free(pathnode, TRUE);
-			return NULL; // leaves don't have children
-		break;
+	for(unsigned int i = 0; value != NULL && i < path->length; i++) {
+		value = getStoreChild(value, path->elements[i].key, path->elements[i].index);
 	}
 
-	g_string_free(pathnode, TRUE);
+	return value;
+}
 
-	if(*iter == '\0') {
-		return value;
-	} else {
-		return getStorePath(value, "%s", iter);
-	}
+API void freeStorePath(StorePath *path)
+{
+	free(path->elements);
+	free(path->buffer);
+	free(path);
 }
 
 API bool setStorePath(Store *store, char *pathFormat, void *value, ...)
@@ -257,3 +273,73 @@ API GPtrArray *splitStorePath(char *path)
 
 	return array;
 }
+
+/**
+ * Cuts the next element off a mutable store path and unescapes it in place
+ *
+ * @param path_p		a pointer to the remaining path, which is advanced past the element and its delimiter
+ * @result				the unescaped element, or NULL if it contains an invalid escape sequence
+ */
+static char *cutStorePathElement(char **path_p)
+{
+	char *key = *path_p;
+	char *read = *path_p;
+	char *write = *path_p;
+	bool escaping = false;
+
+	for(; *read != '\0'; read++) { // Read until next unescaped slash or end
+		if(*read == '/') {
+			if(!escaping) {
+				read++;
+				break;
+			} else {
+				escaping = false;
+			}
+		} else if(*read == '\\') {
+			if(!escaping) {
+				escaping = true;
+				continue;
+			} else {
+				escaping = false;
+			}
+		}
+
+		if(escaping) { // we're still escaping, that's not possible
+			return NULL;
+		}
+
+		*write++ = *read; // unescaped elements are never longer than escaped ones, so we can't overtake the read position
+	}
+
+	*write = '\0';
+	*path_p = read;
+
+	return key;
+}
+
+/**
+ * Looks up a direct child of a store value
+ *
+ * @param parent		the store value to look up the child in
+ * @param key			the key of the child if the parent is an array
+ * @param index			the index of the child if the parent is a list
+ * @result				the child, or NULL if not found
+ */
+static Store *getStoreChild(Store *parent, const char *key, int index)
+{
+	switch(parent->type) {
+		case STORE_ARRAY:
+			return g_hash_table_lookup(parent->content.array, key);
+		break;
+		case STORE_LIST:
+			if(index < 0 || index >= g_queue_get_length(parent->content.list)) { // out of bounds
+				return NULL;
+			}
+
+			return g_queue_peek_nth(parent->content.list, index);
+		break;
+		default:
+			return NULL; // leaves don't have children
+		break;
+	}
+}
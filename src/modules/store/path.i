@@ -21,6 +21,27 @@
 #ifndef STORE_PATH_H
 #define STORE_PATH_H
 
+/**
+ * Struct to represent an element of a compiled store path
+ */
+typedef struct {
+	/** the unescaped key of the element */
+	char *key;
+	/** the key interpreted as list index */
+	int index;
+} StorePathElement;
+
+/**
+ * Struct to represent a store path that was split and unescaped once so it can be looked up repeatedly
+ */
+typedef struct {
+	/** the buffer holding the unescaped keys of all elements */
+	char *buffer;
+	/** the elements of the path */
+	StorePathElement *elements;
+	/** the number of elements in the path */
+	unsigned int length;
+} StorePath;
 
 /**
  * Fetches a store value by its path
@@ -31,6 +52,31 @@
  */
 API Store *getStorePath(Store *store, const char *pathFormat, ...) G_GNUC_PRINTF(2, 3);
 
+/**
+ * Compiles a store path so it can be looked up repeatedly without parsing it again
+ * @see getCompiledStorePath
+ *
+ * @param pathFormat	the printf style path to compile, see getStorePath
+ * @result				the compiled store path, must be freed with freeStorePath, or NULL if the path contains an invalid escape sequence
+ */
+API StorePath *compileStorePath(const char *pathFormat, ...) G_GNUC_PRINTF(1, 2);
+
+/**
+ * Fetches a store value by a compiled path
+ *
+ * @param parent		the store in which the lookup takes place
+ * @param path			the compiled path to look up
+ * @result				the store value, or NULL if not found
+ */
+API Store *getCompiledStorePath(Store *parent, StorePath *path);
+
+/**
+ * Frees a compiled store path
+ *
+ * @param path			the compiled store path to free
+ */
+API void freeStorePath(StorePath *path);
+
 /**
  * Sets a value in a store path
  *
@@ -35,17 +35,23 @@
 MODULE_NAME("xcall");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("The xcall module provides a powerful interface for cross function calls between different languages");
-MODULE_VERSION(0, 2, 8);
+MODULE_VERSION(0, 2, 9);
 MODULE_BCVERSION(0, 2, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 6, 0));
+MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 18, 0));
 
 static Store *xcall_getXCallFunctions(Store *xcall);
 
 static GHashTable *functions;
 
+/**
+ * Compiled store path to the function name inside an XCall's meta array, looked up for every invocation
+ */
+static StorePath *functionPath;
+
 MODULE_INIT
 {
 	functions = g_hash_table_new_full(&g_str_hash, &g_str_equal, &free, NULL);
+	functionPath = $(StorePath *, store, compileStorePath)("xcall/function");
 	addXCallFunction("getXCallFunctions", &xcall_getXCallFunctions);
 
 	return true;
@@ -55,6 +61,7 @@ MODULE_FINALIZE
 {
 	delXCallFunction("getXCallFunctions");
 	g_hash_table_destroy(functions);
+	$(void, store, freeStorePath)(functionPath);
 }
 
 API bool addXCallFunction(const char *name, XCallFunction *func)
@@ -112,7 +119,7 @@ API Store *invokeXCall(Store *xcall)
 		}
 
 		// Now try to read function name inside xcall meta array
-		if((func = $(Store *, store, getStorePath)(xcall, "xcall/function")) == NULL || func->type != STORE_STRING) {
+		if((func = $(Store *, store, getCompiledStorePath)(xcall, functionPath)) == NULL || func->type != STORE_STRING) {
 			GString *xcallstr = $(GString *, store, writeStoreGString)(xcall);
 			logError("Failed to read XCall function name: %s", xcallstr->str);
 			g_string_free(xcallstr, true);
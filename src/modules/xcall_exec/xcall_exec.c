@@ -19,6 +19,7 @@
  */
 
 #include <glib.h>
+#include <stdarg.h>
 
 #include "dll.h"
 #include "types.h"
@@ -29,17 +30,33 @@
 #include "modules/store/store.h"
 #include "modules/store/path.h"
 #include "modules/xcall/xcall.h"
+#include "modules/event/event.h"
 #define API
 
+/**
+ * Struct to collect the output of an asynchronously executed process until it exits
+ */
+typedef struct {
+	/** the name of the XCall function to invoke when the process exited */
+	char *callback;
+	/** the collected standard output of the process */
+	GString *out;
+	/** the collected standard error of the process */
+	GString *err;
+} XCallExecProcess;
+
 static Store *xcall_executeShellCommand(Store *xcall);
 static Store *xcall_executeShellCommandArgs(Store *xcall);
+static Store *xcall_executeShellCommandAsync(Store *xcall);
+static void listener_processOutput(void *subject, const char *event, void *data, va_list args);
+static void listener_processExit(void *subject, const char *event, void *data, va_list args);
 
 MODULE_NAME("xcall_exec");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("XCall module for exec");
-MODULE_VERSION(0, 2, 0);
+MODULE_VERSION(0, 3, 0);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("exec", 0, 1, 0), MODULE_DEPENDENCY("store", 0, 6, 4), MODULE_DEPENDENCY("xcall", 0, 2, 6));
+MODULE_DEPENDS(MODULE_DEPENDENCY("exec", 0, 2, 0), MODULE_DEPENDENCY("store", 0, 6, 4), MODULE_DEPENDENCY("xcall", 0, 2, 6), MODULE_DEPENDENCY("event", 0, 1, 2));
 
 MODULE_INIT
 {
@@ -51,6 +68,10 @@ MODULE_INIT
 		return false;
 	}
 
+	if(!$(bool, xcall, addXCallFunction)("executeShellCommandAsync", &xcall_executeShellCommandAsync)) {
+		return false;
+	}
+
 	return true;
 }
 
@@ -58,6 +79,7 @@ MODULE_FINALIZE
 {
 	$(bool, xcall, delXCallFunction)("executeShellCommand");
 	$(bool, xcall, delXCallFunction)("executeShellCommandArgs");
+	$(bool, xcall, delXCallFunction)("executeShellCommandAsync");
 }
 
 /**
@@ -137,3 +159,152 @@ static Store *xcall_executeShellCommandArgs(Store *xcall)
 
 	return ret;
 }
+
+/**
+ * XCallFunction to asynchronously execute a shell command by a list of arguments without blocking
+ * XCall parameters:
+ *  * list args 		a string list of arguments
+ *  * string callback	the XCall function to invoke with the results after the command exited
+ *  * int timeout		the timeout in seconds after which the command is killed (optional)
+ * Callback XCall parameters:
+ *  * string output			the standard output of the executed command
+ *  * string error_output	the standard error of the executed command
+ *  * string state			"exited", "timed_out", "killed" or "failed"
+ *  * int status			the exit status of the command as returned by waitpid
+ * XCall result:
+ * 	* int success		nonzero if successful
+ *
+ * @param xcall		the xcall as store
+ * @result			a return value as store
+ */
+static Store *xcall_executeShellCommandAsync(Store *xcall)
+{
+	Store *ret = $(Store *, store, createStore)();
+	Store *argsp;
+	Store *callback;
+	Store *timeout;
+
+	if((argsp = $(Store *, store, getStorePath)(xcall, "args")) == NULL || argsp->type != STORE_LIST) {
+		$(bool, store, setStorePath)(ret, "xcall", $(Store *, store, createStore)());
+		$(bool, store, setStorePath)(ret, "xcall/error", $(Store *, store, createStoreStringValue)("Failed to read mandatory list parameter 'args'"));
+		return ret;
+	}
+
+	if((callback = $(Store *, store, getStorePath)(xcall, "callback")) == NULL || callback->type != STORE_STRING) {
+		$(bool, store, setStorePath)(ret, "xcall", $(Store *, store, createStore)());
+		$(bool, store, setStorePath)(ret, "xcall/error", $(Store *, store, createStoreStringValue)("Failed to read mandatory string parameter 'callback'"));
+		return ret;
+	}
+
+	int length = g_queue_get_length(argsp->content.list);
+	char **args = ALLOCATE_OBJECTS(char *, length + 1);
+	memset(args, 0, sizeof(char *) * (length + 1));
+
+	int i = 0;
+
+	for(GList *iter = argsp->content.list->head; iter != NULL; iter = iter->next, i++) {
+		Store *entry = iter->data;
+
+		if(entry->type != STORE_STRING) {
+			g_strfreev(args);
+			GString *error = g_string_new("");
+			g_string_append_printf(error, "args list parameter %d is not of type string", i);
+			$(bool, store, setStorePath)(ret, "xcall", $(Store *, store, createStore)());
+			$(bool, store, setStorePath)(ret, "xcall/error", $(Store *, store, createStoreStringValue)(error->str));
+			g_string_free(error, true);
+			return ret;
+		}
+
+		args[i] = strdup(entry->content.string);
+	}
+
+	XCallExecProcess *context = ALLOCATE_OBJECT(XCallExecProcess);
+	context->callback = strdup(callback->content.string);
+	context->out = g_string_new("");
+	context->err = g_string_new("");
+
+	ExecProcess *process = $(ExecProcess *, exec, createExecProcess)(args);
+	g_strfreev(args);
+
+	$(void, event, attachEventListener)(process, "stdout", context, &listener_processOutput);
+	$(void, event, attachEventListener)(process, "stderr", context, &listener_processOutput);
+	$(void, event, attachEventListener)(process, "exit", context, &listener_processExit);
+
+	int seconds = 0;
+	if((timeout = $(Store *, store, getStorePath)(xcall, "timeout")) != NULL && timeout->type == STORE_INTEGER) {
+		seconds = timeout->content.integer;
+	}
+
+	// If the process fails to start, the exit listener already reported that to the callback
+	bool success = $(bool, exec, startExecProcess)(process, seconds);
+	$(bool, store, setStorePath)(ret, "success", $(Store *, store, createStoreIntegerValue)(success));
+
+	return ret;
+}
+
+/**
+ * Event listener collecting the output of an asynchronously executed process
+ */
+static void listener_processOutput(void *subject, const char *event, void *data, va_list args)
+{
+	XCallExecProcess *context = data;
+	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
+
+	g_string_append_len(strcmp(event, "stdout") == 0 ? context->out : context->err, message, size);
+}
+
+/**
+ * Event listener invoking the callback XCall function of an asynchronously executed process after it exited
+ */
+static void listener_processExit(void *subject, const char *event, void *data, va_list args)
+{
+	ExecProcess *process = subject;
+	XCallExecProcess *context = data;
+	ExecProcessState state = va_arg(args, ExecProcessState);
+
+	const char *stateName;
+	switch(state) {
+		case EXEC_PROCESS_EXITED:
+			stateName = "exited";
+		break;
+		case EXEC_PROCESS_TIMED_OUT:
+			stateName = "timed_out";
+		break;
+		case EXEC_PROCESS_KILLED:
+			stateName = "killed";
+		break;
+		default:
+			stateName = "failed";
+		break;
+	}
+
+	Store *xcall = $(Store *, store, createStore)();
+	$(bool, store, setStorePath)(xcall, "xcall", $(Store *, store, createStoreArrayValue)(NULL));
+	$(bool, store, setStorePath)(xcall, "xcall/function", $(Store *, store, createStoreStringValue)(context->callback));
+	$(bool, store, setStorePath)(xcall, "output", $(Store *, store, createStoreStringValue)(context->out->str));
+	$(bool, store, setStorePath)(xcall, "error_output", $(Store *, store, createStoreStringValue)(context->err->str));
+	$(bool, store, setStorePath)(xcall, "state", $(Store *, store, createStoreStringValue)(stateName));
+	$(bool, store, setStorePath)(xcall, "status", $(Store *, store, createStoreIntegerValue)(process->status));
+
+	Store *ret = $(Store *, xcall, invokeXCall)(xcall);
+	$(void, store, freeStore)(xcall);
+
+	Store *error = $(Store *, store, getStorePath)(ret, "xcall/error");
+
+	if(error != NULL && error->type == STORE_STRING) { // XCall error
+		logError("Callback XCall function '%s' for executed process failed: %s", context->callback, error->content.string);
+	}
+
+	$(void, store, freeStore)(ret);
+
+	$(void, event, detachEventListener)(process, "stdout", context, &listener_processOutput);
+	$(void, event, detachEventListener)(process, "stderr", context, &listener_processOutput);
+	$(void, event, detachEventListener)(process, "exit", context, &listener_processExit);
+	$(void, exec, freeExecProcess)(process);
+
+	free(context->callback);
+	g_string_free(context->out, true);
+	g_string_free(context->err, true);
+	free(context);
+}
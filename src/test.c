@@ -54,6 +54,9 @@ static GPtrArray *module_init_log_lines;
  * execute a test suite
  */
 static GPtrArray *test_suite_whitelist = NULL;
+
+/** True if benchmarks should be run along with the tests */
+static bool run_benchmarks = false;
 static void populateWhitelist();
 static bool isWhitelisted(char *suite_name);
 
@@ -184,6 +187,13 @@ API void addTest(TestSuite *test_suite, char *name, TestFunction *test_function,
 	g_ptr_array_add(test_suite->test_cases, test_case);
 }
 
+API void addBenchmark(TestSuite *test_suite, char *name, TestFunction *function)
+{
+	if(run_benchmarks) {
+		addTest(test_suite, name, function, NULL);
+	}
+}
+
 API void runTestSuite(TestSuite *test_suite)
 {
 	if(test_suite_whitelist->len != 0 && !isWhitelisted(test_suite->name)) {
@@ -230,6 +240,12 @@ API void runTestSuite(TestSuite *test_suite)
 		} else {
 			tests_passed++;
 			appendRight(message, "PASS");
+
+			for(int j = 0; j < test_case->benchmark_lines->len; ++j) {
+				char *line = g_ptr_array_index(test_case->benchmark_lines, j);
+				g_string_append_printf(message, "\n    %s", line);
+			}
+
 			logNotice("%s", message->str);
 		}
 
@@ -246,6 +262,12 @@ API void failTest(TestCase *test_case, char* error, ...)
 	test_case->error = g_strdup_vprintf(error, va);
 }
 
+API void reportBenchmark(TestCase *test_case, char *name, long iterations, double seconds)
+{
+	double rate = seconds > 0.0 ? iterations / seconds : 0.0;
+	g_ptr_array_add(test_case->benchmark_lines, g_strdup_printf("Benchmark %s: %ld iterations in %.3fs (%.0f/s)", name, iterations, seconds, rate));
+}
+
 static void populateWhitelist()
 {
 	// TODO: Add the modules actually used here as dependencies in the
@@ -273,6 +295,13 @@ static void populateWhitelist()
 		logNotice("Whitelisted %lu test suite names", whitelisted);
 	}
 
+	typedef char* (*GetOptType)(char *opt);
+	GetOptType getOpt = (GetOptType) getLibraryFunctionByName("getopts", "getOpt");
+	if(getOpt != NULL && (getOpt("test-benchmarks") != NULL || getOpt("b") != NULL)) {
+		run_benchmarks = true;
+		logNotice("Running benchmarks along with the tests");
+	}
+
 	revokeModule("string_util");
 	revokeModule("getopts");
 }
@@ -314,6 +343,7 @@ static TestCase *createTestCase(char *name, TestFunction *function, TestFixture
 	result->test_fixture = fixture;
 	result->error = NULL;
 	result->log_lines = g_ptr_array_new_with_free_func(&free);
+	result->benchmark_lines = g_ptr_array_new_with_free_func(&free);
 	return result;
 }
 
@@ -325,6 +355,7 @@ static void destroyTestCase(TestCase *test_case)
 	free(test_case->name);
 	free(test_case->error);
 	g_ptr_array_free(test_case->log_lines, true);  // Frees the contained strings
+	g_ptr_array_free(test_case->benchmark_lines, true);
 	free(test_case);
 }
 
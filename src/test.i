@@ -72,6 +72,8 @@ typedef struct TestCaseStruct
 	char *error;
 	/** Array of raw strings storing log lines during test execution */
 	GPtrArray *log_lines;
+	/** Array of raw strings storing the benchmark results reported during test execution */
+	GPtrArray *benchmark_lines;
 } TestCase;
 
 /**
@@ -127,6 +129,16 @@ API void addTestFixture(TestSuite *test_suite, char *name, SetupFunction *setup,
  */
 API void addTest(TestSuite *test_suite, char *name, TestFunction *function, char *fixture_name);
 
+/**
+ * Adds a benchmark to a test suite. Benchmarks are run like tests without a fixture, but only if the test runner was started with the
+ * --test-benchmarks (-b) option, so the default test run stays fast and doesn't depend on timing.
+ *
+ * @param test_suite	the test suite to add the benchmark to
+ * @param name			the name of the benchmark
+ * @param function		a test function to be executed when running the benchmark
+ */
+API void addBenchmark(TestSuite *test_suite, char *name, TestFunction *function);
+
 /**
  * Executes all tests in the test suite.
  */
@@ -139,6 +151,15 @@ API void runTestSuite(TestSuite *test_suite);
  */
 API void failTest(TestCase *test_case, char *error, ...);
 
+/**
+ * Reports the result of a benchmark run inside a test case. Benchmark results are printed along with the outcome of the test case.
+ * @param test_case		the test case that ran the benchmark
+ * @param name			the name of the benchmark
+ * @param iterations	the number of iterations performed
+ * @param seconds		the time in seconds all iterations took
+ */
+API void reportBenchmark(TestCase *test_case, char *name, long iterations, double seconds);
+
 /**
  * Defines a new test case
  *
@@ -162,6 +183,13 @@ API void failTest(TestCase *test_case, char *error, ...);
  */
 #define ADD_SIMPLE_TEST(TEST_NAME) addTest(test_suite, #TEST_NAME, TEST_NAME, NULL);
 
+/**
+ * Adds a benchmark to the current test suite that is only run if benchmarks were enabled on the command line
+ *
+ * @param TEST_NAME		the name of the benchmark to add
+ */
+#define ADD_BENCHMARK(TEST_NAME) addBenchmark(test_suite, #TEST_NAME, TEST_NAME);
+
 /**
  * Adds a test case with a fixture to the current test suite.
  *
@@ -192,6 +220,14 @@ API void failTest(TestCase *test_case, char *error, ...);
  */
 #define TEST_ASSERT(EXPR) if(!(EXPR)) { TEST_FAIL("%s:%d: Assertion failed: " #EXPR, __FILE__, __LINE__); }
 
+/**
+ * Reports a benchmark result for the current test case
+ * @param NAME			the name of the benchmark
+ * @param ITERATIONS	the number of iterations performed
+ * @param SECONDS		the time in seconds all iterations took
+ */
+#define TEST_BENCHMARK(NAME, ITERATIONS, SECONDS) reportBenchmark(test_case, NAME, ITERATIONS, SECONDS);
+
 /**
  * Fails a test case with an error message
  *
@@ -24,22 +24,39 @@
 #include "test.h"
 #include "version.h"
 #include "module.h"
+#include "log.h"
+#include "util.h"
 
 #define API
 
+/** The number of messages to log per log level when checking log level filtering */
+#define TEST_LOG_MESSAGES 16
+
+/** The number of messages to log per log level in the logging benchmark */
+#define BENCHMARK_LOG_MESSAGES 200000
+
 TEST(version_compare);
 TEST(module_failure);
+TEST(log_levels);
+TEST(log_benchmark);
+
+static void countingLogHandler(const char *module, LogLevel level, const char *message);
+static bool logTestMessages(LogLevel level, int count, double *seconds_p);
+
+static int loggedMessages = 0;
 
 MODULE_NAME("test_core");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Test suite for the Kalisko core");
-MODULE_VERSION(0, 1, 2);
+MODULE_VERSION(0, 1, 4);
 MODULE_BCVERSION(0, 1, 2);
 MODULE_NODEPS;
 
 TEST_SUITE_BEGIN(core)
 	ADD_SIMPLE_TEST(version_compare);
 	ADD_SIMPLE_TEST(module_failure);
+	ADD_SIMPLE_TEST(log_levels);
+	ADD_BENCHMARK(log_benchmark);
 TEST_SUITE_END
 
 TEST(version_compare)
@@ -66,3 +83,80 @@ TEST(module_failure)
 	TEST_ASSERT(!$$(bool, requestModule)("_doesnotexist_"));
 	TEST_ASSERT(!$$(bool, revokeModule)("_doesnotexist_"));
 }
+
+TEST(log_levels)
+{
+	LogLevel levels[] = {LOG_LEVEL_TRACE, LOG_LEVEL_INFO, LOG_LEVEL_NOTICE, LOG_LEVEL_WARNING, LOG_LEVEL_ERROR};
+	bool delivered = true;
+	double seconds;
+
+	for(int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+		if(!logTestMessages(levels[i], TEST_LOG_MESSAGES, &seconds)) {
+			delivered = false;
+		}
+	}
+
+	TEST_ASSERT(delivered);
+}
+
+TEST(log_benchmark)
+{
+	LogLevel levels[] = {LOG_LEVEL_TRACE, LOG_LEVEL_INFO, LOG_LEVEL_NOTICE, LOG_LEVEL_WARNING, LOG_LEVEL_ERROR};
+	bool delivered = true;
+	double seconds;
+
+	for(int i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+		if(!logTestMessages(levels[i], BENCHMARK_LOG_MESSAGES, &seconds)) {
+			delivered = false;
+		}
+
+		char *name = g_strdup_printf("log_%s", $$(const char *, getStaticLogLevelName)(levels[i]));
+		TEST_BENCHMARK(name, BENCHMARK_LOG_MESSAGES, seconds);
+		free(name);
+	}
+
+	TEST_ASSERT(delivered);
+}
+
+/**
+ * Log handler that only counts the messages it receives
+ *
+ * @param module		the module in which the log message occured
+ * @param level			the log level of the message
+ * @param message		the log message
+ */
+static void countingLogHandler(const char *module, LogLevel level, const char *message)
+{
+	loggedMessages++;
+}
+
+/**
+ * Logs a number of messages at a log level through a counting log handler that only accepts LOG_LEVEL_NOTICE_UP, and checks that exactly the
+ * messages at accepted levels reached it
+ *
+ * @param level			the log level to log the messages at
+ * @param count			the number of messages to log
+ * @param seconds_p		a pointer to a double field to which the number of seconds spent logging should be written
+ * @result				true if the handler received all messages at an accepted level and none at a filtered one
+ */
+static bool logTestMessages(LogLevel level, int count, double *seconds_p)
+{
+	LogHandler *previousHandler = $$(LogHandler *, getLogHandler)();
+	LogLevel previousLevels = $$(LogLevel, getLogHandlerLevels)();
+
+	$$(void, setLogHandler)(&countingLogHandler);
+	$$(void, setLogHandlerLevels)(LOG_LEVEL_NOTICE_UP);
+
+	loggedMessages = 0;
+
+	double start = $$(double, getMicroTime)();
+	for(int i = 0; i < count; i++) {
+		$$(void, logMessage)("test_core", level, "Test message %d at %s level with a float %f and a string '%s'", i, $$(const char *, getStaticLogLevelName)(level), i * 0.5, "payload");
+	}
+	*seconds_p = $$(double, getMicroTime)() - start;
+
+	$$(void, setLogHandler)(previousHandler);
+	$$(void, setLogHandlerLevels)(previousLevels);
+
+	return loggedMessages == ((level & LOG_LEVEL_NOTICE_UP) ? count : 0);
+}
@@ -0,0 +1,115 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "dll.h"
+#include "test.h"
+#include "util.h"
+#include "timer.h"
+#include "modules/curl/curl.h"
+#include "modules/http_server/http_server.h"
+#include "modules/socket/poll.h"
+
+#define API
+
+MODULE_NAME("test_curl");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the curl module");
+MODULE_VERSION(0, 1, 0);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("curl", 0, 2, 0), MODULE_DEPENDENCY("http_server", 0, 3, 2), MODULE_DEPENDENCY("socket", 0, 14, 0));
+
+#define TEST_CURL_PORT "12347"
+#define TEST_CURL_URL "http://127.0.0.1:" TEST_CURL_PORT "/feed"
+#define TEST_CURL_REQUESTS 8
+#define TEST_CURL_TIMEOUT 5.0
+#define TEST_CURL_CONTENT "<rss><channel><title>kalisko</title></channel></rss>"
+
+static int finished;
+static int failed;
+
+static bool serveFeed(HttpRequest *request, HttpResponse *response, void *userdata)
+{
+	appendHttpResponseContent(response, TEST_CURL_CONTENT);
+	return true;
+}
+
+static void requestFinished(const char *url, GString *result, void *userdata)
+{
+	finished++;
+
+	if(result == NULL || strcmp(result->str, TEST_CURL_CONTENT) != 0 || strcmp(url, TEST_CURL_URL) != 0) {
+		failed++;
+	}
+}
+
+static void requestCancelled(const char *url, GString *result, void *userdata)
+{
+	failed++; // never supposed to be called
+}
+
+/**
+ * Runs the main loop until all expected requests finished or the timeout expired
+ *
+ * @param expected		the number of requests to wait for
+ */
+static void waitForRequests(int expected)
+{
+	double start = $$(double, getMicroTime)();
+
+	while(finished < expected && $$(double, getMicroTime)() - start < TEST_CURL_TIMEOUT) {
+		$$(void, sleepTimers)(10000);
+		$$(void, notifyTimerCallbacks)();
+		$(void, socket, pollSockets)();
+	}
+}
+
+TEST(async_requests)
+{
+	HttpServer *server = $(HttpServer *, http_server, createHttpServer)(TEST_CURL_PORT);
+	TEST_ASSERT($(bool, http_server, startHttpServer)(server));
+	$(void, http_server, registerHttpServerRequestHandler)(server, "^/feed$", &serveFeed, NULL);
+
+	finished = 0;
+	failed = 0;
+
+	for(int i = 0; i < TEST_CURL_REQUESTS; i++) {
+		TEST_ASSERT($(CurlRequest *, curl, curlRequestUrlAsync)(TEST_CURL_URL, &requestFinished, NULL) != NULL);
+	}
+
+	TEST_ASSERT(finished == 0); // nothing happens before the main loop runs
+
+	CurlRequest *cancelled = $(CurlRequest *, curl, curlRequestUrlAsync)(TEST_CURL_URL, &requestCancelled, NULL);
+	TEST_ASSERT(cancelled != NULL);
+	$(void, curl, cancelCurlRequest)(cancelled);
+
+	waitForRequests(TEST_CURL_REQUESTS);
+
+	$(void, http_server, destroyHttpServer)(server);
+
+	TEST_ASSERT(finished == TEST_CURL_REQUESTS);
+	TEST_ASSERT(failed == 0);
+}
+
+TEST_SUITE_BEGIN(curl)
+	ADD_SIMPLE_TEST(async_requests);
+TEST_SUITE_END
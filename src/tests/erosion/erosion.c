@@ -0,0 +1,400 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2011, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *	 @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *	 @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *	   in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <math.h>
+
+#include "dll.h"
+#include "test.h"
+#include "util.h"
+#include "modules/image/image.h"
+#include "modules/erosion/erosion.h"
+
+#define API
+
+/** The width and height of the test terrain */
+#define TERRAIN_SIZE 96
+/** The width and height of the benchmark terrain */
+#define BENCHMARK_TERRAIN_SIZE 512
+/** The number of erosion steps of the benchmarks */
+#define BENCHMARK_STEPS 10
+
+MODULE_NAME("test_erosion");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the erosion module");
+MODULE_VERSION(0, 1, 1);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("erosion", 0, 2, 0), MODULE_DEPENDENCY("image", 0, 5, 16));
+
+TEST(thermal_mass);
+TEST(hydraulic_mass);
+TEST(order_independent);
+TEST(benchmark);
+static Image *createTestTerrain(unsigned int size);
+static double getTerrainMass(Image *terrain);
+static double getTerrainRoughness(Image *terrain);
+static void referenceErodeThermal(Image *hMap, double talusAngle, unsigned int steps);
+static void referenceErodeHydraulic(Image *hMap, unsigned int steps);
+
+TEST_SUITE_BEGIN(erosion)
+	ADD_SIMPLE_TEST(thermal_mass);
+	ADD_SIMPLE_TEST(hydraulic_mass);
+	ADD_SIMPLE_TEST(order_independent);
+	ADD_BENCHMARK(benchmark);
+TEST_SUITE_END
+
+TEST(thermal_mass)
+{
+	Image *terrain = createTestTerrain(TERRAIN_SIZE);
+	Image *reference = $(Image *, image, copyImage)(terrain, IMAGE_TYPE_FLOAT);
+	double mass = getTerrainMass(terrain);
+	double roughness = getTerrainRoughness(terrain);
+
+	$(void, erosion, erodeThermal)(terrain, M_PI / 4.5, 50);
+	referenceErodeThermal(reference, M_PI / 4.5, 50);
+
+	double error = fabs(getTerrainMass(terrain) - mass) / mass;
+	double referenceError = fabs(getTerrainMass(reference) - mass) / mass;
+	double smoothed = getTerrainRoughness(terrain);
+
+	$(void, image, freeImage)(terrain);
+	$(void, image, freeImage)(reference);
+
+	if(error > MAX(referenceError, 1e-5)) {
+		TEST_FAIL("Thermal erosion changed the terrain mass by %g, the reference implementation by %g", error, referenceError);
+	}
+
+	TEST_ASSERT(smoothed < roughness);
+}
+
+TEST(hydraulic_mass)
+{
+	Image *terrain = createTestTerrain(TERRAIN_SIZE);
+	Image *reference = $(Image *, image, copyImage)(terrain, IMAGE_TYPE_FLOAT);
+	double mass = getTerrainMass(terrain);
+
+	$(void, erosion, erodeHydraulic)(terrain, 50);
+	referenceErodeHydraulic(reference, 50);
+
+	double error = fabs(getTerrainMass(terrain) - mass) / mass;
+	double referenceError = fabs(getTerrainMass(reference) - mass) / mass;
+
+	$(void, image, freeImage)(terrain);
+	$(void, image, freeImage)(reference);
+
+	if(error > MAX(referenceError, 1e-5)) {
+		TEST_FAIL("Hydraulic erosion changed the terrain mass by %g, the reference implementation by %g", error, referenceError);
+	}
+}
+
+TEST(order_independent)
+{
+	// eroding a transposed terrain must yield the transposed result, which doesn't hold if cells are updated in place in scan order
+	Image *terrain = createTestTerrain(TERRAIN_SIZE);
+	Image *transposed = $(Image *, image, createImageFloat)(TERRAIN_SIZE, TERRAIN_SIZE, 1);
+	for(unsigned int y = 0; y < TERRAIN_SIZE; y++) {
+		for(unsigned int x = 0; x < TERRAIN_SIZE; x++) {
+			setImage(transposed, y, x, 0, getImage(terrain, x, y, 0));
+		}
+	}
+
+	$(void, erosion, erodeThermal)(terrain, M_PI / 4.5, 20);
+	$(void, erosion, erodeHydraulic)(terrain, 20);
+	$(void, erosion, erodeThermal)(transposed, M_PI / 4.5, 20);
+	$(void, erosion, erodeHydraulic)(transposed, 20);
+
+	double maxDifference = 0.0;
+	for(unsigned int y = 0; y < TERRAIN_SIZE; y++) {
+		for(unsigned int x = 0; x < TERRAIN_SIZE; x++) {
+			maxDifference = MAX(maxDifference, fabs(getImage(terrain, x, y, 0) - getImage(transposed, y, x, 0)));
+		}
+	}
+
+	$(void, image, freeImage)(terrain);
+	$(void, image, freeImage)(transposed);
+
+	TEST_ASSERT(maxDifference < 1e-5);
+}
+
+TEST(benchmark)
+{
+	Image *terrain = createTestTerrain(BENCHMARK_TERRAIN_SIZE);
+	Image *reference = $(Image *, image, copyImage)(terrain, IMAGE_TYPE_FLOAT);
+	long cells = (long) BENCHMARK_TERRAIN_SIZE * BENCHMARK_TERRAIN_SIZE * BENCHMARK_STEPS;
+
+	double start = $$(double, getMicroTime)();
+	$(void, erosion, erodeThermal)(terrain, M_PI / 4.5, BENCHMARK_STEPS);
+	TEST_BENCHMARK("erodeThermal", cells, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+	referenceErodeThermal(reference, M_PI / 4.5, BENCHMARK_STEPS);
+	TEST_BENCHMARK("referenceErodeThermal", cells, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+	$(void, erosion, erodeHydraulic)(terrain, BENCHMARK_STEPS);
+	TEST_BENCHMARK("erodeHydraulic", cells, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+	referenceErodeHydraulic(reference, BENCHMARK_STEPS);
+	TEST_BENCHMARK("referenceErodeHydraulic", cells, $$(double, getMicroTime)() - start);
+
+	$(void, image, freeImage)(terrain);
+	$(void, image, freeImage)(reference);
+}
+
+/**
+ * Creates a test terrain consisting of a few overlapping hills with a steep ridge
+ *
+ * @param size			the width and height of the terrain to create
+ * @result				the created terrain
+ */
+static Image *createTestTerrain(unsigned int size)
+{
+	Image *terrain = $(Image *, image, createImageFloat)(size, size, 1);
+
+	for(unsigned int y = 0; y < size; y++) {
+		for(unsigned int x = 0; x < size; x++) {
+			double u = (double) x / size;
+			double v = (double) y / size;
+			double hills = 0.25 * (sin(7.0 * u) * cos(5.0 * v) + 1.0) + 0.15 * (sin(23.0 * u + 11.0 * v) + 1.0);
+			double ridge = fabs(u - v) < 0.05 ? 0.2 : 0.0;
+			setImage(terrain, x, y, 0, 0.05 + 0.9 * CLAMP(hills + ridge, 0.0, 1.0));
+		}
+	}
+
+	return terrain;
+}
+
+/**
+ * Sums up the heights of a terrain
+ *
+ * @param terrain		the terrain to sum up
+ * @result				the total terrain mass
+ */
+static double getTerrainMass(Image *terrain)
+{
+	double mass = 0.0;
+
+	for(unsigned int y = 0; y < terrain->height; y++) {
+		for(unsigned int x = 0; x < terrain->width; x++) {
+			mass += getImage(terrain, x, y, 0);
+		}
+	}
+
+	return mass;
+}
+
+/**
+ * Sums up the absolute height differences between horizontally and vertically adjacent cells of a terrain
+ *
+ * @param terrain		the terrain to measure
+ * @result				the terrain roughness
+ */
+static double getTerrainRoughness(Image *terrain)
+{
+	double roughness = 0.0;
+
+	for(unsigned int y = 0; y + 1 < terrain->height; y++) {
+		for(unsigned int x = 0; x + 1 < terrain->width; x++) {
+			roughness += fabs(getImage(terrain, x + 1, y, 0) - getImage(terrain, x, y, 0));
+			roughness += fabs(getImage(terrain, x, y + 1, 0) - getImage(terrain, x, y, 0));
+		}
+	}
+
+	return roughness;
+}
+
+/*
+ * The following is the previous in-place implementation of the erosion module, kept as a reference for the mass conservation and speed
+ * of the current one.
+ */
+
+static void referenceErodeThermalCell(Image* hMap, unsigned int x, unsigned int y, float talusAngle)
+{
+	const float c = 0.5;
+	const float cellSize = 0.01;
+	double dMax = 0.0, dTotal = 0.0;
+	double T = cellSize * tan(talusAngle);
+
+	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,hMap->height)); i++) {
+		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,hMap->width)); j++) {
+			if(j == x && i == y)
+				continue;
+
+			double di = getImage(hMap, x, y, 0) - getImage(hMap, j, i, 0);
+			if(di > T) {
+				dTotal += di;
+				if(di > dMax) {
+					dMax = di;
+				}
+			}
+		}
+	}
+
+	if(!(dTotal > 0.0)) {
+		return;
+	}
+
+	float h = getImage(hMap, x, y, 0);
+
+	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,hMap->height)); i++) {
+		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,hMap->width)); j++) {
+			if(j == x && i == y)
+				continue;
+
+			double di = h - getImage(hMap, j, i, 0);
+			if(di > T) {
+				double hNew = getImage(hMap, j, i, 0) + c * (dMax-T) * di/dTotal;
+				setImage(hMap, j, i, 0, hNew);
+			}
+		}
+	}
+
+	float hNew = h - c * (dMax-T);
+	setImage(hMap, x, y, 0, hNew);
+}
+
+/**
+ * Reference thermal erosion, updating the cells of a float heightmap in place
+ *
+ * @param hMap			the float heightmap to erode
+ * @param talusAngle	critical angle of response
+ * @param steps			number of iteration steps
+ */
+static void referenceErodeThermal(Image *hMap, double talusAngle, unsigned int steps)
+{
+	for(unsigned int k = 0; k < steps; k++) {
+		for(unsigned int y = 0; y < hMap->height; y++) {
+			for(unsigned int x = 0; x < hMap->width; x++) {
+				referenceErodeThermalCell(hMap, x, y, talusAngle);
+			}
+		}
+	}
+}
+
+static void referenceWaterFlowCell(Image* hMap, Image* waterMap, Image* sedimentMap, unsigned int x, unsigned int y)
+{
+	unsigned int width = hMap->width;
+	unsigned int height = hMap->height;
+	unsigned int cellCount = 0;
+	double dTotal = 0.0, aTotal = 0.0;
+	double w = getImage(waterMap, x, y, 0);
+	double h = getImage(hMap, x, y, 0);
+	double m = getImage(sedimentMap, x, y, 0);
+	double a = h + w;
+
+	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,height)); i++) {
+		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,width)); j++) {
+			if(j == x && i == y)
+				continue;
+
+			double ai = getImage(hMap, j, i, 0) + getImage(waterMap, j, i, 0);
+			double di = a - ai;
+			if(di > 0.0) {
+				dTotal += di;
+				aTotal += ai;
+				cellCount++;
+			}
+		}
+	}
+
+	if(cellCount < 1) {
+		return;
+	}
+
+	double deltaA = a - (aTotal / (double)cellCount);
+
+	for(unsigned int i=(MAX(y-1,0)); i<(MIN(y+2,height)); i++) {
+		for(unsigned int j=(MAX(x-1,0)); j<(MIN(x+2,width)); j++) {
+			if(j == x && i == y)
+				continue;
+
+			double wi = getImage(waterMap, j, i, 0);
+			double mi = getImage(sedimentMap, j, i, 0);
+			double di = a - (getImage(hMap, j, i, 0) + wi);
+
+			if(di > 0.0) {
+				double deltaWi = (MIN(w, deltaA)) * di / dTotal;
+				setImage(waterMap, j, i, 0, wi + deltaWi);
+
+				double deltaMi = m * deltaWi / w;
+				setImage(sedimentMap, j, i, 0, mi + deltaMi);
+				setImage(sedimentMap, x, y, 0, getImage(sedimentMap, x, y, 0) - deltaMi);
+			}
+		}
+	}
+
+	setImage(waterMap, x, y, 0, w - (MIN(w, deltaA)));
+}
+
+/**
+ * Reference hydraulic erosion, updating the cells of a float heightmap in place
+ *
+ * @param hMap			the float heightmap to erode
+ * @param steps			number of iteration steps
+ */
+static void referenceErodeHydraulic(Image *hMap, unsigned int steps)
+{
+	unsigned int width = hMap->width;
+	unsigned int height = hMap->height;
+	Image *waterMap = $(Image *, image, createImageFloat)(width, height, 1);
+	Image *sedimentMap = $(Image *, image, createImageFloat)(width, height, 1);
+	memset(waterMap->data.float_data, 0, width * height * sizeof(float));
+	memset(sedimentMap->data.float_data, 0, width * height * sizeof(float));
+
+	for(unsigned int k = 0; k < steps; k++) {
+		for(unsigned int y = 0; y < height; y++) {
+			for(unsigned int x = 0; x < width; x++) {
+				double w = getImage(waterMap, x, y, 0) + 0.01;
+				double deltaM = 0.01 * w;
+				setImage(waterMap, x, y, 0, w);
+				setImage(hMap, x, y, 0, getImage(hMap, x, y, 0) - deltaM);
+				setImage(sedimentMap, x, y, 0, getImage(sedimentMap, x, y, 0) + deltaM);
+			}
+		}
+
+		for(unsigned int y = 0; y < height; y++) {
+			for(unsigned int x = 0; x < width; x++) {
+				referenceWaterFlowCell(hMap, waterMap, sedimentMap, x, y);
+			}
+		}
+
+		for(unsigned int y = 0; y < height; y++) {
+			for(unsigned int x = 0; x < width; x++) {
+				double m = getImage(sedimentMap, x, y, 0);
+				double wNew = getImage(waterMap, x, y, 0) * 0.5;
+				double deltaM = MAX(0.0, m - 0.3 * wNew);
+
+				setImage(sedimentMap, x, y, 0, m - deltaM);
+				setImage(hMap, x, y, 0, getImage(hMap, x, y, 0) + deltaM);
+				setImage(waterMap, x, y, 0, wNew);
+			}
+		}
+	}
+
+	for(unsigned int y = 0; y < height; y++) {
+		for(unsigned int x = 0; x < width; x++) {
+			setImage(hMap, x, y, 0, getImage(hMap, x, y, 0) + getImage(sedimentMap, x, y, 0));
+		}
+	}
+
+	$(void, image, freeImage)(waterMap);
+	$(void, image, freeImage)(sedimentMap);
+}
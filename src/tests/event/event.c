@@ -0,0 +1,125 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2009, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+
+#include "dll.h"
+#include "test.h"
+#include "modules/event/event.h"
+
+#define API
+
+MODULE_NAME("test_event");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the event module");
+MODULE_VERSION(0, 1, 0);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("event", 0, 5, 0));
+
+TEST(eventIds);
+TEST(priorities);
+TEST(detachWhileTriggering);
+TEST(noListeners);
+
+static void listener_record(void *subject, const char *event, void *data, va_list args);
+static void listener_detach(void *subject, const char *event, void *data, va_list args);
+
+TEST_SUITE_BEGIN(event)
+	ADD_SIMPLE_TEST(eventIds);
+	ADD_SIMPLE_TEST(priorities);
+	ADD_SIMPLE_TEST(detachWhileTriggering);
+	ADD_SIMPLE_TEST(noListeners);
+TEST_SUITE_END
+
+static GString *record;
+static int subject;
+
+TEST(eventIds)
+{
+	EventId id = $(EventId, event, getEventId)("test_event_ids");
+	TEST_ASSERT(id != EVENT_ID_INVALID);
+	TEST_ASSERT($(EventId, event, getEventId)("test_event_ids") == id);
+	TEST_ASSERT($(EventId, event, getEventId)("test_event_ids_other") != id);
+	TEST_ASSERT(g_strcmp0($(const char *, event, getEventName)(id), "test_event_ids") == 0);
+}
+
+TEST(priorities)
+{
+	record = g_string_new("");
+
+	$(void, event, attachEventListener)(&subject, "test", "n", &listener_record);
+	$(void, event, attachEventListenerWithPriority)(&subject, "test", EVENT_LISTENER_PRIORITY_HIGHEST, "h", &listener_record);
+	$(void, event, attachEventListenerWithPriority)(&subject, "test", EVENT_LISTENER_PRIORITY_LOWEST, "l", &listener_record);
+	$(void, event, attachEventListenerWithPriority)(&subject, "test", -5, "m", &listener_record);
+
+	TEST_ASSERT($(int, event, getEventListenerCount)(&subject, "test") == 4);
+	TEST_ASSERT($(int, event, triggerEvent)(&subject, "test", 1) == 4);
+	TEST_ASSERT(g_strcmp0(record->str, "1l1m1n1h") == 0);
+
+	g_string_truncate(record, 0);
+	TEST_ASSERT($(int, event, triggerEventById)(&subject, $(EventId, event, getEventId)("test"), 2) == 4);
+	TEST_ASSERT(g_strcmp0(record->str, "2l2m2n2h") == 0);
+
+	$(void, event, detachEventListener)(&subject, "test", "n", &listener_record);
+	$(void, event, detachEventListener)(&subject, "test", "h", &listener_record);
+	$(void, event, detachEventListener)(&subject, "test", "l", &listener_record);
+	$(void, event, detachEventListener)(&subject, "test", "m", &listener_record);
+
+	TEST_ASSERT($(int, event, getEventListenerCount)(&subject, "test") == 0);
+
+	g_string_free(record, true);
+}
+
+TEST(detachWhileTriggering)
+{
+	record = g_string_new("");
+
+	$(void, event, attachEventListenerWithPriority)(&subject, "test", EVENT_LISTENER_PRIORITY_LOWEST, NULL, &listener_detach);
+	$(void, event, attachEventListener)(&subject, "test", "a", &listener_record);
+
+	// The detached listener is still notified by the running dispatch, but not by later ones
+	TEST_ASSERT($(int, event, triggerEvent)(&subject, "test", 1) == 2);
+	TEST_ASSERT(g_strcmp0(record->str, "1a") == 0);
+	TEST_ASSERT($(int, event, getEventListenerCount)(&subject, "test") == 1);
+	TEST_ASSERT($(int, event, triggerEvent)(&subject, "test", 2) == 1);
+
+	$(void, event, detachEventListener)(&subject, "test", NULL, &listener_detach);
+	TEST_ASSERT($(int, event, triggerEvent)(&subject, "test", 3) == -1);
+
+	g_string_free(record, true);
+}
+
+TEST(noListeners)
+{
+	TEST_ASSERT($(int, event, triggerEvent)(&subject, "test_event_never_attached") == -1);
+	TEST_ASSERT($(int, event, triggerEventById)(&subject, $(EventId, event, getEventId)("test_event_never_attached")) == -1);
+	TEST_ASSERT($(int, event, getEventListenerCount)(&subject, "test_event_never_attached") == 0);
+}
+
+static void listener_record(void *subject, const char *event, void *data, va_list args)
+{
+	int value = va_arg(args, int);
+	g_string_append_printf(record, "%d%s", value, (char *) data);
+}
+
+static void listener_detach(void *subject, const char *event, void *data, va_list args)
+{
+	$(void, event, detachEventListener)(subject, event, "a", &listener_record);
+}
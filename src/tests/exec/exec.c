@@ -0,0 +1,298 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "dll.h"
+#include "test.h"
+#include "util.h"
+#include "timer.h"
+#include "modules/event/event.h"
+#include "modules/exec/exec.h"
+#include "modules/socket/poll.h"
+
+#define API
+
+MODULE_NAME("test_exec");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the exec module");
+MODULE_VERSION(0, 1, 1);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("exec", 0, 4, 0), MODULE_DEPENDENCY("event", 0, 5, 0), MODULE_DEPENDENCY("socket", 0, 14, 0));
+
+#define TEST_EXEC_WAIT 5.0
+#define TEST_EXEC_QUEUED 3
+#define TEST_EXEC_BACKGROUND_WAIT 2.0
+
+static int exited;
+static ExecProcessState lastState;
+static GString *output;
+
+static void processOutput(void *subject, const char *event, void *data, va_list args)
+{
+	char *message = va_arg(args, char *);
+	int size = va_arg(args, int);
+
+	g_string_append_len(output, message, size);
+}
+
+static void processExited(void *subject, const char *event, void *data, va_list args)
+{
+	exited++;
+	lastState = va_arg(args, int);
+}
+
+/**
+ * Creates a process with our listeners attached
+ *
+ * @param args			the command arguments of the process, terminated by NULL
+ * @result				the created process
+ */
+static ExecProcess *createTestProcess(char **args)
+{
+	ExecProcess *process = $(ExecProcess *, exec, createExecProcess)(args);
+	$(void, event, attachEventListener)(process, "stdout", NULL, &processOutput);
+	$(void, event, attachEventListener)(process, "exit", NULL, &processExited);
+
+	return process;
+}
+
+/**
+ * Frees a process created by createTestProcess
+ *
+ * @param process		the process to free
+ */
+static void freeTestProcess(ExecProcess *process)
+{
+	$(void, event, detachEventListener)(process, "stdout", NULL, &processOutput);
+	$(void, event, detachEventListener)(process, "exit", NULL, &processExited);
+	$(void, exec, freeExecProcess)(process);
+}
+
+/**
+ * Runs the main loop until the expected number of processes exited or we waited for too long
+ *
+ * @param expected		the number of exited processes to wait for
+ * @param seconds		the number of seconds to wait at most
+ */
+static void waitForProcesses(int expected, double seconds)
+{
+	double start = $$(double, getMicroTime)();
+
+	while(exited < expected && $$(double, getMicroTime)() - start < seconds) {
+		$$(void, sleepTimers)(10000);
+		$$(void, notifyTimerCallbacks)();
+		$(void, socket, pollSockets)();
+	}
+}
+
+static void setup()
+{
+	exited = 0;
+	lastState = EXEC_PROCESS_CREATED;
+	output = g_string_new("");
+}
+
+static void teardown()
+{
+	g_string_free(output, true);
+}
+
+TEST(shell_command)
+{
+	char *args[] = {"echo", "kalisko", NULL};
+	GString *result = $(GString *, exec, executeShellCommandArgs)(args);
+
+	TEST_ASSERT(result != NULL);
+	TEST_ASSERT(strcmp(result->str, "kalisko\n") == 0);
+
+	g_string_free(result, true);
+}
+
+TEST(completion)
+{
+	char *args[] = {"echo", "kalisko", NULL};
+	ExecProcess *process = createTestProcess(args);
+
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 0));
+	TEST_ASSERT(process->state == EXEC_PROCESS_RUNNING);
+	TEST_ASSERT(exited == 0); // nothing is delivered before the main loop runs
+
+	waitForProcesses(1, TEST_EXEC_WAIT);
+
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_EXITED);
+	TEST_ASSERT(process->state == EXEC_PROCESS_EXITED);
+	TEST_ASSERT(WIFEXITED(process->status) && WEXITSTATUS(process->status) == 0);
+	TEST_ASSERT(strcmp(output->str, "kalisko\n") == 0);
+
+	freeTestProcess(process);
+}
+
+TEST(exit_status)
+{
+	char *args[] = {"false", NULL};
+	ExecProcess *process = createTestProcess(args);
+
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 0));
+	waitForProcesses(1, TEST_EXEC_WAIT);
+
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_EXITED);
+	TEST_ASSERT(WIFEXITED(process->status) && WEXITSTATUS(process->status) != 0);
+
+	freeTestProcess(process);
+}
+
+TEST(timeout_kill)
+{
+	char *args[] = {"sleep", "60", NULL};
+	ExecProcess *process = createTestProcess(args);
+
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 1));
+	waitForProcesses(1, TEST_EXEC_WAIT);
+
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_TIMED_OUT);
+	TEST_ASSERT(WIFSIGNALED(process->status) && WTERMSIG(process->status) == SIGKILL);
+
+	freeTestProcess(process);
+}
+
+TEST(kill_process)
+{
+	char *args[] = {"sleep", "60", NULL};
+	ExecProcess *process = createTestProcess(args);
+
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 0));
+	TEST_ASSERT($(bool, exec, killExecProcess)(process));
+	waitForProcesses(1, TEST_EXEC_WAIT);
+
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_KILLED);
+	TEST_ASSERT(!$(bool, exec, killExecProcess)(process)); // not running anymore
+
+	freeTestProcess(process);
+}
+
+TEST(queue_limit)
+{
+	unsigned int limit = $(unsigned int, exec, getExecProcessLimit)();
+	$(void, exec, setExecProcessLimit)(1);
+
+	char *blockingArgs[] = {"sleep", "60", NULL};
+	ExecProcess *blocking = createTestProcess(blockingArgs);
+	TEST_ASSERT($(bool, exec, startExecProcess)(blocking, 0));
+	TEST_ASSERT(blocking->state == EXEC_PROCESS_RUNNING);
+
+	char *args[] = {"echo", "kalisko", NULL};
+	ExecProcess *processes[TEST_EXEC_QUEUED];
+
+	for(int i = 0; i < TEST_EXEC_QUEUED; i++) {
+		processes[i] = createTestProcess(args);
+		TEST_ASSERT($(bool, exec, startExecProcess)(processes[i], 0));
+		TEST_ASSERT(processes[i]->state == EXEC_PROCESS_QUEUED);
+	}
+
+	TEST_ASSERT($(bool, exec, killExecProcess)(processes[TEST_EXEC_QUEUED - 1])); // queued processes are finished right away
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_KILLED);
+
+	waitForProcesses(2, 0.5);
+	TEST_ASSERT(exited == 1); // the other queued processes must wait for the blocking one
+
+	TEST_ASSERT($(bool, exec, killExecProcess)(blocking));
+	waitForProcesses(TEST_EXEC_QUEUED + 1, TEST_EXEC_WAIT);
+
+	TEST_ASSERT(exited == TEST_EXEC_QUEUED + 1);
+	TEST_ASSERT(blocking->state == EXEC_PROCESS_KILLED);
+
+	for(int i = 0; i < TEST_EXEC_QUEUED - 1; i++) {
+		TEST_ASSERT(processes[i]->state == EXEC_PROCESS_EXITED);
+	}
+
+	TEST_ASSERT(strcmp(output->str, "kalisko\nkalisko\n") == 0);
+
+	$(void, exec, setExecProcessLimit)(limit);
+
+	freeTestProcess(blocking);
+	for(int i = 0; i < TEST_EXEC_QUEUED; i++) {
+		freeTestProcess(processes[i]);
+	}
+}
+
+TEST(background_output)
+{
+	char *args[] = {"sh", "-c", "sleep 10 & echo kalisko", NULL}; // the background process keeps the output open after the shell exited
+	ExecProcess *process = createTestProcess(args);
+
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 0));
+	waitForProcesses(1, TEST_EXEC_BACKGROUND_WAIT);
+
+	TEST_ASSERT(exited == 1);
+	TEST_ASSERT(lastState == EXEC_PROCESS_EXITED);
+	TEST_ASSERT(WIFEXITED(process->status) && WEXITSTATUS(process->status) == 0);
+	TEST_ASSERT(strcmp(output->str, "kalisko\n") == 0);
+
+	freeTestProcess(process);
+}
+
+TEST(kill_background)
+{
+	unsigned int limit = $(unsigned int, exec, getExecProcessLimit)();
+	$(void, exec, setExecProcessLimit)(1);
+
+	char *blockingArgs[] = {"sh", "-c", "sleep 10 & sleep 60", NULL};
+	ExecProcess *blocking = createTestProcess(blockingArgs);
+	TEST_ASSERT($(bool, exec, startExecProcess)(blocking, 0));
+
+	char *args[] = {"echo", "kalisko", NULL};
+	ExecProcess *process = createTestProcess(args);
+	TEST_ASSERT($(bool, exec, startExecProcess)(process, 0));
+	TEST_ASSERT(process->state == EXEC_PROCESS_QUEUED);
+
+	TEST_ASSERT($(bool, exec, killExecProcess)(blocking));
+	waitForProcesses(2, TEST_EXEC_BACKGROUND_WAIT);
+
+	TEST_ASSERT(exited == 2); // the killed process must release its slot although its background process keeps the output open
+	TEST_ASSERT(blocking->state == EXEC_PROCESS_KILLED);
+	TEST_ASSERT(process->state == EXEC_PROCESS_EXITED);
+	TEST_ASSERT(strcmp(output->str, "kalisko\n") == 0);
+
+	$(void, exec, setExecProcessLimit)(limit);
+
+	freeTestProcess(blocking);
+	freeTestProcess(process);
+}
+
+TEST_SUITE_BEGIN(exec)
+	ADD_TEST_FIXTURE(ExecTest, &setup, &teardown);
+	ADD_FIXTURED_TEST(shell_command, ExecTest);
+	ADD_FIXTURED_TEST(completion, ExecTest);
+	ADD_FIXTURED_TEST(exit_status, ExecTest);
+	ADD_FIXTURED_TEST(timeout_kill, ExecTest);
+	ADD_FIXTURED_TEST(kill_process, ExecTest);
+	ADD_FIXTURED_TEST(queue_limit, ExecTest);
+	ADD_FIXTURED_TEST(background_output, ExecTest);
+	ADD_FIXTURED_TEST(kill_background, ExecTest);
+TEST_SUITE_END
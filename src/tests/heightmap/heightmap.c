@@ -0,0 +1,226 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *	 @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *	 @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *	   in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <math.h>
+
+#include "dll.h"
+#include "test.h"
+#include "log.h"
+#include "util.h"
+#include "modules/image/image.h"
+#include "modules/linalg/Vector.h"
+#include "modules/heightmap/normals.h"
+
+#define API
+
+/** The width and height of the test heightmap */
+#define HEIGHTMAP_SIZE 64
+/** The width and height of the benchmark heightmap */
+#define BENCHMARK_HEIGHTMAP_SIZE 1024
+
+MODULE_NAME("test_heightmap");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the heightmap module");
+MODULE_VERSION(0, 1, 3);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("heightmap", 0, 4, 5), MODULE_DEPENDENCY("linalg", 0, 8, 0), MODULE_DEPENDENCY("image", 0, 5, 16));
+
+TEST(normals);
+TEST(normals_benchmark);
+static Image *createTestHeightmap(unsigned int size);
+static void referenceComputeHeightmapNormals(Image *heights, Image *normals, float widthScale, float heightScale);
+static Vector *getReferenceVector(Image *heights, int x, int y, float widthScale, float heightScale, Vector *current);
+static void addReferenceContribution(Vector *normal, Vector *a, Vector *b, double weight);
+
+TEST_SUITE_BEGIN(heightmap)
+	ADD_SIMPLE_TEST(normals);
+	ADD_BENCHMARK(normals_benchmark);
+TEST_SUITE_END
+
+TEST(normals)
+{
+	Image *heights = createTestHeightmap(HEIGHTMAP_SIZE);
+	Image *normals = $(Image *, image, createImageFloat)(HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 3);
+	Image *reference = $(Image *, image, createImageFloat)(HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, 3);
+
+	$(void, heightmap, computeHeightmapNormals)(heights, normals, 0.5f, 0.25f);
+	referenceComputeHeightmapNormals(heights, reference, 0.5f, 0.25f);
+
+	double maxError = 0.0;
+	for(unsigned int y = 0; y < HEIGHTMAP_SIZE; y++) {
+		for(unsigned int x = 0; x < HEIGHTMAP_SIZE; x++) {
+			for(unsigned int c = 0; c < 3; c++) {
+				maxError = MAX(maxError, fabs(getImage(normals, x, y, c) - getImage(reference, x, y, c)));
+			}
+		}
+	}
+
+	$(void, image, freeImage)(heights);
+	$(void, image, freeImage)(normals);
+	$(void, image, freeImage)(reference);
+
+	if(maxError > 1e-5) {
+		TEST_FAIL("Heightmap normals differ from the reference implementation by up to %g", maxError);
+	}
+}
+
+TEST(normals_benchmark)
+{
+	Image *heights = createTestHeightmap(BENCHMARK_HEIGHTMAP_SIZE);
+	Image *normals = $(Image *, image, createImageFloat)(BENCHMARK_HEIGHTMAP_SIZE, BENCHMARK_HEIGHTMAP_SIZE, 3);
+	long pixels = (long) BENCHMARK_HEIGHTMAP_SIZE * BENCHMARK_HEIGHTMAP_SIZE;
+
+	unsigned long allocationsBefore = $(unsigned long, linalg, getLinalgAllocations)();
+	double start = $$(double, getMicroTime)();
+	$(void, heightmap, computeHeightmapNormals)(heights, normals, 1.0f, 1.0f);
+	TEST_BENCHMARK("computeHeightmapNormals", pixels, $$(double, getMicroTime)() - start);
+	unsigned long allocations = $(unsigned long, linalg, getLinalgAllocations)() - allocationsBefore;
+
+	allocationsBefore = $(unsigned long, linalg, getLinalgAllocations)();
+	start = $$(double, getMicroTime)();
+	referenceComputeHeightmapNormals(heights, normals, 1.0f, 1.0f);
+	TEST_BENCHMARK("referenceComputeHeightmapNormals", pixels, $$(double, getMicroTime)() - start);
+	unsigned long referenceAllocations = $(unsigned long, linalg, getLinalgAllocations)() - allocationsBefore;
+
+	logNotice("Heightmap normals linalg heap allocations: computeHeightmapNormals %lu (%.1f per pixel), referenceComputeHeightmapNormals %lu (%.1f per pixel)", allocations, (double) allocations / pixels, referenceAllocations, (double) referenceAllocations / pixels);
+
+	$(void, image, freeImage)(heights);
+	$(void, image, freeImage)(normals);
+}
+
+/**
+ * Creates a test heightmap consisting of a few overlapping waves with a flat plateau
+ *
+ * @param size			the width and height of the heightmap to create
+ * @result				the created heightmap
+ */
+static Image *createTestHeightmap(unsigned int size)
+{
+	Image *heights = $(Image *, image, createImageFloat)(size, size, 1);
+
+	for(unsigned int y = 0; y < size; y++) {
+		for(unsigned int x = 0; x < size; x++) {
+			double u = (double) x / size;
+			double v = (double) y / size;
+			double waves = 0.3 * sin(9.0 * u) * cos(6.0 * v) + 0.1 * sin(31.0 * u + 17.0 * v);
+			setImage(heights, x, y, 0, MIN(0.5 + waves, 0.7));
+		}
+	}
+
+	return heights;
+}
+
+/**
+ * Computes heightmap normals the way computeHeightmapNormals did before it switched to fixed size vectors, i.e. on heap allocated dynamic
+ * vectors
+ *
+ * @param heights			the heightfield for which to compute the normal vectors
+ * @param normals			the normal map in which to write the computed normals
+ * @param widthScale		factor by which all x coordinates of the heightmap grid should be scaled when computing normals
+ * @param heightScale		factor by which all y coordinates of the heightmap grid should be scaled when computing normals
+ */
+static void referenceComputeHeightmapNormals(Image *heights, Image *normals, float widthScale, float heightScale)
+{
+	int height = heights->height;
+	int width = heights->width;
+
+	for(int y = 0; y < height; y++) {
+		int ym1 = y - 1 < 0 ? 0 : y - 1;
+		int yp1 = y + 1 >= height ? height - 1 : y + 1;
+
+		for(int x = 0; x < width; x++) {
+			int xm1 = x - 1 < 0 ? 0 : x - 1;
+			int xp1 = x + 1 >= width ? width - 1 : x + 1;
+
+			Vector *normal = $(Vector *, linalg, createVector3)(0.0, 0.0, 0.0);
+			Vector *current = getReferenceVector(heights, x, y, widthScale, heightScale, NULL);
+			Vector *exp1yp0 = getReferenceVector(heights, xp1, y, widthScale, heightScale, current);
+			Vector *exp1ym1 = getReferenceVector(heights, xp1, ym1, widthScale, heightScale, current);
+			Vector *exp0yp1 = getReferenceVector(heights, x, yp1, widthScale, heightScale, current);
+			Vector *exp0ym1 = getReferenceVector(heights, x, ym1, widthScale, heightScale, current);
+			Vector *exm1yp1 = getReferenceVector(heights, xm1, yp1, widthScale, heightScale, current);
+			Vector *exm1yp0 = getReferenceVector(heights, xm1, y, widthScale, heightScale, current);
+
+			addReferenceContribution(normal, exp1yp0, exp1ym1, 1.0);
+			addReferenceContribution(normal, exp1ym1, exp0ym1, 1.0);
+			addReferenceContribution(normal, exp0ym1, exm1yp0, 2.0);
+			addReferenceContribution(normal, exm1yp0, exm1yp1, 1.0);
+			addReferenceContribution(normal, exm1yp1, exp0yp1, 1.0);
+			addReferenceContribution(normal, exp0yp1, exp1yp0, 2.0);
+			$(void, linalg, normalizeVector)(normal);
+
+			setImage(normals, x, y, 0, 0.5 * ($(float, linalg, getVector)(normal, 0) + 1));
+			setImage(normals, x, y, 1, 0.5 * ($(float, linalg, getVector)(normal, 1) + 1));
+			setImage(normals, x, y, 2, 0.5 * ($(float, linalg, getVector)(normal, 2) + 1));
+
+			$(void, linalg, freeVector)(normal);
+			$(void, linalg, freeVector)(current);
+			$(void, linalg, freeVector)(exp1yp0);
+			$(void, linalg, freeVector)(exp1ym1);
+			$(void, linalg, freeVector)(exp0yp1);
+			$(void, linalg, freeVector)(exp0ym1);
+			$(void, linalg, freeVector)(exm1yp1);
+			$(void, linalg, freeVector)(exm1yp0);
+		}
+	}
+}
+
+/**
+ * Creates the dynamic reference vector of a heightmap grid point
+ *
+ * @param heights			the heightfield to read from
+ * @param x					the x coordinate of the grid point
+ * @param y					the y coordinate of the grid point
+ * @param widthScale		factor by which all x coordinates of the heightmap grid should be scaled
+ * @param heightScale		factor by which all y coordinates of the heightmap grid should be scaled
+ * @param current			if not NULL, the returned vector is relative to this one
+ * @result					the created vector
+ */
+static Vector *getReferenceVector(Image *heights, int x, int y, float widthScale, float heightScale, Vector *current)
+{
+	Vector *vector = $(Vector *, linalg, createVector3)((float) x * widthScale, getImage(heights, x, y, 0), (float) y * heightScale);
+
+	if(current != NULL) {
+		Vector *relative = $(Vector *, linalg, diffVectors)(vector, current);
+		$(void, linalg, freeVector)(vector);
+		return relative;
+	}
+
+	return vector;
+}
+
+/**
+ * Adds the weighted normal of a triangle spanned by two edge vectors to a dynamic reference normal
+ *
+ * @param normal			the normal to add to
+ * @param a					the first edge vector of the triangle
+ * @param b					the second edge vector of the triangle
+ * @param weight			the weight of the triangle's normal
+ */
+static void addReferenceContribution(Vector *normal, Vector *a, Vector *b, double weight)
+{
+	Vector *cross = $(Vector *, linalg, crossVectors)(a, b);
+
+	$(void, linalg, normalizeVector)(cross);
+	$(void, linalg, multiplyVectorScalar)(cross, weight);
+	$(void, linalg, addVector)(normal, cross);
+	$(void, linalg, freeVector)(cross);
+}
@@ -19,17 +19,45 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <glib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
 #include "dll.h"
+#include "log.h"
 #include "test.h"
+#include "util.h"
+#include "timer.h"
 #include "modules/http_server/http_server.h"
+#include "modules/http_server/http_parser.h"
+#include "modules/socket/poll.h"
 #define API
 
+#define SHARD_BENCHMARK_MAX_SHARDS 4
+#define SHARD_BENCHMARK_CONNECTIONS 64
+#define SHARD_BENCHMARK_SECONDS 2.0
+#define SHARD_BENCHMARK_WORK 200000
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 MODULE_NAME("test_http_server");
 MODULE_AUTHOR("Dino Wernli");
 MODULE_DESCRIPTION("Test suite for the http_server module");
-MODULE_VERSION(0, 0, 2);
+MODULE_VERSION(0, 0, 6);
 MODULE_BCVERSION(0, 0, 1);
-MODULE_DEPENDS(MODULE_DEPENDENCY("http_server", 0, 1, 3));
+MODULE_DEPENDS(MODULE_DEPENDENCY("http_server", 0, 3, 2), MODULE_DEPENDENCY("socket", 0, 12, 0));
 
 static HttpServer *server;
 static HttpRequest *request;
@@ -41,6 +69,222 @@ static bool incrementCounter()
 	return true;
 }
 
+static bool incrementUserdata(HttpRequest *request, HttpResponse *response, void *userdata)
+{
+	++*((int *) userdata);
+	return true;
+}
+
+static bool declineRequest(HttpRequest *request, HttpResponse *response, void *userdata)
+{
+	++*((int *) userdata);
+	return false;
+}
+
+/**
+ * Request handler simulating a request that is expensive to compute
+ */
+static bool computeWork(HttpRequest *request, HttpResponse *response, void *userdata)
+{
+	unsigned int hash = 2166136261u; // FNV-1a offset basis
+
+	for(unsigned int i = 0; i < SHARD_BENCHMARK_WORK; i++) {
+		hash = (hash ^ (i & 0xff)) * 16777619u;
+	}
+
+	appendHttpResponseContent(response, "%08x", hash);
+	return true;
+}
+
+/**
+ * Reserves a free port for the benchmark server shards by binding a socket to it that shares the port with them but never listens, so it
+ * doesn't take any of the connections balanced between the shards
+ *
+ * @param port		a buffer of at least 6 characters to write the reserved port to
+ * @result			the file descriptor of the reserving socket or -1 on failure
+ */
+static int reserveBenchmarkPort(char *port)
+{
+	int fd;
+	if((fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+		return -1;
+	}
+
+	int param = 1;
+	struct sockaddr_in address;
+	socklen_t addressSize = sizeof(struct sockaddr_in);
+	memset(&address, 0, sizeof(struct sockaddr_in));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = 0; // let the kernel pick a free port
+
+	if(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &param, sizeof(int)) != 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &param, sizeof(int)) != 0 || bind(fd, (struct sockaddr *) &address, addressSize) != 0 || getsockname(fd, (struct sockaddr *) &address, &addressSize) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	snprintf(port, 6, "%u", ntohs(address.sin_port));
+	return fd;
+}
+
+/**
+ * Runs a benchmark HTTP server shard in a forked process until it is killed
+ *
+ * @param port		the port to listen on
+ */
+static void runBenchmarkShard(char *port)
+{
+	$(void, socket, resetPoll)(); // don't share our parent's epoll instance
+
+	HttpServer *shardServer = createHttpServer(port);
+	shardServer->server_socket->reuse_port = true;
+
+	if(!startHttpServer(shardServer)) {
+		_exit(EXIT_FAILURE);
+	}
+
+	registerHttpServerRequestHandler(shardServer, "^/work$", &computeWork, NULL);
+
+	while(true) {
+		$$(void, sleepTimers)(1000);
+		$(void, socket, pollSockets)();
+	}
+}
+
+/**
+ * Connects a blocking client socket to the benchmark server, retrying until the server shards are up
+ *
+ * @param port		the port the benchmark server listens on
+ * @result			the file descriptor of the connected socket or -1 on failure
+ */
+static int connectBenchmarkClient(char *port)
+{
+	struct addrinfo hints;
+	struct addrinfo *address;
+
+	memset(&hints, 0, sizeof(struct addrinfo));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+
+	if(getaddrinfo("127.0.0.1", port, &hints, &address) != 0) {
+		return -1;
+	}
+
+	int fd = -1;
+
+	for(int attempt = 0; attempt < 200 && fd < 0; attempt++) {
+		if((fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol)) < 0) {
+			break;
+		}
+
+		if(connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+			close(fd);
+			fd = -1;
+			g_usleep(10000);
+		}
+	}
+
+	freeaddrinfo(address);
+	return fd;
+}
+
+/**
+ * Returns the length of the first complete response in a buffer of received data
+ *
+ * @param buffer	the buffer to look for a complete response in
+ * @result			the length of the first response or 0 if it wasn't received completely yet
+ */
+static unsigned int getBenchmarkResponseLength(GString *buffer)
+{
+	char *end = g_strstr_len(buffer->str, buffer->len, "\r\n\r\n");
+	if(end == NULL) {
+		return 0;
+	}
+
+	unsigned int headLength = end - buffer->str + 4;
+	unsigned int contentLength = 0;
+	char *field = g_strstr_len(buffer->str, headLength, "Content-Length: ");
+	if(field != NULL) {
+		contentLength = atoi(field + strlen("Content-Length: "));
+	}
+
+	if(buffer->len < headLength + contentLength) {
+		return 0;
+	}
+
+	return headLength + contentLength;
+}
+
+/**
+ * Keeps a number of keep-alive connections to the benchmark server busy with requests for a while
+ *
+ * @param port		the port the benchmark server listens on
+ * @param seconds	the number of seconds to generate load for
+ * @result			the number of responses received or -1 on failure
+ */
+static long generateBenchmarkLoad(char *port, double seconds)
+{
+	static const char *request = "GET /work HTTP/1.1\r\nHost: localhost\r\n\r\n";
+	struct pollfd fds[SHARD_BENCHMARK_CONNECTIONS];
+	GString *buffers[SHARD_BENCHMARK_CONNECTIONS];
+	char chunk[4096];
+	long responses = 0;
+
+	for(int i = 0; i < SHARD_BENCHMARK_CONNECTIONS; i++) {
+		fds[i].fd = connectBenchmarkClient(port);
+		fds[i].events = POLLIN;
+		buffers[i] = g_string_new("");
+
+		if(fds[i].fd < 0 || send(fds[i].fd, request, strlen(request), MSG_NOSIGNAL) < 0) {
+			responses = -1;
+		}
+	}
+
+	double start = $$(double, getMicroTime)();
+
+	while(responses >= 0 && $$(double, getMicroTime)() - start < seconds) {
+		if(poll(fds, SHARD_BENCHMARK_CONNECTIONS, 100) < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+
+			responses = -1;
+			break;
+		}
+
+		for(int i = 0; i < SHARD_BENCHMARK_CONNECTIONS; i++) {
+			if(!(fds[i].revents & (POLLIN | POLLERR | POLLHUP))) {
+				continue;
+			}
+
+			int ret;
+			if((ret = recv(fds[i].fd, chunk, sizeof(chunk), 0)) <= 0) {
+				responses = -1;
+				break;
+			}
+
+			g_string_append_len(buffers[i], chunk, ret);
+
+			unsigned int length;
+			while((length = getBenchmarkResponseLength(buffers[i])) > 0) {
+				g_string_erase(buffers[i], 0, length);
+				responses++;
+				send(fds[i].fd, request, strlen(request), MSG_NOSIGNAL); // immediately issue the next request on this connection
+			}
+		}
+	}
+
+	for(int i = 0; i < SHARD_BENCHMARK_CONNECTIONS; i++) {
+		if(fds[i].fd >= 0) {
+			close(fds[i].fd);
+		}
+
+		g_string_free(buffers[i], true);
+	}
+
+	return responses;
+}
+
 static void setup()
 {
 	server = createHttpServer("12345");
@@ -120,6 +364,172 @@ TEST(suffix_match)
 	destroyHttpResponse(response);
 }
 
+TEST(precedence)
+{
+	int first = 0;
+	int second = 0;
+	registerHttpServerRequestHandler(server, "/pre.*", &incrementUserdata, &first);
+	registerHttpServerRequestHandler(server, "/prefix", &incrementUserdata, &second);
+
+	request->hierarchical = strdup("/prefix");
+	HttpResponse *response = handleHttpRequest(server, request);
+	TEST_ASSERT(first == 1);
+	TEST_ASSERT(second == 0);
+	TEST_ASSERT(counter == 0);
+	destroyHttpResponse(response);
+}
+
+TEST(decline)
+{
+	int declined = 0;
+	registerHttpServerRequestHandler(server, "/path.*", &declineRequest, &declined);
+
+	request->hierarchical = strdup("/path");
+	HttpResponse *response = handleHttpRequest(server, request);
+	TEST_ASSERT(counter == 1); // the literal handler registered first is executed first
+	TEST_ASSERT(declined == 0);
+	destroyHttpResponse(response);
+
+	free(request->hierarchical);
+	request->hierarchical = strdup("/pathological");
+	response = handleHttpRequest(server, request);
+	TEST_ASSERT(counter == 1);
+	TEST_ASSERT(declined == 1);
+	TEST_ASSERT(strcmp(response->status, "404 Not Found") == 0);
+	destroyHttpResponse(response);
+}
+
+TEST(unregister)
+{
+	int gone = 0;
+	registerHttpServerRequestHandler(server, "/gone", &incrementUserdata, &gone);
+	unregisterHttpServerRequestHandler(server, "/gone", &incrementUserdata, &gone);
+
+	request->hierarchical = strdup("/gone");
+	HttpResponse *response = handleHttpRequest(server, request);
+	TEST_ASSERT(gone == 0);
+	destroyHttpResponse(response);
+}
+
+TEST(parse_request)
+{
+	HttpRequest *parsed = createHttpRequest();
+	char lines[][64] = {"", "GET  /some%20path?foo=bar HTTP/1.1", "content-length:  12", "Host: localhost", ""};
+
+	for(int i = 0; i < sizeof(lines) / sizeof(lines[0]); i++) {
+		parseHttpRequestLine(parsed, lines[i]);
+	}
+
+	TEST_ASSERT(parsed->method == HTTP_REQUEST_METHOD_GET);
+	TEST_ASSERT(strcmp(parsed->uri, "/some%20path?foo=bar") == 0);
+	TEST_ASSERT(strcmp(parsed->hierarchical, "/some path") == 0);
+	TEST_ASSERT(g_strcmp0(g_hash_table_lookup(parsed->parameters, "foo"), "bar") == 0);
+	TEST_ASSERT(parsed->content_length == 12);
+	TEST_ASSERT(parsed->got_empty_line);
+
+	destroyHttpRequest(parsed);
+}
+
+TEST(parse_malformed)
+{
+	HttpRequest *parsed = createHttpRequest();
+	char method[] = "FETCH /path HTTP/1.1";
+	parseHttpRequestLine(parsed, method);
+	TEST_ASSERT(parsed->method == HTTP_REQUEST_METHOD_UNKNOWN);
+	TEST_ASSERT(parsed->hierarchical == NULL);
+	destroyHttpRequest(parsed);
+
+	parsed = createHttpRequest();
+	char version[] = "GET /path";
+	parseHttpRequestLine(parsed, version);
+	TEST_ASSERT(parsed->method == HTTP_REQUEST_METHOD_UNKNOWN);
+	TEST_ASSERT(parsed->hierarchical == NULL);
+	destroyHttpRequest(parsed);
+}
+
+TEST(parse_keep_alive)
+{
+	HttpRequest *parsed = createHttpRequest();
+	char version11[] = "GET / HTTP/1.1";
+	parseHttpRequestLine(parsed, version11);
+	TEST_ASSERT(parsed->version == HTTP_VERSION_1_1);
+	TEST_ASSERT(parsed->keep_alive);
+	char close[] = "Connection: close";
+	parseHttpRequestLine(parsed, close);
+	TEST_ASSERT(!parsed->keep_alive);
+	destroyHttpRequest(parsed);
+
+	parsed = createHttpRequest();
+	char version10[] = "GET / HTTP/1.0";
+	parseHttpRequestLine(parsed, version10);
+	TEST_ASSERT(parsed->version == HTTP_VERSION_1_0);
+	TEST_ASSERT(!parsed->keep_alive);
+	char keepAlive[] = "connection: Keep-Alive";
+	parseHttpRequestLine(parsed, keepAlive);
+	TEST_ASSERT(parsed->keep_alive);
+	destroyHttpRequest(parsed);
+}
+
+TEST(response_headers)
+{
+	HttpResponse *response = createHttpResponse("200 OK", "content");
+	TEST_ASSERT(strcmp(getHttpResponseHeader(response, "content-type"), "text/html; charset=utf-8") == 0);
+
+	TEST_ASSERT(setHttpResponseHeader(response, "Content-Type", "text/plain"));
+	TEST_ASSERT(setHttpResponseHeader(response, "Cache-Control", "no-cache"));
+	TEST_ASSERT(strcmp(getHttpResponseHeader(response, "Content-Type"), "text/plain") == 0);
+	TEST_ASSERT(strcmp(getHttpResponseHeader(response, "cache-control"), "no-cache") == 0);
+	TEST_ASSERT(getHttpResponseHeader(response, "Expires") == NULL);
+	TEST_ASSERT(g_queue_get_length(response->headers) == 2);
+
+	// Responses without a client socket can't be streamed and keep their content until they are complete
+	TEST_ASSERT(flushHttpResponseContent(response));
+	TEST_ASSERT(!response->streaming);
+	TEST_ASSERT(strcmp(response->content->str, "content") == 0);
+
+	destroyHttpResponse(response);
+}
+
+TEST(shard_benchmark)
+{
+	for(unsigned int shards = 1; shards <= SHARD_BENCHMARK_MAX_SHARDS; shards *= 2) {
+		pid_t pids[SHARD_BENCHMARK_MAX_SHARDS];
+		unsigned int forked = 0;
+		char port[6];
+
+		int reserved;
+		TEST_ASSERT((reserved = reserveBenchmarkPort(port)) >= 0);
+
+		fflush(NULL); // don't let the shards write out our buffered output
+
+		for(; forked < shards; forked++) {
+			if((pids[forked] = fork()) < 0) {
+				break;
+			} else if(pids[forked] == 0) {
+				close(reserved);
+				runBenchmarkShard(port);
+			}
+		}
+
+		long responses = forked == shards ? generateBenchmarkLoad(port, SHARD_BENCHMARK_SECONDS) : -1;
+
+		for(unsigned int i = 0; i < forked; i++) {
+			kill(pids[i], SIGTERM);
+			waitpid(pids[i], NULL, 0);
+		}
+
+		close(reserved);
+
+		if(responses >= 0) {
+			char name[64];
+			snprintf(name, sizeof(name), "HTTP requests with %u shards", shards);
+			TEST_BENCHMARK(name, responses, SHARD_BENCHMARK_SECONDS);
+		} else {
+			logWarning("Failed to generate load on %u HTTP server shards", shards);
+		}
+	}
+}
+
 TEST_SUITE_BEGIN(http_server)
 	ADD_TEST_FIXTURE(HttpServerTest, &setup, &teardown);
 	ADD_FIXTURED_TEST(lifecycle, HttpServerTest);
@@ -129,4 +539,12 @@ TEST_SUITE_BEGIN(http_server)
 	ADD_FIXTURED_TEST(partial_match, HttpServerTest);
 	ADD_FIXTURED_TEST(prefix_match, HttpServerTest);
 	ADD_FIXTURED_TEST(suffix_match, HttpServerTest);
+	ADD_FIXTURED_TEST(precedence, HttpServerTest);
+	ADD_FIXTURED_TEST(decline, HttpServerTest);
+	ADD_FIXTURED_TEST(unregister, HttpServerTest);
+	ADD_SIMPLE_TEST(parse_request);
+	ADD_SIMPLE_TEST(parse_malformed);
+	ADD_SIMPLE_TEST(parse_keep_alive);
+	ADD_SIMPLE_TEST(response_headers);
+	ADD_BENCHMARK(shard_benchmark);
 TEST_SUITE_END
@@ -23,16 +23,19 @@
 #include "dll.h"
 #include "test.h"
 #include "string.h"
+#include "util.h"
 #include "modules/irc_parser/irc_parser.h"
 
 #define API
 
+#define BENCHMARK_ROUNDS 20000
+
 MODULE_NAME("test_irc_parser");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Test suite for the irc_parser module");
-MODULE_VERSION(0, 1, 0);
+MODULE_VERSION(0, 2, 0);
 MODULE_BCVERSION(0, 1, 0);
-MODULE_DEPENDS(MODULE_DEPENDENCY("irc_parser", 0, 1, 0));
+MODULE_DEPENDS(MODULE_DEPENDENCY("irc_parser", 0, 2, 0));
 
 TEST(utf8Trailing);
 TEST(whitespaces);
@@ -42,6 +45,10 @@ TEST(noticeAuth);
 TEST(serverNotice);
 TEST(onlyCommand);
 TEST(passDelimiter);
+TEST(tags);
+TEST(view);
+TEST(viewMalformed);
+TEST(benchmark);
 
 TEST_SUITE_BEGIN(irc_parser)
 	ADD_SIMPLE_TEST(utf8Trailing);
@@ -52,8 +59,36 @@ TEST_SUITE_BEGIN(irc_parser)
 	ADD_SIMPLE_TEST(serverNotice);
 	ADD_SIMPLE_TEST(onlyCommand);
 	ADD_SIMPLE_TEST(passDelimiter);
+	ADD_SIMPLE_TEST(tags);
+	ADD_SIMPLE_TEST(view);
+	ADD_SIMPLE_TEST(viewMalformed);
+	ADD_BENCHMARK(benchmark);
 TEST_SUITE_END
 
+/**
+ * An excerpt of a captured IRC session as seen by the proxy, used to benchmark the parser with a realistic mix of messages
+ */
+static const char *benchmarkLog[] = {
+	":EU.GameSurge.net NOTICE AUTH :*** Looking up your hostname\r\n",
+	":EU.GameSurge.net NOTICE AUTH :*** Found your hostname\r\n",
+	":EU.GameSurge.net 001 Gregor :Welcome to the GameSurge IRC Network via EU.GameSurge.net, Gregor\r\n",
+	":EU.GameSurge.net 005 Gregor WHOX WALLCHOPS WALLVOICES USERIP CPRIVMSG CNOTICE SILENCE=25 MODES=6 MAXCHANNELS=75 MAXBANS=100 NICKLEN=30 :are supported by this server\r\n",
+	":EU.GameSurge.net 372 Gregor :- Please read the rules at http://www.gamesurge.net/aup/\r\n",
+	"PING :EU.GameSurge.net\r\n",
+	":Gregor!kalisko@kalisko.org JOIN #kalisko\r\n",
+	":EU.GameSurge.net 353 Gregor = #kalisko :Gregor @ChanServ +Someone Other Another\r\n",
+	":EU.GameSurge.net 366 Gregor #kalisko :End of /NAMES list.\r\n",
+	":Someone!someone@Someone.user.gamesurge PRIVMSG #kalisko :Hello World\r\n",
+	":Other!other@other.example.org PRIVMSG #kalisko :did anyone look at the new poll loop yet?\r\n",
+	"@time=2012-06-01T12:00:00.000Z;account=someone :Someone!someone@Someone.user.gamesurge PRIVMSG #kalisko :yes, looks good\r\n",
+	":Another!another@another.example.org NOTICE Gregor :\001VERSION Kalisko\001\r\n",
+	":ChanServ!ChanServ@Services.GameSurge.net MODE #kalisko +v Other\r\n",
+	":Other!other@other.example.org PART #kalisko :Leaving\r\n",
+	":Someone!someone@Someone.user.gamesurge QUIT :Quit: bye\r\n",
+	":Staff.CA.US.GameSurge.net NOTICE * :*** Notice -- Received KILL message for grog. From Someone Path: Someone.operator.support!Someone (.)\r\n",
+	"AWAY\r\n"
+};
+
 TEST(utf8Trailing)
 {
 	char *message = "Someone :Зарегистрируйтесь Unicode แผ่นดินฮั่นเสื่อมโทรมแสนสังเวช 1234567890 ╔══╦══╗  ┌──┬──┐  ╭──┬──╮  ╭──┬──╮\r\n";
@@ -198,3 +233,96 @@ TEST(passDelimiter)
 
 	$(void, irc_parser, freeIrcMessage)(parsedMessage);
 }
+
+TEST(tags)
+{
+	IrcMessage *parsedMessage = $(IrcMessage *, irc_parser, parseIrcMessage)("@time=2012-06-01T12:00:00.000Z;account=someone :Someone!someone@Someone.user.gamesurge PRIVMSG #kalisko :tagged\r\n");
+	TEST_ASSERT(parsedMessage != NULL);
+
+	TEST_ASSERT(strcmp(parsedMessage->prefix, "Someone!someone@Someone.user.gamesurge") == 0);
+	TEST_ASSERT(strcmp(parsedMessage->command, "PRIVMSG") == 0);
+	TEST_ASSERT(parsedMessage->params_count == 1);
+	TEST_ASSERT(strcmp(parsedMessage->params[0], "#kalisko") == 0);
+	TEST_ASSERT(strcmp(parsedMessage->trailing, "tagged") == 0);
+
+	$(void, irc_parser, freeIrcMessage)(parsedMessage);
+}
+
+TEST(view)
+{
+	char *message = "@aaa=bbb;ccc;+example.com/ddd=eee; :nick!user@host   PRIVMSG  #kalisko   target :\r\n";
+	IrcMessageView view;
+
+	TEST_ASSERT($(bool, irc_parser, parseIrcMessageView)(message, strlen(message), &view));
+
+	TEST_ASSERT(view.tags_count == 3);
+	TEST_ASSERT(isIrcMessageViewString(&view, view.tags[0].key, "aaa"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.tags[0].value, "bbb"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.tags[1].key, "ccc"));
+	TEST_ASSERT(view.tags[1].value.length == 0);
+	TEST_ASSERT(isIrcMessageViewString(&view, view.tags[2].key, "+example.com/ddd"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.tags[2].value, "eee"));
+
+	TEST_ASSERT(isIrcMessageViewString(&view, view.prefix, "nick!user@host"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.command, "PRIVMSG"));
+	TEST_ASSERT(view.params_count == 2);
+	TEST_ASSERT(isIrcMessageViewString(&view, view.params[0], "#kalisko"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.params[1], "target"));
+	TEST_ASSERT(!isIrcMessageViewString(&view, view.params[1], "targ"));
+	TEST_ASSERT(view.has_trailing);
+	TEST_ASSERT(view.trailing.length == 0);
+
+	// Views don't need a NUL-terminated message
+	TEST_ASSERT($(bool, irc_parser, parseIrcMessageView)("PING :server.example.org garbage", 24, &view));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.command, "PING"));
+	TEST_ASSERT(isIrcMessageViewString(&view, view.trailing, "server.example.org"));
+}
+
+TEST(viewMalformed)
+{
+	IrcMessageView view;
+
+	TEST_ASSERT(!$(bool, irc_parser, parseIrcMessageView)("", 0, &view));
+	TEST_ASSERT(!$(bool, irc_parser, parseIrcMessageView)("\r\n", 2, &view));
+	TEST_ASSERT(!$(bool, irc_parser, parseIrcMessageView)(":prefix.only", 12, &view));
+	TEST_ASSERT(!$(bool, irc_parser, parseIrcMessageView)("@tags=only", 10, &view));
+	TEST_ASSERT($(IrcMessage *, irc_parser, parseIrcMessage)(":prefix.only") == NULL);
+}
+
+TEST(benchmark)
+{
+	int lines = sizeof(benchmarkLog) / sizeof(benchmarkLog[0]);
+	unsigned int lengths[lines];
+	unsigned long params = 0;
+	IrcMessageView view;
+
+	for(int i = 0; i < lines; i++) {
+		lengths[i] = strlen(benchmarkLog[i]);
+	}
+
+	double start = $$(double, getMicroTime)();
+
+	for(int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for(int i = 0; i < lines; i++) {
+			TEST_ASSERT($(bool, irc_parser, parseIrcMessageView)(benchmarkLog[i], lengths[i], &view));
+			params += view.params_count;
+		}
+	}
+
+	TEST_BENCHMARK("parseIrcMessageView", (long) BENCHMARK_ROUNDS * lines, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+
+	for(int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for(int i = 0; i < lines; i++) {
+			IrcMessage *message = $(IrcMessage *, irc_parser, parseIrcMessage)((char *) benchmarkLog[i]);
+			TEST_ASSERT(message != NULL);
+			params -= message->params_count;
+			$(void, irc_parser, freeIrcMessage)(message);
+		}
+	}
+
+	TEST_BENCHMARK("parseIrcMessage", (long) BENCHMARK_ROUNDS * lines, $$(double, getMicroTime)() - start);
+
+	TEST_ASSERT(params == 0); // both parsers must agree on the tokenization
+}
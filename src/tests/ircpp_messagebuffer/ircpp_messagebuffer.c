@@ -0,0 +1,221 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2012, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "dll.h"
+#include "test.h"
+#include "types.h"
+#include "modules/ircpp_messagebuffer/ring.h"
+
+#define API
+
+TEST(ring_capacity);
+TEST(ring_growth);
+TEST(ring_wraparound);
+TEST(ring_budget_drops);
+
+MODULE_NAME("test_ircpp_messagebuffer");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the message rings of the ircpp_messagebuffer module");
+MODULE_VERSION(0, 1, 0);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("ircpp_messagebuffer", 0, 4, 0));
+
+TEST_SUITE_BEGIN(ircpp_messagebuffer)
+	ADD_SIMPLE_TEST(ring_capacity);
+	ADD_SIMPLE_TEST(ring_growth);
+	ADD_SIMPLE_TEST(ring_wraparound);
+	ADD_SIMPLE_TEST(ring_budget_drops);
+TEST_SUITE_END
+
+#define TEST_RING_MAX_TRAILING 128
+
+/**
+ * Formats the test message with a given sequence number, whose trailing part varies in length so the messages end up at uneven arena offsets
+ *
+ * @param i				the sequence number of the message
+ * @param prefix		the buffer of at least 64 bytes to write the prefix to
+ * @param trailing		the buffer of at least TEST_RING_MAX_TRAILING bytes to write the trailing part to
+ */
+static void formatTestMessage(unsigned int i, char *prefix, char *trailing)
+{
+	snprintf(prefix, 64, "nick%u!kalisko@kalisko.org", i % 7);
+
+	unsigned int length = snprintf(trailing, TEST_RING_MAX_TRAILING, "message %u:", i);
+	unsigned int end = length + (i * 37) % 80;
+	for(; length < end; length++) {
+		trailing[length] = 'a' + (i + length) % 26;
+	}
+	trailing[length] = '\0';
+}
+
+/**
+ * Buffers the test message with a given sequence number
+ *
+ * @param budget		the memory budget of the ring
+ * @param ring			the ring to buffer the message in
+ * @param i				the sequence number of the message
+ * @result				true if the message was buffered
+ */
+static bool pushTestMessage(MessageRingBudget *budget, MessageRing *ring, unsigned int i)
+{
+	char prefix[64];
+	char trailing[TEST_RING_MAX_TRAILING];
+	formatTestMessage(i, prefix, trailing);
+
+	return $(bool, ircpp_messagebuffer, pushMessageRing)(budget, ring, prefix, trailing);
+}
+
+/**
+ * Checks that a ring holds the newest test messages in order, that each of them is intact and lies within the arena, and that the arena usage
+ * adds up
+ *
+ * @param ring			the ring to check
+ * @param next			the sequence number of the next test message, i.e. one past the newest one expected in the ring
+ * @result				true if the ring is consistent
+ */
+static bool checkTestMessages(MessageRing *ring, unsigned int next)
+{
+	unsigned int used = 0;
+
+	for(unsigned int j = 0; j < ring->count; j++) {
+		char prefix[64];
+		char trailing[TEST_RING_MAX_TRAILING];
+		formatTestMessage(next - ring->count + j, prefix, trailing);
+
+		MessageRecord *record = $(MessageRecord *, ircpp_messagebuffer, getMessageRingRecord)(ring, j);
+		char *stored = ring->arena + record->offset;
+
+		if(record->prefixLength != strlen(prefix) || record->trailingLength != strlen(trailing)) {
+			return false;
+		}
+
+		if(record->offset + record->prefixLength + record->trailingLength > ring->arenaSize) { // records must never cross the arena end
+			return false;
+		}
+
+		if(memcmp(stored, prefix, record->prefixLength) != 0 || memcmp(stored + record->prefixLength, trailing, record->trailingLength) != 0) {
+			return false;
+		}
+
+		used += record->prefixLength + record->trailingLength;
+	}
+
+	return used == ring->arenaUsed;
+}
+
+TEST(ring_capacity)
+{
+	MessageRingBudget budget = {1024 * 1024, 0};
+	MessageRing *ring = $(MessageRing *, ircpp_messagebuffer, createMessageRing)("#kalisko", 4);
+
+	for(unsigned int i = 0; i < 10; i++) {
+		TEST_ASSERT(pushTestMessage(&budget, ring, i));
+		TEST_ASSERT(ring->count == MIN(i + 1, 4));
+		TEST_ASSERT(checkTestMessages(ring, i + 1));
+	}
+
+	TEST_ASSERT(ring->dropped == 0);
+	TEST_ASSERT(budget.used == ring->arenaSize);
+
+	$(void, ircpp_messagebuffer, clearMessageRing)(&budget, ring);
+	TEST_ASSERT(ring->count == 0);
+	TEST_ASSERT(budget.used == 0);
+
+	$(void, ircpp_messagebuffer, freeMessageRing)(ring);
+}
+
+TEST(ring_growth)
+{
+	MessageRingBudget budget = {1024 * 1024, 0};
+	MessageRing *ring = $(MessageRing *, ircpp_messagebuffer, createMessageRing)("#kalisko", 32);
+
+	for(unsigned int i = 0; i < 100; i++) {
+		TEST_ASSERT(pushTestMessage(&budget, ring, i));
+		TEST_ASSERT(checkTestMessages(ring, i + 1));
+	}
+
+	TEST_ASSERT(ring->count == 32); // the arena grew instead of evicting messages before the ring was full
+	TEST_ASSERT(ring->arenaSize > MESSAGEBUF_ARENA_INITIAL_SIZE);
+	TEST_ASSERT(budget.used == ring->arenaSize);
+
+	$(void, ircpp_messagebuffer, clearMessageRing)(&budget, ring);
+	$(void, ircpp_messagebuffer, freeMessageRing)(ring);
+}
+
+TEST(ring_wraparound)
+{
+	MessageRingBudget budget = {MESSAGEBUF_ARENA_INITIAL_SIZE, 0}; // the arena can't grow, so it has to wrap around
+	MessageRing *ring = $(MessageRing *, ircpp_messagebuffer, createMessageRing)("#kalisko", 64);
+	unsigned int wraps = 0;
+
+	for(unsigned int i = 0; i < 500; i++) {
+		unsigned int head = ring->arenaHead;
+
+		TEST_ASSERT(pushTestMessage(&budget, ring, i));
+		TEST_ASSERT(checkTestMessages(ring, i + 1)); // the oldest messages were evicted in order and the rest came back intact
+
+		if(ring->arenaHead < head) {
+			wraps++;
+		}
+	}
+
+	TEST_ASSERT(wraps > 0);
+	TEST_ASSERT(ring->count < ring->capacity); // messages were evicted for lack of arena space rather than ring capacity
+	TEST_ASSERT(ring->arenaSize == MESSAGEBUF_ARENA_INITIAL_SIZE);
+	TEST_ASSERT(budget.used == MESSAGEBUF_ARENA_INITIAL_SIZE);
+	TEST_ASSERT(ring->dropped == 0);
+
+	$(void, ircpp_messagebuffer, clearMessageRing)(&budget, ring);
+	$(void, ircpp_messagebuffer, freeMessageRing)(ring);
+}
+
+TEST(ring_budget_drops)
+{
+	MessageRingBudget budget = {MESSAGEBUF_ARENA_INITIAL_SIZE, 0};
+	MessageRing *full = $(MessageRing *, ircpp_messagebuffer, createMessageRing)("#kalisko", 64);
+	MessageRing *starved = $(MessageRing *, ircpp_messagebuffer, createMessageRing)("#starved", 64);
+
+	TEST_ASSERT(pushTestMessage(&budget, full, 0));
+	TEST_ASSERT(budget.used == budget.max); // the first ring took the whole budget
+
+	for(unsigned int i = 0; i < 5; i++) {
+		TEST_ASSERT(!pushTestMessage(&budget, starved, i));
+		TEST_ASSERT(starved->dropped == i + 1);
+	}
+
+	TEST_ASSERT(starved->count == 0);
+	TEST_ASSERT(starved->arenaSize == 0);
+
+	$(void, ircpp_messagebuffer, clearMessageRing)(&budget, full); // releasing memory lets the starved ring buffer again
+	TEST_ASSERT(budget.used == 0);
+
+	TEST_ASSERT(pushTestMessage(&budget, starved, 5));
+	TEST_ASSERT(starved->dropped == 0);
+	TEST_ASSERT(starved->count == 1);
+	TEST_ASSERT(checkTestMessages(starved, 6));
+
+	$(void, ircpp_messagebuffer, clearMessageRing)(&budget, starved);
+	$(void, ircpp_messagebuffer, freeMessageRing)(full);
+	$(void, ircpp_messagebuffer, freeMessageRing)(starved);
+}
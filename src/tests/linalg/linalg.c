@@ -20,29 +20,54 @@
 
 #include <glib.h>
 #include <string.h>
+#include <math.h>
 
 #include "dll.h"
 #include "test.h"
+#include "util.h"
 #include "memory_alloc.h"
 #include "modules/linalg/Vector.h"
 #include "modules/linalg/Matrix.h"
+#include "modules/linalg/transform.h"
+#include "modules/linalg/simd.h"
 #define API
 
+/** The number of iterations of the benchmarks */
+#define BENCHMARK_ITERATIONS 200000
+/** The number of points transformed by the batch transform benchmark */
+#define BENCHMARK_POINTS 4096
+/** The number of floats per point record in the batch transform tests, i.e. a position followed by a normal */
+#define POINT_STRIDE 6
+
 TEST(matrix_matrix_multiplication);
 TEST(matrix_vector_multiplication);
 TEST(vector_vector_multiplication);
+TEST(matrix_sum);
+TEST(large_vector);
+TEST(vector_benchmark);
+TEST(matrix_benchmark);
+TEST(transform_benchmark);
+TEST(transform_points);
+TEST(transform_points_benchmark);
 
 MODULE_NAME("test_linalg");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Test suite for the linalg module");
-MODULE_VERSION(0, 1, 4);
+MODULE_VERSION(0, 4, 0);
 MODULE_BCVERSION(0, 1, 4);
-MODULE_DEPENDS(MODULE_DEPENDENCY("linalg", 0, 2, 6));
+MODULE_DEPENDS(MODULE_DEPENDENCY("linalg", 0, 7, 0));
 
 TEST_SUITE_BEGIN(linalg)
 	ADD_SIMPLE_TEST(matrix_matrix_multiplication);
 	ADD_SIMPLE_TEST(matrix_vector_multiplication);
 	ADD_SIMPLE_TEST(vector_vector_multiplication);
+	ADD_SIMPLE_TEST(matrix_sum);
+	ADD_SIMPLE_TEST(large_vector);
+	ADD_BENCHMARK(vector_benchmark);
+	ADD_BENCHMARK(matrix_benchmark);
+	ADD_BENCHMARK(transform_benchmark);
+	ADD_SIMPLE_TEST(transform_points);
+	ADD_BENCHMARK(transform_points_benchmark);
 TEST_SUITE_END
 
 static Matrix *getTestMatrix();
@@ -124,6 +149,215 @@ TEST(vector_vector_multiplication)
 	$(void, linalg, freeVector)(crossVectorSolution);
 }
 
+TEST(matrix_sum)
+{
+	Matrix *testMatrix = $(Matrix *, linalg, createMatrix)(2, 3);
+	for(unsigned int i = 0; i < 2; i++) {
+		for(unsigned int j = 0; j < 3; j++) {
+			$(void, linalg, setMatrix)(testMatrix, i, j, i * 3 + j);
+		}
+	}
+
+	Matrix *sum = $(Matrix *, linalg, sumMatrices)(testMatrix, testMatrix);
+	Matrix *difference = $(Matrix *, linalg, diffMatrices)(sum, testMatrix);
+	TEST_ASSERT($(unsigned int, linalg, getMatrixRows)(sum) == 2);
+	TEST_ASSERT($(unsigned int, linalg, getMatrixCols)(sum) == 3);
+	TEST_ASSERT($(float, linalg, getMatrix)(sum, 1, 2) == 10.0f);
+	TEST_ASSERT($(bool, linalg, matrixEquals)(difference, testMatrix));
+
+	$(void, linalg, freeMatrix)(testMatrix);
+	$(void, linalg, freeMatrix)(sum);
+	$(void, linalg, freeMatrix)(difference);
+}
+
+TEST(large_vector)
+{
+	// vectors with more than four elements don't fit into the inline storage
+	Vector *testVector = $(Vector *, linalg, createVector)(8);
+	for(unsigned int i = 0; i < 8; i++) {
+		$(void, linalg, setVector)(testVector, i, i);
+	}
+
+	Vector *copy = $(Vector *, linalg, copyVector)(testVector);
+	Vector *sum = $(Vector *, linalg, sumVectors)(testVector, copy);
+	TEST_ASSERT($(unsigned int, linalg, getVectorSize)(sum) == 8);
+	TEST_ASSERT($(float, linalg, getVector)(sum, 7) == 14.0f);
+	TEST_ASSERT($(float, linalg, dotVectors)(testVector, copy) == 140.0f);
+
+	$(void, linalg, freeVector)(testVector);
+	$(void, linalg, freeVector)(copy);
+	$(void, linalg, freeVector)(sum);
+}
+
+TEST(vector_benchmark)
+{
+	Vector *a = $(Vector *, linalg, createVector3)(1.0, 2.0, 3.0);
+	Vector *b = $(Vector *, linalg, createVector3)(-0.5, 0.25, 2.0);
+	volatile float check = 0.0f; // keeps the results from being optimized away
+
+	double start = $$(double, getMicroTime)();
+	for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		Vector *sum = $(Vector *, linalg, sumVectors)(a, b);
+		Vector *cross = $(Vector *, linalg, crossVectors)(sum, b);
+		$(void, linalg, normalizeVector)(cross);
+		check += $(float, linalg, dotVectors)(cross, a);
+		$(void, linalg, freeVector)(sum);
+		$(void, linalg, freeVector)(cross);
+	}
+	TEST_BENCHMARK("sumVectors/crossVectors/normalizeVector", BENCHMARK_ITERATIONS, $$(double, getMicroTime)() - start);
+
+	$(void, linalg, freeVector)(a);
+	$(void, linalg, freeVector)(b);
+}
+
+TEST(matrix_benchmark)
+{
+	Matrix *rotation = $(Matrix *, linalg, createRotationMatrixY)(0.1);
+	Matrix *perspective = $(Matrix *, linalg, createPerspectiveMatrix)(G_PI / 3.0, 4.0 / 3.0, 0.1, 100.0);
+	Vector *point = $(Vector *, linalg, createVector4)(1.0, 2.0, 3.0, 1.0);
+	volatile float check = 0.0f; // keeps the results from being optimized away
+
+	double start = $$(double, getMicroTime)();
+	for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		Matrix *product = $(Matrix *, linalg, multiplyMatrices)(perspective, rotation);
+		check += $(float, linalg, getMatrix)(product, 0, 0);
+		$(void, linalg, freeMatrix)(product);
+	}
+	TEST_BENCHMARK("multiplyMatrices", BENCHMARK_ITERATIONS, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+	for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		Vector *transformed = $(Vector *, linalg, multiplyMatrixVector)(perspective, point);
+		check += $(float, linalg, getVector)(transformed, 3);
+		$(void, linalg, freeVector)(transformed);
+	}
+	TEST_BENCHMARK("multiplyMatrixVector", BENCHMARK_ITERATIONS, $$(double, getMicroTime)() - start);
+
+	$(void, linalg, freeMatrix)(rotation);
+	$(void, linalg, freeMatrix)(perspective);
+	$(void, linalg, freeVector)(point);
+}
+
+TEST(transform_benchmark)
+{
+	Matrix *lookAt = $(Matrix *, linalg, createMatrix)(4, 4);
+	Vector *eye = $(Vector *, linalg, createVector3)(1.0, 2.0, 3.0);
+	Vector *direction = $(Vector *, linalg, createVector3)(0.0, 0.0, 1.0);
+	Vector *up = $(Vector *, linalg, createVector3)(0.0, 1.0, 0.0);
+
+	double start = $$(double, getMicroTime)();
+	for(unsigned int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		$(void, linalg, updateLookIntoDirectionMatrix)(lookAt, eye, direction, up);
+	}
+	TEST_BENCHMARK("updateLookIntoDirectionMatrix", BENCHMARK_ITERATIONS, $$(double, getMicroTime)() - start);
+
+	TEST_ASSERT($(float, linalg, getMatrix)(lookAt, 3, 3) == 1.0f);
+
+	$(void, linalg, freeMatrix)(lookAt);
+	$(void, linalg, freeVector)(eye);
+	$(void, linalg, freeVector)(direction);
+	$(void, linalg, freeVector)(up);
+}
+
+TEST(transform_points)
+{
+	Matrix *rotation = $(Matrix *, linalg, createRotationMatrixY)(0.3);
+	$(void, linalg, setMatrix)(rotation, 0, 3, 1.5);
+	$(void, linalg, setMatrix)(rotation, 2, 3, -2.0);
+
+	unsigned int n = 7; // odd to also cover the remainder of kernels transforming several points at once
+	float *points = ALLOCATE_OBJECTS(float, n * POINT_STRIDE);
+	for(unsigned int i = 0; i < n * POINT_STRIDE; i++) {
+		points[i] = 0.5f * i - 3.0f;
+	}
+
+	// run every kernel available in this build and on this CPU, and only check the results once the default kernel is restored
+	TransformPointsKernelType kernels[] = {LINALG_TRANSFORM_POINTS_SCALAR, LINALG_TRANSFORM_POINTS_SSE, LINALG_TRANSFORM_POINTS_AVX};
+	unsigned int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+	bool available[sizeof(kernels) / sizeof(kernels[0])];
+	float *transformed = ALLOCATE_OBJECTS(float, kernelCount * n * POINT_STRIDE);
+
+	for(unsigned int j = 0; j < kernelCount; j++) {
+		float *kernelTransformed = transformed + j * n * POINT_STRIDE;
+		memcpy(kernelTransformed, points, n * POINT_STRIDE * sizeof(float));
+
+		available[j] = $(bool, linalg, setTransformPointsKernel)(kernels[j]);
+		if(available[j]) {
+			$(void, linalg, transformPoints)(rotation, kernelTransformed, kernelTransformed, n, POINT_STRIDE);
+		}
+	}
+
+	TEST_ASSERT($(bool, linalg, setTransformPointsKernel)(LINALG_TRANSFORM_POINTS_AUTO));
+	TEST_ASSERT(available[0]); // the scalar kernel is always available
+
+	for(unsigned int j = 0; j < kernelCount; j++) {
+		if(!available[j]) {
+			continue;
+		}
+
+		float *kernelTransformed = transformed + j * n * POINT_STRIDE;
+
+		for(unsigned int i = 0; i < n; i++) {
+			float *point = points + i * POINT_STRIDE;
+			Vector *vector = $(Vector *, linalg, createVector3)(point[0], point[1], point[2]);
+			Vector *solution = $(Vector *, linalg, multiplyMatrixVector)(rotation, vector);
+
+			for(unsigned int k = 0; k < 3; k++) {
+				TEST_ASSERT(fabs(kernelTransformed[i * POINT_STRIDE + k] - $(float, linalg, getVector)(solution, k)) < 1e-5);
+			}
+
+			for(unsigned int k = 3; k < POINT_STRIDE; k++) { // the rest of the record must be left alone
+				TEST_ASSERT(kernelTransformed[i * POINT_STRIDE + k] == point[k]);
+			}
+
+			$(void, linalg, freeVector)(vector);
+			$(void, linalg, freeVector)(solution);
+		}
+	}
+
+	free(points);
+	free(transformed);
+	$(void, linalg, freeMatrix)(rotation);
+}
+
+TEST(transform_points_benchmark)
+{
+	Matrix *rotation = $(Matrix *, linalg, createRotationMatrixY)(0.3);
+	float *points = ALLOCATE_OBJECTS(float, BENCHMARK_POINTS * POINT_STRIDE);
+	float *transformed = ALLOCATE_OBJECTS(float, BENCHMARK_POINTS * POINT_STRIDE);
+	for(unsigned int i = 0; i < BENCHMARK_POINTS * POINT_STRIDE; i++) {
+		points[i] = 0.001f * i;
+	}
+
+	unsigned int rounds = BENCHMARK_ITERATIONS / BENCHMARK_POINTS * 10;
+	long count = (long) rounds * BENCHMARK_POINTS;
+
+	double start = $$(double, getMicroTime)();
+	for(unsigned int r = 0; r < rounds; r++) {
+		$(void, linalg, transformPoints)(rotation, points, transformed, BENCHMARK_POINTS, POINT_STRIDE);
+	}
+	TEST_BENCHMARK("transformPoints", count, $$(double, getMicroTime)() - start);
+
+	Vector *vector = $(Vector *, linalg, createVector)(3);
+	float *vectorData = $(float *, linalg, getVectorData)(vector);
+
+	start = $$(double, getMicroTime)();
+	for(unsigned int r = 0; r < rounds; r++) {
+		for(unsigned int i = 0; i < BENCHMARK_POINTS; i++) {
+			memcpy(vectorData, points + i * POINT_STRIDE, 3 * sizeof(float));
+			Vector *result = $(Vector *, linalg, multiplyMatrixVector)(rotation, vector);
+			memcpy(transformed + i * POINT_STRIDE, $(float *, linalg, getVectorData)(result), 3 * sizeof(float));
+			$(void, linalg, freeVector)(result);
+		}
+	}
+	TEST_BENCHMARK("multiplyMatrixVector per point", count, $$(double, getMicroTime)() - start);
+
+	$(void, linalg, freeVector)(vector);
+	$(void, linalg, freeMatrix)(rotation);
+	free(points);
+	free(transformed);
+}
+
 static Matrix *getTestMatrix()
 {
 	Matrix *testMatrix = $(Matrix *, linalg, createMatrix)(3, 3);
@@ -0,0 +1,365 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2009, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+#include <math.h>
+
+#include "dll.h"
+#include "test.h"
+#include "util.h"
+#include "modules/linalg/Vector.h"
+#include "modules/image/image.h"
+#include "modules/random/random.h"
+#include "modules/random/worley.h"
+#include "modules/random/perlin.h"
+
+#define API
+
+/** The number of samples used to check the distribution of generated numbers */
+#define DISTRIBUTION_SAMPLES 100000
+/** The number of feature points of the Worley noise benchmark */
+#define WORLEY_BENCHMARK_POINTS 2048
+/** The width and height of the Worley noise benchmark image */
+#define WORLEY_BENCHMARK_SIZE 512
+/** The width and height of the perlin noise benchmark image */
+#define PERLIN_BENCHMARK_SIZE 4096
+/** The number of octaves of the perlin noise benchmark */
+#define PERLIN_BENCHMARK_DEPTH 8
+
+MODULE_NAME("test_random");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the random module");
+MODULE_VERSION(0, 1, 5);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("random", 0, 9, 0), MODULE_DEPENDENCY("linalg", 0, 5, 0), MODULE_DEPENDENCY("image", 0, 5, 16));
+
+TEST(generator_reproducible);
+TEST(generator_jump);
+TEST(uniform_range);
+TEST(gaussian_distribution);
+TEST(permutation);
+TEST(counter_order_independent);
+TEST(worley_matches_exhaustive);
+TEST(worley_benchmark);
+TEST(perlin_rows);
+TEST(perlin_benchmark);
+
+TEST_SUITE_BEGIN(random)
+	ADD_SIMPLE_TEST(generator_reproducible);
+	ADD_SIMPLE_TEST(generator_jump);
+	ADD_SIMPLE_TEST(uniform_range);
+	ADD_SIMPLE_TEST(gaussian_distribution);
+	ADD_SIMPLE_TEST(permutation);
+	ADD_SIMPLE_TEST(counter_order_independent);
+	ADD_SIMPLE_TEST(worley_matches_exhaustive);
+	ADD_BENCHMARK(worley_benchmark);
+	ADD_SIMPLE_TEST(perlin_rows);
+	ADD_BENCHMARK(perlin_benchmark);
+TEST_SUITE_END
+
+TEST(generator_reproducible)
+{
+	RandomGenerator *a = $(RandomGenerator *, random, createRandomGenerator)(42);
+	RandomGenerator *b = $(RandomGenerator *, random, createRandomGenerator)(42);
+	RandomGenerator *c = $(RandomGenerator *, random, createRandomGenerator)(43);
+
+	bool equal = true;
+	bool different = false;
+	for(int i = 0; i < 1000; i++) {
+		uint64_t x = randomNext(a);
+		equal = equal && x == randomNext(b);
+		different = different || x != randomNext(c);
+	}
+
+	// reseeding restarts the sequence
+	$(void, random, seedRandomGenerator)(a, 42);
+	$(void, random, seedRandomGenerator)(b, 42);
+	equal = equal && $(float, random, randomGaussian)(a, 0.0, 1.0) == $(float, random, randomGaussian)(b, 0.0, 1.0);
+
+	$(void, random, freeRandomGenerator)(a);
+	$(void, random, freeRandomGenerator)(b);
+	$(void, random, freeRandomGenerator)(c);
+
+	TEST_ASSERT(equal);
+	TEST_ASSERT(different);
+}
+
+TEST(generator_jump)
+{
+	RandomGenerator *a = $(RandomGenerator *, random, createRandomGenerator)(7);
+	RandomGenerator *b = $(RandomGenerator *, random, createRandomGenerator)(7);
+	$(void, random, jumpRandomGenerator)(b);
+
+	bool overlap = false;
+	for(int i = 0; i < 1000; i++) {
+		overlap = overlap || randomNext(a) == randomNext(b);
+	}
+
+	$(void, random, freeRandomGenerator)(a);
+	$(void, random, freeRandomGenerator)(b);
+
+	TEST_ASSERT(!overlap);
+}
+
+TEST(uniform_range)
+{
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(1);
+	float *values = g_new(float, DISTRIBUTION_SAMPLES);
+	$(void, random, randomFillUniform)(generator, values, DISTRIBUTION_SAMPLES);
+
+	bool inRange = true;
+	double sum = 0.0;
+	for(int i = 0; i < DISTRIBUTION_SAMPLES; i++) {
+		inRange = inRange && values[i] >= 0.0f && values[i] < 1.0f;
+		sum += values[i];
+	}
+
+	bool integersInRange = true;
+	bool sawMin = false;
+	bool sawMax = false;
+	for(int i = 0; i < 1000; i++) {
+		int x = randomGeneratorUniformInteger(generator, -3, 3);
+		integersInRange = integersInRange && x >= -3 && x <= 3;
+		sawMin = sawMin || x == -3;
+		sawMax = sawMax || x == 3;
+	}
+
+	g_free(values);
+	$(void, random, freeRandomGenerator)(generator);
+
+	TEST_ASSERT(inRange);
+	TEST_ASSERT(fabs(sum / DISTRIBUTION_SAMPLES - 0.5) < 0.01);
+	TEST_ASSERT(integersInRange && sawMin && sawMax);
+}
+
+TEST(gaussian_distribution)
+{
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(2);
+	float *values = g_new(float, DISTRIBUTION_SAMPLES);
+
+	// check both the generator and the counter-based bulk fill
+	for(int pass = 0; pass < 2; pass++) {
+		if(pass == 0) {
+			$(void, random, randomFillGaussian)(generator, values, DISTRIBUTION_SAMPLES, 3.0, 2.0);
+		} else {
+			$(void, random, randomFillGaussianCounter)(2, 0, values, DISTRIBUTION_SAMPLES, 3.0, 2.0);
+		}
+
+		double sum = 0.0;
+		double sum2 = 0.0;
+		for(int i = 0; i < DISTRIBUTION_SAMPLES; i++) {
+			sum += values[i];
+			sum2 += values[i] * values[i];
+		}
+
+		double mean = sum / DISTRIBUTION_SAMPLES;
+		double std = sqrt(sum2 / DISTRIBUTION_SAMPLES - mean * mean);
+
+		if(fabs(mean - 3.0) >= 0.05 || fabs(std - 2.0) >= 0.05) {
+			g_free(values);
+			$(void, random, freeRandomGenerator)(generator);
+			TEST_FAIL("Gaussian samples of pass %d have mean %f and standard deviation %f instead of 3 and 2", pass, mean, std);
+		}
+	}
+
+	g_free(values);
+	$(void, random, freeRandomGenerator)(generator);
+}
+
+TEST(permutation)
+{
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(3);
+	unsigned int *permutation = $(unsigned int *, random, randomPermutation)(generator, 256);
+
+	bool seen[256] = {false};
+	bool valid = true;
+	for(unsigned int i = 0; i < 256; i++) {
+		valid = valid && permutation[i] < 256 && !seen[permutation[i]];
+		if(permutation[i] < 256) {
+			seen[permutation[i]] = true;
+		}
+	}
+
+	free(permutation);
+	$(void, random, freeRandomGenerator)(generator);
+
+	TEST_ASSERT(valid);
+}
+
+TEST(counter_order_independent)
+{
+	float whole[1000];
+	float part[101];
+	float gaussianWhole[1000];
+	float gaussianPart[101];
+
+	$(void, random, randomFillUniformCounter)(1234, 0, whole, 1000);
+	$(void, random, randomFillUniformCounter)(1234, 333, part, 101); // unaligned start and length
+	$(void, random, randomFillGaussianCounter)(1234, 0, gaussianWhole, 1000, 0.0, 1.0);
+	$(void, random, randomFillGaussianCounter)(1234, 333, gaussianPart, 101, 0.0, 1.0);
+
+	for(int i = 0; i < 101; i++) {
+		TEST_ASSERT(part[i] == whole[333 + i]);
+		TEST_ASSERT(gaussianPart[i] == gaussianWhole[333 + i]);
+	}
+
+	for(int i = 0; i < 1000; i += 97) {
+		TEST_ASSERT(randomCounterUniform(1234, i) == whole[i]);
+	}
+}
+
+TEST(worley_matches_exhaustive)
+{
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(4);
+
+	// the grid is used for up to three dimensions, four dimensions check the fallback
+	for(unsigned int dimensions = 1; dimensions <= 4; dimensions++) {
+		RandomWorleyContext *context = $(RandomWorleyContext *, random, createWorleyContext)(generator, 300, dimensions);
+		Vector *query = $(Vector *, linalg, createVector)(dimensions);
+		float *queryData = $(float *, linalg, getVectorData)(query);
+
+		for(int i = 0; i < 200; i++) {
+			// include queries outside the unit cube
+			for(unsigned int d = 0; d < dimensions; d++) {
+				queryData[d] = 1.5f * randomGeneratorUniform(generator) - 0.25f;
+			}
+
+			for(unsigned int neighbour = 1; neighbour <= 3; neighbour++) {
+				for(int method = RANDOM_WORLEY_DISTANCE_EUCLIDEAN; method <= RANDOM_WORLEY_DISTANCE_EUCLIDEAN_SQUARED; method++) {
+					float expected = $(float, random, randomWorleyExhaustive)(context, query, neighbour, method);
+					float actual = $(float, random, randomWorley)(context, query, neighbour, method);
+
+					if(fabs(expected - actual) > 1e-6) {
+						$(void, linalg, freeVector)(query);
+						$(void, random, freeWorleyContext)(context);
+						$(void, random, freeRandomGenerator)(generator);
+						TEST_FAIL("Worley noise F%u in %u dimensions is %f instead of %f", neighbour, dimensions, actual, expected);
+					}
+				}
+			}
+
+			float f1 = $(float, random, randomWorleyExhaustive)(context, query, 1, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+			float f2 = $(float, random, randomWorleyExhaustive)(context, query, 2, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+			float f3 = $(float, random, randomWorleyExhaustive)(context, query, 3, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+			TEST_ASSERT(fabs($(float, random, randomWorleyDifference21)(context, query, RANDOM_WORLEY_DISTANCE_EUCLIDEAN) - (f2 - f1)) < 1e-5);
+			TEST_ASSERT(fabs($(float, random, randomWorleyDifference32)(context, query, RANDOM_WORLEY_DISTANCE_EUCLIDEAN) - (f3 - f2)) < 1e-5);
+		}
+
+		$(void, linalg, freeVector)(query);
+		$(void, random, freeWorleyContext)(context);
+	}
+
+	$(void, random, freeRandomGenerator)(generator);
+}
+
+TEST(worley_benchmark)
+{
+	RandomGenerator *generator = $(RandomGenerator *, random, createRandomGenerator)(5);
+	RandomWorleyContext *context = $(RandomWorleyContext *, random, createWorleyContext)(generator, WORLEY_BENCHMARK_POINTS, 2);
+	Image *image = $(Image *, image, createImageFloat)(WORLEY_BENCHMARK_SIZE, WORLEY_BENCHMARK_SIZE, 1);
+	int weights[2] = {-1, 1};
+
+	double start = $$(double, getMicroTime)();
+	bool success = $(bool, random, randomWorleyImage)(context, image, 0, weights, 2, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+	TEST_BENCHMARK("randomWorleyImage", WORLEY_BENCHMARK_SIZE * WORLEY_BENCHMARK_SIZE, $$(double, getMicroTime)() - start);
+
+	// the exhaustive search is far too slow for the whole image, so only sample its first rows
+	Vector *query = $(Vector *, linalg, createVector)(2);
+	float *queryData = $(float *, linalg, getVectorData)(query);
+	bool matches = true;
+	unsigned int rows = 8;
+
+	start = $$(double, getMicroTime)();
+	for(unsigned int y = 0; y < rows; y++) {
+		for(unsigned int x = 0; x < WORLEY_BENCHMARK_SIZE; x++) {
+			queryData[0] = (double) x / WORLEY_BENCHMARK_SIZE;
+			queryData[1] = (double) y / WORLEY_BENCHMARK_SIZE;
+
+			float f1 = $(float, random, randomWorleyExhaustive)(context, query, 1, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+			float f2 = $(float, random, randomWorleyExhaustive)(context, query, 2, RANDOM_WORLEY_DISTANCE_EUCLIDEAN);
+			matches = matches && fabs(getImage(image, x, y, 0) - (f2 - f1)) < 1e-5;
+		}
+	}
+	TEST_BENCHMARK("randomWorleyExhaustive", rows * WORLEY_BENCHMARK_SIZE, $$(double, getMicroTime)() - start);
+
+	$(void, linalg, freeVector)(query);
+	$(void, image, freeImage)(image);
+	$(void, random, freeWorleyContext)(context);
+	$(void, random, freeRandomGenerator)(generator);
+
+	TEST_ASSERT(success);
+	TEST_ASSERT(matches);
+}
+
+TEST(perlin_rows)
+{
+	float values[300];
+	double steps[][3] = {{0.01, 0.0, 0.0}, {0.0, 0.37, 0.0}, {-0.02, 0.005, 0.7}, {1.5, -2.25, 0.0}};
+
+	for(unsigned int i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+		double *step = steps[i];
+		unsigned int count = 300 - 37 * i; // also check rows that don't fill the last block
+
+		$(void, random, randomPerlinRow)(-3.3, 7.1, 0.5, step[0], step[1], step[2], values, count);
+		for(unsigned int j = 0; j < count; j++) {
+			TEST_ASSERT(fabs(values[j] - $(float, random, randomPerlin)(-3.3 + j * step[0], 7.1 + j * step[1], 0.5 + j * step[2])) < 1e-5);
+		}
+
+		$(void, random, noiseFBmRow)(-3.3, 7.1, 0.5, step[0], step[1], step[2], 0.6, 5, values, count);
+		for(unsigned int j = 0; j < count; j++) {
+			TEST_ASSERT(fabs(values[j] - $(float, random, noiseFBm)(-3.3 + j * step[0], 7.1 + j * step[1], 0.5 + j * step[2], 0.6, 5)) < 1e-4);
+		}
+
+		$(void, random, noiseTurbulenceRow)(-3.3, 7.1, 0.5, step[0], step[1], step[2], 0.6, 5, values, count);
+		for(unsigned int j = 0; j < count; j++) {
+			TEST_ASSERT(fabs(values[j] - $(float, random, noiseTurbulence)(-3.3 + j * step[0], 7.1 + j * step[1], 0.5 + j * step[2], 0.6, 5)) < 1e-4);
+		}
+	}
+}
+
+TEST(perlin_benchmark)
+{
+	Image *image = $(Image *, image, createImageFloat)(PERLIN_BENCHMARK_SIZE, PERLIN_BENCHMARK_SIZE, 1);
+	double origin[3] = {0.0, 0.0, 3.5};
+	double stepX[3] = {4.0 / PERLIN_BENCHMARK_SIZE, 0.0, 0.0};
+	double stepY[3] = {0.0, 4.0 / PERLIN_BENCHMARK_SIZE, 0.0};
+
+	double start = $$(double, getMicroTime)();
+	$(void, random, noiseImage)(image, 0, RANDOM_PERLIN_NOISE_FBM, origin, stepX, stepY, 0.5, PERLIN_BENCHMARK_DEPTH);
+	TEST_BENCHMARK("noiseImage", PERLIN_BENCHMARK_SIZE * PERLIN_BENCHMARK_SIZE, $$(double, getMicroTime)() - start);
+
+	// compare a few rows against evaluating the noise sample by sample
+	bool matches = true;
+	unsigned int rows = 64;
+
+	start = $$(double, getMicroTime)();
+	for(unsigned int y = 0; y < rows; y++) {
+		unsigned int row = y * (PERLIN_BENCHMARK_SIZE / rows);
+		for(unsigned int x = 0; x < PERLIN_BENCHMARK_SIZE; x++) {
+			float value = $(float, random, noiseFBm)(x * stepX[0], row * stepY[1], origin[2], 0.5, PERLIN_BENCHMARK_DEPTH);
+			matches = matches && fabs(getImage(image, x, row, 0) - value) < 1e-4;
+		}
+	}
+	TEST_BENCHMARK("noiseFBm", rows * PERLIN_BENCHMARK_SIZE, $$(double, getMicroTime)() - start);
+
+	$(void, image, freeImage)(image);
+
+	TEST_ASSERT(matches);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2009, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "dll.h"
+#include "test.h"
+#include "modules/socket/linebuffer.h"
+
+#define API
+
+MODULE_NAME("test_socket_linebuffer");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the line buffer of the socket module");
+MODULE_VERSION(0, 1, 0);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_DEPENDS(MODULE_DEPENDENCY("socket", 0, 9, 0));
+
+TEST(lines);
+TEST(emptyLines);
+TEST(wrap);
+TEST(grow);
+TEST(bytes);
+
+TEST_SUITE_BEGIN(socket_linebuffer)
+	ADD_SIMPLE_TEST(lines);
+	ADD_SIMPLE_TEST(emptyLines);
+	ADD_SIMPLE_TEST(wrap);
+	ADD_SIMPLE_TEST(grow);
+	ADD_SIMPLE_TEST(bytes);
+TEST_SUITE_END
+
+static void append(LineBuffer *buffer, const char *data)
+{
+	$(void, socket, appendLineBuffer)(buffer, data, strlen(data));
+}
+
+TEST(lines)
+{
+	LineBuffer *buffer = $(LineBuffer *, socket, createLineBuffer)(true);
+	char *line;
+	unsigned int length;
+
+	append(buffer, "PING :foo\r\nPRIV");
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, &length));
+	TEST_ASSERT(strcmp(line, "PING :foo") == 0);
+	TEST_ASSERT(length == 9);
+	TEST_ASSERT(!$(bool, socket, readLineBufferLine)(buffer, &line, &length));
+
+	append(buffer, "MSG #kalisko :hi");
+	TEST_ASSERT(!$(bool, socket, readLineBufferLine)(buffer, &line, &length));
+
+	append(buffer, "\n");
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, &length));
+	TEST_ASSERT(strcmp(line, "PRIVMSG #kalisko :hi") == 0);
+	TEST_ASSERT(getLineBufferLength(buffer) == 0);
+
+	$(void, socket, freeLineBuffer)(buffer);
+}
+
+TEST(emptyLines)
+{
+	LineBuffer *skipping = $(LineBuffer *, socket, createLineBuffer)(true);
+	LineBuffer *keeping = $(LineBuffer *, socket, createLineBuffer)(false);
+	char *line;
+
+	append(skipping, "a\r\n\r\n\nb\n");
+	append(keeping, "a\r\n\r\nb\n");
+
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(skipping, &line, NULL));
+	TEST_ASSERT(strcmp(line, "a") == 0);
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(skipping, &line, NULL));
+	TEST_ASSERT(strcmp(line, "b") == 0);
+	TEST_ASSERT(!$(bool, socket, readLineBufferLine)(skipping, &line, NULL));
+
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(keeping, &line, NULL));
+	TEST_ASSERT(strcmp(line, "a") == 0);
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(keeping, &line, NULL));
+	TEST_ASSERT(strcmp(line, "") == 0);
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(keeping, &line, NULL));
+	TEST_ASSERT(strcmp(line, "b") == 0);
+
+	$(void, socket, freeLineBuffer)(skipping);
+	$(void, socket, freeLineBuffer)(keeping);
+}
+
+TEST(wrap)
+{
+	LineBuffer *buffer = $(LineBuffer *, socket, createLineBuffer)(true);
+	char chunk[LINE_BUFFER_INITIAL_SIZE / 4];
+	char *line;
+	unsigned int length;
+
+	memset(chunk, 'x', sizeof(chunk));
+	chunk[sizeof(chunk) - 1] = '\n';
+
+	// Keep one partial line in the buffer at all times so that the contents repeatedly wrap around the end of the ring
+	$(void, socket, appendLineBuffer)(buffer, chunk, sizeof(chunk) / 2);
+
+	for(int i = 0; i < 32; i++) {
+		$(void, socket, appendLineBuffer)(buffer, chunk, sizeof(chunk));
+		$(void, socket, appendLineBuffer)(buffer, chunk, sizeof(chunk) / 2);
+		TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, &length));
+		TEST_ASSERT(length == sizeof(chunk) + sizeof(chunk) / 2 - 1);
+		TEST_ASSERT(line[0] == 'x' && line[length - 1] == 'x' && line[length] == '\0');
+		TEST_ASSERT(!$(bool, socket, readLineBufferLine)(buffer, &line, &length));
+		TEST_ASSERT(getLineBufferLength(buffer) == sizeof(chunk) / 2);
+	}
+
+	TEST_ASSERT(buffer->size == LINE_BUFFER_INITIAL_SIZE);
+
+	$(void, socket, freeLineBuffer)(buffer);
+}
+
+TEST(grow)
+{
+	LineBuffer *buffer = $(LineBuffer *, socket, createLineBuffer)(true);
+	GString *expected = g_string_new("");
+	char *line;
+	unsigned int length;
+
+	for(int i = 0; i < 1000; i++) {
+		g_string_append_printf(expected, "%d,", i);
+	}
+
+	// Feed the line in small pieces to make sure already scanned bytes are skipped correctly
+	for(unsigned int i = 0; i < expected->len; i += 7) {
+		$(void, socket, appendLineBuffer)(buffer, expected->str + i, MIN(7, expected->len - i));
+		TEST_ASSERT(!$(bool, socket, readLineBufferLine)(buffer, &line, &length));
+	}
+
+	append(buffer, "\r\n");
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, &length));
+	TEST_ASSERT(length == expected->len);
+	TEST_ASSERT(strcmp(line, expected->str) == 0);
+
+	g_string_free(expected, true);
+	$(void, socket, freeLineBuffer)(buffer);
+}
+
+TEST(bytes)
+{
+	LineBuffer *buffer = $(LineBuffer *, socket, createLineBuffer)(false);
+	char *line;
+
+	append(buffer, "POST / HTTP/1.0\r\n\r\nkey=va");
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, NULL));
+	TEST_ASSERT($(bool, socket, readLineBufferLine)(buffer, &line, NULL));
+	TEST_ASSERT(strcmp(line, "") == 0);
+
+	TEST_ASSERT($(char *, socket, readLineBufferBytes)(buffer, 9) == NULL);
+	append(buffer, "lue");
+
+	char *bytes = $(char *, socket, readLineBufferBytes)(buffer, 9);
+	TEST_ASSERT(bytes != NULL);
+	TEST_ASSERT(strncmp(bytes, "key=value", 9) == 0);
+	TEST_ASSERT(getLineBufferLength(buffer) == 0);
+
+	$(void, socket, freeLineBuffer)(buffer);
+}
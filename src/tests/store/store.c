@@ -20,9 +20,12 @@
 
 #include <glib.h>
 #include <string.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include "dll.h"
 #include "test.h"
+#include "util.h"
 #include "memory_alloc.h"
 #include "modules/store/store.h"
 #include "modules/store/parse.h"
@@ -39,9 +42,13 @@
 TEST(lexer);
 TEST(parser_longstring);
 TEST(parser_clone_dump);
+TEST(parser_buffer);
+TEST(parser_benchmark);
 TEST(path_modify);
 TEST(path_create);
 TEST(path_split);
+TEST(path_compiled);
+TEST(path_benchmark);
 TEST(merge);
 TEST(schema_parse);
 TEST(schema_selfvalidation);
@@ -55,23 +62,33 @@ static char *parser_test_input = "foo = \"//bar//\" // comment that is hopefully
 
 static char *path_test_input = "somekey=(foo bar {foo=bar subarray={bird=word answer=42 emptylist=()}}{}())";
 
+#define BENCHMARK_SECTIONS 64
+#define BENCHMARK_KEYS 64
+#define BENCHMARK_ROUNDS 20
+#define BENCHMARK_TILES 20000
+#define BENCHMARK_PARSE_ROUNDS 5
+
 static char *path_split_input = "this/is a \"difficult\"/path\\\\to/split\\/:)";
 static char *path_split_solution[] = {"this", "is a \"difficult\"", "path\\to", "split/:)"};
 
 MODULE_NAME("test_store");
 MODULE_AUTHOR("The Kalisko team");
 MODULE_DESCRIPTION("Test suite for the store module");
-MODULE_VERSION(0, 8, 1);
+MODULE_VERSION(0, 8, 5);
 MODULE_BCVERSION(0, 8, 1);
-MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 16, 0));
+MODULE_DEPENDS(MODULE_DEPENDENCY("store", 0, 19, 0));
 
 TEST_SUITE_BEGIN(store)
 	ADD_SIMPLE_TEST(lexer);
 	ADD_SIMPLE_TEST(parser_longstring);
 	ADD_SIMPLE_TEST(parser_clone_dump);
+	ADD_SIMPLE_TEST(parser_buffer);
+	ADD_BENCHMARK(parser_benchmark);
 	ADD_SIMPLE_TEST(path_modify);
 	ADD_SIMPLE_TEST(path_create);
 	ADD_SIMPLE_TEST(path_split);
+	ADD_SIMPLE_TEST(path_compiled);
+	ADD_BENCHMARK(path_benchmark);
 	ADD_SIMPLE_TEST(merge);
 	ADD_SIMPLE_TEST(schema_parse);
 	ADD_SIMPLE_TEST(schema_selfvalidation);
@@ -153,6 +170,67 @@ TEST(parser_clone_dump)
 	g_string_free(cloneDump, true);
 }
 
+TEST(parser_buffer)
+{
+	static const char *buffer = "number = 1337; string = \"escaped \\\" string\"; cut = 42";
+
+	// Parse everything but the last digit, which the lexer must not read
+	Store *store = $(Store *, store, parseStoreBuffer)(buffer, strlen(buffer) - 1);
+	TEST_ASSERT(store != NULL);
+	TEST_ASSERT($(Store *, store, getStorePath)(store, "number")->content.integer == 1337);
+	TEST_ASSERT(strcmp($(Store *, store, getStorePath)(store, "string")->content.string, "escaped \" string") == 0);
+	TEST_ASSERT($(Store *, store, getStorePath)(store, "cut")->content.integer == 4);
+	$(void, store, freeStore)(store);
+
+	store = $(Store *, store, parseStoreBuffer)(buffer, 0);
+	TEST_ASSERT(store != NULL);
+	TEST_ASSERT(g_hash_table_size(store->content.array) == 0);
+	$(void, store, freeStore)(store);
+}
+
+TEST(parser_benchmark)
+{
+	// Generate a store resembling the per-tile metadata of a large lodmap
+	GString *content = g_string_new("tiles = (\n");
+	for(int i = 0; i < BENCHMARK_TILES; i++) {
+		g_string_append_printf(content, "\t{ x = %d; y = %d; level = %d; minHeight = %f; maxHeight = %f; name = \"tile %d\" }\n", i % 256, i / 256, i % 8, -0.5 * i, 0.25 * i, i);
+	}
+	g_string_append(content, ")\n");
+
+	char *filename;
+	int fd;
+	TEST_ASSERT((fd = g_file_open_tmp("kalisko_store_XXXXXX", &filename, NULL)) >= 0);
+	TEST_ASSERT(write(fd, content->str, content->len) == content->len);
+	close(fd);
+
+	Store *reference = $(Store *, store, parseStoreString)(content->str);
+	TEST_ASSERT(reference != NULL);
+	GString *referenceDump = $(GString *, store, writeStoreGString)(reference);
+	$(void, store, freeStore)(reference);
+
+	double start = $$(double, getMicroTime)();
+
+	for(int round = 0; round < BENCHMARK_PARSE_ROUNDS; round++) {
+		Store *store = $(Store *, store, parseStoreFile)(filename);
+		TEST_ASSERT(store != NULL);
+
+		if(round == 0) { // the file must parse exactly like the string it was written from
+			GString *dump = $(GString *, store, writeStoreGString)(store);
+			TEST_ASSERT(g_strcmp0(dump->str, referenceDump->str) == 0);
+			g_string_free(dump, true);
+		}
+
+		$(void, store, freeStore)(store);
+	}
+
+	TEST_BENCHMARK("parseStoreFile bytes", (long) BENCHMARK_PARSE_ROUNDS * content->len, $$(double, getMicroTime)() - start);
+
+	remove(filename);
+	free(filename);
+	g_string_free(referenceDump, true);
+	g_string_free(content, true);
+}
+
 TEST(path_modify)
 {
 	Store *value;
@@ -222,6 +300,98 @@ TEST(path_split)
 	g_ptr_array_free(array, TRUE);
 }
 
+TEST(path_compiled)
+{
+	Store *store = $(Store *, store, parseStoreString)(path_test_input);
+	TEST_ASSERT(store != NULL);
+	TEST_ASSERT($(bool, store, setStorePath)(store, "some\\/escaped\\\\key", $(Store *, store, createStoreIntegerValue)(1337)));
+
+	char *paths[] = {"", "somekey", "somekey/2", "somekey/2/subarray/bird", "somekey/2/subarray/emptylist", "somekey/1337", "somekey/2/missing", "some\\/escaped\\\\key", "somekey/0/leaf"};
+
+	for(int i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+		StorePath *path = $(StorePath *, store, compileStorePath)("%s", paths[i]);
+		TEST_ASSERT(path != NULL);
+		TEST_ASSERT($(Store *, store, getCompiledStorePath)(store, path) == $(Store *, store, getStorePath)(store, "%s", paths[i]));
+		$(void, store, freeStorePath)(path);
+	}
+
+	StorePath *path = $(StorePath *, store, compileStorePath)("somekey/%d/subarray/%s", 2, "answer");
+	TEST_ASSERT(path->length == 4);
+	TEST_ASSERT(path->elements[1].index == 2);
+	TEST_ASSERT($(Store *, store, getCompiledStorePath)(store, path)->content.integer == 42);
+	$(void, store, freeStorePath)(path);
+
+	TEST_ASSERT($(StorePath *, store, compileStorePath)("invalid\\escape") == NULL);
+	TEST_ASSERT($(Store *, store, getStorePath)(store, "invalid\\escape") == NULL);
+
+	$(void, store, freeStore)(store);
+}
+
+TEST(path_benchmark)
+{
+	Store *store = $(Store *, store, createStore)();
+	GPtrArray *paths = g_ptr_array_new();
+
+	for(int i = 0; i < BENCHMARK_SECTIONS; i++) {
+		Store *section = $(Store *, store, createStoreArrayValue)(NULL);
+		Store *list = $(Store *, store, createStoreListValue)(NULL);
+
+		for(int j = 0; j < BENCHMARK_KEYS; j++) {
+			Store *entry = $(Store *, store, createStoreArrayValue)(NULL);
+			g_hash_table_insert(entry->content.array, strdup("value"), $(Store *, store, createStoreIntegerValue)(j));
+			g_hash_table_insert(section->content.array, g_strdup_printf("key%d", j), entry);
+			g_queue_push_tail(list->content.list, $(Store *, store, createStoreIntegerValue)(j));
+
+			g_ptr_array_add(paths, g_strdup_printf("section%d/key%d/value", i, j));
+			g_ptr_array_add(paths, g_strdup_printf("section%d/list/%d", i, j));
+		}
+
+		g_hash_table_insert(section->content.array, strdup("list"), list);
+		g_hash_table_insert(store->content.array, g_strdup_printf("section%d", i), section);
+	}
+
+	StorePath **compiled = ALLOCATE_OBJECTS(StorePath *, paths->len);
+	for(int i = 0; i < paths->len; i++) {
+		compiled[i] = $(StorePath *, store, compileStorePath)("%s", (char *) paths->pdata[i]);
+	}
+
+	long sum = 0;
+	double start = $$(double, getMicroTime)();
+
+	for(int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for(int i = 0; i < paths->len; i++) {
+			Store *value = $(Store *, store, getStorePath)(store, "%s", (char *) paths->pdata[i]);
+			TEST_ASSERT(value != NULL && value->type == STORE_INTEGER);
+			sum += value->content.integer;
+		}
+	}
+
+	TEST_BENCHMARK("getStorePath", (long) BENCHMARK_ROUNDS * paths->len, $$(double, getMicroTime)() - start);
+
+	start = $$(double, getMicroTime)();
+
+	for(int round = 0; round < BENCHMARK_ROUNDS; round++) {
+		for(int i = 0; i < paths->len; i++) {
+			Store *value = $(Store *, store, getCompiledStorePath)(store, compiled[i]);
+			TEST_ASSERT(value != NULL && value->type == STORE_INTEGER);
+			sum -= value->content.integer;
+		}
+	}
+
+	TEST_BENCHMARK("getCompiledStorePath", (long) BENCHMARK_ROUNDS * paths->len, $$(double, getMicroTime)() - start);
+
+	TEST_ASSERT(sum == 0); // both lookups must resolve the same values
+
+	for(int i = 0; i < paths->len; i++) {
+		$(void, store, freeStorePath)(compiled[i]);
+		free(paths->pdata[i]);
+	}
+
+	free(compiled);
+	g_ptr_array_free(paths, TRUE);
+	$(void, store, freeStore)(store);
+}
+
 TEST(merge)
 {
 	Store *store = $(Store *, store, parseStoreString)("replaced = 13; listmerged = (1 2); recursive = { first = beginning }");
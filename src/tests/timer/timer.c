@@ -0,0 +1,185 @@
+/**
+ * @file
+ * <h3>Copyright</h3>
+ * Copyright (c) 2009, Kalisko Project Leaders
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ *
+ *     @li Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ *     @li Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer
+ *       in the documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ * TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <glib.h>
+
+#include "dll.h"
+#include "test.h"
+#include "timer.h"
+#include "util.h"
+
+#define API
+
+#define BENCHMARK_TIMERS 100000
+
+MODULE_NAME("test_timer");
+MODULE_AUTHOR("The Kalisko team");
+MODULE_DESCRIPTION("Test suite for the Kalisko core timers");
+MODULE_VERSION(0, 1, 0);
+MODULE_BCVERSION(0, 1, 0);
+MODULE_NODEPS;
+
+TEST(order);
+TEST(sameTime);
+TEST(delete);
+TEST(moduleTimers);
+TEST(benchmark);
+
+TEST_SUITE_BEGIN(timer)
+	ADD_SIMPLE_TEST(order);
+	ADD_SIMPLE_TEST(sameTime);
+	ADD_SIMPLE_TEST(delete);
+	ADD_SIMPLE_TEST(moduleTimers);
+	ADD_BENCHMARK(benchmark);
+TEST_SUITE_END
+
+/**
+ * Dummy timer callback, the timers scheduled by this test suite never fire
+ */
+static void testCallback(GTimeVal time, void *custom_data)
+{
+}
+
+TEST(order)
+{
+	// Schedule the timers in the past so they're guaranteed to come before any other scheduled timers
+	int seconds[] = {7, 3, 9, 1, 5, 2, 8, 4, 6};
+	GTimeVal *handles[9];
+
+	for(int i = 0; i < 9; i++) {
+		GTimeVal time = {seconds[i], 0};
+		handles[i] = $$(GTimeVal *, addTimer)("test_timer_order", time, &testCallback, NULL);
+		TEST_ASSERT(handles[i] != NULL);
+	}
+
+	for(int expected = 1; expected <= 9; expected++) {
+		GTimeVal next = $$(GTimeVal, getNextTimerTime)();
+		TEST_ASSERT(next.tv_sec == expected);
+
+		for(int i = 0; i < 9; i++) {
+			if(seconds[i] == expected) {
+				TEST_ASSERT($$(bool, delTimer)(handles[i]));
+			}
+		}
+	}
+
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_order") == 0);
+}
+
+TEST(sameTime)
+{
+	GTimeVal time = {1, 0};
+
+	GTimeVal *first = $$(GTimeVal *, addTimer)("test_timer_same", time, &testCallback, NULL);
+	GTimeVal *second = $$(GTimeVal *, addTimer)("test_timer_same", time, &testCallback, NULL);
+
+	// Timers scheduled for the same time get distinct handles and keep their scheduled time
+	TEST_ASSERT(first != second);
+	TEST_ASSERT(first->tv_sec == 1 && first->tv_usec == 0);
+	TEST_ASSERT(second->tv_sec == 1 && second->tv_usec == 0);
+
+	TEST_ASSERT($$(bool, delTimer)(first));
+	TEST_ASSERT($$(bool, delTimer)(second));
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_same") == 0);
+}
+
+TEST(delete)
+{
+	GTimeVal time = {2, 0};
+	GTimeVal *handles[5];
+
+	for(int i = 0; i < 5; i++) {
+		time.tv_usec = i;
+		handles[i] = $$(GTimeVal *, addTimer)("test_timer_delete", time, &testCallback, NULL);
+	}
+
+	// Delete a timer from the middle of the heap
+	TEST_ASSERT($$(bool, delTimer)(handles[2]));
+
+	GTimeVal next = $$(GTimeVal, getNextTimerTime)();
+	TEST_ASSERT(next.tv_sec == 2 && next.tv_usec == 0);
+
+	// Delete the first timer
+	TEST_ASSERT($$(bool, delTimer)(handles[0]));
+
+	next = $$(GTimeVal, getNextTimerTime)();
+	TEST_ASSERT(next.tv_sec == 2 && next.tv_usec == 1);
+
+	TEST_ASSERT(!$$(bool, delTimer)(NULL));
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_delete") == 3);
+}
+
+TEST(moduleTimers)
+{
+	GTimeVal time = {3, 0};
+
+	for(int i = 0; i < 10; i++) {
+		time.tv_usec = i;
+		$$(GTimeVal *, addTimer)(i % 2 == 0 ? "test_timer_even" : "test_timer_odd", time, &testCallback, NULL);
+	}
+
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_even") == 5);
+
+	GTimeVal next = $$(GTimeVal, getNextTimerTime)();
+	TEST_ASSERT(next.tv_sec == 3 && next.tv_usec == 1);
+
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_even") == 0);
+	TEST_ASSERT($$(int, removeModuleTimers)("test_timer_odd") == 5);
+}
+
+TEST(benchmark)
+{
+	GTimeVal **handles = ALLOCATE_OBJECTS(GTimeVal *, BENCHMARK_TIMERS);
+	GTimeVal time = {4, 0};
+
+	double start = $$(double, getMicroTime)();
+
+	for(int i = 0; i < BENCHMARK_TIMERS; i++) {
+		time.tv_usec = (i * 7919) % G_USEC_PER_SEC; // scatter the timers so the heap actually has to reorder them
+		handles[i] = $$(GTimeVal *, addTimer)("test_timer_benchmark", time, &testCallback, NULL);
+	}
+
+	double added = $$(double, getMicroTime)();
+
+	for(int i = 0; i < BENCHMARK_TIMERS; i += 2) {
+		$$(bool, delTimer)(handles[i]);
+	}
+
+	double deleted = $$(double, getMicroTime)();
+
+	for(int i = 0; i < BENCHMARK_TIMERS / 2; i++) {
+		$$(GTimeVal, getNextTimerTime)();
+	}
+
+	double peeked = $$(double, getMicroTime)();
+
+	int removed = $$(int, removeModuleTimers)("test_timer_benchmark");
+
+	double end = $$(double, getMicroTime)();
+
+	free(handles);
+
+	TEST_ASSERT(removed == BENCHMARK_TIMERS / 2);
+
+	TEST_BENCHMARK("addTimer", BENCHMARK_TIMERS, added - start);
+	TEST_BENCHMARK("delTimer", BENCHMARK_TIMERS / 2, deleted - added);
+	TEST_BENCHMARK("getNextTimerTime", BENCHMARK_TIMERS / 2, peeked - deleted);
+	TEST_BENCHMARK("removeModuleTimers", removed, end - peeked);
+}
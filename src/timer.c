@@ -26,30 +26,68 @@
 #include "memory_alloc.h"
 #include "types.h"
 
-static bool findFirstEntry(void *key, void *value, void *data);
-static bool findModuleTimers(void *key, void *value, void *data);
-static void freeTimerTreeEntry(void *entry_p);
+/**
+ * Struct to group all timers registered by a module so they can be removed without walking all scheduled timers
+ */
+typedef struct {
+	/** The name of the module */
+	char *name;
+	/** The TimerEntry objects registered by the module */
+	GQueue timers;
+} ModuleTimers;
 
+/**
+ * Struct to represent a scheduled timer
+ */
 typedef struct {
-	GTimeVal *time;
+	/** The time when the timer is due. This must be the first member since a pointer to it serves as handle to the timer */
+	GTimeVal time;
+	/** The sequence number of the timer, used to fire timers scheduled for the same time in the order they were added */
+	unsigned long sequence;
+	/** The current position of the timer in the heap */
+	unsigned int index;
+	/** The callback to call when the timer is due */
 	TimerCallback *callback;
+	/** Custom data to pass to the callback */
 	void *custom_data;
-	char *module;
+	/** The timers of the module that registered this timer */
+	ModuleTimers *module;
+	/** The link of this timer inside its module's timer queue */
+	GList *moduleLink;
 } TimerEntry;
 
-typedef struct {
-	GQueue *queue;
-	const char *module;
-} ModuleTimerInfo;
+static bool isEarlierTimer(TimerEntry *first, TimerEntry *second);
+static void setHeapEntry(unsigned int index, TimerEntry *entry);
+static void siftUp(unsigned int index);
+static void siftDown(unsigned int index);
+static void removeTimerEntry(TimerEntry *entry);
+static void freeModuleTimers(void *moduleTimers_p);
+static void defaultTimerSleepHandler(int sleepTime);
+
+/**
+ * Binary min-heap of TimerEntry objects ordered by their due time, so the next timer is always at index 0
+ */
+static GPtrArray *timers;
 
 /**
- * Tree structure that organizes timer callbacks as a priority queue
+ * Hash table mapping module names to their ModuleTimers
  */
-static GTree *timers;
+static GHashTable *moduleTimers;
+
+/**
+ * Sequence number to assign to the next added timer
+ */
+static unsigned long nextSequence = 0;
+
+/**
+ * The handler used to block the main loop until the next timer is due
+ */
+static TimerSleepHandler *sleepHandler = &defaultTimerSleepHandler;
 
 API void initTimers()
 {
-	timers = g_tree_new_full(&compareTimes, NULL, &free, &freeTimerTreeEntry);
+	timers = g_ptr_array_new();
+	moduleTimers = g_hash_table_new_full(&g_str_hash, &g_str_equal, NULL, &freeModuleTimers);
 }
 
 API void freeTimers()
@@ -63,36 +101,45 @@ API GTimeVal *addTimer(const char *module, GTimeVal time, TimerCallback *callbac
 		return NULL;
 	}
 
-	GTimeVal *timeContainer = allocateMemory(sizeof(GTimeVal));
-	*timeContainer = time;
-
-	while(g_tree_lookup(timers, timeContainer) != NULL) { // Find a free tree position
-		timeContainer->tv_usec++;
+	ModuleTimers *owner;
+	if((owner = g_hash_table_lookup(moduleTimers, module)) == NULL) {
+		owner = allocateMemory(sizeof(ModuleTimers));
+		owner->name = strdup(module);
+		g_queue_init(&owner->timers);
+		g_hash_table_insert(moduleTimers, owner->name, owner);
 	}
 
 	TimerEntry *entry = allocateMemory(sizeof(TimerEntry));
-	entry->time = timeContainer;
+	entry->time = time;
+	entry->sequence = nextSequence++;
 	entry->callback = callback;
 	entry->custom_data = custom_data;
-	entry->module = strdup(module);
-	g_tree_insert(timers, timeContainer, entry);
+	entry->module = owner;
+
+	g_queue_push_tail(&owner->timers, entry);
+	entry->moduleLink = owner->timers.tail;
 
-	return timeContainer;
+	g_ptr_array_add(timers, entry);
+	entry->index = timers->len - 1;
+	siftUp(entry->index);
+
+	return &entry->time;
 }
 
 API bool delTimer(GTimeVal *time)
 {
-	if(timers == NULL) {
+	if(timers == NULL || time == NULL) {
 		return false;
 	}
 
-	TimerEntry *entry = g_tree_lookup(timers, time);
+	TimerEntry *entry = (TimerEntry *) time;
 
-	if(entry == NULL) { // don't continue if the entry doesn't exist
+	if(entry->index >= timers->len || g_ptr_array_index(timers, entry->index) != entry) { // don't continue if the entry isn't scheduled
 		return false;
 	}
 
-	return g_tree_remove(timers, time);
+	removeTimerEntry(entry);
+	return true;
 }
 
 API GTimeVal *addTimeout(const char *module, int timeout, TimerCallback *callback, void *custom_data)
@@ -107,13 +154,9 @@ API GTimeVal getNextTimerTime()
 {
 	GTimeVal nextTime = {0,0};
 
-	if(timers != NULL) {
-		TimerEntry *entry = NULL;
-		g_tree_foreach(timers, &findFirstEntry, &entry);
-
-		if(entry != NULL) {
-			nextTime = *entry->time;
-		}
+	if(timers != NULL && timers->len > 0) {
+		TimerEntry *entry = g_ptr_array_index(timers, 0);
+		nextTime = entry->time;
 	}
 
 	return nextTime;
@@ -131,27 +174,36 @@ API int getCurrentSleepTime()
 	return sleepTime > 0 ? sleepTime : 0;
 }
 
+API void setTimerSleepHandler(TimerSleepHandler *handler)
+{
+	if(handler == NULL) {
+		sleepHandler = &defaultTimerSleepHandler;
+	} else {
+		sleepHandler = handler;
+	}
+}
+
+API void sleepTimers(int sleepTime)
+{
+	sleepHandler(sleepTime);
+}
+
 API void notifyTimerCallbacks()
 {
 	GTimeVal time;
 	g_get_current_time(&time);
 
 	while(hasMoreTimerCallbacks()) {
-		TimerEntry *entry = NULL;
-		g_tree_foreach(timers, &findFirstEntry, &entry);
-
-		if(entry == NULL) { // Just to be sure, this should never happen, though
-			break;
-		}
+		TimerEntry *entry = g_ptr_array_index(timers, 0);
 
-		if(compareTimes(&time, entry->time, NULL) >= 0) { // This timer is ready, we can process it
+		if(compareTimes(&time, &entry->time, NULL) >= 0) { // This timer is ready, we can process it
 			// Backup values
-			GTimeVal entryTime = *entry->time;
+			GTimeVal entryTime = entry->time;
 			TimerCallback *callback = entry->callback;
 			void *custom_data = entry->custom_data;
 
-			// Remove it from the tree first
-			g_tree_remove(timers, entry->time);
+			// Remove it from the heap first
+			removeTimerEntry(entry);
 
 			// Now notify the callback
 			callback(entryTime, custom_data);
@@ -164,7 +216,7 @@ API void notifyTimerCallbacks()
 API bool hasMoreTimerCallbacks()
 {
 	if(timers != NULL) {
-		return g_tree_nnodes(timers) > 0;
+		return timers->len > 0;
 	} else {
 		return false;
 	}
@@ -173,10 +225,16 @@ API bool hasMoreTimerCallbacks()
 API void exitGracefully()
 {
 	if(timers != NULL) {
-		g_tree_destroy(timers);
+		for(unsigned int i = 0; i < timers->len; i++) {
+			free(g_ptr_array_index(timers, i));
+		}
+
+		g_ptr_array_free(timers, true);
+		g_hash_table_destroy(moduleTimers);
 	}
 
 	timers = NULL;
+	moduleTimers = NULL;
 }
 
 API bool isExiting()
@@ -190,68 +248,155 @@ API int removeModuleTimers(const char *module)
 		return 0;
 	}
 
-	ModuleTimerInfo info;
-	info.queue = g_queue_new();
-	info.module = module;
-
-	// Collect all timers for this module
-	g_tree_foreach(timers, &findModuleTimers, &info);
+	ModuleTimers *owner;
+	if((owner = g_hash_table_lookup(moduleTimers, module)) == NULL) {
+		return 0;
+	}
 
 	int count = 0;
 
-	for(GList *iter = info.queue->head; iter != NULL; iter = iter->next) {
-		// Remove timer
-		g_tree_remove(timers, iter->data);
+	while(!g_queue_is_empty(&owner->timers)) {
+		removeTimerEntry(g_queue_peek_head(&owner->timers));
 		count++;
 	}
 
-	g_queue_free(info.queue);
+	g_hash_table_remove(moduleTimers, module);
 
 	return count;
 }
 
 /**
- * A GTraverseFunc to read the smallest tree entry and return immediately
- * @param key		the key of the node
- * @param value		the value of the node
- * @param data		a container into which the pointer to the smallest tree entry should be written
- * @result			true if traversal should abort
+ * Checks whether a timer is due before another one
+ *
+ * @param first		the first timer to compare
+ * @param second	the second timer to compare
+ * @result			true if the first timer is due before the second one
  */
-static bool findFirstEntry(void *key, void *value, void *data)
+static bool isEarlierTimer(TimerEntry *first, TimerEntry *second)
 {
-	TimerEntry **target = (TimerEntry **) data;
-	*target = (TimerEntry *) value;
+	if(first->time.tv_sec != second->time.tv_sec) {
+		return first->time.tv_sec < second->time.tv_sec;
+	}
 
-	return true;
+	if(first->time.tv_usec != second->time.tv_usec) {
+		return first->time.tv_usec < second->time.tv_usec;
+	}
+
+	return first->sequence < second->sequence;
 }
 
 /**
- * A GTraverseFunc to find all timers belonging to a specific module
- * @param key		the key of the node
- * @param value		the value of the node, unused
- * @param data		a pointer to the ModuleTimerInfo struct that records the modules
- * @result			true if traversal should abort
+ * Places a timer at a position in the heap and updates its index
+ *
+ * @param index		the heap position to place the timer at
+ * @param entry		the timer to place
  */
-static bool findModuleTimers(void *key, void *value, void *data)
+static void setHeapEntry(unsigned int index, TimerEntry *entry)
 {
-	TimerEntry *entry = (TimerEntry *) value;
-	ModuleTimerInfo *info = (ModuleTimerInfo *) data;
+	timers->pdata[index] = entry;
+	entry->index = index;
+}
+
+/**
+ * Moves a heap entry up until the heap property is restored
+ *
+ * @param index		the heap position of the entry to move up
+ */
+static void siftUp(unsigned int index)
+{
+	TimerEntry *entry = g_ptr_array_index(timers, index);
 
-	if(g_strcmp0(entry->module, info->module) == 0) { // this timer belongs to our module
-		g_queue_push_tail(info->queue, key); // record the key
+	while(index > 0) {
+		unsigned int parentIndex = (index - 1) / 2;
+		TimerEntry *parent = g_ptr_array_index(timers, parentIndex);
+
+		if(!isEarlierTimer(entry, parent)) {
+			break;
+		}
+
+		setHeapEntry(index, parent);
+		index = parentIndex;
 	}
 
-	return false;
+	setHeapEntry(index, entry);
 }
 
 /**
- * A GDestroyNotify wrapper to free a timer tree entry
+ * Moves a heap entry down until the heap property is restored
  *
- * @param entry_p		 a pointer to the timer entry to be destroyed
+ * @param index		the heap position of the entry to move down
  */
-static void freeTimerTreeEntry(void *entry_p)
+static void siftDown(unsigned int index)
 {
-	TimerEntry *entry = (TimerEntry *) entry_p;
-	free(entry->module);
+	TimerEntry *entry = g_ptr_array_index(timers, index);
+
+	while(true) {
+		unsigned int childIndex = 2 * index + 1;
+
+		if(childIndex >= timers->len) {
+			break;
+		}
+
+		TimerEntry *child = g_ptr_array_index(timers, childIndex);
+
+		if(childIndex + 1 < timers->len && isEarlierTimer(g_ptr_array_index(timers, childIndex + 1), child)) { // pick the earlier of both children
+			childIndex++;
+			child = g_ptr_array_index(timers, childIndex);
+		}
+
+		if(!isEarlierTimer(child, entry)) {
+			break;
+		}
+
+		setHeapEntry(index, child);
+		index = childIndex;
+	}
+
+	setHeapEntry(index, entry);
+}
+
+/**
+ * Removes a scheduled timer from the heap and its module's timer queue and frees it
+ *
+ * @param entry		the timer to remove
+ */
+static void removeTimerEntry(TimerEntry *entry)
+{
+	unsigned int index = entry->index;
+	unsigned int last = timers->len - 1;
+	TimerEntry *lastEntry = g_ptr_array_index(timers, last);
+
+	g_ptr_array_set_size(timers, last);
+
+	if(index != last) { // fill the gap with the last entry and restore the heap property
+		setHeapEntry(index, lastEntry);
+		siftUp(index);
+		siftDown(lastEntry->index);
+	}
+
+	g_queue_delete_link(&entry->module->timers, entry->moduleLink);
 	free(entry);
 }
+
+/**
+ * A GDestroyNotify function to free a ModuleTimers object. The timers themselves are not freed.
+ *
+ * @param moduleTimers_p	a pointer to the ModuleTimers object to free
+ */
+static void freeModuleTimers(void *moduleTimers_p)
+{
+	ModuleTimers *owner = moduleTimers_p;
+	g_queue_clear(&owner->timers);
+	free(owner->name);
+	free(owner);
+}
+
+/**
+ * The default timer sleep handler that simply sleeps for the requested time
+ *
+ * @param sleepTime		the time in microseconds to sleep
+ */
+static void defaultTimerSleepHandler(int sleepTime)
+{
+	g_usleep(sleepTime);
+}
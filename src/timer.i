@@ -29,6 +29,11 @@
  */
 typedef void (TimerCallback)(GTimeVal time, void *custom_data);
 
+/**
+ * Function pointer for timer sleep handlers that block the main loop until the next timer is due
+ */
+typedef void (TimerSleepHandler)(int sleepTime);
+
 
 /**
  * Initializes the timers
@@ -46,13 +51,13 @@ API void freeTimers();
  * @param time				the time when the callback should be executed
  * @param callback			the callback that should be called at the specified time
  * @param custom_data		custom data to be passed to the timer callback on execution
- * @result 					a pointer to the actual time scheduled
+ * @result 					a pointer to the actual time scheduled that serves as handle to the timer until it fires or is removed
  */
 API GTimeVal *addTimer(const char *module, GTimeVal time, TimerCallback *callback, void *custom_data);
 
 /**
  * Removes a timer callback
- * @param time		the time of the callback to delete
+ * @param time		the handle returned when the callback was added, must not be used anymore after the callback fired
  * @result			true if successful
  */
 API bool delTimer(GTimeVal *time);
@@ -78,6 +83,18 @@ API GTimeVal getNextTimerTime();
  */
 API int getCurrentSleepTime();
 
+/**
+ * Sets or resets the timer sleep handler. A sleep handler may return before the requested time has passed, e.g. if it was woken up by I/O readiness.
+ * @param handler		the new sleep handler to use or NULL if the default handler (g_usleep) should be restored
+ */
+API void setTimerSleepHandler(TimerSleepHandler *handler);
+
+/**
+ * Blocks the caller by invoking the current timer sleep handler
+ * @param sleepTime		the maximum time in microseconds to block
+ */
+API void sleepTimers(int sleepTime);
+
 /**
  * Notifies all timer callbacks ready for execution
  */